@@ -160,6 +160,35 @@ typedef enum pgactiveOutputBeginFlags
 	pgactive_OUTPUT_TRANSACTION_HAS_ORIGIN = 1
 } pgactiveOutputBeginFlags;
 
+/*
+ * First version whose output plugin can refer to relations by id, see the
+ * relation_ids output plugin option.
+ */
+#define pgactive_RELATION_IDS_VERSION_NUM 20110
+
+/*
+ * First version whose output plugin can stream large transactions before
+ * they commit, see the streaming output plugin option.
+ */
+#define pgactive_STREAMING_VERSION_NUM 20110
+
+/*
+ * First version whose output plugin can compress the messages it sends, see
+ * the compression output plugin option.
+ */
+#define pgactive_COMPRESSION_VERSION_NUM 20110
+
+/*
+ * Compression methods of the messages the output plugin sends, see
+ * pgactive_compress.c. Sent as part of compressed messages, don't renumber.
+ */
+typedef enum pgactiveCompression
+{
+	pgactive_COMPRESSION_NONE = 0,
+	pgactive_COMPRESSION_LZ4 = 1,
+	pgactive_COMPRESSION_ZSTD = 2
+} pgactiveCompression;
+
 /*
  * pgactive conflict detection: type of conflict that was identified.
  *
@@ -193,11 +222,28 @@ typedef enum pgactiveConflictResolution
 	pgactiveConflictResolution_UnhandledTxAbort
 }			pgactiveConflictResolution;
 
+/*
+ * Conflict handler functions pgactive resolves conflicts for itself, without
+ * calling them, see pgactive_conflict_handlers_resolve().
+ */
+typedef enum pgactiveConflictHandlerBuiltin
+{
+	pgactiveConflictHandlerBuiltin_None,
+	pgactiveConflictHandlerBuiltin_KeepLocal,
+	pgactiveConflictHandlerBuiltin_ApplyRemote
+}			pgactiveConflictHandlerBuiltin;
+
 typedef struct pgactiveConflictHandler
 {
 	Oid			handler_oid;
 	pgactiveConflictType handler_type;
 	uint64		timeframe;
+
+	/* set up when the relation's handlers are loaded */
+	pgactiveConflictHandlerBuiltin builtin;
+	FmgrInfo	finfo;
+	/* result type of the function, NULL for built-in handlers */
+	TupleDesc	retdesc;
 }			pgactiveConflictHandler;
 
 /* How detailed logging of DDL locks is */
@@ -230,6 +276,8 @@ typedef struct pgactiveRelation
 
 	pgactiveConflictHandler *conflict_handlers;
 	size_t		conflict_handlers_len;
+	/* holds conflict_handlers and what their functions cache */
+	MemoryContext conflict_handlers_context;
 
 	/* ordered list of replication sets of length num_* */
 	char	  **replication_sets;
@@ -240,6 +288,15 @@ typedef struct pgactiveRelation
 	bool		computed_repl_insert;
 	bool		computed_repl_update;
 	bool		computed_repl_delete;
+	/* attnos of the columns to send, NULL for all */
+	Bitmapset  *computed_repl_columns;
+	/* row filter, NULL for none, and the attnos it refers to */
+	ExprState  *computed_repl_filter;
+	Bitmapset  *computed_repl_filter_columns;
+	/* slot to evaluate the row filter on */
+	TupleTableSlot *computed_repl_filter_slot;
+	/* holds the computed_repl_* data above */
+	MemoryContext computed_repl_context;
 }			pgactiveRelation;
 
 typedef struct pgactiveTupleData
@@ -290,6 +347,12 @@ typedef struct pgactiveApplyWorker
 	 */
 	Latch	   *proclatch;
 
+	/*
+	 * Set along with proclatch when the worker's config may have changed.
+	 * Protected by the pgactive worker shmem control segment lock.
+	 */
+	bool		reload_requested;
+
 	/* last applied transaction id */
 	TransactionId last_applied_xact_id;
 
@@ -298,6 +361,20 @@ typedef struct pgactiveApplyWorker
 
 	/* timestamp at which last change was applied */
 	TimestampTz last_applied_xact_at;
+
+	/*
+	 * If not InvalidXLogRecPtr, a parallel apply worker failed while
+	 * applying changes up to this point, so apply serially until past it.
+	 */
+	XLogRecPtr	parallel_apply_serial_until;
+
+	/*
+	 * Commits waiting to be flushed locally before being confirmed to the
+	 * upstream, and how many the worker has room for without allocating
+	 * memory; see pgactive_get_flush_position().
+	 */
+	int			flush_positions_count;
+	int			flush_positions_size;
 }			pgactiveApplyWorker;
 
 /*
@@ -327,6 +404,15 @@ typedef struct pgactivePerdbWorker
 	 */
 	Latch	   *proclatch;
 
+	/*
+	 * What the perdb worker is woken for: rescanning the connections and
+	 * launching apply workers, or maintaining range-allocated sequences. Set
+	 * before proclatch, with the pgactive worker shmem control segment lock
+	 * held.
+	 */
+	bool		connections_changed;
+	bool		range_seq_pending;
+
 	/* Oid of the database the worker is attached to - populated after start */
 	Oid			p_dboid;
 
@@ -355,6 +441,26 @@ typedef struct pgactiveWalsenderWorker
 	TimestampTz last_sent_xact_at;
 }			pgactiveWalsenderWorker;
 
+/*
+ * Parallel apply worker. These are launched by an apply worker when
+ * pgactive.apply_parallel_workers is set, apply remote transactions handed
+ * to them by that apply worker and exit along with it.
+ */
+typedef struct pgactiveApplyParallelWorker
+{
+	/* oid of the database this worker is applying changes to */
+	Oid			dboid;
+
+	/* Identification for the remote db the leader apply worker replays */
+	pgactiveNodeId remote_node;
+
+	/* Slot of the leader apply worker in pgactiveWorkerCtl */
+	uint32		leader_idx;
+
+	/* Number of remote transactions this worker applied */
+	uint64		nxacts_applied;
+}			pgactiveApplyParallelWorker;
+
 /*
  * Type of pgactive worker in a pgactiveWorker struct
  *
@@ -373,7 +479,9 @@ typedef enum
 	/* This is data for a per-database worker pgactivePerdbWorker */
 	pgactive_WORKER_PERDB,
 	/* This is data for a walsenders currently streaming data out */
-	pgactive_WORKER_WALSENDER
+	pgactive_WORKER_WALSENDER,
+	/* This is data for a pgactiveApplyParallelWorker */
+	pgactive_WORKER_APPLY_PARALLEL
 }			pgactiveWorkerType;
 
 extern PGDLLIMPORT const char *const pgactiveWorkerTypeNames[];
@@ -402,6 +510,7 @@ typedef struct pgactiveWorker
 		pgactiveApplyWorker apply;
 		pgactivePerdbWorker perdb;
 		pgactiveWalsenderWorker walsnd;
+		pgactiveApplyParallelWorker apply_parallel;
 	}			data;
 
 }			pgactiveWorker;
@@ -441,7 +550,6 @@ typedef enum pgactiveConnectionsAttno
 
 typedef struct pgactiveFlushPosition
 {
-	dlist_node	node;
 	XLogRecPtr	local_end;
 	XLogRecPtr	remote_end;
 }			pgactiveFlushPosition;
@@ -454,6 +562,7 @@ extern char *pgactive_temp_dump_directory;
 extern bool pgactive_log_conflicts_to_table;
 extern bool pgactive_log_conflicts_to_logfile;
 extern bool pgactive_conflict_logging_include_tuples;
+extern int	pgactive_conflict_logging_buffer_size;
 
 /*
  * replaced by pgactive_skip_ddl_replication for now
@@ -475,10 +584,22 @@ extern bool pgactive_debug_trace_replay;
 extern int	pgactive_debug_trace_ddl_locks_level;
 extern char *pgactive_extra_apply_connection_options;
 extern int	pgactive_init_node_parallel_jobs;
+extern bool pgactive_init_node_stream_data;
+extern int	pgactive_debug_init_node_stream_range_size;
+extern int	pgactive_debug_flush_positions_initial_size;
 extern int	pgactive_max_nodes;
 extern bool pgactive_permit_node_identifier_getter_function_creation;
 extern bool pgactive_debug_trace_connection_errors;
 extern bool pgactive_apply_as_table_owner;
+extern bool pgactive_apply_multi_insert;
+extern int	pgactive_apply_group_max_xacts;
+extern int	pgactive_apply_group_max_interval;
+extern int	pgactive_apply_parallel_workers;
+extern int	pgactive_max_relation_stats;
+extern bool pgactive_track_apply_timing;
+extern char *pgactive_apply_capture_directory;
+extern int	pgactive_apply_compression;
+extern int	pgactive_apply_compression_threshold;
 
 static const char *const pgactive_default_apply_connection_options =
 "connect_timeout=30 "
@@ -568,12 +689,14 @@ extern void UserTableUpdateIndexes(struct EState *estate,
 extern void UserTableUpdateOpenIndexes(struct EState *estate,
 									   struct TupleTableSlot *slot,
 									   ResultRelInfo *relinfo, bool update);
-extern void build_index_scan_keys(ResultRelInfo *relinfo,
-								  struct ScanKeyData **scan_keys,
-								  pgactiveTupleData * tup);
 extern bool build_index_scan_key(struct ScanKeyData *skey, Relation rel,
 								 Relation idxrel,
 								 pgactiveTupleData * tup);
+extern void build_index_scan_key_template(struct ScanKeyData *skey,
+										  Relation rel, Relation idxrel);
+extern bool build_index_scan_key_values(struct ScanKeyData *skey,
+										Relation idxrel,
+										pgactiveTupleData * tup);
 extern bool find_pkey_tuple(struct ScanKeyData *skey, pgactiveRelation * rel,
 							Relation idxrel, struct TupleTableSlot *slot,
 							bool lock, enum LockTupleMode mode);
@@ -630,6 +753,7 @@ extern pgactiveApplyConflict * pgactive_make_apply_conflict(pgactiveConflictType
 
 extern void pgactive_conflict_log_serverlog(pgactiveApplyConflict * conflict);
 extern void pgactive_conflict_log_table(pgactiveApplyConflict * conflict);
+extern void pgactive_conflict_log_flush(void);
 
 extern void tuple_to_stringinfo(StringInfo s, TupleDesc tupdesc, HeapTuple tuple);
 
@@ -645,6 +769,37 @@ extern void pgactive_count_update_conflict(void);
 extern void pgactive_count_delete(void);
 extern void pgactive_count_delete_conflict(void);
 extern void pgactive_count_disconnect(void);
+extern void pgactive_count_conflict_log_dropped(void);
+extern void pgactive_count_compressed(uint64 compressed, uint64 uncompressed);
+extern void pgactive_count_apply_xact(TimestampTz remote_committime,
+									  TimestampTz begin_at,
+									  TimestampTz applied_at,
+									  uint64 rows, uint64 bytes);
+extern void pgactive_count_set_deferred(bool deferred);
+extern void pgactive_count_flush(void);
+
+/* per-relation statistics, times in microseconds */
+typedef enum pgactiveRelStat
+{
+	pgactiveRelStat_Insert,
+	pgactiveRelStat_Update,
+	pgactiveRelStat_Delete,
+	pgactiveRelStat_InsertInsert,
+	pgactiveRelStat_UpdateUpdate,
+	pgactiveRelStat_UpdateDelete,
+	pgactiveRelStat_DeleteDelete,
+	pgactiveRelStat_LookupTime,
+	pgactiveRelStat_WriteTime,
+	pgactiveRelStat_Bytes,
+	pgactiveRelStat_NumStats
+}			pgactiveRelStat;
+
+typedef struct pgactiveRelStats pgactiveRelStats;
+
+extern pgactiveRelStats * pgactive_count_relation_stats(const pgactiveNodeId * const peer,
+														Oid relid, bool sent);
+extern void pgactive_count_relation(pgactiveRelStats * stats, pgactiveRelStat stat,
+									uint64 n);
 
 /* compat check functions */
 extern bool pgactive_get_float4byval(void);
@@ -690,12 +845,14 @@ extern void pgactive_capture_ddl(Node *parsetree, const char *queryString,
 								 DestReceiver *dest, CommandTag completionTag);
 
 extern void pgactive_locks_shmem_init(void);
-extern void pgactive_locks_check_dml(void);
+extern void pgactive_locks_check_dml(List *rtable);
 
 /* background workers and supporting functions for them */
 PGDLLEXPORT extern void pgactive_apply_main(Datum main_arg);
 PGDLLEXPORT extern void pgactive_perdb_worker_main(Datum main_arg);
 PGDLLEXPORT extern void pgactive_supervisor_worker_main(Datum main_arg);
+PGDLLEXPORT extern void pgactive_apply_parallel_main(Datum main_arg);
+PGDLLEXPORT extern void pgactive_apply_replay_main(Datum main_arg);
 
 extern void pgactive_bgworker_init(uint32 worker_arg, pgactiveWorkerType worker_type);
 extern void pgactive_supervisor_register(void);
@@ -703,6 +860,55 @@ extern bool IspgactiveApplyWorker(void);
 extern bool IspgactivePerdbWorker(void);
 extern pgactiveApplyWorker * GetpgactiveApplyWorkerShmemPtr(void);
 
+/* apply support used by parallel apply, see pgactive_apply.c */
+extern void pgactive_process_remote_action(StringInfo s);
+extern void pgactive_apply_push_flush_position(XLogRecPtr local_end,
+											   XLogRecPtr remote_end);
+extern void pgactive_apply_setup_parallel_worker(pgactiveApplyWorker * apply);
+extern void pgactive_apply_setup_replay(pgactiveApplyWorker * apply, bool dry_run);
+extern void pgactive_apply_replay_finish(void);
+extern void pgactive_apply_relstate_invalidate(Oid relid);
+extern void pgactive_apply_remote_relation_invalidate(Oid relid);
+extern void pgactive_apply_remote_relation_names(uint32 remote_relid,
+												 const char **nspname,
+												 const char **relname);
+
+/* apply of streamed transactions, see pgactive_apply_stream.c */
+extern bool pgactive_apply_stream_in_progress(void);
+extern void pgactive_apply_stream_start(StringInfo s);
+extern void pgactive_apply_stream_stop(void);
+extern void pgactive_apply_stream_spool(char action, StringInfo s);
+extern void pgactive_apply_stream_abort(StringInfo s);
+extern void pgactive_apply_stream_commit(StringInfo s);
+
+/* capture and replay of the replication stream, see pgactive_apply_capture.c */
+extern void pgactive_apply_capture_configure(const pgactiveNodeId * const remote,
+											 bool connecting);
+extern void pgactive_apply_capture_message(const char *data, int len);
+extern void pgactive_apply_capture_flush(void);
+
+/* compression of the replication stream, see pgactive_compress.c */
+extern const char *pgactive_compression_name(pgactiveCompression method);
+extern bool pgactive_compression_from_name(const char *name,
+										   pgactiveCompression * method);
+extern void pgactive_compress_message(pgactiveCompression method,
+									  StringInfo out, int start);
+extern void pgactive_decompress_message(StringInfo s);
+
+/* parallel apply, see pgactive_apply_parallel.c */
+extern void pgactive_apply_parallel_start(RepOriginId origin_id);
+extern bool pgactive_apply_parallel_is_active(void);
+extern void pgactive_apply_parallel_dispatch(StringInfo s);
+extern void pgactive_apply_parallel_collect(bool wait_all);
+extern bool pgactive_apply_parallel_in_flight(void);
+extern bool pgactive_apply_parallel_consume_wakeup(void);
+extern bool IspgactiveApplyParallelWorker(void);
+extern void pgactive_apply_parallel_wait_turn(void);
+extern void pgactive_apply_parallel_xact_done(XLogRecPtr local_end,
+											  TransactionId remote_xid,
+											  TimestampTz committs,
+											  TimestampTz applied_at);
+
 extern Oid	pgactive_get_supervisordb_oid(bool missing_ok);
 
 /* Postgres commit 7dbfea3c455e introduced SIGHUP handler in version 13. */
@@ -869,6 +1075,16 @@ extern const char *pgactive_error_severity(int elevel);
  * sequencer support
  */
 
+/* after how long an unanswered claim of a sequence chunk is given up */
+#define pgactive_RANGE_SEQ_CLAIM_TIMEOUT_MS 60000
+
+extern void pgactive_seq_shmem_init(void);
+extern bool pgactive_range_seq_maintain(void);
+extern bool pgactive_range_seq_process_message(int msg_type, bool transactional,
+											   XLogRecPtr lsn,
+											   const pgactiveNodeId * const origin,
+											   StringInfo message);
+
 /*
  * Protocol
  */
@@ -19,9 +19,10 @@ typedef enum pgactiveLockType
 
 void		pgactive_locks_startup(void);
 void		pgactive_locks_set_nnodes(int nnodes);
-void		pgactive_acquire_ddl_lock(pgactiveLockType lock_type);
+void		pgactive_acquire_ddl_lock(pgactiveLockType lock_type, List *relids);
 void		pgactive_process_acquire_ddl_lock(const pgactiveNodeId * const node,
-											  pgactiveLockType lock_type);
+											  pgactiveLockType lock_type,
+											  List *relations);
 void		pgactive_process_release_ddl_lock(const pgactiveNodeId * const origin, const pgactiveNodeId * const lock);
 void		pgactive_process_confirm_ddl_lock(const pgactiveNodeId * const origin, const pgactiveNodeId * const lock,
 											  pgactiveLockType lock_type);
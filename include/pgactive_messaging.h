@@ -13,7 +13,10 @@ typedef enum pgactiveMessageType
 	pgactive_MESSAGE_DECLINE_LOCK,
 	/* Replay confirmations */
 	pgactive_MESSAGE_REQUEST_REPLAY_CONFIRM,
-	pgactive_MESSAGE_REPLAY_CONFIRM
+	pgactive_MESSAGE_REPLAY_CONFIRM,
+	/* Range-allocated sequences */
+	pgactive_MESSAGE_SEQ_CLAIM,
+	pgactive_MESSAGE_SEQ_VOTE
 	/* Node detach/join */
 
 }			pgactiveMessageType;
@@ -0,0 +1,64 @@
+/* pgactive--2.1.9--2.1.10.sql */
+
+-- complain if script is sourced in psql, rather than via ALTER EXTENSION
+\echo Use "ALTER EXTENSION pgactive UPDATE TO '2.1.10'" to load this file. \quit
+
+SET pgactive.skip_ddl_replication = true;
+SET LOCAL search_path = pgactive;
+-- Start Upgrade SQLs/Functions/Procedures
+
+CREATE FUNCTION _pgactive_check_replication_set_config_private (
+    relation regclass,
+    set_name name,
+    replicate_inserts boolean,
+    replicate_updates boolean,
+    replicate_deletes boolean,
+    column_list name[],
+    row_filter text
+)
+RETURNS void
+AS 'MODULE_PATHNAME','pgactive_check_replication_set_config'
+LANGUAGE C;
+
+REVOKE ALL ON FUNCTION _pgactive_check_replication_set_config_private(regclass, name, boolean, boolean, boolean, name[], text) FROM public;
+
+COMMENT ON FUNCTION _pgactive_check_replication_set_config_private(regclass, name, boolean, boolean, boolean, name[], text) IS
+'Check that the column list and row filter of a replication set can be used for a relation in it';
+
+-- Check column lists and row filters against the tables in the set when
+-- they're written; the walsenders ignore the ones they can't use.
+CREATE FUNCTION pgactive_replication_set_config_check()
+  RETURNS trigger
+  LANGUAGE plpgsql
+  SET search_path = ''
+  AS $$
+BEGIN
+  IF NEW.column_list IS NULL AND NEW.row_filter IS NULL THEN
+    RETURN NEW;
+  END IF;
+
+  PERFORM pgactive._pgactive_check_replication_set_config_private(
+            c.oid, NEW.set_name, NEW.replicate_inserts, NEW.replicate_updates,
+            NEW.replicate_deletes, NEW.column_list, NEW.row_filter)
+    FROM pg_catalog.pg_class c
+   WHERE c.relkind = 'r'
+     AND c.relpersistence = 'p'
+     AND c.relnamespace NOT IN ('pg_catalog'::regnamespace,
+                                'information_schema'::regnamespace,
+                                'pgactive'::regnamespace)
+     AND NEW.set_name = ANY (pgactive.pgactive_get_table_replication_sets(c.oid));
+
+  RETURN NEW;
+END;
+$$;
+
+CREATE TRIGGER pgactive_replication_set_config_check_trigg
+BEFORE INSERT OR UPDATE
+ON pgactive.pgactive_replication_set_config
+FOR EACH ROW
+EXECUTE PROCEDURE pgactive_replication_set_config_check();
+
+
+-- Finish Upgrade SQLs/Functions/Procedures
+RESET pgactive.skip_ddl_replication;
+RESET search_path;
@@ -40,7 +40,10 @@ CREATE FUNCTION pgactive_get_stats (
     OUT nr_update_conflict int8,
     OUT nr_delete int8,
     OUT nr_delete_conflict int8,
-    OUT nr_disconnect int8
+    OUT nr_disconnect int8,
+    OUT nr_conflict_log_dropped int8,
+    OUT nr_bytes_compressed int8,
+    OUT nr_bytes_decompressed int8
 )
 RETURNS SETOF record
 AS 'MODULE_PATHNAME'
@@ -50,6 +53,69 @@ REVOKE ALL ON FUNCTION pgactive_get_stats() FROM PUBLIC;
 
 CREATE VIEW pgactive_stats AS SELECT * FROM pgactive_get_stats();
 
+CREATE FUNCTION pgactive_get_stats_histograms (
+    OUT rep_node_id oid,
+    OUT riremoteid text,
+    OUT histogram text,
+    OUT bucket_lower int8,
+    OUT bucket_upper int8,
+    OUT count int8
+)
+RETURNS SETOF record
+AS 'MODULE_PATHNAME'
+LANGUAGE C;
+
+REVOKE ALL ON FUNCTION pgactive_get_stats_histograms() FROM PUBLIC;
+
+CREATE VIEW pgactive_stats_histograms AS SELECT * FROM pgactive_get_stats_histograms();
+
+CREATE FUNCTION pgactive_get_relation_stats (
+    OUT node_sysid text,
+    OUT node_timeline oid,
+    OUT node_dboid oid,
+    OUT datid oid,
+    OUT relid oid,
+    OUT direction text,
+    OUT n_insert int8,
+    OUT n_update int8,
+    OUT n_delete int8,
+    OUT n_insert_insert_conflict int8,
+    OUT n_update_update_conflict int8,
+    OUT n_update_delete_conflict int8,
+    OUT n_delete_delete_conflict int8,
+    OUT lookup_time float8,
+    OUT write_time float8,
+    OUT bytes int8
+)
+RETURNS SETOF record
+AS 'MODULE_PATHNAME'
+LANGUAGE C;
+
+REVOKE ALL ON FUNCTION pgactive_get_relation_stats() FROM PUBLIC;
+
+CREATE VIEW pgactive_relation_stats AS
+SELECT node_sysid, node_timeline, node_dboid, relid::regclass AS relation,
+       direction, n_insert, n_update, n_delete, n_insert_insert_conflict,
+       n_update_update_conflict, n_update_delete_conflict,
+       n_delete_delete_conflict, lookup_time, write_time, bytes
+FROM pgactive_get_relation_stats()
+WHERE datid = (SELECT oid FROM pg_catalog.pg_database
+               WHERE datname = pg_catalog.current_database());
+
+-- Tables being copied by a logical join of this node, with the rows and
+-- bytes loaded so far by the COPY sessions working on each of them
+CREATE VIEW pgactive_init_sync_progress AS
+SELECT p.relid::regclass AS relation,
+       pg_catalog.count(*) AS streams,
+       pg_catalog.sum(p.tuples_processed) AS tuples_processed,
+       pg_catalog.sum(p.bytes_processed) AS bytes_processed
+FROM pg_catalog.pg_stat_progress_copy p
+JOIN pg_catalog.pg_stat_activity a ON a.pid = p.pid
+WHERE p.datname = pg_catalog.current_database()
+  AND p.command = 'COPY FROM'
+  AND a.application_name LIKE 'pgactive:%:init restore'
+GROUP BY p.relid;
+
 CREATE TYPE pgactive_conflict_type AS ENUM (
     'insert_insert',
     'insert_update',
@@ -94,6 +160,38 @@ RETURNS VOID
 AS 'MODULE_PATHNAME'
 LANGUAGE C STRICT;
 
+CREATE FUNCTION pgactive_conflict_handler_keep_local (
+    local_row ANYELEMENT,
+    remote_row ANYELEMENT,
+    command_tag TEXT,
+    rel REGCLASS,
+    event_type pgactive.pgactive_conflict_type,
+    OUT row_out ANYELEMENT,
+    OUT action pgactive.pgactive_conflict_handler_action
+)
+RETURNS RECORD
+AS 'MODULE_PATHNAME'
+LANGUAGE C;
+
+COMMENT ON FUNCTION pgactive_conflict_handler_keep_local(anyelement, anyelement, text, regclass, pgactive.pgactive_conflict_type) IS
+'Built-in conflict handler keeping the local row. Resolved without calling it, so cheaper than an equivalent PL/pgSQL handler.';
+
+CREATE FUNCTION pgactive_conflict_handler_apply_remote (
+    local_row ANYELEMENT,
+    remote_row ANYELEMENT,
+    command_tag TEXT,
+    rel REGCLASS,
+    event_type pgactive.pgactive_conflict_type,
+    OUT row_out ANYELEMENT,
+    OUT action pgactive.pgactive_conflict_handler_action
+)
+RETURNS RECORD
+AS 'MODULE_PATHNAME'
+LANGUAGE C;
+
+COMMENT ON FUNCTION pgactive_conflict_handler_apply_remote(anyelement, anyelement, text, regclass, pgactive.pgactive_conflict_type) IS
+'Built-in conflict handler applying the remote row. Resolved without calling it, so cheaper than an equivalent PL/pgSQL handler.';
+
 CREATE TYPE pgactive_conflict_resolution AS ENUM (
     'conflict_trigger_skip_change',
     'conflict_trigger_returned_tuple',
@@ -329,7 +427,9 @@ CREATE TABLE pgactive_replication_set_config (
     set_name name PRIMARY KEY,
     replicate_inserts bool NOT NULL DEFAULT true,
     replicate_updates bool NOT NULL DEFAULT true,
-    replicate_deletes bool NOT NULL DEFAULT true
+    replicate_deletes bool NOT NULL DEFAULT true,
+    column_list name[],
+    row_filter text
 );
 ALTER TABLE pgactive_replication_set_config SET (user_catalog_table = true);
 
@@ -1721,7 +1821,15 @@ AS 'MODULE_PATHNAME','pgactive_snowflake_id_nextval_oid'
 LANGUAGE C STRICT VOLATILE;
 
 COMMENT ON FUNCTION pgactive_snowflake_id_nextval(regclass) IS
-'Generate sequence values unique to this node using a local sequence as a seed';
+'Generate sequence values unique to this node';
+
+CREATE FUNCTION pgactive_snowflake_id_nextval(regclass, bigint)
+RETURNS SETOF bigint
+AS 'MODULE_PATHNAME','pgactive_snowflake_id_nextval_n'
+LANGUAGE C STRICT VOLATILE;
+
+COMMENT ON FUNCTION pgactive_snowflake_id_nextval(regclass, bigint) IS
+'Generate the given number of sequence values unique to this node';
 
 -- For testing purposes we sometimes want to be able to override the timestamp
 -- etc.
@@ -1733,6 +1841,119 @@ LANGUAGE C STRICT VOLATILE;
 COMMENT ON FUNCTION _pgactive_snowflake_id_nextval_private(regclass, bigint) IS
 'Function for pgactive testing only, do not use in application code';
 
+CREATE TABLE pgactive_range_sequences (
+    seqschema name NOT NULL,
+    seqname name NOT NULL,
+    chunk_size bigint NOT NULL CHECK (chunk_size > 0),
+    PRIMARY KEY (seqschema, seqname)
+);
+REVOKE ALL ON TABLE pgactive_range_sequences FROM PUBLIC;
+SELECT pg_catalog.pg_extension_config_dump('pgactive_range_sequences', '');
+
+COMMENT ON TABLE pgactive_range_sequences IS
+'Sequences whose values are handed out to nodes in chunks, and the chunk size';
+
+CREATE TABLE pgactive_sequence_chunks (
+    seqschema name NOT NULL,
+    seqname name NOT NULL,
+    chunk_start bigint NOT NULL,
+    chunk_end bigint NOT NULL,
+    owner_sysid text NOT NULL,
+    owner_timeline oid NOT NULL,
+    owner_dboid oid NOT NULL,
+    state "char" NOT NULL,
+    accepted_by text[] NOT NULL DEFAULT '{}',
+    votes_needed integer NOT NULL,
+    claimed_at timestamptz NOT NULL DEFAULT pg_catalog.now(),
+    PRIMARY KEY (seqschema, seqname, owner_sysid, owner_timeline, owner_dboid, chunk_start)
+);
+REVOKE ALL ON TABLE pgactive_sequence_chunks FROM PUBLIC;
+SELECT pg_catalog.pg_extension_config_dump('pgactive_sequence_chunks', '');
+
+COMMENT ON TABLE pgactive_sequence_chunks IS
+'Chunks of range-allocated sequences claimed (p), allocated (a) or given up (r) by nodes';
+
+CREATE FUNCTION pgactive_set_sequence_chunk_size(seq regclass, chunk_size bigint)
+RETURNS void LANGUAGE plpgsql VOLATILE
+SET search_path = pgactive, pg_catalog
+AS
+$body$
+DECLARE
+    v_nspname name;
+    v_relname name;
+BEGIN
+    SELECT n.nspname, c.relname INTO v_nspname, v_relname
+    FROM pg_catalog.pg_class c
+    JOIN pg_catalog.pg_namespace n ON n.oid = c.relnamespace
+    WHERE c.oid = seq AND c.relkind = 'S';
+
+    IF NOT FOUND THEN
+        RAISE USING
+            MESSAGE = format('relation %s is not a sequence', seq),
+            ERRCODE = 'wrong_object_type';
+    END IF;
+
+    INSERT INTO pgactive.pgactive_range_sequences (seqschema, seqname, chunk_size)
+    VALUES (v_nspname, v_relname, chunk_size)
+    ON CONFLICT (seqschema, seqname)
+    DO UPDATE SET chunk_size = EXCLUDED.chunk_size;
+END;
+$body$;
+
+REVOKE ALL ON FUNCTION pgactive_set_sequence_chunk_size(regclass, bigint) FROM public;
+
+COMMENT ON FUNCTION pgactive_set_sequence_chunk_size(regclass, bigint) IS
+'Make a sequence range-allocated, handing out values to nodes in chunks of the given size';
+
+CREATE FUNCTION pgactive_range_sequence_nextval(regclass)
+RETURNS bigint
+AS 'MODULE_PATHNAME','pgactive_range_sequence_nextval'
+LANGUAGE C STRICT VOLATILE;
+
+COMMENT ON FUNCTION pgactive_range_sequence_nextval(regclass) IS
+'Generate the next value of a range-allocated sequence from a chunk allocated to this node';
+
+CREATE FUNCTION pgactive_apply_replay (
+    capture_file text,
+    dry_run boolean DEFAULT false,
+    OUT transactions int8,
+    OUT changes int8,
+    OUT messages int8,
+    OUT seconds float8
+)
+RETURNS record
+AS 'MODULE_PATHNAME','pgactive_apply_replay'
+LANGUAGE C VOLATILE STRICT;
+
+REVOKE ALL ON FUNCTION pgactive_apply_replay(text, boolean) FROM public;
+
+COMMENT ON FUNCTION pgactive_apply_replay(text, boolean) IS
+'Apply a capture of the replication stream taken with pgactive.apply_capture_directory, optionally rolling back every transaction';
+
+CREATE FUNCTION pgactive_decode_benchmark (
+    slot_name name,
+    upto_lsn pg_lsn DEFAULT NULL,
+    loops integer DEFAULT 1,
+    OUT changes int8,
+    OUT bytes int8,
+    OUT seconds float8,
+    OUT changes_per_second float8,
+    OUT binary_columns int8,
+    OUT binary_bytes int8,
+    OUT sendrecv_columns int8,
+    OUT sendrecv_bytes int8,
+    OUT text_columns int8,
+    OUT text_bytes int8
+)
+RETURNS record
+AS 'MODULE_PATHNAME','pgactive_decode_benchmark'
+LANGUAGE C VOLATILE;
+
+REVOKE ALL ON FUNCTION pgactive_decode_benchmark(name, pg_lsn, integer) FROM public;
+
+COMMENT ON FUNCTION pgactive_decode_benchmark(name, pg_lsn, integer) IS
+'Decode the changes of a slot with the pgactive output plugin repeatedly without sending them, and report the time taken and how columns were encoded';
+
 CREATE FUNCTION pgactive_acquire_global_lock(lockmode text)
 RETURNS void
 AS 'MODULE_PATHNAME','pgactive_acquire_global_lock'
@@ -2878,7 +3099,9 @@ CREATE FUNCTION pgactive_get_workers_info (
     OUT pid int4,
     OUT unregistered boolean,
     OUT last_error text,
-    OUT last_error_time timestamptz
+    OUT last_error_time timestamptz,
+    OUT pending_flush_positions int4,
+    OUT flush_positions_capacity int4
 )
 RETURNS SETOF record
 AS 'MODULE_PATHNAME'
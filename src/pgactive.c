@@ -123,10 +123,22 @@ int			pgactive_debug_trace_ddl_locks_level = DDL_LOCK_TRACE_STATEMENT;
 char	   *pgactive_extra_apply_connection_options;
 int			pgactive_log_min_messages = WARNING;
 int			pgactive_init_node_parallel_jobs;
+bool		pgactive_init_node_stream_data;
+int			pgactive_debug_init_node_stream_range_size;
+int			pgactive_debug_flush_positions_initial_size;
 int			pgactive_max_nodes;
 bool		pgactive_permit_node_identifier_getter_function_creation;
 bool		pgactive_debug_trace_connection_errors;
 bool		pgactive_apply_as_table_owner;
+bool		pgactive_apply_multi_insert;
+int			pgactive_apply_group_max_xacts;
+int			pgactive_apply_group_max_interval;
+int			pgactive_apply_parallel_workers;
+int			pgactive_max_relation_stats;
+bool		pgactive_track_apply_timing;
+char	   *pgactive_apply_capture_directory;
+int			pgactive_apply_compression = pgactive_COMPRESSION_NONE;
+int			pgactive_apply_compression_threshold;
 
 PG_MODULE_MAGIC;
 
@@ -215,6 +227,19 @@ static const struct config_enum_entry pgactive_debug_trace_ddl_locks_level_optio
 	{NULL, 0, false}
 };
 
+/* only the methods this server was built with */
+static const struct config_enum_entry pgactive_apply_compression_options[] = {
+	{"none", pgactive_COMPRESSION_NONE, false},
+#ifdef USE_LZ4
+	{"lz4", pgactive_COMPRESSION_LZ4, false},
+#endif
+#ifdef USE_ZSTD
+	{"zstd", pgactive_COMPRESSION_ZSTD, false},
+#endif
+	{"off", pgactive_COMPRESSION_NONE, true},
+	{NULL, 0, false}
+};
+
 /*
  * Lookup table for types of pgactive workers.
  */
@@ -223,6 +248,7 @@ const char *const pgactiveWorkerTypeNames[] = {
 	[pgactive_WORKER_APPLY] = "apply worker",
 	[pgactive_WORKER_PERDB] = "per-db worker",
 	[pgactive_WORKER_WALSENDER] = "walsender",
+	[pgactive_WORKER_APPLY_PARALLEL] = "parallel apply worker",
 };
 
 /*
@@ -582,7 +608,9 @@ pgactive_bgworker_init(uint32 worker_arg, pgactiveWorkerType worker_type)
 		proc_exit(0);
 	}
 
-	pgactive_worker_shmem_acquire(worker_type, worker_idx, false);
+	/* parallel apply workers are never restarted, so free their slot on exit */
+	pgactive_worker_shmem_acquire(worker_type, worker_idx,
+								  worker_type == pgactive_WORKER_APPLY_PARALLEL);
 
 	/* figure out database to connect to */
 	if (worker_type == pgactive_WORKER_PERDB)
@@ -600,8 +628,12 @@ pgactive_bgworker_init(uint32 worker_arg, pgactiveWorkerType worker_type)
 		apply->last_applied_xact_id = InvalidTransactionId;
 		apply->last_applied_xact_committs = 0;
 		apply->last_applied_xact_at = 0;
+		apply->flush_positions_count = 0;
+		apply->flush_positions_size = 0;
 		dboid = apply->dboid;
 	}
+	else if (worker_type == pgactive_WORKER_APPLY_PARALLEL)
+		dboid = pgactive_worker_slot->data.apply_parallel.dboid;
 	else
 		elog(FATAL, "don't know how to connect to this type of worker: %u",
 			 pgactive_worker_type);
@@ -711,7 +743,8 @@ pgactive_bgworker_init(uint32 worker_arg, pgactiveWorkerType worker_type)
 	SetConfigOption("log_min_messages", pgactive_error_severity(pgactive_log_min_messages),
 					PGC_POSTMASTER, PGC_S_OVERRIDE);
 
-	if (worker_type == pgactive_WORKER_APPLY)
+	if (worker_type == pgactive_WORKER_APPLY ||
+		worker_type == pgactive_WORKER_APPLY_PARALLEL)
 	{
 		/* Run as replica session replication role, this avoids FK checks. */
 		SetConfigOption("session_replication_role", "replica",
@@ -732,6 +765,12 @@ pgactive_bgworker_init(uint32 worker_arg, pgactiveWorkerType worker_type)
 
 		pgactive_setup_cached_remote_name(&apply->remote_node);
 	}
+	else if (worker_type == pgactive_WORKER_APPLY_PARALLEL)
+	{
+		pgactiveApplyParallelWorker *pw = &pgactive_worker_slot->data.apply_parallel;
+
+		pgactive_setup_cached_remote_name(&pw->remote_node);
+	}
 	else if (worker_type == pgactive_WORKER_WALSENDER)
 	{
 		pgactiveWalsenderWorker *walsender = &pgactive_worker_slot->data.walsnd;
@@ -1045,6 +1084,17 @@ _PG_init(void)
 							 PGC_SIGHUP,
 							 0,
 							 NULL, NULL, NULL);
+
+	DefineCustomIntVariable("pgactive.conflict_logging_buffer_size",
+							"Sets the number of conflicts logged to the conflict history table at once.",
+							"Conflicts are buffered and logged when the apply transaction commits; "
+							"conflicts beyond this number are not logged to the table. "
+							"0 logs each conflict as it occurs.",
+							&pgactive_conflict_logging_buffer_size,
+							0, 0, 100000,
+							PGC_SIGHUP,
+							0,
+							NULL, NULL, NULL);
 /*
  * replaced by pgactive_skip_ddl_replication for now
  * DefineCustomBoolVariable("pgactive.permit_ddl_locking",
@@ -1224,6 +1274,33 @@ _PG_init(void)
 							0,
 							NULL, NULL, NULL);
 
+	DefineCustomBoolVariable("pgactive.init_node_stream_data",
+							 "Streams table data from the remote node while logical join of a node instead of dumping it to a temporary directory first.",
+							 NULL,
+							 &pgactive_init_node_stream_data,
+							 false,
+							 PGC_SIGHUP,
+							 0,
+							 NULL, NULL, NULL);
+
+	DefineCustomIntVariable("pgactive.debug_init_node_stream_range_size",
+							"Sets the size from which tables are split into block ranges copied concurrently while logical join of a node streams table data.",
+							NULL,
+							&pgactive_debug_init_node_stream_range_size,
+							(1024 * 1024 * 1024) / BLCKSZ, 1, INT_MAX / 2,
+							PGC_SIGHUP,
+							GUC_UNIT_BLOCKS,
+							NULL, NULL, NULL);
+
+	DefineCustomIntVariable("pgactive.debug_flush_positions_initial_size",
+							"Sets how many commits an apply worker initially has room for while waiting for them to be flushed locally.",
+							"Rounded up to a power of 2.",
+							&pgactive_debug_flush_positions_initial_size,
+							1024, 1, 1024 * 1024,
+							PGC_SIGHUP,
+							0,
+							NULL, NULL, NULL);
+
 	DefineCustomIntVariable("pgactive.max_nodes",
 							"Sets maximum allowed nodes in a pgactive group.",
 							"This parameter must be set to same value on all pgactive members, otherwise "
@@ -1262,6 +1339,97 @@ _PG_init(void)
 							 0,
 							 NULL, NULL, NULL);
 
+	DefineCustomBoolVariable("pgactive.apply_multi_insert",
+							 "Batch consecutive remote INSERTs into a table.",
+							 "When enabled, the apply worker buffers remote INSERTs that don't "
+							 "conflict with local rows and inserts them together, like COPY.",
+							 &pgactive_apply_multi_insert,
+							 true,
+							 PGC_SIGHUP,
+							 0,
+							 NULL, NULL, NULL);
+
+	DefineCustomIntVariable("pgactive.apply_group_max_xacts",
+							"Sets the maximum number of remote transactions applied in one local transaction.",
+							"Consecutive remote transactions that are received together are committed "
+							"together. 1 commits each remote transaction on its own.",
+							&pgactive_apply_group_max_xacts,
+							1, 1, 10000,
+							PGC_SIGHUP,
+							0,
+							NULL, NULL, NULL);
+
+	DefineCustomIntVariable("pgactive.apply_group_max_interval",
+							"Sets the maximum time between the remote commits of transactions applied in one local transaction.",
+							"The local transaction gets the commit timestamp of the last remote transaction, "
+							"which last-update-wins conflict resolution compares.",
+							&pgactive_apply_group_max_interval,
+							10, 0, 1000,
+							PGC_SIGHUP,
+							GUC_UNIT_MS,
+							NULL, NULL, NULL);
+
+	DefineCustomIntVariable("pgactive.apply_parallel_workers",
+							"Sets the number of parallel apply workers each apply worker may use.",
+							"Independent remote transactions are applied by these workers concurrently "
+							"and committed in remote commit order. 0 applies all changes serially.",
+							&pgactive_apply_parallel_workers,
+							0, 0, 64,
+							PGC_SIGHUP,
+							0,
+							NULL, NULL, NULL);
+
+	DefineCustomIntVariable("pgactive.max_relation_stats",
+							"Sets the maximum number of relations replication statistics are kept for.",
+							"Statistics are kept per relation and peer node, separately for "
+							"sent and applied changes. 0 disables per-relation statistics.",
+							&pgactive_max_relation_stats,
+							1000, 0, 1000000,
+							PGC_POSTMASTER,
+							0,
+							NULL, NULL, NULL);
+
+	DefineCustomBoolVariable("pgactive.track_apply_timing",
+							 "Collects timing statistics of applied changes per relation.",
+							 "Measures the time apply workers spend looking up conflicting "
+							 "tuples and writing changes, which costs clock reads per change.",
+							 &pgactive_track_apply_timing,
+							 false,
+							 PGC_SIGHUP,
+							 0,
+							 NULL, NULL, NULL);
+
+	DefineCustomStringVariable("pgactive.apply_capture_directory",
+							   "Directory apply workers capture the replication stream they receive to.",
+							   "Each apply worker writes the messages it receives to a file in this "
+							   "directory, for replay with pgactive_apply_replay(). Empty disables capture. "
+							   "Capturing starts when an apply worker connects.",
+							   &pgactive_apply_capture_directory,
+							   "",
+							   PGC_SIGHUP,
+							   0,
+							   NULL, NULL, NULL);
+
+	DefineCustomEnumVariable("pgactive.apply_compression",
+							 "Sets how apply workers ask their upstream node to compress the changes it sends.",
+							 "Takes effect when an apply worker connects. Upstream nodes that don't "
+							 "support the method send changes uncompressed.",
+							 &pgactive_apply_compression,
+							 pgactive_COMPRESSION_NONE,
+							 pgactive_apply_compression_options,
+							 PGC_SIGHUP,
+							 0,
+							 NULL, NULL, NULL);
+
+	DefineCustomIntVariable("pgactive.apply_compression_threshold",
+							"Sets the size from which messages sent to apply workers are compressed.",
+							NULL,
+							&pgactive_apply_compression_threshold,
+							256, 0, INT_MAX,
+							PGC_SIGHUP,
+							GUC_UNIT_BYTE,
+							NULL, NULL, NULL);
+
 	EmitWarningsOnPlaceholders("pgactive");
 
 	/* Security label provider hook */
@@ -1790,7 +1958,7 @@ pgactive_get_worker_pid_byid(const pgactiveNodeId * const node, pgactiveWorkerTy
 Datum
 pgactive_get_workers_info(PG_FUNCTION_ARGS)
 {
-#define pgactive_GET_WORKERS_PID_COLS	8
+#define pgactive_GET_WORKERS_PID_COLS	10
 	ReturnSetInfo *rsinfo = (ReturnSetInfo *) fcinfo->resultinfo;
 	int			i;
 
@@ -1809,6 +1977,8 @@ pgactive_get_workers_info(PG_FUNCTION_ARGS)
 		char		sysid_str[33];
 		text	   *worker_type = NULL; /* keep compiler quiet */
 		bool		unregistered = false;
+		int			flush_positions_count = -1;
+		int			flush_positions_size = -1;
 
 		/* unused slot */
 		if (w->worker_type == pgactive_WORKER_EMPTY_SLOT)
@@ -1822,6 +1992,8 @@ pgactive_get_workers_info(PG_FUNCTION_ARGS)
 			timeline = aw->remote_node.timeline;
 			dboid = aw->remote_node.dboid;
 			worker_type = cstring_to_text("apply");
+			flush_positions_count = aw->flush_positions_count;
+			flush_positions_size = aw->flush_positions_size;
 		}
 		else if (w->worker_type == pgactive_WORKER_PERDB)
 		{
@@ -1842,6 +2014,15 @@ pgactive_get_workers_info(PG_FUNCTION_ARGS)
 			dboid = ws->remote_node.dboid;
 			worker_type = cstring_to_text("walsender");
 		}
+		else if (w->worker_type == pgactive_WORKER_APPLY_PARALLEL)
+		{
+			pgactiveApplyParallelWorker *pw = &w->data.apply_parallel;
+
+			sysid = pw->remote_node.sysid;
+			timeline = pw->remote_node.timeline;
+			dboid = pw->remote_node.dboid;
+			worker_type = cstring_to_text("parallel apply");
+		}
 
 		if (w->worker_type != pgactive_WORKER_PERDB)
 		{
@@ -1866,6 +2047,17 @@ pgactive_get_workers_info(PG_FUNCTION_ARGS)
 			nulls[7] = true;
 		}
 
+		if (flush_positions_count >= 0)
+		{
+			values[8] = Int32GetDatum(flush_positions_count);
+			values[9] = Int32GetDatum(flush_positions_size);
+		}
+		else
+		{
+			nulls[8] = true;
+			nulls[9] = true;
+		}
+
 		tuplestore_putvalues(rsinfo->setResult, rsinfo->setDesc,
 							 values, nulls);
 	}
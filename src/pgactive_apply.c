@@ -47,9 +47,15 @@
 
 #include "parser/parse_type.h"
 
+#include "port/pg_bitutils.h"
+
+#include "portability/instr_time.h"
+
 #include "replication/logical.h"
 #include "replication/origin.h"
 
+#include "rewrite/rewriteHandler.h"
+
 #include "storage/lmgr.h"
 #include "storage/lwlock.h"
 #include "storage/proc.h"
@@ -61,6 +67,7 @@
 #include "utils/array.h"
 #include "utils/builtins.h"
 #include "utils/datetime.h"
+#include "utils/hsearch.h"
 #include "utils/lsyscache.h"
 #include "utils/memutils.h"
 #include "utils/snapmgr.h"
@@ -117,6 +124,53 @@ static XLogRecPtr remote_origin_lsn = InvalidXLogRecPtr;
 /* The local identifier for the remote's origin, if any. */
 static RepOriginId remote_origin_id = InvalidRepOriginId;
 
+/*
+ * Remote transactions applied in the current local transaction without
+ * committing it, see pgactive.apply_group_max_xacts. The local transaction
+ * is committed with the commit LSN and timestamp of the last of them.
+ */
+static int	group_xacts = 0;
+static TimestampTz group_first_committime = 0;
+static XLogRecPtr group_commit_lsn = InvalidXLogRecPtr;
+static TimestampTz group_committime = 0;
+static TransactionId group_remote_xid = InvalidTransactionId;
+
+/* the last remote transaction was applied, its commit is pending */
+static bool group_commit_pending = false;
+
+/*
+ * Statistics of the remote transactions applied in the current local
+ * transaction, counted once it has committed, see apply_group_count_xacts().
+ */
+typedef struct ApplyGroupXact
+{
+	TransactionId remote_xid;
+	TimestampTz committime;
+	TimestampTz begin_at;
+	TimestampTz applied_at;
+	uint64		rows;
+	uint64		bytes;
+} ApplyGroupXact;
+
+static ApplyGroupXact *group_xact_stats = NULL;
+static int	group_xact_stats_size = 0;
+static int	group_xact_stats_count = 0;
+
+/* commit the current remote transaction without waiting for more */
+static bool group_break = false;
+
+/*
+ * Replaying a capture rather than applying from an upstream, see
+ * pgactive_apply_capture.c. A dry run rolls back each remote transaction.
+ */
+static bool apply_replaying = false;
+static bool apply_replay_dry_run = false;
+
+/* for the histograms of applied transactions, see pgactive_count_apply_xact() */
+static TimestampTz xact_begin_at = 0;
+static uint64 xact_rows = 0;
+static uint64 xact_bytes = 0;
+
 /*
  * A message counter for the xact, for debugging. We don't send
  * the remote change LSN with messages, so this aids identification
@@ -132,7 +186,107 @@ static pgactiveApplyWorker * pgactive_apply_worker = NULL;
 
 static pgactiveConnectionConfig * pgactive_apply_config = NULL;
 
-static dlist_head pgactive_lsn_association = DLIST_STATIC_INIT(pgactive_lsn_association);
+/*
+ * Local commit record ends and the remote commit ends they applied, oldest
+ * first, for pgactive_get_flush_position(). Transactions are committed in
+ * remote commit order, so both increase. Kept in a ring buffer that's
+ * doubled when full, so that remote commits don't allocate memory and the
+ * locally flushed ones can be found with a binary search.
+ */
+static pgactiveFlushPosition *flush_positions = NULL;
+static int	flush_positions_size = 0;	/* a power of 2 */
+static int	flush_positions_head = 0;	/* index of the oldest */
+static int	flush_positions_count = 0;
+
+#define FLUSH_POSITION(i) \
+	(&flush_positions[(flush_positions_head + (i)) & (flush_positions_size - 1)])
+
+/*
+ * How to convert the remote values of a column sent in send/recv or text
+ * format, looked up when first needed, see apply_relstate_column(). Also the
+ * default of the column for INSERTs that don't send it, see
+ * apply_relstate_fill_defaults().
+ */
+typedef struct pgactiveApplyColumn
+{
+	FmgrInfo	recv_func;
+	Oid			recv_ioparam;
+	FmgrInfo	input_func;
+	Oid			input_ioparam;
+	bool		default_valid;
+	ExprState  *default_expr;	/* NULL if the column has no default */
+}			pgactiveApplyColumn;
+
+/*
+ * What's needed to apply changes to a relation: executor state, slots, open
+ * indexes and index scan keys. Setting all that up again for every row would
+ * dominate the cost of applying bulk changes, so it's kept around for the
+ * rest of the remote transaction, unless the relation is invalidated.
+ */
+typedef struct pgactiveApplyRelState
+{
+	Oid			relid;			/* hash key */
+	bool		valid;
+
+	/* our own reference to the relation, NULL once released */
+	Relation	rel;
+
+	EState	   *estate;
+	ResultRelInfo *relinfo;
+	TupleTableSlot *oldslot;
+	TupleTableSlot *newslot;
+
+	/*
+	 * Scan key template for each index in relinfo that can be used to look
+	 * up tuples, i.e. unique indexes without expressions, NULL for others.
+	 */
+	ScanKey    *index_skeys;
+
+	/* index of the replica identity or primary key in relinfo, or -1 */
+	int			replident_index;
+
+	/* one per attribute */
+	pgactiveApplyColumn *columns;
+
+	/* can INSERTs be buffered for table_multi_insert()? */
+	bool		multi_insert;
+
+	/* buffered INSERTs, see apply_relstate_buffer_insert() */
+	TupleTableSlot **insert_slots;
+	int			ninserts;
+	Size		insert_bytes;
+
+	/* statistics of changes applied from the origin, may be NULL */
+	pgactiveRelStats *stats;
+}			pgactiveApplyRelState;
+
+/*
+ * Limits of the number and size of buffered INSERTs, same as COPY FROM's.
+ */
+#define APPLY_MULTI_INSERT_MAX_TUPLES	1000
+#define APPLY_MULTI_INSERT_MAX_BYTES	65535
+
+/* relation state of the current transaction, keyed by relation oid */
+static HTAB *ApplyRelStateHash = NULL;
+static MemoryContext ApplyRelStateContext = NULL;
+
+/* relation with buffered INSERTs, if any */
+static pgactiveApplyRelState * ApplyRelStatePendingInserts = NULL;
+
+/*
+ * Upstream relation described by a relation message, which changes then
+ * refer to by its upstream oid.
+ */
+typedef struct pgactiveRemoteRelation
+{
+	uint32		remote_relid;	/* hash key */
+	char	   *nspname;
+	char	   *relname;
+	/* local relation of that name, InvalidOid if not looked up or changed */
+	Oid			localrelid;
+}			pgactiveRemoteRelation;
+
+static HTAB *RemoteRelationHash = NULL;
 
 struct ActionErrCallbackArg
 {
@@ -144,7 +298,14 @@ struct ActionErrCallbackArg
 };
 
 static pgactiveRelation * read_rel(StringInfo s, LOCKMODE mode, struct ActionErrCallbackArg *cbarg);
-static void read_tuple_parts(StringInfo s, pgactiveRelation * rel, pgactiveTupleData * tup);
+static void read_tuple_parts(StringInfo s, pgactiveApplyRelState * state,
+							 pgactiveRelation * rel, pgactiveTupleData * tup);
+static bool remote_varlena_check(FormData_pg_attribute *att, const char *val,
+								 int len, bool *make_short);
+static HeapTuple read_tuple_binary(StringInfo s, pgactiveRelation * rel,
+								   pgactiveTupleData * tup);
+static HeapTuple read_tuple(StringInfo s, pgactiveApplyRelState * state,
+							pgactiveRelation * rel, pgactiveTupleData * tup);
 
 static void check_apply_update(pgactiveConflictType conflict_type,
 							   RepOriginId local_node_id, TimestampTz local_ts,
@@ -158,6 +319,16 @@ static HeapTuple process_queued_drop(HeapTuple cmdtup);
 static void process_queued_ddl_command(HeapTuple cmdtup, bool tx_just_started);
 static bool pgactive_performing_work(void);
 
+static pgactiveApplyRelState * apply_relstate_get(pgactiveRelation * rel);
+static void apply_relstate_buffer_insert(pgactiveApplyRelState * state,
+										 TupleTableSlot *slot);
+static void apply_relstate_flush_inserts(void);
+static void apply_relstate_start_time(instr_time *start);
+static void apply_relstate_count_time(pgactiveApplyRelState * state,
+									  pgactiveRelStat stat, instr_time *start);
+static void apply_relstate_release_all(void);
+
+static void process_remote_relation(StringInfo s);
 static void process_remote_begin(StringInfo s);
 static void process_remote_commit(StringInfo s);
 static void process_remote_insert(StringInfo s);
@@ -259,6 +430,611 @@ action_error_callback(void *arg)
 	}
 }
 
+/*
+ * Release the relation state of the current transaction. Must be done before
+ * commit, and before executing DDL that might need exclusive use of the
+ * relations.
+ */
+static void
+apply_relstate_release_all(void)
+{
+	HASH_SEQ_STATUS status;
+	pgactiveApplyRelState *state;
+
+	if (ApplyRelStateHash == NULL)
+		return;
+
+	apply_relstate_flush_inserts();
+
+	hash_seq_init(&status, ApplyRelStateHash);
+	while ((state = hash_seq_search(&status)) != NULL)
+	{
+		if (state->rel == NULL)
+			continue;
+
+		ExecCloseIndices(state->relinfo);
+		ExecResetTupleTable(state->estate->es_tupleTable, true);
+		FreeExecutorState(state->estate);
+		table_close(state->rel, NoLock);
+		state->rel = NULL;
+	}
+
+	MemoryContextDelete(ApplyRelStateContext);
+	ApplyRelStateContext = NULL;
+	ApplyRelStateHash = NULL;
+}
+
+static void
+apply_relstate_xact_callback(XactEvent event, void *arg)
+{
+	switch (event)
+	{
+		case XACT_EVENT_PRE_COMMIT:
+			apply_relstate_release_all();
+			break;
+		case XACT_EVENT_ABORT:
+			/* freed along with the transaction's memory and resources */
+			ApplyRelStateContext = NULL;
+			ApplyRelStateHash = NULL;
+			ApplyRelStatePendingInserts = NULL;
+			break;
+		default:
+			break;
+	}
+}
+
+/*
+ * Relcache invalidation callback, see pgactiveRelcacheHashInvalidateCallback.
+ * The state is rebuilt the next time the relation is used.
+ */
+void
+pgactive_apply_relstate_invalidate(Oid relid)
+{
+	HASH_SEQ_STATUS status;
+	pgactiveApplyRelState *state;
+
+	if (ApplyRelStateHash == NULL)
+		return;
+
+	if (relid == InvalidOid)
+	{
+		hash_seq_init(&status, ApplyRelStateHash);
+		while ((state = hash_seq_search(&status)) != NULL)
+			state->valid = false;
+	}
+	else if ((state = hash_search(ApplyRelStateHash, &relid,
+								  HASH_FIND, NULL)) != NULL)
+		state->valid = false;
+}
+
+/*
+ * Get the state to apply a change to the relation, setting it up if it isn't
+ * cached yet in the current transaction.
+ *
+ * The caller has to clear the slots once done with the change.
+ */
+static pgactiveApplyRelState *
+apply_relstate_get(pgactiveRelation * rel)
+{
+	static bool callback_registered = false;
+	Oid			relid = RelationGetRelid(rel->rel);
+	pgactiveApplyRelState *state;
+	bool		found;
+	MemoryContext oldctx;
+	Oid			idxoid;
+	int			i;
+
+	Assert(IsTransactionState());
+
+	if (ApplyRelStateHash == NULL)
+	{
+		HASHCTL		ctl;
+
+		if (!callback_registered)
+		{
+			RegisterXactCallback(apply_relstate_xact_callback, NULL);
+			callback_registered = true;
+		}
+
+		ApplyRelStateContext = AllocSetContextCreate(TopTransactionContext,
+													 "pgactive apply relation state",
+													 ALLOCSET_DEFAULT_SIZES);
+
+		memset(&ctl, 0, sizeof(ctl));
+		ctl.keysize = sizeof(Oid);
+		ctl.entrysize = sizeof(pgactiveApplyRelState);
+		ctl.hcxt = ApplyRelStateContext;
+		ApplyRelStateHash = hash_create("pgactive apply relation state", 16,
+										&ctl, HASH_ELEM | HASH_BLOBS | HASH_CONTEXT);
+	}
+
+	/* keep buffered INSERTs in order with changes to other relations */
+	if (ApplyRelStatePendingInserts != NULL &&
+		(ApplyRelStatePendingInserts->relid != relid ||
+		 !ApplyRelStatePendingInserts->valid))
+		apply_relstate_flush_inserts();
+
+	state = hash_search(ApplyRelStateHash, &relid, HASH_ENTER, &found);
+
+	if (found && state->valid)
+	{
+		ResetPerTupleExprContext(state->estate);
+		return state;
+	}
+
+	if (found && state->rel != NULL)
+	{
+		ExecCloseIndices(state->relinfo);
+		ExecResetTupleTable(state->estate->es_tupleTable, true);
+		FreeExecutorState(state->estate);
+		table_close(state->rel, NoLock);
+	}
+
+	oldctx = MemoryContextSwitchTo(ApplyRelStateContext);
+
+	/* the caller holds the lock */
+	state->rel = table_open(relid, NoLock);
+	state->relinfo = makeNode(ResultRelInfo);
+	state->estate = pgactive_create_rel_estate(state->rel, state->relinfo);
+
+	MemoryContextSwitchTo(state->estate->es_query_cxt);
+
+#if PG_VERSION_NUM >= 120000
+	state->oldslot = table_slot_create(state->rel, &state->estate->es_tupleTable);
+#else
+	state->oldslot = ExecInitExtraTupleSlotpgactive(state->estate, NULL);
+	ExecSetSlotDescriptor(state->oldslot, RelationGetDescr(state->rel));
+#endif
+
+	state->newslot = ExecInitExtraTupleSlotpgactive(state->estate, NULL);
+	ExecSetSlotDescriptor(state->newslot, RelationGetDescr(state->rel));
+
+	state->columns = palloc0(RelationGetNumberOfAttributes(state->rel) *
+							 sizeof(pgactiveApplyColumn));
+
+	ExecOpenIndices(state->relinfo, false);
+
+	idxoid = RelationGetReplicaIndex(state->rel);
+	if (!OidIsValid(idxoid))
+#if PG_VERSION_NUM >= 180000
+		idxoid = RelationGetPrimaryKeyIndex(state->rel, false);
+#else
+		idxoid = RelationGetPrimaryKeyIndex(state->rel);
+#endif
+
+	state->replident_index = -1;
+	state->index_skeys = palloc0(state->relinfo->ri_NumIndices * sizeof(ScanKey));
+
+	for (i = 0; i < state->relinfo->ri_NumIndices; i++)
+	{
+		IndexInfo  *ii = state->relinfo->ri_IndexRelationInfo[i];
+		Relation	idxrel = state->relinfo->ri_IndexRelationDescs[i];
+
+		if (RelationGetRelid(idxrel) == idxoid)
+			state->replident_index = i;
+
+		/*
+		 * Only unique indexes are of interest here, and we can't deal with
+		 * expression indexes so far. FIXME: predicates should be handled
+		 * better.
+		 */
+		if (!ii->ii_Unique || ii->ii_Expressions != NIL)
+			continue;
+
+		state->index_skeys[i] =
+			palloc(RelationGetNumberOfAttributes(idxrel) * sizeof(ScanKeyData));
+		build_index_scan_key_template(state->index_skeys[i], state->rel, idxrel);
+	}
+
+	/*
+	 * Inserts into our own catalogs have side effects, e.g. queued DDL, so
+	 * have to be done right away.
+	 */
+	state->multi_insert = pgactive_apply_multi_insert &&
+		RelationGetNamespace(state->rel) != pgactiveSchemaOid;
+	state->insert_slots = NULL;
+	state->ninserts = 0;
+	state->insert_bytes = 0;
+
+	MemoryContextSwitchTo(oldctx);
+
+	state->stats = pgactive_count_relation_stats(&origin, relid, false);
+
+	state->valid = true;
+
+	return state;
+}
+
+/*
+ * Get the conversion functions of an attribute for remote values sent in
+ * the given format, 's' (send/recv) or 't' (text).
+ */
+static pgactiveApplyColumn *
+apply_relstate_column(pgactiveApplyRelState * state, int attnum, char kind)
+{
+	pgactiveApplyColumn *col = &state->columns[attnum];
+	FormData_pg_attribute *att = TupleDescAttr(RelationGetDescr(state->rel), attnum);
+	Oid			func;
+
+	if (kind == 's' && !OidIsValid(col->recv_func.fn_oid))
+	{
+		getTypeBinaryInputInfo(att->atttypid, &func, &col->recv_ioparam);
+		fmgr_info_cxt(func, &col->recv_func, state->estate->es_query_cxt);
+	}
+	else if (kind == 't' && !OidIsValid(col->input_func.fn_oid))
+	{
+		getTypeInputInfo(att->atttypid, &func, &col->input_ioparam);
+		fmgr_info_cxt(func, &col->input_func, state->estate->es_query_cxt);
+	}
+
+	return col;
+}
+
+/*
+ * Give the columns an INSERT didn't send, because they're not in the column
+ * lists of the replication sets on the upstream, their local default instead
+ * of NULL. Returns the tuple to insert.
+ */
+static HeapTuple
+apply_relstate_fill_defaults(pgactiveApplyRelState * state,
+							 pgactiveTupleData * tup, HeapTuple tuple)
+{
+	TupleDesc	desc = RelationGetDescr(state->rel);
+	ExprContext *econtext = GetPerTupleExprContext(state->estate);
+	bool		filled = false;
+	int			i;
+
+	for (i = 0; i < desc->natts; i++)
+	{
+		FormData_pg_attribute *att = TupleDescAttr(desc, i);
+		pgactiveApplyColumn *col = &state->columns[i];
+
+		/* generated columns are computed on insert anyway */
+		if (tup->changed[i] || att->attisdropped || att->attgenerated)
+			continue;
+
+		if (!col->default_valid)
+		{
+			Expr	   *expr;
+
+			expr = (Expr *) build_column_default(state->rel, i + 1);
+			if (expr != NULL)
+				col->default_expr = ExecPrepareExpr(expr, state->estate);
+			col->default_valid = true;
+		}
+
+		if (col->default_expr == NULL)
+			continue;
+
+		tup->values[i] = ExecEvalExprSwitchContext(col->default_expr, econtext,
+												   &tup->isnull[i]);
+		filled = true;
+	}
+
+	if (!filled)
+		return tuple;
+
+	return heap_form_tuple(desc, tup->values, tup->isnull);
+}
+
+/*
+ * Start measuring time for apply_relstate_count_time(), if
+ * pgactive.track_apply_timing is on.
+ */
+static void
+apply_relstate_start_time(instr_time *start)
+{
+	if (pgactive_track_apply_timing)
+		INSTR_TIME_SET_CURRENT(*start);
+	else
+		INSTR_TIME_SET_ZERO(*start);
+}
+
+/*
+ * Add the time since *start to a per-relation timing statistic and restart
+ * the measurement from now, if pgactive.track_apply_timing is on.
+ */
+static void
+apply_relstate_count_time(pgactiveApplyRelState * state, pgactiveRelStat stat,
+						  instr_time *start)
+{
+	instr_time	now;
+	instr_time	elapsed;
+
+	if (!pgactive_track_apply_timing || state->stats == NULL ||
+		INSTR_TIME_IS_ZERO(*start))
+		return;
+
+	INSTR_TIME_SET_CURRENT(now);
+	elapsed = now;
+	INSTR_TIME_SUBTRACT(elapsed, *start);
+	pgactive_count_relation(state->stats, stat, INSTR_TIME_GET_MICROSEC(elapsed));
+	*start = now;
+}
+
+/*
+ * Buffer a remotely INSERTed tuple that didn't conflict with a local one, to
+ * insert it along with further INSERTs to the relation using
+ * table_multi_insert(), the way COPY FROM does.
+ *
+ * Any other change, and the commit, flush the buffered INSERTs first. A
+ * remote transaction can still INSERT a tuple conflicting with a buffered
+ * one if a local unique index doesn't exist on the upstream; see
+ * apply_relstate_buffered_key_exists().
+ */
+static void
+apply_relstate_buffer_insert(pgactiveApplyRelState * state, TupleTableSlot *slot)
+{
+	TupleTableSlot *bufslot;
+
+	Assert(state->multi_insert);
+	Assert(ApplyRelStatePendingInserts == NULL ||
+		   ApplyRelStatePendingInserts == state);
+
+	if (state->insert_slots == NULL)
+		state->insert_slots =
+			MemoryContextAllocZero(state->estate->es_query_cxt,
+								   APPLY_MULTI_INSERT_MAX_TUPLES * sizeof(TupleTableSlot *));
+
+	bufslot = state->insert_slots[state->ninserts];
+	if (bufslot == NULL)
+	{
+		MemoryContext oldctx = MemoryContextSwitchTo(state->estate->es_query_cxt);
+
+		bufslot = table_slot_create(state->rel, &state->estate->es_tupleTable);
+		state->insert_slots[state->ninserts] = bufslot;
+		MemoryContextSwitchTo(oldctx);
+	}
+
+	ExecCopySlot(bufslot, slot);
+	state->ninserts++;
+	state->insert_bytes += TTS_TUP(slot)->t_len;
+	ApplyRelStatePendingInserts = state;
+
+	if (state->ninserts >= APPLY_MULTI_INSERT_MAX_TUPLES ||
+		state->insert_bytes >= APPLY_MULTI_INSERT_MAX_BYTES)
+		apply_relstate_flush_inserts();
+}
+
+/*
+ * Is there a buffered INSERT with the same key as one of the unique index
+ * scan keys of a tuple about to be INSERTed?
+ *
+ * Buffered tuples aren't in the indexes yet, so the conflict search can't
+ * find them. The caller flushes them first if so, to resolve the conflict
+ * like any other instead of failing with a unique violation on flush.
+ */
+static bool
+apply_relstate_buffered_key_exists(pgactiveApplyRelState * state,
+								   ScanKey *index_keys)
+{
+	ResultRelInfo *relinfo = state->relinfo;
+	int			b;
+	int			i;
+
+	if (ApplyRelStatePendingInserts != state)
+		return false;
+
+	for (b = 0; b < state->ninserts; b++)
+	{
+		TupleTableSlot *bufslot = state->insert_slots[b];
+
+		for (i = 0; i < relinfo->ri_NumIndices; i++)
+		{
+			Relation	idxrel = relinfo->ri_IndexRelationDescs[i];
+			ScanKey		skey = index_keys[i];
+			bool		match = true;
+			int			attoff;
+
+			if (skey == NULL)
+				continue;
+
+			for (attoff = 0; match && attoff < RelationGetNumberOfAttributes(idxrel); attoff++)
+			{
+				Datum		value;
+				bool		isnull;
+
+				value = slot_getattr(bufslot,
+									 idxrel->rd_index->indkey.values[attoff],
+									 &isnull);
+				match = !isnull &&
+					DatumGetBool(FunctionCall2Coll(&skey[attoff].sk_func,
+												   skey[attoff].sk_collation,
+												   value,
+												   skey[attoff].sk_argument));
+			}
+
+			if (match)
+				return true;
+		}
+	}
+
+	return false;
+}
+
+/*
+ * Insert the buffered INSERTs, if any, and their index entries.
+ */
+static void
+apply_relstate_flush_inserts(void)
+{
+	pgactiveApplyRelState *state = ApplyRelStatePendingInserts;
+	UserContext ucxt;
+	int			i;
+
+	if (state == NULL)
+		return;
+
+	ApplyRelStatePendingInserts = NULL;
+
+	/* index expressions and predicates must run as the INSERTs would have */
+	if (pgactive_apply_as_table_owner)
+		SwitchToUntrustedUser(state->rel->rd_rel->relowner, &ucxt);
+
+	/*
+	 * No BulkInsertState; its buffer ring would evict the relation's pages
+	 * from shared buffers for every transaction, which hurts more than it
+	 * helps when applying many small transactions.
+	 */
+	table_multi_insert(state->rel, state->insert_slots, state->ninserts,
+					   GetCurrentCommandId(true), 0, NULL);
+
+	for (i = 0; i < state->ninserts; i++)
+	{
+		ResetPerTupleExprContext(state->estate);
+		UserTableUpdateOpenIndexes(state->estate, state->insert_slots[i],
+								   state->relinfo, false);
+		ExecClearTuple(state->insert_slots[i]);
+	}
+
+	if (pgactive_apply_as_table_owner)
+		RestoreUserContext(&ucxt);
+
+	state->ninserts = 0;
+	state->insert_bytes = 0;
+
+	CommandCounterIncrement();
+}
+
+/*
+ * Can the remote transaction being committed be left uncommitted locally, to
+ * be committed along with the next remote transaction(s)?
+ *
+ * Only transactions of the upstream itself are grouped, not ones forwarded
+ * from other nodes, and only while applying serially and not replaying a
+ * capture. Transactions that had conflicts or DDL end their group.
+ */
+static bool
+apply_group_can_defer(TimestampTz committime)
+{
+	int			apply_delay = pgactive_apply_config->apply_delay;
+
+	if (apply_delay == -1)
+		apply_delay = pgactive_debug_apply_delay;
+
+	/* don't sleep for apply_delay with the local transaction open */
+	if (apply_delay > 0)
+		return false;
+
+	if (pgactive_apply_group_max_xacts <= 1 ||
+		group_xacts + 1 >= pgactive_apply_group_max_xacts)
+		return false;
+
+	if (group_break ||
+		apply_replaying ||
+		apply_replay_dry_run ||
+		remote_origin_id != InvalidRepOriginId ||
+		pgactive_apply_worker->replay_stop_lsn != InvalidXLogRecPtr ||
+		IspgactiveApplyParallelWorker() ||
+		pgactive_apply_parallel_is_active())
+		return false;
+
+	if (group_xacts > 0 &&
+		TimestampDifferenceExceeds(group_first_committime, committime,
+								   pgactive_apply_group_max_interval))
+		return false;
+
+	return true;
+}
+
+/*
+ * Remember the statistics of a remote transaction whose commit is deferred.
+ */
+static void
+apply_group_save_xact(TimestampTz committime, TimestampTz applied_at)
+{
+	ApplyGroupXact *xact;
+
+	if (group_xact_stats_count >= group_xact_stats_size)
+	{
+		int			newsize = Max(group_xact_stats_size * 2, 16);
+
+		if (group_xact_stats == NULL)
+			group_xact_stats = MemoryContextAlloc(TopMemoryContext,
+												  newsize * sizeof(ApplyGroupXact));
+		else
+			group_xact_stats = repalloc(group_xact_stats,
+										newsize * sizeof(ApplyGroupXact));
+		group_xact_stats_size = newsize;
+	}
+
+	xact = &group_xact_stats[group_xact_stats_count++];
+	xact->remote_xid = replication_origin_xid;
+	xact->committime = committime;
+	xact->begin_at = xact_begin_at;
+	xact->applied_at = applied_at;
+	xact->rows = xact_rows;
+	xact->bytes = xact_bytes;
+}
+
+/*
+ * Count the remote transactions whose commit was deferred, once the local
+ * transaction they were applied in has committed.
+ */
+static void
+apply_group_count_xacts(void)
+{
+	int			i;
+
+	for (i = 0; i < group_xact_stats_count; i++)
+	{
+		ApplyGroupXact *xact = &group_xact_stats[i];
+
+		pgactive_count_commit();
+		pgactive_count_apply_xact(xact->committime, xact->begin_at,
+								  xact->applied_at, xact->rows, xact->bytes);
+	}
+	group_xact_stats_count = 0;
+}
+
+/*
+ * Commit the remote transactions applied since the last local commit, if
+ * their commit was deferred.
+ *
+ * Must be called before anything other than the next remote transaction is
+ * processed, and before waiting for more data from the upstream.
+ */
+static void
+apply_group_commit(void)
+{
+	ApplyGroupXact *last;
+
+	if (!group_commit_pending)
+		return;
+
+	Assert(started_transaction);
+
+	replorigin_session_origin_lsn = group_commit_lsn;
+	replorigin_session_origin_timestamp = group_committime;
+	replication_origin_xid = group_remote_xid;
+
+	CommitTransactionCommand();
+	MemoryContextSwitchTo(MessageContext);
+	CurrentResourceOwner = pgactive_saved_resowner;
+
+	if (!apply_replaying)
+		pgactive_apply_push_flush_position(XactLastCommitEnd,
+										   replorigin_session_origin_lsn);
+	pgstat_report_stat(false);
+
+	/* the last of the remote transactions was applied last */
+	Assert(group_xact_stats_count > 0);
+	last = &group_xact_stats[group_xact_stats_count - 1];
+	pgactive_apply_worker->last_applied_xact_id = last->remote_xid;
+	pgactive_apply_worker->last_applied_xact_committs = last->committime;
+	pgactive_apply_worker->last_applied_xact_at = last->applied_at;
+
+	apply_group_count_xacts();
+
+	started_transaction = false;
+	group_commit_pending = false;
+	group_xacts = 0;
+
+	replication_origin_xid = InvalidTransactionId;
+	replorigin_session_origin_lsn = InvalidXLogRecPtr;
+	replorigin_session_origin_timestamp = 0;
+}
+
 static void
 process_remote_begin(StringInfo s)
 {
@@ -274,6 +1050,7 @@ process_remote_begin(StringInfo s)
 	Assert(pgactive_apply_worker != NULL);
 
 	xact_action_counter = 1;
+	xact_begin_at = GetCurrentTimestamp();
 	memset(&cbarg, 0, sizeof(struct ActionErrCallbackArg));
 	cbarg.action_name = "BEGIN";
 	errcallback.callback = action_error_callback;
@@ -281,11 +1058,21 @@ process_remote_begin(StringInfo s)
 	errcallback.previous = error_context_stack;
 	error_context_stack = &errcallback;
 
-	started_transaction = false;
 	remote_origin_id = InvalidRepOriginId;
+	group_break = false;
 
 	flags = pq_getmsgint(s, 4);
 
+	/* forwarded transactions can't join a group, see apply_group_can_defer() */
+	if (flags & pgactive_OUTPUT_TRANSACTION_HAS_ORIGIN)
+		apply_group_commit();
+
+	/* join the local transaction of the previous remote transaction */
+	if (group_commit_pending)
+		group_commit_pending = false;
+	else
+		started_transaction = false;
+
 	/*
 	 * This is the LSN of the end of the commit xlog record + 1, even though
 	 * we're in BEGIN. We have it because we process the whole reorder buffer
@@ -342,7 +1129,7 @@ process_remote_begin(StringInfo s)
 	 * If we're in catchup mode, see if this transaction is relayed from
 	 * elsewhere and prepare to advance the appropriate replication origin.
 	 */
-	if (flags & pgactive_OUTPUT_TRANSACTION_HAS_ORIGIN)
+	if ((flags & pgactive_OUTPUT_TRANSACTION_HAS_ORIGIN) && !apply_replaying)
 	{
 		char	   *remote_ident;
 		MemoryContext old_ctx;
@@ -467,8 +1254,9 @@ static void
 process_remote_commit(StringInfo s)
 {
 	XLogRecPtr	commit_lsn PG_USED_FOR_ASSERTS_ONLY;
-	TimestampTz committime PG_USED_FOR_ASSERTS_ONLY;
+	TimestampTz committime;
 	XLogRecPtr	commit_afterend_lsn;
+	TimestampTz now;
 	int			flags;
 	ErrorContextCallback errcallback;
 	struct ActionErrCallbackArg cbarg;
@@ -514,27 +1302,67 @@ process_remote_commit(StringInfo s)
 	if (replorigin_session_origin_lsn == commit_lsn)
 		replorigin_session_origin_lsn += 1;
 
+	/* before waiting, so parallel apply workers log conflicts concurrently */
 	if (started_transaction)
+		pgactive_conflict_log_flush();
+
+	/* leave the local transaction open for the next remote transaction */
+	if (started_transaction && apply_group_can_defer(committime))
 	{
-		pgactiveFlushPosition *flushpos;
+		if (group_xacts == 0)
+			group_first_committime = committime;
+		group_xacts++;
+		group_commit_lsn = replorigin_session_origin_lsn;
+		group_committime = committime;
+		group_remote_xid = replication_origin_xid;
+		group_commit_pending = true;
+
+		pgstat_report_activity(STATE_IDLEINTRANSACTION, NULL);
 
+		/* counted and published once the local transaction commits */
+		apply_group_save_xact(committime, GetCurrentTimestamp());
+
+		xact_action_counter = 0;
+
+		if (error_context_stack == &errcallback)
+			error_context_stack = errcallback.previous;
+		return;
+	}
+	group_xacts = 0;
+
+	/*
+	 * Parallel apply workers must commit in the order the upstream committed,
+	 * so wait until all earlier remote transactions are committed.
+	 */
+	if (IspgactiveApplyParallelWorker())
+		pgactive_apply_parallel_wait_turn();
+
+	if (started_transaction && apply_replay_dry_run)
+	{
+		AbortCurrentTransaction();
+		MemoryContextSwitchTo(MessageContext);
+	}
+	else if (started_transaction)
+	{
 		CommitTransactionCommand();
 		MemoryContextSwitchTo(MessageContext);
 
 		/*
 		 * Associate the end of the remote commit lsn with the local end of
-		 * the commit record.
+		 * the commit record. Feedback is supposed to be the last flushed LSN
+		 * + 1. Parallel apply workers leave that to the leader apply worker,
+		 * see pgactive_apply_parallel_xact_done(), and nobody waits for
+		 * feedback from a replay.
 		 */
-		flushpos = (pgactiveFlushPosition *)
-			MemoryContextAlloc(TopMemoryContext, sizeof(pgactiveFlushPosition));
-		flushpos->local_end = XactLastCommitEnd;
-		/* Feedback is supposed to be the last flushed LSN + 1 */
-		flushpos->remote_end = replorigin_session_origin_lsn;
-
-		dlist_push_tail(&pgactive_lsn_association, &flushpos->node);
+		if (!IspgactiveApplyParallelWorker() && !apply_replaying)
+			pgactive_apply_push_flush_position(XactLastCommitEnd,
+											   replorigin_session_origin_lsn);
 
 		/* report stats, only relevant if something was actually written */
 		pgstat_report_stat(false);
+
+		/* earlier remote transactions of the group committed along */
+		apply_group_count_xacts();
 	}
 
 	pgstat_report_activity(STATE_IDLE, NULL);
@@ -567,10 +1395,26 @@ process_remote_commit(StringInfo s)
 
 	pgactive_count_commit();
 
-	/* Save last applied transaction info */
-	pgactive_apply_worker->last_applied_xact_id = replication_origin_xid;
-	pgactive_apply_worker->last_applied_xact_committs = replorigin_session_origin_timestamp;
-	pgactive_apply_worker->last_applied_xact_at = GetCurrentTimestamp();
+	now = GetCurrentTimestamp();
+	pgactive_count_apply_xact(committime, xact_begin_at, now,
+							  xact_rows, xact_bytes);
+
+	/*
+	 * Save last applied transaction info. Parallel apply workers leave that
+	 * to the leader apply worker, which publishes it in commit order.
+	 */
+	if (IspgactiveApplyParallelWorker())
+		pgactive_apply_parallel_xact_done(started_transaction ?
+										  XactLastCommitEnd : InvalidXLogRecPtr,
+										  replication_origin_xid,
+										  replorigin_session_origin_timestamp,
+										  now);
+	else
+	{
+		pgactive_apply_worker->last_applied_xact_id = replication_origin_xid;
+		pgactive_apply_worker->last_applied_xact_committs = replorigin_session_origin_timestamp;
+		pgactive_apply_worker->last_applied_xact_at = now;
+	}
 
 	replication_origin_xid = InvalidTransactionId;
 	replorigin_session_origin_lsn = InvalidXLogRecPtr;
@@ -618,11 +1462,13 @@ process_remote_insert(StringInfo s)
 	char		action;
 	EState	   *estate;
 	pgactiveTupleData new_tuple;
+	HeapTuple	tuple;
 	TupleTableSlot *newslot;
 	TupleTableSlot *oldslot;
 	pgactiveRelation *rel;
+	pgactiveApplyRelState *state;
 	bool		started_tx;
-	ResultRelInfo *relinfo = makeNode(ResultRelInfo);
+	ResultRelInfo *relinfo;
 	ItemPointer conflicts;
 	bool		conflict = false;
 	ScanKey    *index_keys;
@@ -631,6 +1477,7 @@ process_remote_insert(StringInfo s)
 	ErrorContextCallback errcallback;
 	struct ActionErrCallbackArg cbarg;
 	UserContext ucxt;
+	instr_time	start;
 
 	ItemPointerSetInvalid(&conflicting_tid);
 
@@ -662,26 +1509,17 @@ process_remote_insert(StringInfo s)
 	if (action != 'N')
 		elog(ERROR, "expected new tuple but got %d", action);
 
-	estate = pgactive_create_rel_estate(rel->rel, relinfo);
+	state = apply_relstate_get(rel);
+	estate = state->estate;
+	relinfo = state->relinfo;
+	oldslot = state->oldslot;
+	newslot = state->newslot;
 
-#if PG_VERSION_NUM >= 120000
-	oldslot = table_slot_create(rel->rel, &estate->es_tupleTable);
-#else
-	oldslot = ExecInitExtraTupleSlotpgactive(estate, NULL);
-	ExecSetSlotDescriptor(oldslot, RelationGetDescr(rel->rel));
-#endif
+	pgactive_count_relation(state->stats, pgactiveRelStat_Bytes, s->len);
 
-	newslot = ExecInitExtraTupleSlotpgactive(estate, NULL);
-	ExecSetSlotDescriptor(newslot, RelationGetDescr(rel->rel));
-
-	read_tuple_parts(s, rel, &new_tuple);
-	{
-		HeapTuple	tup;
-
-		tup = heap_form_tuple(RelationGetDescr(rel->rel),
-							  new_tuple.values, new_tuple.isnull);
-		ExecStoreHeapTuple(tup, newslot, true);
-	}
+	tuple = read_tuple(s, state, rel, &new_tuple);
+	ExecStoreHeapTuple(apply_relstate_fill_defaults(state, &new_tuple, tuple),
+					   newslot, true);
 
 	if (rel->rel->rd_rel->relkind != RELKIND_RELATION)
 		elog(ERROR, "unexpected relkind '%c' rel \"%s\"",
@@ -695,12 +1533,23 @@ process_remote_insert(StringInfo s)
 	/*
 	 * Search for conflicting tuples.
 	 */
-	ExecOpenIndices(relinfo, false);
+	apply_relstate_start_time(&start);
 
 	index_keys = palloc0(relinfo->ri_NumIndices * sizeof(ScanKeyData *));
 	conflicts = palloc0(relinfo->ri_NumIndices * sizeof(ItemPointerData));
 
-	build_index_scan_keys(relinfo, index_keys, &new_tuple);
+	/* only use an index if we could build a key without NULLs */
+	for (i = 0; i < relinfo->ri_NumIndices; i++)
+	{
+		if (state->index_skeys[i] != NULL &&
+			!build_index_scan_key_values(state->index_skeys[i],
+										 relinfo->ri_IndexRelationDescs[i],
+										 &new_tuple))
+			index_keys[i] = state->index_skeys[i];
+	}
+
+	if (apply_relstate_buffered_key_exists(state, index_keys))
+		apply_relstate_flush_inserts();
 
 	/* do a SnapshotDirty search for conflicting tuples */
 	for (i = 0; i < relinfo->ri_NumIndices; i++)
@@ -713,7 +1562,7 @@ process_remote_insert(StringInfo s)
 		 * expression indexes so far. FIXME: predicates should be handled
 		 * better.
 		 *
-		 * NB: Needs to match expression in build_index_scan_key
+		 * NB: Needs to match expression in apply_relstate_get
 		 */
 		if (!ii->ii_Unique || ii->ii_Expressions != NIL)
 			continue;
@@ -763,6 +1612,8 @@ process_remote_insert(StringInfo s)
 		CHECK_FOR_INTERRUPTS();
 	}
 
+	apply_relstate_count_time(state, pgactiveRelStat_LookupTime, &start);
+
 	PushActiveSnapshot(GetTransactionSnapshot());
 
 	/*
@@ -803,6 +1654,8 @@ process_remote_insert(StringInfo s)
 			pgactive_conflict_log_serverlog(apply_conflict);
 
 			pgactive_count_insert_conflict();
+			pgactive_count_relation(state->stats, pgactiveRelStat_InsertInsert, 1);
+			group_break = true;
 		}
 
 		/*
@@ -853,6 +1706,7 @@ process_remote_insert(StringInfo s)
 			UserTableUpdateOpenIndexes(estate, newslot, relinfo, false);
 
 			pgactive_count_insert();
+			pgactive_count_relation(state->stats, pgactiveRelStat_Insert, 1);
 		}
 
 		/* Log conflict to table */
@@ -862,6 +1716,12 @@ process_remote_insert(StringInfo s)
 			pgactive_conflict_logging_cleanup();
 		}
 	}
+	else if (state->multi_insert)
+	{
+		apply_relstate_buffer_insert(state, newslot);
+		pgactive_count_insert();
+		pgactive_count_relation(state->stats, pgactiveRelStat_Insert, 1);
+	}
 	else
 	{
 #if PG_VERSION_NUM >= 120000
@@ -871,15 +1731,16 @@ process_remote_insert(StringInfo s)
 #endif
 		UserTableUpdateOpenIndexes(estate, newslot, relinfo, false);
 		pgactive_count_insert();
+		pgactive_count_relation(state->stats, pgactiveRelStat_Insert, 1);
 	}
 
 	PopActiveSnapshot();
 
+	apply_relstate_count_time(state, pgactiveRelStat_WriteTime, &start);
+
 	if (pgactive_apply_as_table_owner)
 		RestoreUserContext(&ucxt);
 
-	ExecCloseIndices(relinfo);
-
 	check_pgactive_wakeups(rel);
 
 	/*
@@ -909,8 +1770,11 @@ process_remote_insert(StringInfo s)
 		LockRelationIdForSession(&lockid, RowExclusiveLock);
 		pgactive_table_close(rel, NoLock);
 
-		ExecResetTupleTable(estate->es_tupleTable, true);
-		FreeExecutorState(estate);
+		/* DDL may need exclusive use of the relations we have open */
+		apply_relstate_release_all();
+
+		/* and DDL isn't grouped with later transactions */
+		group_break = true;
 
 		if (relid == QueuedDDLCommandsRelid)
 		{
@@ -939,8 +1803,8 @@ process_remote_insert(StringInfo s)
 	else
 	{
 		pgactive_table_close(rel, NoLock);
-		ExecResetTupleTable(estate->es_tupleTable, true);
-		FreeExecutorState(estate);
+		ExecClearTuple(oldslot);
+		ExecClearTuple(newslot);
 	}
 
 	CommandCounterIncrement();
@@ -960,16 +1824,17 @@ process_remote_update(StringInfo s)
 	bool		found_tuple;
 	pgactiveTupleData old_tuple;
 	pgactiveTupleData new_tuple;
-	Oid			idxoid;
 	pgactiveRelation *rel;
+	pgactiveApplyRelState *state;
 	Relation	idxrel;
-	ScanKeyData skey[INDEX_MAX_KEYS];
+	ScanKey		skey;
 	HeapTuple	user_tuple = NULL,
 				remote_tuple = NULL;
 	ErrorContextCallback errcallback;
 	struct ActionErrCallbackArg cbarg;
-	ResultRelInfo *relinfo = makeNode(ResultRelInfo);
+	ResultRelInfo *relinfo;
 	UserContext ucxt;
+	instr_time	start;
 
 	xact_action_counter++;
 	memset(&cbarg, 0, sizeof(struct ActionErrCallbackArg));
@@ -999,21 +1864,18 @@ process_remote_update(StringInfo s)
 	if (action != 'K' && action != 'N')
 		elog(ERROR, "expected action 'N' or 'K', got %c", action);
 
-	estate = pgactive_create_rel_estate(rel->rel, relinfo);
-#if PG_VERSION_NUM >= 120000
-	oldslot = table_slot_create(rel->rel, &estate->es_tupleTable);
-#else
-	oldslot = ExecInitExtraTupleSlotpgactive(estate, NULL);
-	ExecSetSlotDescriptor(oldslot, RelationGetDescr(rel->rel));
-#endif
+	state = apply_relstate_get(rel);
+	estate = state->estate;
+	relinfo = state->relinfo;
+	oldslot = state->oldslot;
+	newslot = state->newslot;
 
-	newslot = ExecInitExtraTupleSlotpgactive(estate, NULL);
-	ExecSetSlotDescriptor(newslot, RelationGetDescr(rel->rel));
+	pgactive_count_relation(state->stats, pgactiveRelStat_Bytes, s->len);
 
 	if (action == 'K')
 	{
 		pkey_sent = true;
-		read_tuple_parts(s, rel, &old_tuple);
+		read_tuple_parts(s, state, rel, &old_tuple);
 		action = pq_getmsgbyte(s);
 	}
 	else
@@ -1028,28 +1890,23 @@ process_remote_update(StringInfo s)
 			 rel->rel->rd_rel->relkind, RelationGetRelationName(rel->rel));
 
 	/* read new tuple */
-	read_tuple_parts(s, rel, &new_tuple);
+	read_tuple_parts(s, state, rel, &new_tuple);
 
 	/* lookup index to build scankey */
-	idxoid = RelationGetReplicaIndex(rel->rel);
-	if (!OidIsValid(idxoid))
-#if PG_VERSION_NUM >= 180000
-		idxoid = RelationGetPrimaryKeyIndex(rel->rel, false);
-#else
-		idxoid = RelationGetPrimaryKeyIndex(rel->rel);
-#endif
-	if (!OidIsValid(idxoid))
+	if (state->replident_index < 0)
 		elog(ERROR, "could not find primary key for table with oid %u",
 			 RelationGetRelid(rel->rel));
 
-	/* open index, so we can build scan key for row */
-	idxrel = index_open(idxoid, RowExclusiveLock);
+	idxrel = relinfo->ri_IndexRelationDescs[state->replident_index];
+	skey = state->index_skeys[state->replident_index];
 
-	Assert(idxrel->rd_index->indisunique);
+	Assert(idxrel->rd_index->indisunique && skey != NULL);
 
 	/* Use columns from the new tuple if the key didn't change. */
-	build_index_scan_key(skey, rel->rel, idxrel,
-						 pkey_sent ? &old_tuple : &new_tuple);
+	build_index_scan_key_values(skey, idxrel,
+								pkey_sent ? &old_tuple : &new_tuple);
+
+	apply_relstate_start_time(&start);
 
 	PushActiveSnapshot(GetTransactionSnapshot());
 
@@ -1057,6 +1914,8 @@ process_remote_update(StringInfo s)
 	found_tuple = find_pkey_tuple(skey, rel, idxrel, oldslot, true,
 								  pkey_sent ? LockTupleExclusive : LockTupleNoKeyExclusive);
 
+	apply_relstate_count_time(state, pgactiveRelStat_LookupTime, &start);
+
 	if (found_tuple)
 	{
 		TimestampTz local_ts;
@@ -1112,6 +1971,8 @@ process_remote_update(StringInfo s)
 			pgactive_conflict_log_serverlog(apply_conflict);
 
 			pgactive_count_update_conflict();
+			pgactive_count_relation(state->stats, pgactiveRelStat_UpdateUpdate, 1);
+			group_break = true;
 		}
 
 		if (apply_update)
@@ -1153,8 +2014,9 @@ process_remote_update(StringInfo s)
 #else
 			simple_heap_update(rel->rel, &(TTS_TUP(oldslot)->t_self), TTS_TUP(newslot));
 #endif
-			UserTableUpdateIndexes(estate, newslot, relinfo);
+			UserTableUpdateOpenIndexes(estate, newslot, relinfo, false);
 			pgactive_count_update();
+			pgactive_count_relation(state->stats, pgactiveRelStat_Update, 1);
 		}
 
 		/* Log conflict to table */
@@ -1188,6 +2050,8 @@ process_remote_update(StringInfo s)
 														0, &skip);
 
 		pgactive_count_update_conflict();
+		pgactive_count_relation(state->stats, pgactiveRelStat_UpdateDelete, 1);
+		group_break = true;
 
 		if (skip)
 			resolution = pgactiveConflictResolution_ConflictTriggerSkipChange;
@@ -1228,17 +2092,18 @@ process_remote_update(StringInfo s)
 
 	PopActiveSnapshot();
 
+	apply_relstate_count_time(state, pgactiveRelStat_WriteTime, &start);
+
 	if (pgactive_apply_as_table_owner)
 		RestoreUserContext(&ucxt);
 
 	check_pgactive_wakeups(rel);
 
 	/* release locks upon commit */
-	index_close(idxrel, NoLock);
 	pgactive_table_close(rel, NoLock);
 
-	ExecResetTupleTable(estate->es_tupleTable, true);
-	FreeExecutorState(estate);
+	ExecClearTuple(oldslot);
+	ExecClearTuple(newslot);
 
 	CommandCounterIncrement();
 
@@ -1250,18 +2115,17 @@ static void
 process_remote_delete(StringInfo s)
 {
 	char		action;
-	EState	   *estate;
 	pgactiveTupleData oldtup;
 	TupleTableSlot *oldslot;
-	Oid			idxoid;
 	pgactiveRelation *rel;
+	pgactiveApplyRelState *state;
 	Relation	idxrel;
-	ScanKeyData skey[INDEX_MAX_KEYS];
+	ScanKey		skey;
 	bool		found_old;
 	ErrorContextCallback errcallback;
 	struct ActionErrCallbackArg cbarg;
-	ResultRelInfo *relinfo = makeNode(ResultRelInfo);
 	UserContext ucxt;
+	instr_time	start;
 
 	Assert(pgactive_apply_worker != NULL);
 
@@ -1301,32 +2165,20 @@ process_remote_delete(StringInfo s)
 		return;
 	}
 
-	estate = pgactive_create_rel_estate(rel->rel, relinfo);
-#if PG_VERSION_NUM >= 120000
-	oldslot = table_slot_create(rel->rel, &estate->es_tupleTable);
-#else
-	oldslot = ExecInitExtraTupleSlotpgactive(estate, NULL);
-	ExecSetSlotDescriptor(oldslot, RelationGetDescr(rel->rel));
-#endif
+	state = apply_relstate_get(rel);
+	oldslot = state->oldslot;
+
+	pgactive_count_relation(state->stats, pgactiveRelStat_Bytes, s->len);
 
-	read_tuple_parts(s, rel, &oldtup);
+	read_tuple_parts(s, state, rel, &oldtup);
 
 	/* lookup index to build scankey */
-	if (rel->rel->rd_indexvalid == 0)
-		RelationGetIndexList(rel->rel);
-	idxoid = RelationGetReplicaIndex(rel->rel);
-	if (!OidIsValid(idxoid))
-#if PG_VERSION_NUM >= 180000
-		idxoid = RelationGetPrimaryKeyIndex(rel->rel, false);
-#else
-		idxoid = RelationGetPrimaryKeyIndex(rel->rel);
-#endif
-	if (!OidIsValid(idxoid))
+	if (state->replident_index < 0)
 		elog(ERROR, "could not find primary key for table with oid %u",
 			 RelationGetRelid(rel->rel));
 
-	/* Now open the primary key index */
-	idxrel = index_open(idxoid, RowExclusiveLock);
+	idxrel = state->relinfo->ri_IndexRelationDescs[state->replident_index];
+	skey = state->index_skeys[state->replident_index];
 
 	if (rel->rel->rd_rel->relkind != RELKIND_RELATION)
 		elog(ERROR, "unexpected relkind '%c' rel \"%s\"",
@@ -1343,17 +2195,22 @@ process_remote_delete(StringInfo s)
 	log_tuple("DELETE old-key:%s", RelationGetDescr(rel->rel), TTS_TUP(oldslot));
 #endif
 
+	apply_relstate_start_time(&start);
+
 	PushActiveSnapshot(GetTransactionSnapshot());
 
-	build_index_scan_key(skey, rel->rel, idxrel, &oldtup);
+	build_index_scan_key_values(skey, idxrel, &oldtup);
 
 	/* try to find tuple via a (candidate|primary) key */
 	found_old = find_pkey_tuple(skey, rel, idxrel, oldslot, true, LockTupleExclusive);
 
+	apply_relstate_count_time(state, pgactiveRelStat_LookupTime, &start);
+
 	if (found_old)
 	{
 		simple_heap_delete(rel->rel, &(TTS_TUP(oldslot)->t_self));
 		pgactive_count_delete();
+		pgactive_count_relation(state->stats, pgactiveRelStat_Delete, 1);
 	}
 	else
 	{
@@ -1377,6 +2234,8 @@ process_remote_delete(StringInfo s)
 		pgactiveApplyConflict *apply_conflict;
 
 		pgactive_count_delete_conflict();
+		pgactive_count_relation(state->stats, pgactiveRelStat_DeleteDelete, 1);
+		group_break = true;
 
 		/* Since the local tuple is missing, fill slot from the received data. */
 		remote_tuple = heap_form_tuple(RelationGetDescr(rel->rel),
@@ -1426,16 +2285,16 @@ process_remote_delete(StringInfo s)
 
 	PopActiveSnapshot();
 
+	apply_relstate_count_time(state, pgactiveRelStat_WriteTime, &start);
+
 	if (pgactive_apply_as_table_owner)
 		RestoreUserContext(&ucxt);
 
 	check_pgactive_wakeups(rel);
 
-	index_close(idxrel, NoLock);
 	pgactive_table_close(rel, NoLock);
 
-	ExecResetTupleTable(estate->es_tupleTable, true);
-	FreeExecutorState(estate);
+	ExecClearTuple(oldslot);
 
 	CommandCounterIncrement();
 
@@ -1455,6 +2314,17 @@ get_local_tuple_origin(HeapTuple tuple, TimestampTz *commit_ts, RepOriginId * no
 	/* refetch tuple, check for old commit ts & origin */
 	xmin = HeapTupleHeaderGetXmin(tuple->t_data);
 
+	/*
+	 * Written by this remote transaction or an earlier one applied in the
+	 * same local transaction, see apply_group_can_defer().
+	 */
+	if (TransactionIdIsCurrentTransactionId(xmin))
+	{
+		*commit_ts = replorigin_session_origin_timestamp;
+		*node_id = replorigin_session_origin;
+		return;
+	}
+
 	TransactionIdGetCommitTsData(xmin, commit_ts, &node_id_raw);
 	*node_id = node_id_raw;
 }
@@ -2177,7 +3047,8 @@ read_tuple_parts_error_badatts(pgactiveRelation * rel, TupleDesc desc, int rnatt
 }
 
 static void
-read_tuple_parts(StringInfo s, pgactiveRelation * rel, pgactiveTupleData * tup)
+read_tuple_parts(StringInfo s, pgactiveApplyRelState * state,
+				 pgactiveRelation * rel, pgactiveTupleData * tup)
 {
 	TupleDesc	desc = RelationGetDescr(rel->rel);
 	int			i;
@@ -2194,8 +3065,6 @@ read_tuple_parts(StringInfo s, pgactiveRelation * rel, pgactiveTupleData * tup)
 
 	rnatts = pq_getmsgint(s, 4);
 
-	/* FIXME: unaligned data accesses */
-
 	/* Consume remote data as long as there's a local column to put it in */
 	for (i = 0; i < Min(desc->natts, rnatts); i++)
 	{
@@ -2225,35 +3094,64 @@ read_tuple_parts(StringInfo s, pgactiveRelation * rel, pgactiveTupleData * tup)
 
 				data = pq_getmsgbytes(s, len);
 
-				/* and data */
-				if (att->attbyval)
-					tup->values[i] = fetch_att(data, true, len);
-				else
+				/*
+				 * The value is at an arbitrary offset in the message, so
+				 * copy it where it can be accessed if it isn't suitably
+				 * aligned.
+				 */
+				if (att->attbyval)
+				{
+					Datum		aligned;
+
+					if (len != att->attlen)
+						elog(ERROR, "unexpected length %d of by-value attribute %d",
+							 len, i + 1);
+
+					memcpy(&aligned, data, len);
+					tup->values[i] = fetch_att(&aligned, true, len);
+				}
+				else
+				{
+					bool		make_short;
+
+					if (att->attlen == -1 ?
+						!remote_varlena_check(att, data, len, &make_short) :
+						len != att->attlen)
+						ereport(ERROR,
+								(errcode(ERRCODE_INVALID_BINARY_REPRESENTATION),
+								 errmsg("unexpected length %d of binary attribute %d",
+										len, i + 1)));
+
+					if (!(att->attlen == -1 && VARATT_IS_1B(data)) &&
+						att_align_nominal((uintptr_t) data, att->attalign) != (uintptr_t) data)
+					{
+						char	   *copy = palloc(len);
+
+						memcpy(copy, data, len);
+						data = copy;
+					}
+
 					tup->values[i] = PointerGetDatum(data);
+				}
 				break;
 			case 's':			/* send/recv format */
 				{
-					Oid			typreceive;
-					Oid			typioparam;
+					pgactiveApplyColumn *col;
 					StringInfoData buf;
 
 					tup->isnull[i] = false;
 					len = pq_getmsgint(s, 4);	/* read length */
 
-					getTypeBinaryInputInfo(att->atttypid,
-										   &typreceive, &typioparam);
+					col = apply_relstate_column(state, i, kind);
 
-					/*
-					 * Create StringInfo pointing into the bigger buffer.
-					 * First free the palloc-ed memory that initStringInfo
-					 * gives to not leak any memory.
-					 */
-					initStringInfo(&buf);
-					pfree(buf.data);
+					/* point into the bigger buffer */
 					buf.data = (char *) pq_getmsgbytes(s, len);
 					buf.len = len;
-					tup->values[i] = OidReceiveFunctionCall(
-															typreceive, &buf, typioparam, att->atttypmod);
+					buf.maxlen = len;
+					buf.cursor = 0;
+					tup->values[i] = ReceiveFunctionCall(&col->recv_func, &buf,
+														 col->recv_ioparam,
+														 att->atttypmod);
 
 					if (buf.len != buf.cursor)
 						ereport(ERROR,
@@ -2263,17 +3161,19 @@ read_tuple_parts(StringInfo s, pgactiveRelation * rel, pgactiveTupleData * tup)
 				}
 			case 't':			/* text format */
 				{
-					Oid			typinput;
-					Oid			typioparam;
+					pgactiveApplyColumn *col;
 
 					tup->isnull[i] = false;
 					len = pq_getmsgint(s, 4);	/* read length */
 
-					getTypeInputInfo(att->atttypid, &typinput, &typioparam);
+					col = apply_relstate_column(state, i, kind);
+
 					/* and data */
 					data = (char *) pq_getmsgbytes(s, len);
-					tup->values[i] = OidInputFunctionCall(
-														  typinput, (char *) data, typioparam, att->atttypmod);
+					tup->values[i] = InputFunctionCall(&col->input_func,
+													   (char *) data,
+													   col->input_ioparam,
+													   att->atttypmod);
 				}
 				break;
 			default:
@@ -2371,6 +3271,325 @@ read_tuple_parts(StringInfo s, pgactiveRelation * rel, pgactiveTupleData * tup)
 	/* Don't test pq_getmsgend, there might be another message chunk */
 }
 
+/*
+ * Check a binary varlena value of len bytes received from the upstream
+ * before copying it into a tuple: it must be stored inline and be as long as
+ * its header says. The value is at an arbitrary offset in the message, so a
+ * 4-byte header is copied out before being looked at.
+ *
+ * Returns false if the value can't be copied as is. Otherwise sets
+ * *make_short to whether it can be stored with a short header, as
+ * heap_fill_tuple() would.
+ */
+static bool
+remote_varlena_check(FormData_pg_attribute *att, const char *val, int len,
+					 bool *make_short)
+{
+	uint32		header;
+
+	*make_short = false;
+
+	if (len < 1)
+		return false;
+
+	if (VARATT_IS_1B(val))
+		return !VARATT_IS_1B_E(val) && VARSIZE_1B(val) == len;
+
+	if (len < VARHDRSZ)
+		return false;
+
+	memcpy(&header, val, VARHDRSZ);
+	if (VARSIZE_4B(&header) != len)
+		return false;
+
+	*make_short = att->attstorage != TYPSTORAGE_PLAIN &&
+		VARATT_IS_4B_U(&header) &&
+		len - VARHDRSZ + VARHDRSZ_SHORT <= VARATT_SHORT_MAX;
+
+	return true;
+}
+
+/*
+ * Read a tuple whose columns were all sent in binary format or as NULLs
+ * straight into a heap tuple, laid out as heap_form_tuple() would. Each value
+ * is copied once, from the message to its aligned place in the tuple, and
+ * tup's values point into the tuple.
+ *
+ * Returns NULL without consuming the tuple if it has columns in other formats
+ * or a different number of columns than the local table; the caller then has
+ * to use read_tuple_parts().
+ */
+static HeapTuple
+read_tuple_binary(StringInfo s, pgactiveRelation * rel, pgactiveTupleData * tup)
+{
+	TupleDesc	desc = RelationGetDescr(rel->rel);
+	int			start = s->cursor;
+	int			natts;
+	Size		data_len = 0;
+	bool		hasnull = false;
+	bool		hasvarwidth = false;
+	int			hoff;
+	HeapTuple	tuple;
+	HeapTupleHeader td;
+	char	   *data;
+	int			i;
+
+	if (pq_getmsgbyte(s) != 'T')
+		goto fallback;
+
+	natts = pq_getmsgint(s, 4);
+	if (natts != desc->natts)
+		goto fallback;
+
+	/* size the tuple, as heap_compute_data_size() does */
+	for (i = 0; i < natts; i++)
+	{
+		FormData_pg_attribute *att = TupleDescAttr(desc, i);
+		char		kind = pq_getmsgbyte(s);
+		const char *val;
+		int			len;
+		bool		make_short;
+
+		if (kind == 'n')
+		{
+			hasnull = true;
+			continue;
+		}
+
+		if (kind != 'b' || att->attisdropped)
+			goto fallback;
+
+		len = pq_getmsgint(s, 4);
+		val = pq_getmsgbytes(s, len);
+
+		if (att->attlen == -1)
+		{
+			if (!remote_varlena_check(att, val, len, &make_short))
+				goto fallback;
+
+			hasvarwidth = true;
+
+			if (make_short)
+				data_len += len - VARHDRSZ + VARHDRSZ_SHORT;
+			else if (VARATT_IS_1B(val))
+				data_len += len;
+			else
+				data_len = att_align_nominal(data_len, att->attalign) + len;
+		}
+		else
+		{
+			if (len != att->attlen)
+				goto fallback;
+
+			data_len = att_align_nominal(data_len, att->attalign) + len;
+		}
+	}
+
+	hoff = SizeofHeapTupleHeader;
+	if (hasnull)
+		hoff += BITMAPLEN(natts);
+	hoff = MAXALIGN(hoff);
+
+	tuple = (HeapTuple) palloc0(HEAPTUPLESIZE + hoff + data_len);
+	tuple->t_data = td = (HeapTupleHeader) ((char *) tuple + HEAPTUPLESIZE);
+	tuple->t_len = hoff + data_len;
+	ItemPointerSetInvalid(&tuple->t_self);
+	tuple->t_tableOid = InvalidOid;
+
+	HeapTupleHeaderSetDatumLength(td, tuple->t_len);
+	HeapTupleHeaderSetTypeId(td, desc->tdtypeid);
+	HeapTupleHeaderSetTypMod(td, desc->tdtypmod);
+	ItemPointerSetInvalid(&td->t_ctid);
+	HeapTupleHeaderSetNatts(td, natts);
+	td->t_hoff = hoff;
+
+	if (hasnull)
+		td->t_infomask |= HEAP_HASNULL;
+	if (hasvarwidth)
+		td->t_infomask |= HEAP_HASVARWIDTH;
+
+	memset(tup->changed, 1, sizeof(tup->changed));
+
+	/* and fill it, as heap_fill_tuple() does */
+	s->cursor = start + 1 + 4;
+	data = (char *) td + hoff;
+
+	for (i = 0; i < natts; i++)
+	{
+		FormData_pg_attribute *att = TupleDescAttr(desc, i);
+		char		kind = pq_getmsgbyte(s);
+		const char *val;
+		int			len;
+		bool		make_short = false;
+
+		if (kind == 'n')
+		{
+			tup->isnull[i] = true;
+			tup->values[i] = 0xdeadbeef;
+			continue;
+		}
+
+		if (hasnull)
+			td->t_bits[i >> 3] |= 1 << (i & 0x07);
+
+		len = pq_getmsgint(s, 4);
+		val = pq_getmsgbytes(s, len);
+
+		tup->isnull[i] = false;
+
+		/* already checked while sizing the tuple */
+		if (att->attlen == -1)
+			(void) remote_varlena_check(att, val, len, &make_short);
+
+		if (make_short)
+		{
+			SET_VARSIZE_SHORT(data, len - VARHDRSZ + VARHDRSZ_SHORT);
+			memcpy(data + VARHDRSZ_SHORT, val + VARHDRSZ, len - VARHDRSZ);
+			tup->values[i] = PointerGetDatum(data);
+			data += len - VARHDRSZ + VARHDRSZ_SHORT;
+			continue;
+		}
+
+		if (!(att->attlen == -1 && VARATT_IS_1B(val)))
+			data = (char *) att_align_nominal(data, att->attalign);
+
+		memcpy(data, val, len);
+
+		if (att->attbyval)
+			tup->values[i] = fetch_att(data, true, len);
+		else
+			tup->values[i] = PointerGetDatum(data);
+
+		data += len;
+	}
+
+	Assert(data == (char *) td + tuple->t_len);
+
+	return tuple;
+
+fallback:
+	s->cursor = start;
+	return NULL;
+}
+
+/*
+ * Read a tuple for a change, forming it directly from the message where
+ * possible, see read_tuple_binary().
+ */
+static HeapTuple
+read_tuple(StringInfo s, pgactiveApplyRelState * state,
+		   pgactiveRelation * rel, pgactiveTupleData * tup)
+{
+	HeapTuple	tuple;
+
+	tuple = read_tuple_binary(s, rel, tup);
+
+	if (tuple == NULL)
+	{
+		read_tuple_parts(s, state, rel, tup);
+		tuple = heap_form_tuple(RelationGetDescr(rel->rel),
+								tup->values, tup->isnull);
+	}
+
+	return tuple;
+}
+
+/*
+ * Process a relation message, remembering the name of an upstream relation
+ * the following changes refer to by id.
+ */
+static void
+process_remote_relation(StringInfo s)
+{
+	pgactiveRemoteRelation *entry;
+	uint32		remote_relid;
+	int			len;
+	const char *nspname;
+	const char *relname;
+	bool		found;
+
+	remote_relid = pq_getmsgint(s, 4);
+	len = pq_getmsgint(s, 2);
+	nspname = pq_getmsgbytes(s, len);
+	len = pq_getmsgint(s, 2);
+	relname = pq_getmsgbytes(s, len);
+
+	if (RemoteRelationHash == NULL)
+	{
+		HASHCTL		ctl;
+
+		memset(&ctl, 0, sizeof(ctl));
+		ctl.keysize = sizeof(uint32);
+		ctl.entrysize = sizeof(pgactiveRemoteRelation);
+		ctl.hcxt = TopMemoryContext;
+		RemoteRelationHash = hash_create("pgactive remote relations", 128,
+										 &ctl, HASH_ELEM | HASH_BLOBS | HASH_CONTEXT);
+	}
+
+	entry = hash_search(RemoteRelationHash, &remote_relid, HASH_ENTER, &found);
+	if (found)
+	{
+		pfree(entry->nspname);
+		pfree(entry->relname);
+	}
+
+	entry->nspname = MemoryContextStrdup(TopMemoryContext, nspname);
+	entry->relname = MemoryContextStrdup(TopMemoryContext, relname);
+	entry->localrelid = InvalidOid;
+}
+
+static pgactiveRemoteRelation *
+lookup_remote_relation(uint32 remote_relid)
+{
+	pgactiveRemoteRelation *entry = NULL;
+
+	if (RemoteRelationHash != NULL)
+		entry = hash_search(RemoteRelationHash, &remote_relid, HASH_FIND, NULL);
+
+	if (entry == NULL)
+		ereport(ERROR,
+				(errcode(ERRCODE_PROTOCOL_VIOLATION),
+				 errmsg("change refers to unknown upstream relation %u",
+						remote_relid)));
+
+	return entry;
+}
+
+/*
+ * Get the names of an upstream relation changes refer to by id.
+ */
+void
+pgactive_apply_remote_relation_names(uint32 remote_relid,
+									 const char **nspname, const char **relname)
+{
+	pgactiveRemoteRelation *entry = lookup_remote_relation(remote_relid);
+
+	*nspname = entry->nspname;
+	*relname = entry->relname;
+}
+
+/*
+ * Relcache invalidation callback, see pgactiveRelcacheHashInvalidateCallback.
+ * The local relation an upstream relation maps to is looked up by name again
+ * the next time it's used.
+ */
+void
+pgactive_apply_remote_relation_invalidate(Oid relid)
+{
+	HASH_SEQ_STATUS status;
+	pgactiveRemoteRelation *entry;
+
+	if (RemoteRelationHash == NULL)
+		return;
+
+	hash_seq_init(&status, RemoteRelationHash);
+	while ((entry = hash_seq_search(&status)) != NULL)
+	{
+		if (relid == InvalidOid || entry->localrelid == relid)
+			entry->localrelid = InvalidOid;
+	}
+}
+
 static pgactiveRelation *
 read_rel(StringInfo s, LOCKMODE mode, struct ActionErrCallbackArg *cbarg)
 {
@@ -2379,9 +3598,38 @@ read_rel(StringInfo s, LOCKMODE mode, struct ActionErrCallbackArg *cbarg)
 	RangeVar   *rv;
 	Oid			relid;
 
+	nspnamelen = pq_getmsgint(s, 2);
+
+	/* relation id, see process_remote_relation() */
+	if (nspnamelen == 0)
+	{
+		pgactiveRemoteRelation *entry;
+
+		entry = lookup_remote_relation(pq_getmsgint(s, 4));
+		cbarg->remote_nspname = entry->nspname;
+		cbarg->remote_relname = entry->relname;
+
+		relid = entry->localrelid;
+		if (OidIsValid(relid))
+		{
+			LockRelationOid(relid, mode);
+
+			/* still the same relation after processing invalidations? */
+			if (entry->localrelid == relid)
+				return pgactive_table_open(relid, NoLock);
+
+			UnlockRelationOid(relid, mode);
+		}
+
+		rv = makeRangeVar(entry->nspname, entry->relname, -1);
+		relid = RangeVarGetRelidExtended(rv, mode, 0, NULL, NULL);
+		entry->localrelid = relid;
+
+		return pgactive_table_open(relid, NoLock);
+	}
+
 	rv = makeNode(RangeVar);
 
-	nspnamelen = pq_getmsgint(s, 2);
 	rv->schemaname = (char *) pq_getmsgbytes(s, nspnamelen);
 	cbarg->remote_nspname = rv->schemaname;
 
@@ -2399,12 +3647,45 @@ read_rel(StringInfo s, LOCKMODE mode, struct ActionErrCallbackArg *cbarg)
  *
  * May set ProcDiePending to stop processing before next record.
  */
-static void
+void
 pgactive_process_remote_action(StringInfo s)
 {
 	char		action = pq_getmsgbyte(s);
 
 	Assert(CurrentMemoryContext == MessageContext);
+
+	/*
+	 * pgactive messages of a capture were meant for the nodes that were
+	 * running back then; acting on them could send messages to the group.
+	 */
+	if (action == 'M' && apply_replaying)
+		return;
+
+	/* changes of a streamed transaction are applied when it commits */
+	if (pgactive_apply_stream_in_progress() &&
+		(action == 'I' || action == 'U' || action == 'D' || action == 'M'))
+	{
+		pgactive_apply_stream_spool(action, s);
+		return;
+	}
+
+	/* only the next remote transaction may join the current group */
+	if (group_commit_pending && action != 'B')
+		apply_group_commit();
+
+	if (action == 'B')
+	{
+		xact_rows = 0;
+		xact_bytes = 0;
+	}
+	xact_bytes += s->len;
+	if (action == 'I' || action == 'U' || action == 'D')
+		xact_rows++;
+
+	/* apply buffered INSERTs in order with everything else */
+	if (action != 'I' && action != 'R')
+		apply_relstate_flush_inserts();
+
 	switch (action)
 	{
 			/* BEGIN */
@@ -2430,6 +3711,26 @@ pgactive_process_remote_action(StringInfo s)
 		case 'M':
 			pgactive_process_remote_message(s);
 			break;
+			/* RELATION */
+		case 'R':
+			process_remote_relation(s);
+			break;
+			/* STREAM START */
+		case 'S':
+			pgactive_apply_stream_start(s);
+			break;
+			/* STREAM STOP */
+		case 'E':
+			pgactive_apply_stream_stop();
+			break;
+			/* STREAM ABORT */
+		case 'A':
+			pgactive_apply_stream_abort(s);
+			break;
+			/* STREAM COMMIT */
+		case 'c':
+			pgactive_apply_stream_commit(s);
+			break;
 		default:
 			elog(ERROR, "unknown action of type %c", action);
 	}
@@ -2447,56 +3748,109 @@ pgactive_process_remote_action(StringInfo s)
 }
 
 
+/*
+ * Associate the end of a remote commit with the local end of the commit
+ * record that applied it, for pgactive_get_flush_position().
+ */
+void
+pgactive_apply_push_flush_position(XLogRecPtr local_end, XLogRecPtr remote_end)
+{
+	pgactiveFlushPosition *flushpos;
+
+	Assert(flush_positions_count == 0 ||
+		   FLUSH_POSITION(flush_positions_count - 1)->local_end <= local_end);
+
+	if (flush_positions_count == flush_positions_size)
+	{
+		int			newsize;
+		pgactiveFlushPosition *newpositions;
+		int			i;
+
+		newsize = flush_positions_size == 0 ?
+			pg_nextpower2_32(pgactive_debug_flush_positions_initial_size) :
+			flush_positions_size * 2;
+		newpositions = (pgactiveFlushPosition *)
+			MemoryContextAlloc(TopMemoryContext,
+							   newsize * sizeof(pgactiveFlushPosition));
+
+		for (i = 0; i < flush_positions_count; i++)
+			newpositions[i] = *FLUSH_POSITION(i);
+
+		if (flush_positions != NULL)
+			pfree(flush_positions);
+		flush_positions = newpositions;
+		flush_positions_size = newsize;
+		flush_positions_head = 0;
+
+		pgactive_apply_worker->flush_positions_size = flush_positions_size;
+	}
+
+	flushpos = FLUSH_POSITION(flush_positions_count);
+	flushpos->local_end = local_end;
+	flushpos->remote_end = remote_end;
+	flush_positions_count++;
+
+	pgactive_apply_worker->flush_positions_count = flush_positions_count;
+}
+
 /*
  * Figure out which write/flush positions to report to the walsender process.
  *
  * We can't simply report back the last LSN the walsender sent us because the
  * local transaction might not yet be flushed to disk locally. Instead we
- * build a list that associates local with remote LSNs for every commit. When
- * reporting back the flush position to the sender we iterate that list and
- * check which entries on it are already locally flushed. Those we can report
- * as having been flushed.
+ * keep a list that associates local with remote LSNs for every commit. When
+ * reporting back the flush position to the sender we look up the newest
+ * entry that's already locally flushed, and report it and all older ones as
+ * having been flushed.
  *
  * Returns true if there's no outstanding transactions that need to be
- * flushed.
+ * flushed. Transactions still being applied by parallel apply workers are
+ * outstanding too.
  */
 static bool
 pgactive_get_flush_position(XLogRecPtr *write, XLogRecPtr *flush)
 {
-	dlist_mutable_iter iter;
-	XLogRecPtr	local_flush = GetFlushRecPtr();
+	XLogRecPtr	local_flush;
+	int			low,
+				high;
 
 	*write = InvalidXLogRecPtr;
 	*flush = InvalidXLogRecPtr;
 
-	dlist_foreach_modify(iter, &pgactive_lsn_association)
+	if (flush_positions_count > 0)
 	{
-		pgactiveFlushPosition *pos =
-			dlist_container(pgactiveFlushPosition, node, iter.cur);
+		local_flush = GetFlushRecPtr();
 
-		*write = pos->remote_end;
+		*write = FLUSH_POSITION(flush_positions_count - 1)->remote_end;
 
-		if (pos->local_end <= local_flush)
+		/* find the number of entries that are locally flushed */
+		low = 0;
+		high = flush_positions_count;
+		while (low < high)
 		{
-			*flush = pos->remote_end;
-			dlist_delete(iter.cur);
-			pfree(pos);
+			int			mid = low + (high - low) / 2;
+
+			if (FLUSH_POSITION(mid)->local_end <= local_flush)
+				low = mid + 1;
+			else
+				high = mid;
 		}
-		else
+
+		if (low > 0)
 		{
-			/*
-			 * Don't want to uselessly iterate over the rest of the list which
-			 * could potentially be long. Instead get the last element and
-			 * grab the write position from there.
-			 */
-			pos = dlist_tail_element(pgactiveFlushPosition, node,
-									 &pgactive_lsn_association);
-			*write = pos->remote_end;
-			return false;
+			*flush = FLUSH_POSITION(low - 1)->remote_end;
+
+			flush_positions_head =
+				(flush_positions_head + low) & (flush_positions_size - 1);
+			flush_positions_count -= low;
+
+			pgactive_apply_worker->flush_positions_count = flush_positions_count;
 		}
 	}
 
-	return dlist_is_empty(&pgactive_lsn_association);
+	return flush_positions_count == 0 &&
+		!group_commit_pending &&
+		!pgactive_apply_parallel_in_flight();
 }
 
 /*
@@ -2705,10 +4059,13 @@ pgactive_apply_work(PGconn *streamConn)
 	/* mark as idle, before starting to loop */
 	pgstat_report_activity(STATE_IDLE, NULL);
 
+	pgactive_apply_capture_configure(&pgactive_apply_worker->remote_node, true);
+
 	while (!ProcDiePending)
 	{
 		int			rc;
 		int			r;
+		bool		reload = false;
 
 		if (ConfigReloadPending)
 		{
@@ -2717,6 +4074,9 @@ pgactive_apply_work(PGconn *streamConn)
 			/* set log_min_messages */
 			SetConfigOption("log_min_messages", pgactive_error_severity(pgactive_log_min_messages),
 							PGC_POSTMASTER, PGC_S_OVERRIDE);
+
+			/* stop capturing, starting waits for the next connection */
+			pgactive_apply_capture_configure(&pgactive_apply_worker->remote_node, false);
 		}
 
 		/*
@@ -2741,17 +4101,30 @@ pgactive_apply_work(PGconn *streamConn)
 			elog(ERROR, "connection to other side has died");
 		}
 
-		if (rc & WL_LATCH_SET)
+		/*
+		 * Apply worker latch was set. This could be an attempt to resume
+		 * apply that wasn't paused in the first place, or could be a request
+		 * to reload our config. It's safe to reload, so just do so.
+		 *
+		 * Parallel apply workers set our latch too, whenever they have
+		 * committed a transaction, and waiting for them resets it. So we
+		 * don't reload on their wakeups, and rely on reload requests being
+		 * flagged in shared memory as well.
+		 */
+		if ((rc & WL_LATCH_SET) && !pgactive_apply_parallel_consume_wakeup())
+			reload = true;
+
+		if (pgactive_apply_worker->reload_requested)
 		{
-			/*
-			 * Apply worker latch was set. This could be an attempt to resume
-			 * apply that wasn't paused in the first place, or could be a
-			 * request to reload our config. It's safe to reload, so just do
-			 * so.
-			 */
-			pgactive_apply_reload_config();
+			LWLockAcquire(pgactiveWorkerCtl->lock, LW_EXCLUSIVE);
+			pgactive_apply_worker->reload_requested = false;
+			LWLockRelease(pgactiveWorkerCtl->lock);
+			reload = true;
 		}
 
+		if (reload)
+			pgactive_apply_reload_config();
+
 		if (rc & WL_SOCKET_READABLE)
 			PQconsumeInput(streamConn);
 
@@ -2776,7 +4149,12 @@ pgactive_apply_work(PGconn *streamConn)
 			else if (r < 0)
 				elog(ERROR, "invalid COPY status %d", r);
 			else if (r == 0)
+			{
+				/* don't wait with remote transactions left uncommitted */
+				apply_group_commit();
+				pgactive_apply_capture_flush();
 				break;			/* need to wait for new data */
+			}
 			else
 			{
 				int			c;
@@ -2802,6 +4180,8 @@ pgactive_apply_work(PGconn *streamConn)
 					XLogRecPtr	start_lsn;
 					XLogRecPtr	end_lsn;
 
+					pgactive_apply_capture_message(copybuf, r);
+
 					start_lsn = pq_getmsgint64(&s);
 					end_lsn = pq_getmsgint64(&s);
 					pq_getmsgint64(&s); /* sendTime */
@@ -2812,7 +4192,12 @@ pgactive_apply_work(PGconn *streamConn)
 					if (last_received < end_lsn)
 						last_received = end_lsn;
 
-					pgactive_process_remote_action(&s);
+					pgactive_decompress_message(&s);
+
+					if (pgactive_apply_parallel_is_active())
+						pgactive_apply_parallel_dispatch(&s);
+					else
+						pgactive_process_remote_action(&s);
 				}
 				else if (c == 'k')
 				{
@@ -2853,6 +4238,13 @@ pgactive_apply_work(PGconn *streamConn)
 
 		}
 
+		if (pgactive_apply_parallel_is_active())
+		{
+			/* collect transactions parallel apply workers committed since */
+			pgactive_apply_parallel_collect(false);
+			pgactive_count_flush();
+		}
+
 		/* confirm all writes at once */
 		pgactive_send_feedback(streamConn, last_received,
 							   GetCurrentTimestamp(), false);
@@ -2880,6 +4272,10 @@ pgactive_apply_work(PGconn *streamConn)
 		 */
 		while (pgactiveWorkerCtl->pause_apply && !IsTransactionState())
 		{
+			/* don't leave parallel apply workers busy while paused */
+			if (pgactive_apply_parallel_is_active())
+				pgactive_apply_parallel_collect(true);
+
 			ereport(LOG,
 					(errmsg("apply has paused"),
 					 errhint("Execute pgactive_apply_resume() to continue.")));
@@ -2924,6 +4320,7 @@ pgactive_apply_main(Datum main_arg)
 	XLogRecPtr	start_from;
 	NameData	slot_name;
 	char		status;
+	int			remote_version_num = 0;
 
 	pgactive_bgworker_init(DatumGetInt32(main_arg), pgactive_WORKER_APPLY);
 
@@ -3046,6 +4443,26 @@ pgactive_apply_main(Datum main_arg)
 	if (pgactive_apply_worker->forward_changesets)
 		appendStringInfo(&query, ", forward_changesets 't'");
 
+	/*
+	 * Have changes refer to relations by id rather than by name, large
+	 * transactions streamed before they commit, and messages compressed if
+	 * configured, if the upstream supports that.
+	 */
+	res = PQexec(streamConn, "SELECT pgactive.pgactive_version_num()");
+	if (PQresultStatus(res) == PGRES_TUPLES_OK)
+		remote_version_num = atoi(PQgetvalue(res, 0, 0));
+	PQclear(res);
+
+	if (remote_version_num >= pgactive_RELATION_IDS_VERSION_NUM)
+		appendStringInfo(&query, ", relation_ids 't'");
+	if (remote_version_num >= pgactive_STREAMING_VERSION_NUM)
+		appendStringInfo(&query, ", streaming 't'");
+	if (remote_version_num >= pgactive_COMPRESSION_VERSION_NUM &&
+		pgactive_apply_compression != pgactive_COMPRESSION_NONE)
+		appendStringInfo(&query, ", compression '%s', compression_threshold '%d'",
+						 pgactive_compression_name(pgactive_apply_compression),
+						 pgactive_apply_compression_threshold);
+
 	appendStringInfoChar(&query, ')');
 
 	elog(DEBUG3, "sending replication command: %s", query.data);
@@ -3066,6 +4483,9 @@ pgactive_apply_main(Datum main_arg)
 
 	pgactive_conflict_logging_startup();
 
+	/* launch parallel apply workers, if configured and possible */
+	pgactive_apply_parallel_start(rep_origin_id);
+
 	PG_TRY();
 	{
 		pgactive_apply_work(streamConn);
@@ -3077,6 +4497,7 @@ pgactive_apply_main(Datum main_arg)
 
 		if (IsTransactionState())
 			pgactive_count_rollback();
+		pgactive_count_flush();
 		PG_RE_THROW();
 	}
 	PG_END_TRY();
@@ -3099,3 +4520,70 @@ GetpgactiveApplyWorkerShmemPtr(void)
 {
 	return pgactive_apply_worker;
 }
+
+/*
+ * Set up the apply state of a parallel apply worker, so it can process the
+ * remote actions of the leader apply worker it was started by.
+ */
+void
+pgactive_apply_setup_parallel_worker(pgactiveApplyWorker * apply)
+{
+	Assert(IspgactiveApplyParallelWorker());
+
+	pgactive_apply_worker = apply;
+	pgactive_nodeid_cpy(&origin, &apply->remote_node);
+
+	/* Read our connection configuration from the database */
+	pgactive_apply_reload_config();
+
+	MessageContext = AllocSetContextCreate(TopMemoryContext,
+										   "MessageContext",
+										   ALLOCSET_DEFAULT_MINSIZE,
+										   ALLOCSET_DEFAULT_INITSIZE,
+										   ALLOCSET_DEFAULT_MAXSIZE);
+}
+
+/*
+ * Set up the apply state of a replay worker, so it can process the remote
+ * actions captured from the apply worker for the node in apply->remote_node.
+ *
+ * Replication origins of the nodes forwarded transactions came from are
+ * left alone, and nothing is confirmed to anyone.
+ */
+void
+pgactive_apply_setup_replay(pgactiveApplyWorker * apply, bool dry_run)
+{
+	pgactive_apply_worker = apply;
+	pgactive_nodeid_cpy(&origin, &apply->remote_node);
+
+	apply_replaying = true;
+	apply_replay_dry_run = dry_run;
+
+	/* Read the connection configuration of the captured node */
+	pgactive_apply_reload_config();
+
+	MessageContext = AllocSetContextCreate(TopMemoryContext,
+										   "MessageContext",
+										   ALLOCSET_DEFAULT_MINSIZE,
+										   ALLOCSET_DEFAULT_INITSIZE,
+										   ALLOCSET_DEFAULT_MAXSIZE);
+}
+
+/*
+ * End a replay: commit what's left of a group commit and roll back the
+ * remote transaction the capture ended in the middle of, if any.
+ */
+void
+pgactive_apply_replay_finish(void)
+{
+	Assert(apply_replaying);
+
+	MemoryContextSwitchTo(MessageContext);
+	apply_group_commit();
+
+	if (IsTransactionState())
+	{
+		AbortCurrentTransaction();
+		started_transaction = false;
+	}
+}
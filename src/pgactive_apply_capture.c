@@ -0,0 +1,573 @@
+/* -------------------------------------------------------------------------
+ *
+ * pgactive_apply_capture.c
+ *		Capture and replay of the replication stream an apply worker receives
+ *
+ * When pgactive.apply_capture_directory is set, every apply worker writes
+ * the CopyData messages carrying changes ('w') it receives from its upstream
+ * to a capture file in that directory, exactly as received. Keepalives
+ * aren't captured. A capture always starts when the apply worker connects,
+ * as the stream can only be applied from its start: the relation ids of
+ * later changes refer to relation messages sent once per connection, and a
+ * transaction's changes follow its begin message.
+ *
+ * pgactive_apply_replay() feeds a capture through the apply code again, in
+ * a background worker connected to the current database, as fast as it can
+ * and without any network involved. That makes apply performance problems
+ * reproducible, and builds comparable, on a copy of the node the capture was
+ * taken on. A dry run rolls back every remote transaction.
+ *
+ * Replay commits with the "pgactive_replay" replication origin, so the
+ * changes it makes aren't sent on to peer nodes, and it leaves the
+ * replication origins of the group alone. pgactive messages (DDL locking,
+ * replay confirmations, etc.) in a capture are skipped.
+ *
+ * A capture file starts with a pgactiveCaptureHeader, followed by the
+ * messages, each preceded by its length as a uint32. Both are in the byte
+ * order of the machine that wrote the capture.
+ *
+ * Copyright (C) 2012-2015, PostgreSQL Global Development Group
+ *
+ * IDENTIFICATION
+ *		pgactive_apply_capture.c
+ *
+ * -------------------------------------------------------------------------
+ */
+#include "postgres.h"
+
+#include <time.h>
+#include <unistd.h>
+
+#include "pgactive.h"
+
+#include "fmgr.h"
+#include "funcapi.h"
+#include "miscadmin.h"
+#include "pgstat.h"
+
+#include "access/htup_details.h"
+#include "access/xact.h"
+
+#include "commands/dbcommands.h"
+
+#include "libpq/pqformat.h"
+
+#include "portability/instr_time.h"
+
+#include "postmaster/bgworker.h"
+
+#include "replication/origin.h"
+
+#include "storage/dsm.h"
+#include "storage/fd.h"
+#include "storage/ipc.h"
+
+#include "utils/builtins.h"
+#include "utils/guc.h"
+#include "utils/memutils.h"
+#include "utils/resowner.h"
+#include "utils/timestamp.h"
+
+#define PGACTIVE_CAPTURE_MAGIC		0x70614370
+#define PGACTIVE_CAPTURE_VERSION	1
+
+/* write buffered messages out once this much is buffered */
+#define PGACTIVE_CAPTURE_BUFFER_SIZE	(1024 * 1024)
+
+#define PGACTIVE_REPLAY_ORIGIN_NAME	"pgactive_replay"
+
+typedef struct pgactiveCaptureHeader
+{
+	uint32		magic;
+	uint32		version;
+	uint64		remote_sysid;
+	TimeLineID	remote_timeline;
+	Oid			remote_dboid;
+}			pgactiveCaptureHeader;
+
+/*
+ * Shared between the backend running pgactive_apply_replay() and the replay
+ * worker it launched.
+ */
+typedef struct pgactiveReplayShared
+{
+	Oid			dboid;
+	Oid			userid;
+	bool		dry_run;
+	char		path[MAXPGPATH];
+
+	/* set by the worker once the whole capture was replayed */
+	bool		done;
+	int64		nmessages;
+	int64		nxacts;
+	int64		nchanges;
+	double		elapsed;
+}			pgactiveReplayShared;
+
+PG_FUNCTION_INFO_V1(pgactive_apply_replay);
+
+/* capture file of this apply worker, -1 if not capturing */
+static int	capture_fd = -1;
+static char *capture_dir = NULL;
+static char *capture_path = NULL;
+static StringInfo capture_buf = NULL;
+
+static void capture_close(void);
+static void capture_exit(int code, Datum arg);
+static bool replay_read(FILE *file, void *buf, size_t len, const char *path);
+
+/*
+ * Start or stop capturing, as pgactive.apply_capture_directory says. Called
+ * by the apply worker when it connected, and after a configuration reload.
+ *
+ * Capturing only starts when connecting; after a reload it can only stop.
+ */
+void
+pgactive_apply_capture_configure(const pgactiveNodeId * const remote,
+								 bool connecting)
+{
+	static bool exit_registered = false;
+	pgactiveCaptureHeader hdr;
+	char		path[MAXPGPATH];
+
+	if (pgactive_apply_capture_directory == NULL ||
+		pgactive_apply_capture_directory[0] == '\0')
+	{
+		capture_close();
+		return;
+	}
+
+	/* already capturing to that directory */
+	if (capture_fd >= 0 &&
+		strcmp(capture_dir, pgactive_apply_capture_directory) == 0)
+		return;
+
+	capture_close();
+
+	if (!connecting)
+	{
+		ereport(LOG,
+				(errmsg("capturing replication stream from node " pgactive_NODEID_FORMAT_WITHNAME " starts when the apply worker reconnects",
+						pgactive_NODEID_FORMAT_WITHNAME_ARGS(*remote))));
+		return;
+	}
+
+	snprintf(path, MAXPGPATH, "%s/pgactive_capture_" UINT64_FORMAT "_%u_%u_%d_" INT64_FORMAT ".bin",
+			 pgactive_apply_capture_directory,
+			 remote->sysid, remote->timeline, remote->dboid, MyProcPid,
+			 (int64) time(NULL));
+
+	capture_fd = BasicOpenFile(path, O_WRONLY | O_CREAT | O_EXCL | PG_BINARY);
+	if (capture_fd < 0)
+	{
+		ereport(WARNING,
+				(errcode_for_file_access(),
+				 errmsg("could not create capture file \"%s\": %m", path)));
+		return;
+	}
+
+	/* write out what's buffered if apply fails */
+	if (!exit_registered)
+	{
+		on_proc_exit(capture_exit, (Datum) 0);
+		exit_registered = true;
+	}
+
+	capture_dir = MemoryContextStrdup(TopMemoryContext,
+									  pgactive_apply_capture_directory);
+	capture_path = MemoryContextStrdup(TopMemoryContext, path);
+	if (capture_buf == NULL)
+	{
+		MemoryContext oldctx = MemoryContextSwitchTo(TopMemoryContext);
+
+		capture_buf = makeStringInfo();
+		MemoryContextSwitchTo(oldctx);
+	}
+
+	memset(&hdr, 0, sizeof(hdr));
+	hdr.magic = PGACTIVE_CAPTURE_MAGIC;
+	hdr.version = PGACTIVE_CAPTURE_VERSION;
+	hdr.remote_sysid = remote->sysid;
+	hdr.remote_timeline = remote->timeline;
+	hdr.remote_dboid = remote->dboid;
+	appendBinaryStringInfo(capture_buf, (char *) &hdr, sizeof(hdr));
+
+	ereport(LOG,
+			(errmsg("capturing replication stream from node " pgactive_NODEID_FORMAT_WITHNAME " to \"%s\"",
+					pgactive_NODEID_FORMAT_WITHNAME_ARGS(*remote), path)));
+}
+
+/*
+ * Capture a CopyData message received from the upstream.
+ */
+void
+pgactive_apply_capture_message(const char *data, int len)
+{
+	uint32		msglen = len;
+
+	if (capture_fd < 0)
+		return;
+
+	appendBinaryStringInfo(capture_buf, (char *) &msglen, sizeof(uint32));
+	appendBinaryStringInfo(capture_buf, data, len);
+
+	if (capture_buf->len >= PGACTIVE_CAPTURE_BUFFER_SIZE)
+		pgactive_apply_capture_flush();
+}
+
+/*
+ * Write out the buffered messages. Capturing stops on write errors rather
+ * than failing apply.
+ */
+void
+pgactive_apply_capture_flush(void)
+{
+	int			written = 0;
+
+	if (capture_fd < 0 || capture_buf->len == 0)
+		return;
+
+	while (written < capture_buf->len)
+	{
+		ssize_t		rc;
+
+		rc = write(capture_fd, capture_buf->data + written,
+				   capture_buf->len - written);
+		if (rc < 0)
+		{
+			if (errno == EINTR)
+				continue;
+
+			ereport(WARNING,
+					(errcode_for_file_access(),
+					 errmsg("could not write to capture file \"%s\": %m",
+							capture_path),
+					 errdetail("Capturing the replication stream stopped.")));
+			resetStringInfo(capture_buf);
+			close(capture_fd);
+			capture_fd = -1;
+			return;
+		}
+		written += rc;
+	}
+
+	resetStringInfo(capture_buf);
+}
+
+static void
+capture_close(void)
+{
+	if (capture_path == NULL)
+		return;
+
+	pgactive_apply_capture_flush();
+
+	/* the flush may have given up on the file already */
+	if (capture_fd >= 0)
+	{
+		close(capture_fd);
+		capture_fd = -1;
+	}
+
+	ereport(LOG,
+			(errmsg("stopped capturing replication stream to \"%s\"",
+					capture_path)));
+
+	pfree(capture_dir);
+	pfree(capture_path);
+	capture_dir = NULL;
+	capture_path = NULL;
+}
+
+static void
+capture_exit(int code, Datum arg)
+{
+	capture_close();
+}
+
+/*
+ * Read from a capture file, returning false at its end.
+ */
+static bool
+replay_read(FILE *file, void *buf, size_t len, const char *path)
+{
+	size_t		nread = fread(buf, 1, len, file);
+
+	if (nread == len)
+		return true;
+
+	if (ferror(file))
+		ereport(ERROR,
+				(errcode_for_file_access(),
+				 errmsg("could not read capture file \"%s\": %m", path)));
+
+	/* a capture may end in the middle of the message being written */
+	if (nread != 0)
+		ereport(WARNING,
+				(errmsg("capture file \"%s\" ends in the middle of a message",
+						path)));
+
+	return false;
+}
+
+/*
+ * Entry point of the replay worker launched by pgactive_apply_replay().
+ */
+void
+pgactive_apply_replay_main(Datum main_arg)
+{
+	dsm_segment *seg;
+	pgactiveReplayShared *shared;
+	pgactiveCaptureHeader hdr;
+	pgactiveApplyWorker *apply;
+	RepOriginId origin_id;
+	FILE	   *file;
+	StringInfoData buf;
+	instr_time	start;
+	instr_time	duration;
+	int64		nmessages = 0;
+	int64		nxacts = 0;
+	int64		nchanges = 0;
+
+	pqsignal(SIGHUP, SignalHandlerForConfigReload);
+	pqsignal(SIGTERM, die);
+	BackgroundWorkerUnblockSignals();
+
+	seg = dsm_attach(DatumGetUInt32(main_arg));
+	if (seg == NULL)
+		ereport(ERROR,
+				(errcode(ERRCODE_OBJECT_NOT_IN_PREREQUISITE_STATE),
+				 errmsg("could not map dynamic shared memory segment")));
+	shared = dsm_segment_address(seg);
+
+	MyProcPort = (Port *) calloc(1, sizeof(Port));
+
+	BackgroundWorkerInitializeConnectionByOid(shared->dboid, shared->userid, 0);
+
+	/* apply as the apply workers do, see pgactive_bgworker_init() */
+	SetConfigOption("search_path", "pgactive, pg_catalog",
+					PGC_BACKEND, PGC_S_OVERRIDE);
+	SetConfigOption("synchronous_commit", "off",
+					PGC_BACKEND, PGC_S_OVERRIDE);
+	SetConfigOption("session_replication_role", "replica",
+					PGC_SUSET, PGC_S_OVERRIDE);
+	SetConfigOption("check_function_bodies", "off",
+					PGC_INTERNAL, PGC_S_OVERRIDE);
+
+	/* read across the transactions of the replay, so not AllocateFile() */
+	file = fopen(shared->path, PG_BINARY_R);
+	if (file == NULL)
+		ereport(ERROR,
+				(errcode_for_file_access(),
+				 errmsg("could not open capture file \"%s\": %m", shared->path)));
+
+	if (!replay_read(file, &hdr, sizeof(hdr), shared->path) ||
+		hdr.magic != PGACTIVE_CAPTURE_MAGIC ||
+		hdr.version != PGACTIVE_CAPTURE_VERSION)
+		ereport(ERROR,
+				(errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+				 errmsg("\"%s\" is not a pgactive capture file", shared->path)));
+
+	apply = MemoryContextAllocZero(TopMemoryContext, sizeof(pgactiveApplyWorker));
+	apply->dboid = MyDatabaseId;
+	apply->remote_node.sysid = hdr.remote_sysid;
+	apply->remote_node.timeline = hdr.remote_timeline;
+	apply->remote_node.dboid = hdr.remote_dboid;
+	apply->replay_stop_lsn = InvalidXLogRecPtr;
+
+	StartTransactionCommand();
+	MyProcPort->database_name = MemoryContextStrdup(TopMemoryContext,
+													get_database_name(MyDatabaseId));
+	pgactive_setup_my_cached_node_names();
+	pgactive_setup_cached_remote_name(&apply->remote_node);
+	origin_id = replorigin_by_name(PGACTIVE_REPLAY_ORIGIN_NAME, true);
+	if (origin_id == InvalidRepOriginId)
+		origin_id = replorigin_create(PGACTIVE_REPLAY_ORIGIN_NAME);
+	CommitTransactionCommand();
+
+	pgactive_apply_setup_replay(apply, shared->dry_run);
+
+	/* nothing is committed in a dry run, leave the origin to others */
+	if (!shared->dry_run)
+	{
+		StartTransactionCommand();
+#if PG_VERSION_NUM >= 160000
+		replorigin_session_setup(origin_id, 0);
+#else
+		replorigin_session_setup(origin_id);
+#endif
+		CommitTransactionCommand();
+		replorigin_session_origin = origin_id;
+	}
+
+	pgactive_count_set_current_node(origin_id);
+	pgactive_conflict_logging_startup();
+
+	CurrentResourceOwner = ResourceOwnerCreate(NULL, "pgactive replay top-level resource owner");
+	pgactive_saved_resowner = CurrentResourceOwner;
+
+	ereport(LOG,
+			(errmsg("replaying%s capture \"%s\" of node " pgactive_NODEID_FORMAT_WITHNAME,
+					shared->dry_run ? " (dry run)" : "", shared->path,
+					pgactive_NODEID_FORMAT_WITHNAME_ARGS(apply->remote_node))));
+
+	pgstat_report_activity(STATE_RUNNING, "pgactive replay");
+
+	MemoryContextSwitchTo(TopMemoryContext);
+	initStringInfo(&buf);
+
+	INSTR_TIME_SET_CURRENT(start);
+
+	for (;;)
+	{
+		uint32		msglen;
+		StringInfoData s;
+		char		action;
+
+		CHECK_FOR_INTERRUPTS();
+
+		if (!replay_read(file, &msglen, sizeof(uint32), shared->path))
+			break;
+
+		resetStringInfo(&buf);
+		enlargeStringInfo(&buf, msglen);
+		if (!replay_read(file, buf.data, msglen, shared->path))
+			break;
+		buf.len = msglen;
+
+		s.data = buf.data;
+		s.len = buf.len;
+		s.maxlen = -1;
+		s.cursor = 0;
+
+		/* as received by pgactive_apply_work() */
+		if (pq_getmsgbyte(&s) != 'w')
+			continue;
+		pq_getmsgint64(&s);		/* start_lsn */
+		pq_getmsgint64(&s);		/* end_lsn */
+		pq_getmsgint64(&s);		/* sendTime */
+
+		MemoryContextSwitchTo(MessageContext);
+		pgactive_decompress_message(&s);
+
+		action = s.data[s.cursor];
+		if (action == 'C' || action == 'c')
+			nxacts++;
+		else if (action == 'I' || action == 'U' || action == 'D')
+			nchanges++;
+		nmessages++;
+
+		pgactive_process_remote_action(&s);
+		MemoryContextSwitchTo(TopMemoryContext);
+	}
+
+	pgactive_apply_replay_finish();
+
+	INSTR_TIME_SET_CURRENT(duration);
+	INSTR_TIME_SUBTRACT(duration, start);
+
+	fclose(file);
+
+	shared->nmessages = nmessages;
+	shared->nxacts = nxacts;
+	shared->nchanges = nchanges;
+	shared->elapsed = INSTR_TIME_GET_DOUBLE(duration);
+	shared->done = true;
+
+	ereport(LOG,
+			(errmsg("replayed %lld transactions with %lld changes from \"%s\" in %.3f s",
+					(long long) nxacts, (long long) nchanges, shared->path,
+					shared->elapsed)));
+
+	proc_exit(0);
+}
+
+/*
+ * Replay a capture file in a background worker and wait for it to finish.
+ */
+Datum
+pgactive_apply_replay(PG_FUNCTION_ARGS)
+{
+	char	   *path = text_to_cstring(PG_GETARG_TEXT_PP(0));
+	bool		dry_run = PG_GETARG_BOOL(1);
+	dsm_segment *seg;
+	pgactiveReplayShared *shared;
+	BackgroundWorker bgw;
+	BackgroundWorkerHandle *handle;
+	pid_t		pid;
+	TupleDesc	tupdesc;
+	Datum		values[4];
+	bool		nulls[4] = {false, false, false, false};
+
+	if (get_call_result_type(fcinfo, NULL, &tupdesc) != TYPEFUNC_COMPOSITE)
+		elog(ERROR, "return type must be a row type");
+
+	if (!is_absolute_path(path))
+		ereport(ERROR,
+				(errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+				 errmsg("capture file path must be absolute")));
+
+	if (strlen(path) >= MAXPGPATH)
+		ereport(ERROR,
+				(errcode(ERRCODE_NAME_TOO_LONG),
+				 errmsg("capture file path is too long")));
+
+	seg = dsm_create(sizeof(pgactiveReplayShared), 0);
+	shared = dsm_segment_address(seg);
+	memset(shared, 0, sizeof(pgactiveReplayShared));
+	shared->dboid = MyDatabaseId;
+	shared->userid = GetUserId();
+	shared->dry_run = dry_run;
+	strlcpy(shared->path, path, MAXPGPATH);
+
+	memset(&bgw, 0, sizeof(bgw));
+	bgw.bgw_flags = BGWORKER_SHMEM_ACCESS |
+		BGWORKER_BACKEND_DATABASE_CONNECTION;
+	bgw.bgw_start_time = BgWorkerStart_RecoveryFinished;
+	bgw.bgw_restart_time = BGW_NEVER_RESTART;
+	snprintf(bgw.bgw_library_name, BGW_MAXLEN, pgactive_LIBRARY_NAME);
+	snprintf(bgw.bgw_function_name, BGW_MAXLEN, "pgactive_apply_replay_main");
+	snprintf(bgw.bgw_type, BGW_MAXLEN, "pgactive replay worker");
+	snprintf(bgw.bgw_name, BGW_MAXLEN, "pgactive replay worker for PID %d",
+			 MyProcPid);
+	bgw.bgw_main_arg = UInt32GetDatum(dsm_segment_handle(seg));
+	bgw.bgw_notify_pid = MyProcPid;
+
+	if (!RegisterDynamicBackgroundWorker(&bgw, &handle))
+		ereport(ERROR,
+				(errcode(ERRCODE_CONFIGURATION_LIMIT_EXCEEDED),
+				 errmsg("could not register pgactive replay worker"),
+				 errhint("Consider increasing configuration parameter \"max_worker_processes\".")));
+
+	/* don't leave the worker replaying if we're cancelled */
+	PG_TRY();
+	{
+		if (WaitForBackgroundWorkerStartup(handle, &pid) != BGWH_STARTED)
+			ereport(ERROR,
+					(errcode(ERRCODE_INSUFFICIENT_RESOURCES),
+					 errmsg("could not start pgactive replay worker")));
+
+		(void) WaitForBackgroundWorkerShutdown(handle);
+	}
+	PG_CATCH();
+	{
+		TerminateBackgroundWorker(handle);
+		PG_RE_THROW();
+	}
+	PG_END_TRY();
+
+	if (!shared->done)
+		ereport(ERROR,
+				(errcode(ERRCODE_OBJECT_NOT_IN_PREREQUISITE_STATE),
+				 errmsg("pgactive replay worker failed to replay \"%s\"", path),
+				 errhint("See the server log for details.")));
+
+	values[0] = Int64GetDatum(shared->nxacts);
+	values[1] = Int64GetDatum(shared->nchanges);
+	values[2] = Int64GetDatum(shared->nmessages);
+	values[3] = Float8GetDatum(shared->elapsed);
+
+	dsm_detach(seg);
+
+	PG_RETURN_DATUM(HeapTupleGetDatum(heap_form_tuple(tupdesc, values, nulls)));
+}
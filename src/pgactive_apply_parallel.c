@@ -0,0 +1,1667 @@
+/* -------------------------------------------------------------------------
+ *
+ * pgactive_apply_parallel.c
+ *		Parallel apply of remote transactions
+ *
+ * An apply worker normally replays the transactions of its upstream one
+ * after another. When pgactive.apply_parallel_workers is set, it instead
+ * acts as the leader of a group of parallel apply workers: it buffers each
+ * remote transaction as it arrives and hands it to an idle parallel apply
+ * worker over a shm_mq, so that transactions that don't touch the same rows
+ * are applied concurrently.
+ *
+ * The leader tracks dependencies between transactions using the replica
+ * identity key values of the rows they change, or the whole relation when
+ * its key values can't be compared that way (other unique indexes,
+ * exclusion constraints, expression or non-bitwise-equal key columns). A
+ * parallel apply worker only starts applying a transaction once all earlier
+ * transactions it depends on have committed, and every transaction commits
+ * in remote commit order. That keeps replication origin progress, feedback
+ * and last-update-wins conflict resolution exactly as with serial apply.
+ *
+ * A parallel apply worker holds a heavyweight lock on the sequence number of
+ * the transaction it is applying, and workers waiting for an earlier
+ * transaction to commit wait on that lock. Should commit ordering and row
+ * locks ever deadlock, e.g. because of a dependency we failed to see, the
+ * deadlock detector resolves it instead of apply hanging; the leader then
+ * restarts and applies serially past the failed transactions.
+ *
+ * Transactions containing messages, DDL or other changes to pgactive's own
+ * catalogs, very large transactions and transactions streamed before they
+ * committed are applied by the leader itself once all parallel apply workers
+ * are idle.
+ *
+ * Parallel apply workers share the leader's replication origin session,
+ * which requires PostgreSQL 16 or later.
+ *
+ * Copyright (C) 2012-2015, PostgreSQL Global Development Group
+ *
+ * IDENTIFICATION
+ *		pgactive_apply_parallel.c
+ *
+ * -------------------------------------------------------------------------
+ */
+#include "postgres.h"
+
+#include "pgactive.h"
+
+#include "miscadmin.h"
+#include "pgstat.h"
+
+#include "access/genam.h"
+#include "access/nbtree.h"
+#include "access/table.h"
+#include "access/xact.h"
+
+#include "catalog/namespace.h"
+#include "catalog/pg_am.h"
+
+#include "common/hashfn.h"
+
+#include "libpq/pqformat.h"
+
+#include "nodes/makefuncs.h"
+
+#include "port/atomics.h"
+
+#include "postmaster/bgworker.h"
+
+#include "replication/origin.h"
+
+#include "storage/condition_variable.h"
+#include "storage/dsm.h"
+#include "storage/lock.h"
+#include "storage/proc.h"
+#include "storage/shm_mq.h"
+#include "storage/shm_toc.h"
+
+#include "utils/guc.h"
+#include "utils/hsearch.h"
+#include "utils/inval.h"
+#include "utils/memutils.h"
+#include "utils/rel.h"
+
+/* magic number and keys of the parallel apply shm_toc */
+#define PGACTIVE_PARALLEL_APPLY_MAGIC		0x70614170
+#define PGACTIVE_PARALLEL_APPLY_KEY_SHARED	1
+#define PGACTIVE_PARALLEL_APPLY_KEY_QUEUES	2
+
+/* size of the queue a parallel apply worker receives transactions on */
+#define PGACTIVE_PARALLEL_APPLY_QUEUE_SIZE	(64 * 1024)
+
+/* transactions bigger than this are applied serially by the leader */
+#define PGACTIVE_PARALLEL_APPLY_MAX_XACT_SIZE (4 * 1024 * 1024)
+
+/*
+ * Beyond this many row keys, a transaction depends on whole relations
+ * instead; beyond this many relations, it is applied serially.
+ */
+#define PGACTIVE_PARALLEL_APPLY_MAX_XACT_KEYS	10000
+#define PGACTIVE_PARALLEL_APPLY_MAX_XACT_RELS	64
+
+/* prune the leader's row key table once it grows beyond this */
+#define PGACTIVE_PARALLEL_APPLY_PRUNE_KEYS	100000
+
+/* locktag_field4 of the advisory locks used for commit ordering */
+#define PGACTIVE_PARALLEL_APPLY_LOCKTAG_FIELD4	0x7061
+
+/*
+ * Per parallel apply worker state in the shared segment.
+ */
+typedef struct pgactiveParallelApplySlot
+{
+	/* sequence number whose ordering lock the worker holds, or 0 */
+	pg_atomic_uint64 locked_seq;
+
+	/*
+	 * Local end of the commit record of the last transaction the worker
+	 * committed, or InvalidXLogRecPtr if it didn't write anything. Set
+	 * before last_committed_seq is advanced past that transaction.
+	 */
+	XLogRecPtr	local_end;
+
+	/*
+	 * Remote xid, remote commit time and local apply time of that
+	 * transaction, for the leader to publish as the last applied one. Set
+	 * along with local_end.
+	 */
+	TransactionId remote_xid;
+	TimestampTz committs;
+	TimestampTz applied_at;
+}			pgactiveParallelApplySlot;
+
+/*
+ * Shared state of a leader apply worker and its parallel apply workers.
+ */
+typedef struct pgactiveParallelApplyShared
+{
+	pid_t		leader_pid;
+	Latch	   *leader_latch;
+	RepOriginId origin_id;
+	int			nworkers;
+
+	/* set when the leader exits */
+	pg_atomic_uint32 shutdown;
+
+	/* set by parallel apply workers before they set the leader's latch */
+	pg_atomic_uint32 leader_wakeup;
+
+	/*
+	 * Sequence number of the last committed transaction. Transactions are
+	 * numbered from 1 in remote commit order.
+	 */
+	pg_atomic_uint64 last_committed_seq;
+
+	/* broadcast whenever last_committed_seq or a locked_seq changes */
+	ConditionVariable cv;
+
+	pgactiveParallelApplySlot slots[FLEXIBLE_ARRAY_MEMBER];
+}			pgactiveParallelApplyShared;
+
+/*
+ * Header of a transaction sent to a parallel apply worker, followed by the
+ * transaction's messages, each prefixed by its uint32 length.
+ */
+typedef struct pgactiveParallelApplyXactHeader
+{
+	uint64		seq;
+	/* don't start applying before this transaction is committed */
+	uint64		dep_seq;
+}			pgactiveParallelApplyXactHeader;
+
+/*
+ * Leader's state of a parallel apply worker.
+ */
+typedef struct pgactiveParallelApplyWorkerInfo
+{
+	BackgroundWorkerHandle *handle;
+	shm_mq_handle *mqh;
+	/* transaction being applied, or 0 if idle */
+	uint64		seq;
+	/* end of the remote commit record of that transaction + 1 */
+	XLogRecPtr	remote_end;
+}			pgactiveParallelApplyWorkerInfo;
+
+/*
+ * How the leader tracks dependencies of changes to a relation.
+ */
+typedef enum
+{
+	/* apply transactions changing it serially */
+	PA_REL_SERIAL,
+	/* depend on all earlier transactions changing the relation */
+	PA_REL_WHOLE,
+	/* depend on earlier transactions changing the same replica identity */
+	PA_REL_KEYED
+}			pgactiveParallelApplyRelMode;
+
+typedef struct pgactiveParallelApplyRelKey
+{
+	NameData	nspname;
+	NameData	relname;
+}			pgactiveParallelApplyRelKey;
+
+/*
+ * Leader's cache of what it needs to know about a remote relation to compute
+ * dependencies, looked up by the names the upstream sends.
+ */
+typedef struct pgactiveParallelApplyRel
+{
+	pgactiveParallelApplyRelKey key;
+	bool		valid;
+	Oid			relid;
+	pgactiveParallelApplyRelMode mode;
+	int			nkeyatts;
+	AttrNumber	keyatts[INDEX_MAX_KEYS];
+	bool		keyatt_varlena[INDEX_MAX_KEYS];
+}			pgactiveParallelApplyRel;
+
+/* last transactions that changed a relation, per relation */
+typedef struct pgactiveParallelApplyRelDep
+{
+	Oid			relid;
+	uint64		last_seq;
+	/* last of those that depended on the whole relation */
+	uint64		last_whole_seq;
+}			pgactiveParallelApplyRelDep;
+
+/* last transaction that changed a row, by hash of relation and key */
+typedef struct pgactiveParallelApplyKeyDep
+{
+	uint64		hash;
+	uint64		last_seq;
+}			pgactiveParallelApplyKeyDep;
+
+/* relation changed by the transaction being buffered */
+typedef struct pgactiveParallelApplyXactRel
+{
+	Oid			relid;
+	bool		whole;
+}			pgactiveParallelApplyXactRel;
+
+typedef enum
+{
+	/* between transactions */
+	PA_XACT_IDLE,
+	/* buffering a transaction to hand to a parallel apply worker */
+	PA_XACT_BUFFERING,
+	/* applying the current transaction ourselves */
+	PA_XACT_SERIAL
+}			pgactiveParallelApplyXactState;
+
+/* state shared by the leader and parallel apply workers */
+static pgactiveParallelApplyShared * pa_shared = NULL;
+
+/* leader state */
+static pgactiveParallelApplyWorkerInfo * pa_workers = NULL;
+static uint64 pa_next_seq = 1;
+static int	pa_ninflight = 0;
+static bool pa_latch_consumed = false;
+static pgactiveParallelApplyXactState pa_xact_state = PA_XACT_IDLE;
+static MemoryContext pa_xact_context = NULL;
+static StringInfoData pa_xact_buf;
+static XLogRecPtr pa_xact_begin_lsn;
+static pgactiveParallelApplyXactRel pa_xact_rels[PGACTIVE_PARALLEL_APPLY_MAX_XACT_RELS];
+static int	pa_xact_nrels;
+static uint64 *pa_xact_keys = NULL;
+static int	pa_xact_nkeys;
+static int	pa_xact_keys_size;
+static bool pa_xact_whole;
+static HTAB *pa_rel_cache = NULL;
+static HTAB *pa_rel_deps = NULL;
+static HTAB *pa_key_deps = NULL;
+
+/* parallel apply worker state */
+static bool pa_is_worker = false;
+static int	pa_my_idx = -1;
+static uint64 pa_current_seq = 0;
+
+static void pa_leader_shutdown(int code, Datum arg);
+static void pa_check_workers(void);
+static void pa_leader_wait(void);
+static void pa_collect_committed(void);
+static void pa_xact_begin(StringInfo msg);
+static void pa_xact_append(StringInfo msg);
+static bool pa_tuple_key_hash(StringInfo msg, pgactiveParallelApplyRel * rel,
+							  uint64 *hash);
+static bool pa_xact_track_change(StringInfo msg);
+static void pa_xact_send(XLogRecPtr remote_end);
+static void pa_xact_apply_serially(void);
+static void pa_xact_reset(void);
+static void pa_send_relation(StringInfo msg);
+static pgactiveParallelApplyRel * pa_rel_lookup(StringInfo msg);
+static void pa_rel_invalidate(Datum arg, Oid relid);
+static void pa_set_locktag(LOCKTAG *tag, uint64 seq);
+static void pa_wait_for_commit(uint64 target);
+static void pa_apply_messages(char *data, Size len);
+static void pa_worker_loop(shm_mq_handle *mqh);
+
+/*
+ * Launch parallel apply workers for the calling apply worker, if
+ * pgactive.apply_parallel_workers is set and parallel apply is possible.
+ *
+ * Must be called after the apply worker's replication origin session has
+ * been set up.
+ */
+void
+pgactive_apply_parallel_start(RepOriginId origin_id)
+{
+	pgactiveApplyWorker *apply = GetpgactiveApplyWorkerShmemPtr();
+	shm_toc_estimator e;
+	shm_toc    *toc;
+	dsm_segment *seg;
+	Size		shared_size;
+	Size		segsize;
+	char	   *mqspace;
+	int			nworkers = pgactive_apply_parallel_workers;
+	int			nlaunched = 0;
+	uint32		leader_idx;
+	int			i;
+	HASHCTL		ctl;
+
+	Assert(IspgactiveApplyWorker());
+
+	if (nworkers == 0)
+		return;
+
+#if PG_VERSION_NUM < 160000
+	ereport(WARNING,
+			(errmsg("ignoring \"pgactive.apply_parallel_workers\", parallel apply requires PostgreSQL 16 or later")));
+	return;
+#endif
+
+	/*
+	 * Catchup and limited replay have to advance other nodes' replication
+	 * origins and stop at an exact position, so leave them serial.
+	 */
+	if (apply->forward_changesets ||
+		apply->replay_stop_lsn != InvalidXLogRecPtr)
+		return;
+
+	leader_idx = pgactive_worker_slot - pgactiveWorkerCtl->slots;
+
+	shared_size = add_size(offsetof(pgactiveParallelApplyShared, slots),
+						   mul_size(nworkers, sizeof(pgactiveParallelApplySlot)));
+
+	shm_toc_initialize_estimator(&e);
+	shm_toc_estimate_chunk(&e, shared_size);
+	shm_toc_estimate_chunk(&e, mul_size(nworkers, PGACTIVE_PARALLEL_APPLY_QUEUE_SIZE));
+	shm_toc_estimate_keys(&e, 2);
+	segsize = shm_toc_estimate(&e);
+
+	seg = dsm_create(segsize, 0);
+	dsm_pin_mapping(seg);
+	toc = shm_toc_create(PGACTIVE_PARALLEL_APPLY_MAGIC,
+						 dsm_segment_address(seg), segsize);
+
+	pa_shared = shm_toc_allocate(toc, shared_size);
+	memset(pa_shared, 0, shared_size);
+	pa_shared->leader_pid = MyProcPid;
+	pa_shared->leader_latch = &MyProc->procLatch;
+	pa_shared->origin_id = origin_id;
+	pg_atomic_init_u32(&pa_shared->shutdown, 0);
+	pg_atomic_init_u32(&pa_shared->leader_wakeup, 0);
+	pg_atomic_init_u64(&pa_shared->last_committed_seq, 0);
+	ConditionVariableInit(&pa_shared->cv);
+	for (i = 0; i < nworkers; i++)
+	{
+		pg_atomic_init_u64(&pa_shared->slots[i].locked_seq, 0);
+		pa_shared->slots[i].local_end = InvalidXLogRecPtr;
+	}
+	shm_toc_insert(toc, PGACTIVE_PARALLEL_APPLY_KEY_SHARED, pa_shared);
+
+	mqspace = shm_toc_allocate(toc, mul_size(nworkers, PGACTIVE_PARALLEL_APPLY_QUEUE_SIZE));
+	shm_toc_insert(toc, PGACTIVE_PARALLEL_APPLY_KEY_QUEUES, mqspace);
+
+	pa_workers = MemoryContextAllocZero(TopMemoryContext,
+										nworkers * sizeof(pgactiveParallelApplyWorkerInfo));
+
+	before_shmem_exit(pa_leader_shutdown, (Datum) 0);
+
+	for (i = 0; i < nworkers; i++)
+	{
+		BackgroundWorker bgw;
+		pgactiveWorker *worker = NULL;
+		pgactiveApplyParallelWorker *pw;
+		uint32		slot;
+		uint32		worker_arg;
+		dsm_handle	handle = dsm_segment_handle(seg);
+		shm_mq	   *mq;
+		int			j;
+
+		/* Allocate a shmem slot, without erroring out if there's none left */
+		LWLockAcquire(pgactiveWorkerCtl->lock, LW_EXCLUSIVE);
+		for (j = 0; j < pgactive_max_workers; j++)
+		{
+			if (pgactiveWorkerCtl->slots[j].worker_type == pgactive_WORKER_EMPTY_SLOT)
+			{
+				worker = pgactive_worker_shmem_alloc(pgactive_WORKER_APPLY_PARALLEL, &slot);
+				break;
+			}
+		}
+
+		if (worker == NULL)
+		{
+			LWLockRelease(pgactiveWorkerCtl->lock);
+			break;
+		}
+
+		pw = &worker->data.apply_parallel;
+		pw->dboid = MyDatabaseId;
+		pgactive_nodeid_cpy(&pw->remote_node, &apply->remote_node);
+		pw->leader_idx = leader_idx;
+		pw->nxacts_applied = 0;
+
+		/* Tell the worker what its shmem slot is, see pgactive_bgworker_init */
+		Assert(slot <= UINT16_MAX);
+		worker_arg = (((uint32) pgactiveWorkerCtl->worker_generation) << 16) | (uint32) slot;
+		LWLockRelease(pgactiveWorkerCtl->lock);
+
+		memset(&bgw, 0, sizeof(bgw));
+		bgw.bgw_flags = BGWORKER_SHMEM_ACCESS |
+			BGWORKER_BACKEND_DATABASE_CONNECTION;
+		bgw.bgw_start_time = BgWorkerStart_RecoveryFinished;
+		bgw.bgw_restart_time = BGW_NEVER_RESTART;
+		snprintf(bgw.bgw_library_name, BGW_MAXLEN, pgactive_LIBRARY_NAME);
+		snprintf(bgw.bgw_function_name, BGW_MAXLEN, "pgactive_apply_parallel_main");
+		snprintf(bgw.bgw_type, BGW_MAXLEN, "pgactive parallel apply worker");
+		snprintf(bgw.bgw_name, BGW_MAXLEN,
+				 "pgactive parallel apply worker %d for apply worker %d",
+				 i, MyProcPid);
+		bgw.bgw_main_arg = Int32GetDatum(worker_arg);
+		bgw.bgw_notify_pid = MyProcPid;
+		memcpy(bgw.bgw_extra, &handle, sizeof(dsm_handle));
+		memcpy(bgw.bgw_extra + sizeof(dsm_handle), &i, sizeof(int));
+
+		mq = shm_mq_create(mqspace + ((Size) i) * PGACTIVE_PARALLEL_APPLY_QUEUE_SIZE,
+						   PGACTIVE_PARALLEL_APPLY_QUEUE_SIZE);
+		shm_mq_set_sender(mq, MyProc);
+
+		if (!RegisterDynamicBackgroundWorker(&bgw, &pa_workers[i].handle))
+		{
+			pgactive_worker_shmem_free(worker, NULL, true);
+			break;
+		}
+
+		pa_workers[i].mqh = shm_mq_attach(mq, seg, pa_workers[i].handle);
+		nlaunched++;
+	}
+
+	/* workers only look at the slots of launched workers */
+	pa_shared->nworkers = nlaunched;
+
+	if (nlaunched == 0)
+	{
+		ereport(WARNING,
+				(errcode(ERRCODE_CONFIGURATION_LIMIT_EXCEEDED),
+				 errmsg("could not register pgactive parallel apply workers, applying changes serially"),
+				 errhint("Consider increasing configuration parameter \"max_worker_processes\".")));
+		pa_shared = NULL;
+		pa_workers = NULL;
+		dsm_detach(seg);
+		return;
+	}
+
+	for (i = 0; i < nlaunched; i++)
+	{
+		pid_t		pid;
+
+		if (WaitForBackgroundWorkerStartup(pa_workers[i].handle, &pid) != BGWH_STARTED)
+			ereport(ERROR,
+					(errcode(ERRCODE_INSUFFICIENT_RESOURCES),
+					 errmsg("could not start pgactive parallel apply worker"),
+					 errhint("More details may be available in the server log.")));
+	}
+
+	pa_xact_context = AllocSetContextCreate(TopMemoryContext,
+											"pgactive parallel apply transaction",
+											ALLOCSET_DEFAULT_SIZES);
+
+	memset(&ctl, 0, sizeof(ctl));
+	ctl.keysize = sizeof(pgactiveParallelApplyRelKey);
+	ctl.entrysize = sizeof(pgactiveParallelApplyRel);
+	ctl.hcxt = TopMemoryContext;
+	pa_rel_cache = hash_create("pgactive parallel apply relations", 128, &ctl,
+							   HASH_ELEM | HASH_BLOBS | HASH_CONTEXT);
+
+	memset(&ctl, 0, sizeof(ctl));
+	ctl.keysize = sizeof(Oid);
+	ctl.entrysize = sizeof(pgactiveParallelApplyRelDep);
+	ctl.hcxt = TopMemoryContext;
+	pa_rel_deps = hash_create("pgactive parallel apply relation dependencies", 128, &ctl,
+							  HASH_ELEM | HASH_BLOBS | HASH_CONTEXT);
+
+	memset(&ctl, 0, sizeof(ctl));
+	ctl.keysize = sizeof(uint64);
+	ctl.entrysize = sizeof(pgactiveParallelApplyKeyDep);
+	ctl.hcxt = TopMemoryContext;
+	pa_key_deps = hash_create("pgactive parallel apply key dependencies", 1024, &ctl,
+							  HASH_ELEM | HASH_BLOBS | HASH_CONTEXT);
+
+	CacheRegisterRelcacheCallback(pa_rel_invalidate, (Datum) 0);
+
+	/* several processes count into our stats slot now */
+	pgactive_count_set_deferred(true);
+
+	elog(LOG, "pgactive apply worker using %d parallel apply workers", nlaunched);
+}
+
+/*
+ * Is the calling apply worker handing transactions to parallel apply
+ * workers?
+ */
+bool
+pgactive_apply_parallel_is_active(void)
+{
+	return pa_shared != NULL && !pa_is_worker;
+}
+
+/*
+ * Are there remote transactions received by the calling apply worker that
+ * aren't committed yet?
+ */
+bool
+pgactive_apply_parallel_in_flight(void)
+{
+	return pa_ninflight > 0 || pa_xact_state == PA_XACT_BUFFERING;
+}
+
+/*
+ * Check, and reset, whether the apply worker's latch may have been set (or
+ * reset) by parallel apply.
+ */
+bool
+pgactive_apply_parallel_consume_wakeup(void)
+{
+	bool		consumed = pa_latch_consumed;
+
+	if (!pgactive_apply_parallel_is_active())
+		return false;
+
+	pa_latch_consumed = false;
+
+	if (pg_atomic_exchange_u32(&pa_shared->leader_wakeup, 0) != 0)
+		consumed = true;
+
+	return consumed;
+}
+
+bool
+IspgactiveApplyParallelWorker(void)
+{
+	return pa_is_worker;
+}
+
+/*
+ * Terminate our parallel apply workers when the leader exits.
+ */
+static void
+pa_leader_shutdown(int code, Datum arg)
+{
+	int			i;
+
+	if (pa_shared == NULL)
+		return;
+
+	pg_atomic_write_u32(&pa_shared->shutdown, 1);
+	ConditionVariableBroadcast(&pa_shared->cv);
+
+	for (i = 0; i < pa_shared->nworkers; i++)
+		TerminateBackgroundWorker(pa_workers[i].handle);
+}
+
+/*
+ * A parallel apply worker exited. Remember to apply the transactions it might
+ * have failed on serially after restart, and error out.
+ */
+static void
+pa_worker_failed(void)
+{
+	pgactiveApplyWorker *apply = GetpgactiveApplyWorkerShmemPtr();
+	XLogRecPtr	serial_until = InvalidXLogRecPtr;
+	int			i;
+
+	for (i = 0; i < pa_shared->nworkers; i++)
+	{
+		if (pa_workers[i].seq != 0 && pa_workers[i].remote_end > serial_until)
+			serial_until = pa_workers[i].remote_end;
+	}
+
+	apply->parallel_apply_serial_until = serial_until;
+
+	ereport(ERROR,
+			(errmsg("pgactive parallel apply worker exited unexpectedly"),
+			 errdetail("Remote transactions up to %X/%X will be applied serially.",
+					   LSN_FORMAT_ARGS(serial_until))));
+}
+
+static void
+pa_check_workers(void)
+{
+	int			i;
+
+	for (i = 0; i < pa_shared->nworkers; i++)
+	{
+		pid_t		pid;
+
+		if (GetBackgroundWorkerPid(pa_workers[i].handle, &pid) != BGWH_STARTED)
+			pa_worker_failed();
+	}
+}
+
+/*
+ * Wait for a parallel apply worker to commit a transaction.
+ */
+static void
+pa_leader_wait(void)
+{
+	pa_check_workers();
+
+	(void) pgactiveWaitLatch(&MyProc->procLatch,
+							 WL_LATCH_SET | WL_TIMEOUT | WL_EXIT_ON_PM_DEATH,
+							 1000L, PG_WAIT_EXTENSION);
+	ResetLatch(&MyProc->procLatch);
+	pa_latch_consumed = true;
+
+	CHECK_FOR_INTERRUPTS();
+}
+
+/*
+ * Hand the transactions parallel apply workers committed, in commit order,
+ * over to feedback, publish the last of them as the last applied
+ * transaction, and mark the workers idle.
+ */
+static void
+pa_collect_committed(void)
+{
+	uint64		committed = pg_atomic_read_u64(&pa_shared->last_committed_seq);
+	pgactiveParallelApplySlot *last = NULL;
+
+	/* pairs with the write barrier in pgactive_apply_parallel_xact_done() */
+	pg_read_barrier();
+
+	while (pa_ninflight > 0)
+	{
+		uint64		oldest = pa_next_seq - pa_ninflight;
+		int			i;
+
+		if (oldest > committed)
+			break;
+
+		for (i = 0; i < pa_shared->nworkers; i++)
+		{
+			if (pa_workers[i].seq == oldest)
+				break;
+		}
+		Assert(i < pa_shared->nworkers);
+
+		if (pa_shared->slots[i].local_end != InvalidXLogRecPtr)
+			pgactive_apply_push_flush_position(pa_shared->slots[i].local_end,
+											   pa_workers[i].remote_end);
+
+		last = &pa_shared->slots[i];
+		pa_workers[i].seq = 0;
+		pa_ninflight--;
+	}
+
+	/*
+	 * Read under the worker control lock by
+	 * pgactive_get_last_applied_xact_info(), so it doesn't see the fields
+	 * of different transactions.
+	 */
+	if (last != NULL)
+	{
+		pgactiveApplyWorker *apply = GetpgactiveApplyWorkerShmemPtr();
+
+		LWLockAcquire(pgactiveWorkerCtl->lock, LW_EXCLUSIVE);
+		apply->last_applied_xact_id = last->remote_xid;
+		apply->last_applied_xact_committs = last->committs;
+		apply->last_applied_xact_at = last->applied_at;
+		LWLockRelease(pgactiveWorkerCtl->lock);
+	}
+}
+
+/*
+ * Collect the transactions parallel apply workers have committed. If
+ * wait_all is set, wait until all transactions handed to them are committed.
+ */
+void
+pgactive_apply_parallel_collect(bool wait_all)
+{
+	Assert(pgactive_apply_parallel_is_active());
+
+	for (;;)
+	{
+		pa_collect_committed();
+
+		if (pa_ninflight == 0 || !wait_all)
+			break;
+
+		pa_leader_wait();
+	}
+
+	if (pa_ninflight > 0)
+		pa_check_workers();
+
+	/* forget about rows only changed by committed transactions */
+	if (hash_get_num_entries(pa_key_deps) > PGACTIVE_PARALLEL_APPLY_PRUNE_KEYS)
+	{
+		HASH_SEQ_STATUS status;
+		pgactiveParallelApplyKeyDep *dep;
+		uint64		committed = pg_atomic_read_u64(&pa_shared->last_committed_seq);
+
+		hash_seq_init(&status, pa_key_deps);
+		while ((dep = hash_seq_search(&status)) != NULL)
+		{
+			if (dep->last_seq <= committed)
+				hash_search(pa_key_deps, &dep->hash, HASH_REMOVE, NULL);
+		}
+	}
+}
+
+/*
+ * Process a remote action received by a leader apply worker: buffer it as
+ * part of the transaction to hand to a parallel apply worker, or apply it
+ * ourselves.
+ *
+ * The caller's memory context must be MessageContext, see
+ * pgactive_process_remote_action().
+ */
+void
+pgactive_apply_parallel_dispatch(StringInfo s)
+{
+	StringInfoData msg;
+	char		action;
+
+	Assert(pgactive_apply_parallel_is_active());
+	Assert(CurrentMemoryContext == MessageContext);
+
+	/* look at the message without consuming it */
+	msg.data = s->data + s->cursor;
+	msg.len = s->len - s->cursor;
+	msg.maxlen = -1;
+	msg.cursor = 0;
+
+	action = msg.data[0];
+
+	/*
+	 * Relation messages describe relations for the rest of the session, so
+	 * every parallel apply worker needs them, not just the one applying the
+	 * transaction they appear in.
+	 */
+	if (action == 'R')
+	{
+		pa_send_relation(&msg);
+		pgactive_process_remote_action(s);
+		return;
+	}
+
+	switch (pa_xact_state)
+	{
+		case PA_XACT_IDLE:
+			if (action == 'B')
+			{
+				pgactiveApplyWorker *apply = GetpgactiveApplyWorkerShmemPtr();
+
+				pa_xact_begin(&msg);
+
+				if (apply->parallel_apply_serial_until != InvalidXLogRecPtr)
+				{
+					if (pa_xact_begin_lsn <= apply->parallel_apply_serial_until)
+					{
+						/* a parallel apply worker failed on this before */
+						pa_xact_apply_serially();
+						pa_xact_state = PA_XACT_SERIAL;
+						break;
+					}
+					apply->parallel_apply_serial_until = InvalidXLogRecPtr;
+				}
+
+				pa_xact_state = PA_XACT_BUFFERING;
+			}
+			else if (action == 'S' || action == 'A' ||
+					 pgactive_apply_stream_in_progress())
+			{
+				/* streamed changes are only spooled until stream commit */
+				pgactive_process_remote_action(s);
+			}
+			else
+			{
+				/* non-transactional message, or stream commit */
+				pgactive_apply_parallel_collect(true);
+				pgactive_process_remote_action(s);
+			}
+			break;
+
+		case PA_XACT_BUFFERING:
+			pa_xact_append(&msg);
+
+			if (action == 'C')
+			{
+				XLogRecPtr	commit_lsn;
+				XLogRecPtr	remote_end;
+
+				(void) pq_getmsgbyte(&msg);
+				(void) pq_getmsgint(&msg, 4);	/* flags */
+				commit_lsn = pq_getmsgint64(&msg);
+
+				/* as in process_remote_commit() */
+				remote_end = pa_xact_begin_lsn;
+				if (remote_end == commit_lsn)
+					remote_end += 1;
+
+				pa_xact_send(remote_end);
+				pa_xact_state = PA_XACT_IDLE;
+			}
+			else if (!pa_xact_track_change(&msg) ||
+					 pa_xact_buf.len > PGACTIVE_PARALLEL_APPLY_MAX_XACT_SIZE)
+			{
+				/* apply the rest of this transaction ourselves */
+				pa_xact_apply_serially();
+				pa_xact_state = PA_XACT_SERIAL;
+			}
+			break;
+
+		case PA_XACT_SERIAL:
+			pgactive_process_remote_action(s);
+
+			if (action == 'C')
+			{
+				pa_xact_reset();
+				pa_xact_state = PA_XACT_IDLE;
+			}
+			break;
+	}
+}
+
+/*
+ * Start buffering a remote transaction with its BEGIN message.
+ */
+static void
+pa_xact_begin(StringInfo msg)
+{
+	MemoryContext oldctx;
+	pgactiveParallelApplyXactHeader hdr;
+
+	/* notice relations changed locally, see pa_rel_lookup() */
+	AcceptInvalidationMessages();
+
+	(void) pq_getmsgbyte(msg);
+	(void) pq_getmsgint(msg, 4);	/* flags */
+	pa_xact_begin_lsn = pq_getmsgint64(msg);
+
+	oldctx = MemoryContextSwitchTo(pa_xact_context);
+	initStringInfo(&pa_xact_buf);
+	/* room for the header, filled in by pa_xact_send() */
+	memset(&hdr, 0, sizeof(hdr));
+	appendBinaryStringInfo(&pa_xact_buf, (char *) &hdr, sizeof(hdr));
+	pa_xact_keys_size = 64;
+	pa_xact_keys = palloc(pa_xact_keys_size * sizeof(uint64));
+	MemoryContextSwitchTo(oldctx);
+
+	pa_xact_nrels = 0;
+	pa_xact_nkeys = 0;
+	pa_xact_whole = false;
+
+	msg->cursor = 0;
+	pa_xact_append(msg);
+}
+
+static void
+pa_xact_append(StringInfo msg)
+{
+	uint32		len = msg->len;
+
+	appendBinaryStringInfo(&pa_xact_buf, (char *) &len, sizeof(uint32));
+	appendBinaryStringInfo(&pa_xact_buf, msg->data, msg->len);
+}
+
+static void
+pa_xact_reset(void)
+{
+	MemoryContextReset(pa_xact_context);
+	pa_xact_keys = NULL;
+	pa_xact_nrels = 0;
+	pa_xact_nkeys = 0;
+	pa_xact_whole = false;
+}
+
+/*
+ * Apply the transaction buffered so far ourselves, once all transactions
+ * handed to parallel apply workers are committed.
+ */
+static void
+pa_xact_apply_serially(void)
+{
+	int			off = sizeof(pgactiveParallelApplyXactHeader);
+
+	pgactive_apply_parallel_collect(true);
+
+	while (off < pa_xact_buf.len)
+	{
+		StringInfoData s;
+		uint32		len;
+
+		memcpy(&len, pa_xact_buf.data + off, sizeof(uint32));
+		off += sizeof(uint32);
+
+		s.data = pa_xact_buf.data + off;
+		s.len = len;
+		s.maxlen = -1;
+		s.cursor = 0;
+		off += len;
+
+		MemoryContextSwitchTo(MessageContext);
+		pgactive_process_remote_action(&s);
+	}
+
+	MemoryContextSwitchTo(MessageContext);
+	pa_xact_reset();
+}
+
+/*
+ * Send a relation message to all parallel apply workers, ahead of any
+ * transaction referring to the relation.
+ */
+static void
+pa_send_relation(StringInfo msg)
+{
+	pgactiveParallelApplyXactHeader hdr;
+	StringInfoData buf;
+	uint32		len = msg->len;
+	int			i;
+
+	/* seq 0 marks messages outside of any transaction */
+	memset(&hdr, 0, sizeof(hdr));
+
+	initStringInfo(&buf);
+	appendBinaryStringInfo(&buf, (char *) &hdr, sizeof(hdr));
+	appendBinaryStringInfo(&buf, (char *) &len, sizeof(uint32));
+	appendBinaryStringInfo(&buf, msg->data, msg->len);
+
+	for (i = 0; i < pa_shared->nworkers; i++)
+	{
+		shm_mq_result res;
+
+#if PG_VERSION_NUM >= 150000
+		res = shm_mq_send(pa_workers[i].mqh, buf.len, buf.data, false, true);
+#else
+		res = shm_mq_send(pa_workers[i].mqh, buf.len, buf.data, false);
+#endif
+		if (res != SHM_MQ_SUCCESS)
+			pa_worker_failed();
+	}
+
+	pfree(buf.data);
+}
+
+/*
+ * Hand the buffered transaction to an idle parallel apply worker.
+ */
+static void
+pa_xact_send(XLogRecPtr remote_end)
+{
+	pgactiveParallelApplyXactHeader hdr;
+	uint64		seq = pa_next_seq;
+	uint64		dep_seq = 0;
+	pgactiveParallelApplyWorkerInfo *w = NULL;
+	shm_mq_result res;
+	int			i;
+
+	/* compute the dependencies, and record ours for later transactions */
+	for (i = 0; i < pa_xact_nrels; i++)
+	{
+		pgactiveParallelApplyRelDep *dep;
+		bool		found;
+
+		dep = hash_search(pa_rel_deps, &pa_xact_rels[i].relid, HASH_ENTER, &found);
+		if (!found)
+		{
+			dep->last_seq = 0;
+			dep->last_whole_seq = 0;
+		}
+
+		if (pa_xact_rels[i].whole || pa_xact_whole)
+		{
+			dep_seq = Max(dep_seq, dep->last_seq);
+			dep->last_whole_seq = seq;
+		}
+		else
+			dep_seq = Max(dep_seq, dep->last_whole_seq);
+		dep->last_seq = seq;
+	}
+
+	for (i = 0; i < pa_xact_nkeys && !pa_xact_whole; i++)
+	{
+		pgactiveParallelApplyKeyDep *dep;
+		bool		found;
+
+		dep = hash_search(pa_key_deps, &pa_xact_keys[i], HASH_ENTER, &found);
+		if (!found)
+			dep->last_seq = 0;
+
+		/* the same row may be changed more than once in a transaction */
+		if (dep->last_seq != seq)
+			dep_seq = Max(dep_seq, dep->last_seq);
+		dep->last_seq = seq;
+	}
+
+	hdr.seq = seq;
+	hdr.dep_seq = dep_seq;
+	memcpy(pa_xact_buf.data, &hdr, sizeof(hdr));
+
+	/* find an idle worker, waiting for one if needed */
+	for (;;)
+	{
+		pa_collect_committed();
+
+		for (i = 0; i < pa_shared->nworkers; i++)
+		{
+			if (pa_workers[i].seq == 0)
+			{
+				w = &pa_workers[i];
+				break;
+			}
+		}
+
+		if (w != NULL)
+			break;
+
+		pa_leader_wait();
+	}
+
+	w->seq = seq;
+	w->remote_end = remote_end;
+	pa_next_seq++;
+	pa_ninflight++;
+
+#if PG_VERSION_NUM >= 150000
+	res = shm_mq_send(w->mqh, pa_xact_buf.len, pa_xact_buf.data, false, true);
+#else
+	res = shm_mq_send(w->mqh, pa_xact_buf.len, pa_xact_buf.data, false);
+#endif
+	if (res != SHM_MQ_SUCCESS)
+		pa_worker_failed();
+
+	pa_xact_reset();
+}
+
+/*
+ * Compute the hash of the replica identity of a tuple of the given relation,
+ * reading the tuple from msg.
+ *
+ * Returns false if the key can't be hashed such that equal keys have equal
+ * hashes.
+ */
+static bool
+pa_tuple_key_hash(StringInfo msg, pgactiveParallelApplyRel * rel, uint64 *hash)
+{
+	const char *keydata[INDEX_MAX_KEYS];
+	int			keylen[INDEX_MAX_KEYS];
+	char		keykind[INDEX_MAX_KEYS];
+	int			nfound = 0;
+	bool		hashable = true;
+	int			natts;
+	int			i;
+	int			k;
+
+	if (pq_getmsgbyte(msg) != 'T')
+		return false;
+
+	natts = pq_getmsgint(msg, 4);
+	for (i = 0; i < natts; i++)
+	{
+		const char *data = NULL;
+		int			len = 0;
+		char		kind = pq_getmsgbyte(msg);
+
+		if (kind == 'b' || kind == 's' || kind == 't')
+		{
+			len = pq_getmsgint(msg, 4);
+			data = pq_getmsgbytes(msg, len);
+		}
+		else if (kind != 'n' && kind != 'u')
+			return false;
+
+		for (k = 0; k < rel->nkeyatts; k++)
+		{
+			if (rel->keyatts[k] != i + 1)
+				continue;
+
+			if (data == NULL)
+				hashable = false;
+			else if (kind == 'b' && rel->keyatt_varlena[k])
+			{
+				/*
+				 * Datums are sent as stored, so the same value may come with
+				 * a different header or compressed. Hash just the data of
+				 * uncompressed ones.
+				 */
+				if (len < 1 || VARATT_IS_1B_E(data))
+					hashable = false;
+				else if (VARATT_IS_1B(data))
+				{
+					data += VARHDRSZ_SHORT;
+					len -= VARHDRSZ_SHORT;
+				}
+				else if (len < VARHDRSZ || VARATT_IS_4B_C(data))
+					hashable = false;
+				else
+				{
+					data += VARHDRSZ;
+					len -= VARHDRSZ;
+				}
+			}
+
+			keydata[k] = data;
+			keylen[k] = len;
+			keykind[k] = kind;
+			nfound++;
+		}
+	}
+
+	if (!hashable || nfound != rel->nkeyatts)
+		return false;
+
+	*hash = (uint64) rel->relid;
+	for (k = 0; k < rel->nkeyatts; k++)
+		*hash = hash_combine64(*hash,
+							   hash_bytes_extended((const unsigned char *) keydata[k],
+												   keylen[k], keykind[k]));
+
+	return true;
+}
+
+/*
+ * Record the relation and rows changed by an INSERT, UPDATE or DELETE of the
+ * buffered transaction.
+ *
+ * Returns false if the transaction has to be applied serially.
+ */
+static bool
+pa_xact_track_change(StringInfo msg)
+{
+	char		action = pq_getmsgbyte(msg);
+	pgactiveParallelApplyRel *rel;
+	bool		whole;
+	char		kind;
+	int			i;
+
+	if (action != 'I' && action != 'U' && action != 'D')
+		return false;
+
+	rel = pa_rel_lookup(msg);
+	if (rel->mode == PA_REL_SERIAL)
+		return false;
+
+	whole = (rel->mode == PA_REL_WHOLE);
+
+	/*
+	 * An INSERT has the new tuple, an UPDATE the old key if it changed and
+	 * the new tuple, a DELETE the old key unless the relation has none.
+	 */
+	while (!whole)
+	{
+		uint64		hash;
+
+		kind = pq_getmsgbyte(msg);
+		if ((kind != 'K' && kind != 'N') ||
+			!pa_tuple_key_hash(msg, rel, &hash))
+		{
+			whole = true;
+			break;
+		}
+
+		if (pa_xact_nkeys >= PGACTIVE_PARALLEL_APPLY_MAX_XACT_KEYS)
+		{
+			/* too many rows, depend on the changed relations instead */
+			pa_xact_whole = true;
+			pa_xact_nkeys = 0;
+		}
+		if (!pa_xact_whole)
+		{
+			if (pa_xact_nkeys >= pa_xact_keys_size)
+			{
+				pa_xact_keys_size *= 2;
+				pa_xact_keys = repalloc(pa_xact_keys,
+										pa_xact_keys_size * sizeof(uint64));
+			}
+			pa_xact_keys[pa_xact_nkeys++] = hash;
+		}
+
+		if (action != 'U' || kind != 'K')
+			break;
+	}
+
+	for (i = 0; i < pa_xact_nrels; i++)
+	{
+		if (pa_xact_rels[i].relid == rel->relid)
+			break;
+	}
+
+	if (i == pa_xact_nrels)
+	{
+		if (pa_xact_nrels >= PGACTIVE_PARALLEL_APPLY_MAX_XACT_RELS)
+			return false;
+
+		pa_xact_rels[i].relid = rel->relid;
+		pa_xact_rels[i].whole = false;
+		pa_xact_nrels++;
+	}
+	pa_xact_rels[i].whole |= whole;
+
+	return true;
+}
+
+/*
+ * Look up the relation of a change message, positioned at the relation
+ * names.
+ */
+static pgactiveParallelApplyRel *
+pa_rel_lookup(StringInfo msg)
+{
+	pgactiveParallelApplyRelKey key;
+	pgactiveParallelApplyRel *entry;
+	const char *nspname;
+	const char *relname;
+	int			len;
+	bool		found;
+	bool		started_tx;
+	MemoryContext oldctx;
+	Oid			relid;
+
+	memset(&key, 0, sizeof(key));
+
+	len = pq_getmsgint(msg, 2);
+	if (len == 0)
+	{
+		/* relation id, see process_remote_relation() */
+		pgactive_apply_remote_relation_names(pq_getmsgint(msg, 4),
+											 &nspname, &relname);
+	}
+	else
+	{
+		nspname = pq_getmsgbytes(msg, len);
+		len = pq_getmsgint(msg, 2);
+		relname = pq_getmsgbytes(msg, len);
+	}
+	strlcpy(NameStr(key.nspname), nspname, NAMEDATALEN);
+	strlcpy(NameStr(key.relname), relname, NAMEDATALEN);
+
+	entry = hash_search(pa_rel_cache, &key, HASH_ENTER, &found);
+	if (found && entry->valid)
+		return entry;
+
+	entry->valid = true;
+	entry->relid = InvalidOid;
+	entry->mode = PA_REL_SERIAL;
+	entry->nkeyatts = 0;
+
+	/* changes to pgactive's own catalogs, e.g. queued DDL */
+	if (strcmp(NameStr(key.nspname), pgactive_SCHEMA_NAME) == 0)
+		return entry;
+
+	oldctx = CurrentMemoryContext;
+	started_tx = !IsTransactionState();
+	if (started_tx)
+		StartTransactionCommand();
+
+	relid = RangeVarGetRelid(makeRangeVar(NameStr(key.nspname),
+										  NameStr(key.relname), -1),
+							 AccessShareLock, true);
+
+	if (OidIsValid(relid))
+	{
+		Relation	rel = table_open(relid, NoLock);
+		Oid			idxoid;
+
+		entry->relid = relid;
+
+		idxoid = RelationGetReplicaIndex(rel);
+		if (!OidIsValid(idxoid))
+#if PG_VERSION_NUM >= 180000
+			idxoid = RelationGetPrimaryKeyIndex(rel, false);
+#else
+			idxoid = RelationGetPrimaryKeyIndex(rel);
+#endif
+
+		if (rel->rd_rel->relkind == RELKIND_RELATION)
+			entry->mode = PA_REL_WHOLE;
+
+		/*
+		 * Rows with different replica identities can only conflict if there
+		 * is no other unique index or exclusion constraint, and if equal key
+		 * values are always bitwise equal.
+		 */
+		if (entry->mode == PA_REL_WHOLE && OidIsValid(idxoid))
+		{
+			List	   *indexes = RelationGetIndexList(rel);
+			ListCell   *lc;
+			bool		keyed = true;
+
+			foreach(lc, indexes)
+			{
+				Relation	idxrel = index_open(lfirst_oid(lc), AccessShareLock);
+
+				if (RelationGetRelid(idxrel) == idxoid)
+				{
+					int			i;
+
+					if (idxrel->rd_rel->relam != BTREE_AM_OID ||
+						!_bt_allequalimage(idxrel, false))
+						keyed = false;
+
+					for (i = 0; keyed && i < IndexRelationGetNumberOfKeyAttributes(idxrel); i++)
+					{
+						AttrNumber	attnum = idxrel->rd_index->indkey.values[i];
+
+						if (attnum <= 0)
+						{
+							keyed = false;
+							break;
+						}
+
+						entry->keyatts[i] = attnum;
+						entry->keyatt_varlena[i] =
+							TupleDescAttr(RelationGetDescr(rel), attnum - 1)->attlen == -1;
+						entry->nkeyatts = i + 1;
+					}
+				}
+				else if (idxrel->rd_index->indisunique ||
+						 idxrel->rd_index->indisexclusion)
+					keyed = false;
+
+				index_close(idxrel, AccessShareLock);
+			}
+			list_free(indexes);
+
+			if (keyed && entry->nkeyatts > 0)
+				entry->mode = PA_REL_KEYED;
+		}
+
+		table_close(rel, NoLock);
+	}
+
+	if (started_tx)
+		CommitTransactionCommand();
+	MemoryContextSwitchTo(oldctx);
+
+	return entry;
+}
+
+static void
+pa_rel_invalidate(Datum arg, Oid relid)
+{
+	HASH_SEQ_STATUS status;
+	pgactiveParallelApplyRel *entry;
+
+	if (pa_rel_cache == NULL)
+		return;
+
+	hash_seq_init(&status, pa_rel_cache);
+	while ((entry = hash_seq_search(&status)) != NULL)
+	{
+		if (relid == InvalidOid || entry->relid == relid ||
+			entry->relid == InvalidOid)
+			entry->valid = false;
+	}
+}
+
+static void
+pa_set_locktag(LOCKTAG *tag, uint64 seq)
+{
+	SET_LOCKTAG_ADVISORY(*tag, MyDatabaseId, (uint32) pa_shared->leader_pid,
+						 (uint32) seq, PGACTIVE_PARALLEL_APPLY_LOCKTAG_FIELD4);
+}
+
+/*
+ * Wait until the remote transaction with the given sequence number, and so
+ * all before it, is committed.
+ *
+ * Where possible we wait on the ordering lock of the oldest uncommitted
+ * transaction, so that the deadlock detector sees whom we're waiting for.
+ */
+static void
+pa_wait_for_commit(uint64 target)
+{
+	uint64		waited_on = 0;
+
+	ConditionVariablePrepareToSleep(&pa_shared->cv);
+
+	for (;;)
+	{
+		uint64		next;
+		int			i;
+
+		next = pg_atomic_read_u64(&pa_shared->last_committed_seq) + 1;
+		if (next > target)
+			break;
+
+		if (pg_atomic_read_u32(&pa_shared->shutdown) != 0)
+			ereport(ERROR,
+					(errmsg("pgactive apply worker exited, parallel apply worker exiting")));
+
+		if (next != waited_on)
+		{
+			for (i = 0; i < pa_shared->nworkers; i++)
+			{
+				if (i != pa_my_idx &&
+					pg_atomic_read_u64(&pa_shared->slots[i].locked_seq) == next)
+				{
+					LOCKTAG		tag;
+
+					ConditionVariableCancelSleep();
+					pa_set_locktag(&tag, next);
+					(void) LockAcquire(&tag, ShareLock, true, false);
+					LockRelease(&tag, ShareLock, true);
+					ConditionVariablePrepareToSleep(&pa_shared->cv);
+
+					waited_on = next;
+					break;
+				}
+			}
+
+			if (waited_on == next)
+				continue;
+		}
+
+		ConditionVariableSleep(&pa_shared->cv, PG_WAIT_EXTENSION);
+	}
+
+	ConditionVariableCancelSleep();
+}
+
+/*
+ * Wait until it's the turn of the transaction being applied by this parallel
+ * apply worker to commit.
+ */
+void
+pgactive_apply_parallel_wait_turn(void)
+{
+	Assert(pa_is_worker && pa_current_seq != 0);
+
+	pa_wait_for_commit(pa_current_seq - 1);
+}
+
+/*
+ * Tell the leader and the other parallel apply workers that this worker
+ * committed its transaction, ending locally at local_end, and what the
+ * leader is to publish as the last applied transaction.
+ */
+void
+pgactive_apply_parallel_xact_done(XLogRecPtr local_end,
+								  TransactionId remote_xid,
+								  TimestampTz committs,
+								  TimestampTz applied_at)
+{
+	LOCKTAG		tag;
+	pgactiveParallelApplySlot *slot = &pa_shared->slots[pa_my_idx];
+
+	Assert(pa_is_worker && pa_current_seq != 0);
+	Assert(pg_atomic_read_u64(&pa_shared->last_committed_seq) == pa_current_seq - 1);
+
+	slot->local_end = local_end;
+	slot->remote_xid = remote_xid;
+	slot->committs = committs;
+	slot->applied_at = applied_at;
+	pg_write_barrier();
+	pg_atomic_write_u64(&pa_shared->last_committed_seq, pa_current_seq);
+	pg_atomic_write_u64(&slot->locked_seq, 0);
+
+	pa_set_locktag(&tag, pa_current_seq);
+	LockRelease(&tag, ExclusiveLock, true);
+
+	ConditionVariableBroadcast(&pa_shared->cv);
+	pg_atomic_write_u32(&pa_shared->leader_wakeup, 1);
+	SetLatch(pa_shared->leader_latch);
+
+	pgactive_worker_slot->data.apply_parallel.nxacts_applied++;
+	pgactive_count_flush();
+
+	pa_current_seq = 0;
+}
+
+/*
+ * Apply the length-prefixed messages of a buffer received from the leader.
+ */
+static void
+pa_apply_messages(char *data, Size len)
+{
+	Size		off = 0;
+
+	while (off < len)
+	{
+		StringInfoData s;
+		uint32		msglen;
+
+		memcpy(&msglen, data + off, sizeof(uint32));
+		off += sizeof(uint32);
+
+		s.data = data + off;
+		s.len = msglen;
+		s.maxlen = -1;
+		s.cursor = 0;
+		off += msglen;
+
+		MemoryContextSwitchTo(MessageContext);
+		pgactive_process_remote_action(&s);
+	}
+}
+
+/*
+ * Apply a transaction received from the leader.
+ */
+static void
+pa_apply_xact(char *data, Size len)
+{
+	pgactiveParallelApplyXactHeader hdr;
+	LOCKTAG		tag;
+	Size		off = sizeof(hdr);
+
+	memcpy(&hdr, data, sizeof(hdr));
+
+	/* relation messages, see pa_send_relation() */
+	if (hdr.seq == 0)
+	{
+		pa_apply_messages(data + off, len - off);
+		return;
+	}
+
+	/* let others wait for our commit on the lock */
+	pa_set_locktag(&tag, hdr.seq);
+	(void) LockAcquire(&tag, ExclusiveLock, true, false);
+	pg_atomic_write_u64(&pa_shared->slots[pa_my_idx].locked_seq, hdr.seq);
+	ConditionVariableBroadcast(&pa_shared->cv);
+
+	pa_current_seq = hdr.seq;
+
+	if (hdr.dep_seq != 0)
+		pa_wait_for_commit(hdr.dep_seq);
+
+	pa_apply_messages(data + off, len - off);
+
+	if (pa_current_seq != 0)
+		elog(ERROR, "parallel apply transaction %llu ended without commit",
+			 (unsigned long long) hdr.seq);
+}
+
+static void
+pa_worker_loop(shm_mq_handle *mqh)
+{
+	for (;;)
+	{
+		Size		len;
+		void	   *data;
+		shm_mq_result res;
+
+		CHECK_FOR_INTERRUPTS();
+
+		if (ConfigReloadPending)
+		{
+			ConfigReloadPending = false;
+			ProcessConfigFile(PGC_SIGHUP);
+			/* set log_min_messages */
+			SetConfigOption("log_min_messages", pgactive_error_severity(pgactive_log_min_messages),
+							PGC_POSTMASTER, PGC_S_OVERRIDE);
+		}
+
+		/* wait on our latch ourselves, so reloads don't wait for a message */
+		res = shm_mq_receive(mqh, &len, &data, true);
+
+		if (res == SHM_MQ_WOULD_BLOCK)
+		{
+			(void) pgactiveWaitLatch(&MyProc->procLatch,
+									 WL_LATCH_SET | WL_EXIT_ON_PM_DEATH,
+									 -1L, PG_WAIT_EXTENSION);
+			ResetLatch(&MyProc->procLatch);
+			continue;
+		}
+
+		/* the leader exited */
+		if (res == SHM_MQ_DETACHED)
+			return;
+
+		Assert(res == SHM_MQ_SUCCESS);
+
+		pa_apply_xact(data, len);
+	}
+}
+
+/*
+ * Entry point for a pgactive parallel apply worker.
+ */
+void
+pgactive_apply_parallel_main(Datum main_arg)
+{
+	dsm_handle	handle;
+	dsm_segment *seg;
+	shm_toc    *toc;
+	shm_mq	   *mq;
+	shm_mq_handle *mqh;
+	pgactiveWorker *leader;
+
+	memcpy(&handle, MyBgworkerEntry->bgw_extra, sizeof(dsm_handle));
+	memcpy(&pa_my_idx, MyBgworkerEntry->bgw_extra + sizeof(dsm_handle), sizeof(int));
+
+	pgactive_bgworker_init(DatumGetInt32(main_arg), pgactive_WORKER_APPLY_PARALLEL);
+
+	pa_is_worker = true;
+
+	seg = dsm_attach(handle);
+	if (seg == NULL)
+		ereport(ERROR,
+				(errcode(ERRCODE_OBJECT_NOT_IN_PREREQUISITE_STATE),
+				 errmsg("could not map dynamic shared memory segment")));
+	dsm_pin_mapping(seg);
+
+	toc = shm_toc_attach(PGACTIVE_PARALLEL_APPLY_MAGIC, dsm_segment_address(seg));
+	if (toc == NULL)
+		ereport(ERROR,
+				(errcode(ERRCODE_OBJECT_NOT_IN_PREREQUISITE_STATE),
+				 errmsg("invalid magic number in dynamic shared memory segment")));
+
+	pa_shared = shm_toc_lookup(toc, PGACTIVE_PARALLEL_APPLY_KEY_SHARED, false);
+	mq = (shm_mq *) ((char *) shm_toc_lookup(toc, PGACTIVE_PARALLEL_APPLY_KEY_QUEUES, false) +
+					 ((Size) pa_my_idx) * PGACTIVE_PARALLEL_APPLY_QUEUE_SIZE);
+	shm_mq_set_receiver(mq, MyProc);
+	mqh = shm_mq_attach(mq, seg, NULL);
+
+	/* apply on behalf of the leader apply worker */
+	leader = &pgactiveWorkerCtl->slots[pgactive_worker_slot->data.apply_parallel.leader_idx];
+	pgactive_apply_setup_parallel_worker(&leader->data.apply);
+
+	CurrentResourceOwner = ResourceOwnerCreate(NULL, "pgactive parallel apply top-level resource owner");
+	pgactive_saved_resowner = CurrentResourceOwner;
+
+	/* share the leader's replication origin session */
+	StartTransactionCommand();
+#if PG_VERSION_NUM >= 160000
+	replorigin_session_setup(pa_shared->origin_id, pa_shared->leader_pid);
+#else
+	elog(ERROR, "parallel apply requires PostgreSQL 16 or later");
+#endif
+	CommitTransactionCommand();
+	replorigin_session_origin = pa_shared->origin_id;
+
+	pgactive_count_set_current_node(pa_shared->origin_id);
+	pgactive_count_set_deferred(true);
+
+	pgactive_conflict_logging_startup();
+
+	pgstat_report_activity(STATE_IDLE, NULL);
+
+	PG_TRY();
+	{
+		pa_worker_loop(mqh);
+	}
+	PG_CATCH();
+	{
+		if (IsTransactionState())
+			pgactive_count_rollback();
+		pgactive_count_flush();
+		PG_RE_THROW();
+	}
+	PG_END_TRY();
+
+	proc_exit(0);
+}
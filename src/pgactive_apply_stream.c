@@ -0,0 +1,376 @@
+/* -------------------------------------------------------------------------
+ *
+ * pgactive_apply_stream.c
+ *		Apply of remote transactions streamed while in progress
+ *
+ * When a remote transaction exceeds logical_decoding_work_mem, the upstream
+ * output plugin streams its changes in chunks before it commits instead of
+ * spilling them to disk there and sending them all at commit. Each chunk is
+ * enclosed in stream start ('S') and stream stop ('E') messages, and chunks
+ * of different transactions may be interleaved with each other and with
+ * regular transactions.
+ *
+ * The apply worker spools the changes of each streamed transaction to a
+ * temporary file, so memory use stays bounded no matter how large the
+ * transaction is. Aborted (sub)transactions are discarded from the spool file
+ * on stream abort ('A'). On stream commit ('c'), the spooled changes are
+ * applied like a regular transaction, in remote commit order.
+ *
+ * Copyright (C) 2012-2015, PostgreSQL Global Development Group
+ *
+ * IDENTIFICATION
+ *		pgactive_apply_stream.c
+ *
+ * -------------------------------------------------------------------------
+ */
+#include "postgres.h"
+
+#include "pgactive.h"
+
+#include "libpq/pqformat.h"
+
+#include "storage/buffile.h"
+
+#include "utils/hsearch.h"
+#include "utils/memutils.h"
+
+/*
+ * Where a subtransaction's changes start in the spool file.
+ */
+typedef struct pgactiveStreamSubXact
+{
+	TransactionId xid;
+	int			fileno;
+	off_t		offset;
+	off_t		size;
+}			pgactiveStreamSubXact;
+
+/*
+ * Spooled changes of a streamed remote transaction.
+ */
+typedef struct pgactiveStreamXact
+{
+	TransactionId xid;			/* hash key */
+	BufFile    *file;
+	/* bytes spooled, not counting aborted subtransactions */
+	off_t		size;
+	int			nsubxacts;
+	int			maxsubxacts;
+	pgactiveStreamSubXact *subxacts;
+}			pgactiveStreamXact;
+
+static HTAB *StreamXactHash = NULL;
+static MemoryContext StreamContext = NULL;
+
+/* transaction whose chunk is being received, NULL outside of chunks */
+static pgactiveStreamXact * stream_xact = NULL;
+
+static pgactiveStreamXact * stream_xact_lookup(TransactionId xid, bool create);
+static void stream_xact_discard(pgactiveStreamXact * xact);
+
+/*
+ * Is a chunk of a streamed transaction being received, so that changes must
+ * be passed to pgactive_apply_stream_spool()?
+ */
+bool
+pgactive_apply_stream_in_progress(void)
+{
+	return stream_xact != NULL;
+}
+
+/*
+ * Process a stream start message, opening the spool file of the transaction
+ * on its first chunk.
+ */
+void
+pgactive_apply_stream_start(StringInfo s)
+{
+	TransactionId xid = pq_getmsgint(s, 4);
+
+	if (stream_xact != NULL)
+		ereport(ERROR,
+				(errcode(ERRCODE_PROTOCOL_VIOLATION),
+				 errmsg("stream start for remote transaction %u inside stream of remote transaction %u",
+						xid, stream_xact->xid)));
+
+	stream_xact = stream_xact_lookup(xid, true);
+}
+
+/*
+ * Process a stream stop message.
+ */
+void
+pgactive_apply_stream_stop(void)
+{
+	if (stream_xact == NULL)
+		ereport(ERROR,
+				(errcode(ERRCODE_PROTOCOL_VIOLATION),
+				 errmsg("stream stop outside of a stream")));
+
+	stream_xact = NULL;
+}
+
+/*
+ * Spool a change of the transaction being streamed. The action has been
+ * read, the message continues with the xid of the (sub)transaction that made
+ * the change and the change as sent for regular transactions.
+ */
+void
+pgactive_apply_stream_spool(char action, StringInfo s)
+{
+	pgactiveStreamXact *xact = stream_xact;
+	TransactionId subxid = pq_getmsgint(s, 4);
+	uint32		len = 1 + s->len - s->cursor;
+
+	Assert(xact != NULL);
+
+	/*
+	 * Remember where a subtransaction's changes start, so they can be
+	 * discarded should it abort. Everything spooled after that belongs to it
+	 * or to its subtransactions.
+	 */
+	if (subxid != xact->xid &&
+		(xact->nsubxacts == 0 ||
+		 xact->subxacts[xact->nsubxacts - 1].xid != subxid))
+	{
+		pgactiveStreamSubXact *sub;
+		int			i;
+
+		for (i = 0; i < xact->nsubxacts; i++)
+		{
+			if (xact->subxacts[i].xid == subxid)
+				break;
+		}
+
+		if (i == xact->nsubxacts)
+		{
+			if (xact->nsubxacts == xact->maxsubxacts)
+			{
+				xact->maxsubxacts *= 2;
+				xact->subxacts = repalloc(xact->subxacts,
+										  xact->maxsubxacts * sizeof(pgactiveStreamSubXact));
+			}
+
+			sub = &xact->subxacts[xact->nsubxacts++];
+			sub->xid = subxid;
+			BufFileTell(xact->file, &sub->fileno, &sub->offset);
+			sub->size = xact->size;
+		}
+	}
+
+	BufFileWrite(xact->file, &len, sizeof(uint32));
+	BufFileWrite(xact->file, &action, 1);
+	BufFileWrite(xact->file, s->data + s->cursor, len - 1);
+	xact->size += sizeof(uint32) + len;
+
+	s->cursor = s->len;
+}
+
+/*
+ * Process a stream abort message, discarding the spooled changes of the
+ * aborted transaction or subtransaction.
+ */
+void
+pgactive_apply_stream_abort(StringInfo s)
+{
+	TransactionId xid = pq_getmsgint(s, 4);
+	TransactionId subxid = pq_getmsgint(s, 4);
+	pgactiveStreamXact *xact;
+	int			i;
+
+	xact = stream_xact_lookup(xid, false);
+
+	/* nothing was streamed for it since we (re)connected */
+	if (xact == NULL)
+		return;
+
+	if (subxid == xid)
+	{
+		stream_xact_discard(xact);
+		return;
+	}
+
+	for (i = 0; i < xact->nsubxacts; i++)
+	{
+		pgactiveStreamSubXact *sub = &xact->subxacts[i];
+
+		if (sub->xid == subxid)
+		{
+			/* later writes overwrite what was spooled from here on */
+			if (BufFileSeek(xact->file, sub->fileno, sub->offset, SEEK_SET) != 0)
+				ereport(ERROR,
+						(errcode_for_file_access(),
+						 errmsg("could not seek in spool file of remote transaction %u: %m",
+								xid)));
+			xact->size = sub->size;
+			xact->nsubxacts = i;
+			break;
+		}
+	}
+}
+
+/*
+ * Process a stream commit message: apply the spooled changes as a regular
+ * transaction, framed by BEGIN and COMMIT messages made up from the stream
+ * commit message.
+ *
+ * Must be called in MessageContext, which is reset after each spooled change
+ * as the apply loop would between messages.
+ */
+void
+pgactive_apply_stream_commit(StringInfo s)
+{
+	TransactionId xid = pq_getmsgint(s, 4);
+	pgactiveStreamXact *xact;
+	StringInfoData commit;
+	StringInfoData msg;
+	StringInfoData buf;
+	XLogRecPtr	end_lsn;
+	TimestampTz committime;
+	off_t		done = 0;
+
+	Assert(CurrentMemoryContext == MessageContext);
+
+	if (stream_xact != NULL)
+		ereport(ERROR,
+				(errcode(ERRCODE_PROTOCOL_VIOLATION),
+				 errmsg("stream commit of remote transaction %u inside stream of remote transaction %u",
+						xid, stream_xact->xid)));
+
+	xact = stream_xact_lookup(xid, false);
+	if (xact == NULL)
+		ereport(ERROR,
+				(errcode(ERRCODE_PROTOCOL_VIOLATION),
+				 errmsg("stream commit of unknown remote transaction %u", xid)));
+
+	/* the rest is a regular COMMIT message */
+	commit.data = s->data + s->cursor;
+	commit.len = s->len - s->cursor;
+	commit.maxlen = -1;
+	commit.cursor = 0;
+
+	(void) pq_getmsgint(&commit, 4);	/* flags */
+	(void) pq_getmsgint64(&commit); /* commit_lsn */
+	end_lsn = pq_getmsgint64(&commit);
+	committime = pq_getmsgint64(&commit);
+
+	MemoryContextSwitchTo(StreamContext);
+
+	/* as sent by pg_decode_begin_txn() */
+	initStringInfo(&msg);
+	pq_sendbyte(&msg, 'B');
+	pq_sendint(&msg, 0, 4);
+	pq_sendint64(&msg, end_lsn);
+	pq_sendint64(&msg, committime);
+	pq_sendint(&msg, xid, 4);
+
+	MemoryContextSwitchTo(MessageContext);
+	pgactive_process_remote_action(&msg);
+	MemoryContextReset(MessageContext);
+
+	MemoryContextSwitchTo(StreamContext);
+	initStringInfo(&buf);
+
+	if (BufFileSeek(xact->file, 0, 0, SEEK_SET) != 0)
+		ereport(ERROR,
+				(errcode_for_file_access(),
+				 errmsg("could not seek in spool file of remote transaction %u: %m",
+						xid)));
+
+	while (done < xact->size)
+	{
+		uint32		len;
+
+		if (BufFileRead(xact->file, &len, sizeof(uint32)) != sizeof(uint32))
+			ereport(ERROR,
+					(errcode_for_file_access(),
+					 errmsg("could not read from spool file of remote transaction %u: %m",
+							xid)));
+
+		resetStringInfo(&buf);
+		enlargeStringInfo(&buf, len);
+		if (BufFileRead(xact->file, buf.data, len) != len)
+			ereport(ERROR,
+					(errcode_for_file_access(),
+					 errmsg("could not read from spool file of remote transaction %u: %m",
+							xid)));
+		buf.len = len;
+		buf.cursor = 0;
+		done += sizeof(uint32) + len;
+
+		MemoryContextSwitchTo(MessageContext);
+		pgactive_process_remote_action(&buf);
+		MemoryContextReset(MessageContext);
+
+		CHECK_FOR_INTERRUPTS();
+	}
+
+	/* as sent by pg_decode_commit_txn() */
+	resetStringInfo(&buf);
+	pq_sendbyte(&buf, 'C');
+	appendBinaryStringInfo(&buf, commit.data, commit.len);
+
+	MemoryContextSwitchTo(MessageContext);
+	pgactive_process_remote_action(&buf);
+
+	stream_xact_discard(xact);
+	MemoryContextReset(StreamContext);
+
+	s->cursor = s->len;
+}
+
+static pgactiveStreamXact *
+stream_xact_lookup(TransactionId xid, bool create)
+{
+	pgactiveStreamXact *xact;
+	bool		found;
+
+	if (StreamXactHash == NULL)
+	{
+		HASHCTL		ctl;
+
+		if (!create)
+			return NULL;
+
+		StreamContext = AllocSetContextCreate(TopMemoryContext,
+											  "pgactive stream apply",
+											  ALLOCSET_DEFAULT_SIZES);
+
+		memset(&ctl, 0, sizeof(ctl));
+		ctl.keysize = sizeof(TransactionId);
+		ctl.entrysize = sizeof(pgactiveStreamXact);
+		ctl.hcxt = TopMemoryContext;
+		StreamXactHash = hash_create("pgactive streamed transactions", 16,
+									 &ctl, HASH_ELEM | HASH_BLOBS | HASH_CONTEXT);
+	}
+
+	xact = hash_search(StreamXactHash, &xid,
+					   create ? HASH_ENTER : HASH_FIND, &found);
+
+	if (create && !found)
+	{
+		MemoryContext oldctx = MemoryContextSwitchTo(TopMemoryContext);
+
+		/* the spool file outlives the transactions applied meanwhile */
+		xact->file = BufFileCreateTemp(true);
+		xact->size = 0;
+		xact->nsubxacts = 0;
+		xact->maxsubxacts = 16;
+		xact->subxacts = palloc(xact->maxsubxacts * sizeof(pgactiveStreamSubXact));
+
+		MemoryContextSwitchTo(oldctx);
+	}
+
+	return xact;
+}
+
+static void
+stream_xact_discard(pgactiveStreamXact * xact)
+{
+	TransactionId xid = xact->xid;
+
+	BufFileClose(xact->file);
+	pfree(xact->subxacts);
+
+	(void) hash_search(StreamXactHash, &xid, HASH_REMOVE, NULL);
+}
@@ -23,6 +23,7 @@
 #include "access/heapam.h"
 
 #include "catalog/namespace.h"
+#include "catalog/pg_inherits.h"
 
 #include "commands/dbcommands.h"
 #include "commands/event_trigger.h"
@@ -192,15 +193,23 @@ filter_CreateStmt(Node *parsetree,
 	}
 }
 
+/*
+ * Check an ALTER TABLE and determine the global lock it needs. A write lock
+ * is limited to the relations returned in relids if possible, NIL meaning
+ * the whole database.
+ */
 static void
 filter_AlterTableStmt(Node *parsetree,
 					  const char *completionTag,
 					  const char *queryString,
-					  pgactiveLockType * lock_type)
+					  pgactiveLockType * lock_type,
+					  List **relids)
 {
 	AlterTableStmt *astmt;
 	ListCell   *cell1;
 	bool		hasInvalid;
+	List	   *fkrelids = NIL;
+	bool		lock_database = false;
 #if PG_VERSION_NUM >= 130000
 	AlterTableStmt *stmts = makeNode(AlterTableStmt);
 	List	   *beforeStmts;
@@ -212,6 +221,8 @@ filter_AlterTableStmt(Node *parsetree,
 	Oid			relid;
 	LOCKMODE	lockmode;
 
+	*relids = NIL;
+
 	/*
 	 * replace pgactive_permit_unsafe_commands by
 	 * pgactive_skip_ddl_replication for now
@@ -380,6 +391,18 @@ filter_AlterTableStmt(Node *parsetree,
 												   "ALTER TABLE ... ADD CONSTRAINT ... EXCLUDE",
 												   lockmode,
 												   astmt->missing_ok);
+
+						/* validating the key reads the referenced table too */
+						if (con->contype == CONSTR_FOREIGN)
+						{
+							Oid			pkrelid = RangeVarGetRelid(con->pktable,
+																   NoLock, true);
+
+							if (OidIsValid(pkrelid))
+								fkrelids = list_append_unique_oid(fkrelids, pkrelid);
+							else
+								lock_database = true;
+						}
 					}
 					break;
 
@@ -506,6 +529,23 @@ filter_AlterTableStmt(Node *parsetree,
 							   "This variant of ALTER TABLE",
 							   lockmode,
 							   astmt->missing_ok);
+
+	/*
+	 * Peers only need to stop writes to the table, the inheritance children
+	 * the command recurses to and the tables referenced by new foreign keys.
+	 */
+	if (*lock_type == pgactive_LOCK_WRITE && !lock_database &&
+		OidIsValid(relid) &&
+		(get_rel_relkind(relid) == RELKIND_RELATION ||
+		 get_rel_relkind(relid) == RELKIND_PARTITIONED_TABLE))
+	{
+		if (astmt->relation->inh)
+			*relids = find_all_inheritors(relid, NoLock, NULL);
+		else
+			*relids = list_make1_oid(relid);
+
+		*relids = list_concat_unique_oid(*relids, fkrelids);
+	}
 }
 
 static void
@@ -882,6 +922,9 @@ pgactive_commandfilter(PlannedStmt *pstmt,
 	/* take strongest lock by default. */
 	pgactiveLockType lock_type = pgactive_LOCK_WRITE;
 
+	/* relations a write lock is limited to, NIL for the whole database */
+	List	   *lock_relids = NIL;
+
 	/*
 	 * Only pgactive can create/drop/alter pgactive node identifier getter
 	 * function on local node i.e. no replication to other pgactive members.
@@ -1228,9 +1271,9 @@ pgactive_commandfilter(PlannedStmt *pstmt,
 
 		case T_AlterTableStmt:
 #if PG_VERSION_NUM >= 130000
-			filter_AlterTableStmt(parsetree, GetCommandTagName(CreateCommandTag(parsetree)), queryString, &lock_type);
+			filter_AlterTableStmt(parsetree, GetCommandTagName(CreateCommandTag(parsetree)), queryString, &lock_type, &lock_relids);
 #else
-			filter_AlterTableStmt(parsetree, completionTag, queryString, &lock_type);
+			filter_AlterTableStmt(parsetree, completionTag, queryString, &lock_type, &lock_relids);
 #endif
 			break;
 
@@ -1552,7 +1595,7 @@ pgactive_commandfilter(PlannedStmt *pstmt,
 	 */
 	if (!pgactive_skip_ddl_replication && !affects_only_nonpermanent
 		&& lock_type != pgactive_LOCK_NOLOCK)
-		pgactive_acquire_ddl_lock(lock_type);
+		pgactive_acquire_ddl_lock(lock_type, lock_relids);
 
 	/*
 	 * Many top level DDL statements trigger subsequent actions that also
@@ -0,0 +1,270 @@
+/* -------------------------------------------------------------------------
+ *
+ * pgactive_compress.c
+ *		Compression of the messages the output plugin sends
+ *
+ * An apply worker may ask its upstream to compress the messages it sends
+ * with lz4 or zstd, see pgactive.apply_compression. The output plugin then
+ * compresses every message at least pgactive.apply_compression_threshold
+ * bytes long that gets smaller by it, and sends it as:
+ *
+ *   'Z', the compression method (byte), the uncompressed length (int32),
+ *   the compressed message
+ *
+ * in place of the message. No other message starts with 'Z'. The apply
+ * worker restores the message before processing it, so the rest of the
+ * protocol is the same either way. Only the methods this server was built
+ * with are available; an upstream that lacks the requested method sends
+ * uncompressed messages.
+ *
+ * Copyright (C) 2012-2015, PostgreSQL Global Development Group
+ *
+ * IDENTIFICATION
+ *		pgactive_compress.c
+ *
+ * -------------------------------------------------------------------------
+ */
+#include "postgres.h"
+
+#ifdef USE_LZ4
+#include <lz4.h>
+#endif
+#ifdef USE_ZSTD
+#include <zstd.h>
+#endif
+
+#include "pgactive.h"
+
+#include "libpq/pqformat.h"
+
+#include "utils/memutils.h"
+
+/* 'Z', method and uncompressed length */
+#define COMPRESSED_HEADER_SIZE (1 + 1 + 4)
+
+/*
+ * Messages up to this size are compressed and restored in buffers kept
+ * around; larger ones get their own, so one huge message doesn't keep its
+ * memory allocated.
+ */
+#define COMPRESS_BUFFER_KEEP (1024 * 1024)
+
+static char *compress_buffer = NULL;
+static int	compress_buffer_size = 0;
+
+static char *decompress_buffer = NULL;
+static int	decompress_buffer_size = 0;
+
+#ifdef USE_ZSTD
+static ZSTD_CCtx *zstd_cctx = NULL;
+static ZSTD_DCtx *zstd_dctx = NULL;
+#endif
+
+/*
+ * Name of a compression method, as used by the output plugin option.
+ */
+const char *
+pgactive_compression_name(pgactiveCompression method)
+{
+	switch (method)
+	{
+		case pgactive_COMPRESSION_NONE:
+			return "none";
+		case pgactive_COMPRESSION_LZ4:
+			return "lz4";
+		case pgactive_COMPRESSION_ZSTD:
+			return "zstd";
+	}
+
+	return "unknown";
+}
+
+/*
+ * Look up a compression method by name. Returns false if this build doesn't
+ * support it.
+ */
+bool
+pgactive_compression_from_name(const char *name, pgactiveCompression * method)
+{
+	if (strcmp(name, "none") == 0)
+	{
+		*method = pgactive_COMPRESSION_NONE;
+		return true;
+	}
+#ifdef USE_LZ4
+	if (strcmp(name, "lz4") == 0)
+	{
+		*method = pgactive_COMPRESSION_LZ4;
+		return true;
+	}
+#endif
+#ifdef USE_ZSTD
+	if (strcmp(name, "zstd") == 0)
+	{
+		*method = pgactive_COMPRESSION_ZSTD;
+		return true;
+	}
+#endif
+
+	return false;
+}
+
+/*
+ * Get a buffer of at least size bytes, reusing *buffer if it's small enough
+ * to keep.
+ */
+static char *
+compress_get_buffer(char **buffer, int *buffer_size, int size)
+{
+	if (size > COMPRESS_BUFFER_KEEP)
+		return palloc(size);
+
+	if (*buffer_size < size)
+	{
+		if (*buffer != NULL)
+			pfree(*buffer);
+		*buffer = MemoryContextAlloc(TopMemoryContext, size);
+		*buffer_size = size;
+	}
+
+	return *buffer;
+}
+
+/*
+ * Compress the message in out, starting at offset start, with method, if
+ * that makes it smaller. Whatever precedes the message in out, like the
+ * header of a walsender's CopyData message, is left alone.
+ */
+void
+pgactive_compress_message(pgactiveCompression method, StringInfo out, int start)
+{
+	const char *raw = out->data + start;
+	int			raw_len = out->len - start;
+	char	   *buf = NULL;
+	int			bound = 0;
+	int			len = 0;
+
+	switch (method)
+	{
+		case pgactive_COMPRESSION_NONE:
+			return;
+		case pgactive_COMPRESSION_LZ4:
+#ifdef USE_LZ4
+			bound = LZ4_compressBound(raw_len);
+			buf = compress_get_buffer(&compress_buffer, &compress_buffer_size,
+									  bound);
+			len = LZ4_compress_default(raw, buf, raw_len, bound);
+#endif
+			break;
+		case pgactive_COMPRESSION_ZSTD:
+#ifdef USE_ZSTD
+			{
+				size_t		zlen;
+
+				if (zstd_cctx == NULL)
+				{
+					zstd_cctx = ZSTD_createCCtx();
+					if (zstd_cctx == NULL)
+						ereport(ERROR,
+								(errcode(ERRCODE_OUT_OF_MEMORY),
+								 errmsg("out of memory")));
+				}
+
+				bound = ZSTD_compressBound(raw_len);
+				buf = compress_get_buffer(&compress_buffer, &compress_buffer_size,
+										  bound);
+				/* the fastest level, we're in the way of replication */
+				zlen = ZSTD_compressCCtx(zstd_cctx, buf, bound, raw, raw_len, 1);
+				len = ZSTD_isError(zlen) ? 0 : (int) zlen;
+			}
+#endif
+			break;
+	}
+
+	/* send it compressed only if that saves more than the header */
+	if (len > 0 && len + COMPRESSED_HEADER_SIZE < raw_len)
+	{
+		out->len = start;
+		pq_sendbyte(out, 'Z');
+		pq_sendbyte(out, method);
+		pq_sendint(out, raw_len, 4);
+		pq_sendbytes(out, buf, len);
+	}
+
+	if (buf != NULL && buf != compress_buffer)
+		pfree(buf);
+}
+
+/*
+ * If the message at the cursor of s is compressed, make s point to the
+ * restored message instead.
+ *
+ * The restored message is only valid until the next call, or until the
+ * current memory context is reset.
+ */
+void
+pgactive_decompress_message(StringInfo s)
+{
+	int			method;
+	int			raw_len;
+	const char *src;
+	int			src_len;
+	char	   *raw;
+	bool		done = false;
+
+	if (s->cursor >= s->len || s->data[s->cursor] != 'Z')
+		return;
+
+	pq_getmsgbyte(s);
+	method = pq_getmsgbyte(s);
+	raw_len = pq_getmsgint(s, 4);
+	src = s->data + s->cursor;
+	src_len = s->len - s->cursor;
+
+	if (raw_len < 0 || raw_len >= MaxAllocSize)
+		elog(ERROR, "invalid uncompressed length %d of compressed message", raw_len);
+
+	raw = compress_get_buffer(&decompress_buffer, &decompress_buffer_size,
+							  raw_len + 1);
+
+#ifdef USE_LZ4
+	if (method == pgactive_COMPRESSION_LZ4)
+	{
+		if (LZ4_decompress_safe(src, raw, src_len, raw_len) != raw_len)
+			elog(ERROR, "could not decompress lz4 compressed message");
+		done = true;
+	}
+#endif
+#ifdef USE_ZSTD
+	if (method == pgactive_COMPRESSION_ZSTD)
+	{
+		size_t		len;
+
+		if (zstd_dctx == NULL)
+		{
+			zstd_dctx = ZSTD_createDCtx();
+			if (zstd_dctx == NULL)
+				ereport(ERROR,
+						(errcode(ERRCODE_OUT_OF_MEMORY),
+						 errmsg("out of memory")));
+		}
+
+		len = ZSTD_decompressDCtx(zstd_dctx, raw, raw_len, src, src_len);
+		if (ZSTD_isError(len) || len != (size_t) raw_len)
+			elog(ERROR, "could not decompress zstd compressed message");
+		done = true;
+	}
+#endif
+	if (!done)
+		ereport(ERROR,
+				(errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+				 errmsg("message compressed with unsupported method %d", method)));
+	raw[raw_len] = '\0';
+
+	pgactive_count_compressed(src_len + COMPRESSED_HEADER_SIZE, raw_len);
+
+	s->data = raw;
+	s->len = raw_len;
+	s->maxlen = -1;
+	s->cursor = 0;
+}
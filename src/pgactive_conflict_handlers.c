@@ -47,6 +47,8 @@
 
 PG_FUNCTION_INFO_V1(pgactive_create_conflict_handler);
 PG_FUNCTION_INFO_V1(pgactive_drop_conflict_handler);
+PG_FUNCTION_INFO_V1(pgactive_conflict_handler_keep_local);
+PG_FUNCTION_INFO_V1(pgactive_conflict_handler_apply_remote);
 
 static const char *create_handler_sql =
 "INSERT INTO pgactive.pgactive_conflict_handlers " \
@@ -66,6 +68,9 @@ static const char *get_conflict_handlers_for_table_sql =
 static void pgactive_conflict_handlers_check_handler_fun(Relation rel, Oid proc_oid);
 static void pgactive_conflict_handlers_check_access(Oid reloid);
 static const char *pgactive_conflict_handlers_event_type_name(pgactiveConflictType event_type);
+static pgactiveConflictHandlerBuiltin pgactive_conflict_handlers_builtin(FmgrInfo *finfo);
+static void pgactive_conflict_handlers_prepare(pgactiveRelation * rel,
+											   pgactiveConflictHandler * handler);
 
 static Oid	pgactive_conflict_handler_table_oid = InvalidOid;
 static Oid	pgactive_conflict_handler_type_oid = InvalidOid;
@@ -74,10 +79,14 @@ static Oid	pgactive_conflict_handler_action_ignore_oid = InvalidOid;
 static Oid	pgactive_conflict_handler_action_row_oid = InvalidOid;
 static Oid	pgactive_conflict_handler_action_skip_oid = InvalidOid;
 
+/* pgactive.pgactive_conflict_type values, by pgactiveConflictType */
+static Oid	pgactive_conflict_handler_event_oids[pgactiveConflictType_UnhandledTxAbort + 1];
+
 void
 pgactive_conflict_handlers_init(void)
 {
 	Oid			schema_oid = get_namespace_oid("pgactive", false);
+	int			i;
 
 	pgactive_conflict_handler_table_oid = get_relname_relid("pgactive_conflict_handlers",
 															schema_oid);
@@ -109,6 +118,16 @@ pgactive_conflict_handlers_init(void)
 		pgactiveGetSysCacheOid2Error(ENUMTYPOIDNAME, Anum_pg_enum_oid,
 									 pgactive_conflict_handler_action_oid,
 									 CStringGetDatum("SKIP"));
+
+	for (i = 0; i <= pgactiveConflictType_UnhandledTxAbort; i++)
+	{
+		const char *event = pgactive_conflict_handlers_event_type_name(i);
+
+		pgactive_conflict_handler_event_oids[i] =
+			pgactiveGetSysCacheOid2Error(ENUMTYPOIDNAME, Anum_pg_enum_oid,
+										 pgactive_conflict_handler_type_oid,
+										 CStringGetDatum(event));
+	}
 }
 
 /*
@@ -471,6 +490,13 @@ pgactive_conflict_handlers_check_handler_fun(Relation rel, Oid proc_oid)
 	const char *hint = NULL;
 	FormData_pg_attribute *att0 = NULL;
 	FormData_pg_attribute *att1 = NULL;
+	FmgrInfo	finfo;
+	Oid			rowtype = rel->rd_rel->reltype;
+
+	/* built-in handlers take rows of any table */
+	fmgr_info(proc_oid, &finfo);
+	if (pgactive_conflict_handlers_builtin(&finfo) != pgactiveConflictHandlerBuiltin_None)
+		rowtype = ANYELEMENTOID;
 
 	tuple = SearchSysCache1(PROCOID, ObjectIdGetDatum(proc_oid));
 	if (!HeapTupleIsValid(tuple))
@@ -507,7 +533,7 @@ pgactive_conflict_handlers_check_handler_fun(Relation rel, Oid proc_oid)
 		att0 = TupleDescAttr(retdesc, 0);
 		att1 = TupleDescAttr(retdesc, 1);
 
-		if (att0->atttypid != rel->rd_rel->reltype ||
+		if (att0->atttypid != rowtype ||
 			att1->atttypid != pgactive_conflict_handler_action_oid)
 		{
 			hint = "OUT argument are not of the expected types.";
@@ -536,14 +562,16 @@ pgactive_conflict_handlers_check_handler_fun(Relation rel, Oid proc_oid)
 		}
 
 		typtype = get_typtype(argtypes[0]);
-		if (typtype != TYPTYPE_COMPOSITE || argtypes[0] != rel->rd_rel->reltype)
+		if ((typtype != TYPTYPE_COMPOSITE && rowtype != ANYELEMENTOID) ||
+			argtypes[0] != rowtype)
 		{
 			hint = "First input argument must be of the same type as the table.";
 			break;
 		}
 
 		typtype = get_typtype(argtypes[1]);
-		if (typtype != TYPTYPE_COMPOSITE || argtypes[1] != rel->rd_rel->reltype)
+		if ((typtype != TYPTYPE_COMPOSITE && rowtype != ANYELEMENTOID) ||
+			argtypes[1] != rowtype)
 		{
 			hint = "Second input argument must be of the same type as the table.";
 			break;
@@ -582,7 +610,7 @@ pgactive_get_conflict_handlers(pgactiveRelation * rel)
 	/*
 	 * build up cache if not yet done
 	 */
-	if (rel->conflict_handlers == NULL)
+	if (rel->conflict_handlers_context == NULL)
 	{
 		int			fun_col_no,
 					type_col_no,
@@ -604,10 +632,14 @@ pgactive_get_conflict_handlers(pgactiveRelation * rel)
 		if (ret != SPI_OK_SELECT)
 			elog(ERROR, "expected SPI state %u, got %u", SPI_OK_SELECT, ret);
 
+		rel->conflict_handlers_context =
+			AllocSetContextCreate(CacheMemoryContext,
+								  "pgactive conflict handlers",
+								  ALLOCSET_SMALL_SIZES);
 		rel->conflict_handlers_len = SPI_processed;
 		rel->conflict_handlers =
-			MemoryContextAlloc(CacheMemoryContext,
-							   SPI_processed * sizeof(pgactiveConflictHandler));
+			MemoryContextAllocZero(rel->conflict_handlers_context,
+								   SPI_processed * sizeof(pgactiveConflictHandler));
 
 		fun_col_no = SPI_fnumber(SPI_tuptable->tupdesc, "ch_fun");
 		type_col_no = SPI_fnumber(SPI_tuptable->tupdesc, "ch_type");
@@ -668,6 +700,11 @@ pgactive_get_conflict_handlers(pgactiveRelation * rel)
 					intrvl->time;
 			}
 
+			/*
+			 * Look up the function and its result type now rather than on
+			 * every conflict.
+			 */
+			pgactive_conflict_handlers_prepare(rel, &rel->conflict_handlers[i]);
 		}
 
 		if (SPI_finish() != SPI_OK_FINISH)
@@ -676,6 +713,113 @@ pgactive_get_conflict_handlers(pgactiveRelation * rel)
 	}
 }
 
+static void
+pgactive_conflict_handlers_prepare(pgactiveRelation * rel,
+								   pgactiveConflictHandler * handler)
+{
+	HeapTuple	fun_tup;
+	MemoryContext oldctx;
+
+	fmgr_info_cxt(handler->handler_oid, &handler->finfo,
+				  rel->conflict_handlers_context);
+
+	handler->builtin = pgactive_conflict_handlers_builtin(&handler->finfo);
+	if (handler->builtin != pgactiveConflictHandlerBuiltin_None)
+		return;
+
+	fun_tup = SearchSysCache1(PROCOID, ObjectIdGetDatum(handler->handler_oid));
+	if (!HeapTupleIsValid(fun_tup))
+		elog(ERROR, "cache lookup failed for function %u",
+			 handler->handler_oid);
+
+	oldctx = MemoryContextSwitchTo(rel->conflict_handlers_context);
+	handler->retdesc = build_function_result_tupdesc_t(fun_tup);
+	MemoryContextSwitchTo(oldctx);
+
+	ReleaseSysCache(fun_tup);
+
+	if (handler->retdesc == NULL)
+		elog(ERROR, "function %u is not a conflict handler",
+			 handler->handler_oid);
+}
+
+/*
+ * Is the function one of the built-in conflict handlers?
+ */
+static pgactiveConflictHandlerBuiltin
+pgactive_conflict_handlers_builtin(FmgrInfo *finfo)
+{
+	if (finfo->fn_addr == pgactive_conflict_handler_keep_local)
+		return pgactiveConflictHandlerBuiltin_KeepLocal;
+	if (finfo->fn_addr == pgactive_conflict_handler_apply_remote)
+		return pgactiveConflictHandlerBuiltin_ApplyRemote;
+	return pgactiveConflictHandlerBuiltin_None;
+}
+
+/*
+ * Result of a built-in conflict handler called from SQL.
+ */
+static Datum
+pgactive_conflict_handlers_builtin_result(FunctionCallInfo fcinfo,
+										  int row_arg, Oid action)
+{
+	TupleDesc	tupdesc;
+	Datum		values[2];
+	bool		nulls[2];
+
+	if (get_call_result_type(fcinfo, NULL, &tupdesc) != TYPEFUNC_COMPOSITE)
+		elog(ERROR, "return type must be a row type");
+
+	if (row_arg < 0 || PG_ARGISNULL(row_arg))
+	{
+		values[0] = (Datum) 0;
+		nulls[0] = true;
+	}
+	else
+	{
+		values[0] = PG_GETARG_DATUM(row_arg);
+		nulls[0] = false;
+	}
+	values[1] = ObjectIdGetDatum(action);
+	nulls[1] = false;
+
+	return HeapTupleGetDatum(heap_form_tuple(BlessTupleDesc(tupdesc),
+											 values, nulls));
+}
+
+/*
+ * Built-in conflict handler keeping the local row, i.e. discarding the
+ * remote change. pgactive_conflict_handlers_resolve() doesn't call it.
+ */
+Datum
+pgactive_conflict_handler_keep_local(PG_FUNCTION_ARGS)
+{
+	if (!OidIsValid(pgactive_conflict_handler_action_skip_oid))
+		pgactive_conflict_handlers_init();
+
+	return pgactive_conflict_handlers_builtin_result(fcinfo, -1,
+													 pgactive_conflict_handler_action_skip_oid);
+}
+
+/*
+ * Built-in conflict handler applying the remote row, regardless of which
+ * change is more recent. pgactive_conflict_handlers_resolve() doesn't call
+ * it.
+ */
+Datum
+pgactive_conflict_handler_apply_remote(PG_FUNCTION_ARGS)
+{
+	if (!OidIsValid(pgactive_conflict_handler_action_row_oid))
+		pgactive_conflict_handlers_init();
+
+	if (PG_ARGISNULL(1))
+		return pgactive_conflict_handlers_builtin_result(fcinfo, -1,
+														 pgactive_conflict_handler_action_ignore_oid);
+
+	return pgactive_conflict_handlers_builtin_result(fcinfo, 1,
+													 pgactive_conflict_handler_action_row_oid);
+}
+
 static const char *
 pgactive_conflict_handlers_event_type_name(pgactiveConflictType event_type)
 {
@@ -720,38 +864,49 @@ pgactive_conflict_handlers_resolve(pgactiveRelation * rel, const HeapTuple local
 #else
 	FunctionCallInfoData fcinfo;
 #endif
-	FmgrInfo	finfo;
-	HeapTuple	fun_tup;
 	HeapTupleData result_tup;
 	HeapTupleHeader tup_header;
 	TupleDesc	retdesc;
 	Datum		val;
 	bool		isnull;
 	Oid			event_oid;
-	const char *event = pgactive_conflict_handlers_event_type_name(event_type);
 	FormData_pg_attribute *att0 = NULL;
 
 	*skip = false;
 
 	pgactive_get_conflict_handlers(rel);
 
-	event_oid = pgactiveGetSysCacheOid2Error(ENUMTYPOIDNAME, Anum_pg_enum_enumtypid,
-											 pgactive_conflict_handler_type_oid,
-											 CStringGetDatum(event));
+	/* also checks event_type */
+	(void) pgactive_conflict_handlers_event_type_name(event_type);
+	event_oid = pgactive_conflict_handler_event_oids[event_type];
 
 	for (i = 0; i < rel->conflict_handlers_len; ++i)
 	{
+		pgactiveConflictHandler *handler = &rel->conflict_handlers[i];
+
 		/*
 		 * ignore all handlers which don't match the type or are not usable by
 		 * timeframe
 		 */
-		if (rel->conflict_handlers[i].handler_type != event_type ||
-			(rel->conflict_handlers[i].timeframe != 0 &&
-			 rel->conflict_handlers[i].timeframe < timeframe))
+		if (handler->handler_type != event_type ||
+			(handler->timeframe != 0 &&
+			 handler->timeframe < timeframe))
 			continue;
 
-		fmgr_info(rel->conflict_handlers[i].handler_oid, &finfo);
-		InitFunctionCallInfoData(fcinfo, &finfo, 5, InvalidOid, NULL, NULL);
+		/* built-in handlers don't need the rows as datums or a call */
+		if (handler->builtin == pgactiveConflictHandlerBuiltin_KeepLocal)
+		{
+			*skip = true;
+			return NULL;
+		}
+		else if (handler->builtin == pgactiveConflictHandlerBuiltin_ApplyRemote)
+		{
+			if (remote == NULL)
+				continue;
+			return heap_copytuple(remote);
+		}
+
+		InitFunctionCallInfoData(fcinfo, &handler->finfo, 5, InvalidOid, NULL, NULL);
 
 #if PG_VERSION_NUM >= 120000
 		if (local != NULL)
@@ -817,15 +972,7 @@ pgactive_conflict_handlers_resolve(pgactiveRelation * rel, const HeapTuple local
 
 		tup_header = DatumGetHeapTupleHeader(retval);
 
-		fun_tup = SearchSysCache1(PROCOID,
-								  ObjectIdGetDatum(rel->conflict_handlers[i].handler_oid));
-		if (!HeapTupleIsValid(fun_tup))
-			elog(ERROR, "cache lookup failed for function %u",
-				 rel->conflict_handlers[i].handler_oid);
-
-		retdesc = build_function_result_tupdesc_t(fun_tup);
-
-		ReleaseSysCache(fun_tup);
+		retdesc = handler->retdesc;
 
 		result_tup.t_len = HeapTupleHeaderGetDatumLength(tup_header);
 		ItemPointerSetInvalid(&(result_tup.t_self));
@@ -851,7 +998,7 @@ pgactive_conflict_handlers_resolve(pgactiveRelation * rel, const HeapTuple local
 			att0 = TupleDescAttr(retdesc, 0);
 			if (HeapTupleHeaderGetTypeId(tup_header) != rel->rel->rd_rel->reltype)
 				elog(ERROR, "handler %d returned unexpected tuple type %d",
-					 rel->conflict_handlers[i].handler_oid,
+					 handler->handler_oid,
 					 att0->atttypid);
 
 			tup->t_len = HeapTupleHeaderGetDatumLength(tup_header);
@@ -16,6 +16,7 @@
 
 #include "funcapi.h"
 
+#include "access/tableam.h"
 #include "access/xact.h"
 
 #include "catalog/index.h"
@@ -23,6 +24,8 @@
 #include "catalog/pg_namespace.h"
 #include "catalog/pg_type.h"
 
+#include "executor/executor.h"
+
 #include "tcop/tcopprot.h"
 
 #include "replication/origin.h"
@@ -41,6 +44,7 @@
 bool		pgactive_log_conflicts_to_table = true;
 bool		pgactive_log_conflicts_to_logfile = false;
 bool		pgactive_conflict_logging_include_tuples = false;
+int			pgactive_conflict_logging_buffer_size = 0;
 
 static Oid	pgactiveConflictTypeOid = InvalidOid;
 static Oid	pgactiveConflictResolutionOid = InvalidOid;
@@ -52,6 +56,19 @@ static Oid	pgactiveConflictHistorySeqId = InvalidOid;
 /* We want our own memory ctx to clean up easily & reliably */
 static MemoryContext conflict_log_context;
 
+/*
+ * Conflict history rows of the current transaction not inserted yet, see
+ * pgactive.conflict_logging_buffer_size. Allocated in a child of
+ * TopTransactionContext.
+ */
+static MemoryContext conflict_log_buffer_context = NULL;
+static HeapTuple *conflict_log_buffer = NULL;
+static int	conflict_log_buffer_len = 0;
+static int	conflict_log_buffer_max = 0;
+
+static void pgactive_conflict_log_buffer_init(void);
+static void pgactive_conflict_log_xact_callback(XactEvent event, void *arg);
+
 /*
  * Perform syscache lookups etc for pgactive conflict logging.
  *
@@ -389,6 +406,20 @@ pgactive_conflict_log_table(pgactiveApplyConflict * conflict)
 		/* No logging enabled and we don't own any memory, just bail */
 		return;
 
+	if (conflict_log_buffer == NULL && pgactive_conflict_logging_buffer_size > 0)
+		pgactive_conflict_log_buffer_init();
+
+	/*
+	 * Don't let conflict storms make the transaction's buffer grow without
+	 * bounds; skip the conflict before doing any work for it.
+	 */
+	if (conflict_log_buffer != NULL &&
+		conflict_log_buffer_len >= conflict_log_buffer_max)
+	{
+		pgactive_count_conflict_log_dropped();
+		return;
+	}
+
 	/* Pg has no uint64 SQL type so we have to store all them as text */
 	snprintf(local_sysid, sizeof(local_sysid), UINT64_FORMAT, myid.sysid);
 	snprintf(remote_sysid, sizeof(remote_sysid), UINT64_FORMAT,
@@ -562,6 +593,19 @@ pgactive_conflict_log_table(pgactiveApplyConflict * conflict)
 	 */
 	log_rel = table_open(pgactiveConflictHistoryRelId, RowExclusiveLock);
 
+	/* inserted with the others by pgactive_conflict_log_flush() */
+	if (conflict_log_buffer != NULL)
+	{
+		MemoryContext oldctx = MemoryContextSwitchTo(conflict_log_buffer_context);
+
+		conflict_log_buffer[conflict_log_buffer_len++] =
+			heap_form_tuple(RelationGetDescr(log_rel), values, nulls);
+		MemoryContextSwitchTo(oldctx);
+
+		table_close(log_rel, NoLock);
+		return;
+	}
+
 	/* Prepare executor state for index updates */
 	log_estate = pgactive_create_rel_estate(log_rel, relinfo);
 	log_slot = ExecInitExtraTupleSlotpgactive(log_estate, NULL);
@@ -582,6 +626,108 @@ pgactive_conflict_log_table(pgactiveApplyConflict * conflict)
 	FreeExecutorState(log_estate);
 }
 
+static void
+pgactive_conflict_log_buffer_init(void)
+{
+	static bool callback_registered = false;
+
+	if (!callback_registered)
+	{
+		RegisterXactCallback(pgactive_conflict_log_xact_callback, NULL);
+		callback_registered = true;
+	}
+
+	conflict_log_buffer_context =
+		AllocSetContextCreate(TopTransactionContext,
+							  "pgactive conflict log buffer",
+							  ALLOCSET_DEFAULT_SIZES);
+	conflict_log_buffer_max = pgactive_conflict_logging_buffer_size;
+	conflict_log_buffer =
+		MemoryContextAlloc(conflict_log_buffer_context,
+						   conflict_log_buffer_max * sizeof(HeapTuple));
+	conflict_log_buffer_len = 0;
+}
+
+static void
+pgactive_conflict_log_xact_callback(XactEvent event, void *arg)
+{
+	switch (event)
+	{
+		case XACT_EVENT_PRE_COMMIT:
+			pgactive_conflict_log_flush();
+			break;
+		case XACT_EVENT_ABORT:
+			/* freed along with the transaction's memory */
+			conflict_log_buffer_context = NULL;
+			conflict_log_buffer = NULL;
+			conflict_log_buffer_len = 0;
+			break;
+		default:
+			break;
+	}
+}
+
+/*
+ * Insert the conflicts buffered by pgactive_conflict_log_table() into
+ * pgactive.pgactive_conflict_history, all at once.
+ *
+ * Happens at the latest when the transaction commits, but the apply worker
+ * calls it earlier so that parallel apply workers do it before waiting for
+ * their turn to commit.
+ */
+void
+pgactive_conflict_log_flush(void)
+{
+	Relation	log_rel;
+	EState	   *log_estate;
+	ResultRelInfo *relinfo;
+	TupleTableSlot **slots;
+	MemoryContext oldctx;
+	int			i;
+
+	if (conflict_log_buffer == NULL)
+		return;
+
+	if (conflict_log_buffer_len > 0)
+	{
+		oldctx = MemoryContextSwitchTo(conflict_log_buffer_context);
+
+		log_rel = table_open(pgactiveConflictHistoryRelId, RowExclusiveLock);
+
+		relinfo = makeNode(ResultRelInfo);
+		log_estate = pgactive_create_rel_estate(log_rel, relinfo);
+		ExecOpenIndices(relinfo, false);
+
+		slots = palloc(conflict_log_buffer_len * sizeof(TupleTableSlot *));
+		for (i = 0; i < conflict_log_buffer_len; i++)
+		{
+			slots[i] = table_slot_create(log_rel, &log_estate->es_tupleTable);
+			ExecForceStoreHeapTuple(conflict_log_buffer[i], slots[i], false);
+		}
+
+		table_multi_insert(log_rel, slots, conflict_log_buffer_len,
+						   GetCurrentCommandId(true), 0, NULL);
+
+		for (i = 0; i < conflict_log_buffer_len; i++)
+		{
+			ResetPerTupleExprContext(log_estate);
+			UserTableUpdateOpenIndexes(log_estate, slots[i], relinfo, false);
+		}
+
+		ExecCloseIndices(relinfo);
+		table_close(log_rel, RowExclusiveLock);
+		ExecResetTupleTable(log_estate->es_tupleTable, true);
+		FreeExecutorState(log_estate);
+
+		MemoryContextSwitchTo(oldctx);
+	}
+
+	MemoryContextDelete(conflict_log_buffer_context);
+	conflict_log_buffer_context = NULL;
+	conflict_log_buffer = NULL;
+	conflict_log_buffer_len = 0;
+}
+
 /*
  * Log a pgactive apply conflict to the postgreql log.
  */
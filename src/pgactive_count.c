@@ -26,9 +26,21 @@
 
 #include "storage/fd.h"
 #include "storage/lwlock.h"
+#include "storage/shmem.h"
 #include "storage/spin.h"
 
+#include "port/atomics.h"
+#include "port/pg_bitutils.h"
+
 #include "utils/builtins.h"
+#include "utils/hsearch.h"
+#include "utils/timestamp.h"
+
+/*
+ * Number of buckets of each histogram. Bucket 0 counts zeroes, bucket i
+ * values in [2^(i-1), 2^i), and the last bucket also all larger values.
+ */
+#define pgactive_COUNT_HIST_BUCKETS 32
 
 /*
  * Statistics about logical replication
@@ -52,6 +64,23 @@ typedef struct pgactiveCountSlot
 	int64		nr_delete_conflict;
 
 	int64		nr_disconnect;
+
+	/* conflicts not logged to the table as the buffer was full */
+	int64		nr_conflict_log_dropped;
+
+	/* compressed messages received, and their size once decompressed */
+	int64		nr_bytes_compressed;
+	int64		nr_bytes_decompressed;
+
+	/*
+	 * Histograms of the applied transactions: microseconds from remote commit
+	 * to local commit, microseconds spent applying, and size in rows and in
+	 * protocol bytes.
+	 */
+	int64		hist_apply_lag[pgactive_COUNT_HIST_BUCKETS];
+	int64		hist_apply_duration[pgactive_COUNT_HIST_BUCKETS];
+	int64		hist_xact_rows[pgactive_COUNT_HIST_BUCKETS];
+	int64		hist_xact_bytes[pgactive_COUNT_HIST_BUCKETS];
 }			pgactiveCountSlot;
 
 /*
@@ -60,9 +89,34 @@ typedef struct pgactiveCountSlot
 typedef struct pgactiveCountControl
 {
 	LWLockId	lock;
+	/* protects the set of entries in pgactiveRelStatsHash */
+	LWLockId	rel_lock;
 	pgactiveCountSlot slots[FLEXIBLE_ARRAY_MEMBER];
 }			pgactiveCountControl;
 
+/*
+ * Per-relation statistics, kept separately for each peer node and for
+ * changes sent to and applied from it.
+ *
+ * Unlike the per-node statistics they're not written to disk, and entries
+ * are never removed, so the counters can be updated without taking a lock
+ * through a pointer looked up once. Once pgactive.max_relation_stats entries
+ * exist, further relations are not counted.
+ */
+typedef struct pgactiveRelStatsKey
+{
+	pgactiveNodeId peer;
+	Oid			dboid;
+	Oid			relid;
+	bool		sent;
+}			pgactiveRelStatsKey;
+
+struct pgactiveRelStats
+{
+	pgactiveRelStatsKey key;	/* hash key */
+	pg_atomic_uint64 counters[pgactiveRelStat_NumStats];
+};
+
 /*
  * Header of a stats disk serialization, used to detect old files, changed
  * parameters and such.
@@ -78,17 +132,28 @@ typedef struct pgactiveCountSerialize
 static const uint32 pgactive_count_magic = 0x5e51A7;
 
 /* everytime the stored data format changes, increase */
-static const uint32 pgactive_count_version = 2;
+static const uint32 pgactive_count_version = 5;
 
 /* shortcut for the finding pgactiveCountControl in memory */
 static pgactiveCountControl * pgactiveCountCtl = NULL;
 
+/* per-relation statistics, NULL if disabled */
+static HTAB *pgactiveRelStatsHash = NULL;
+
 /* how many nodes have we built shmem for */
 static Size pgactive_count_nnodes = 0;
 
 /* offset in the pgactiveCountControl->slots "our" backend is in */
 static int	MyCountOffsetIdx = -1;
 
+/*
+ * When several backends count into the same slot (parallel apply), each of
+ * them accumulates into a local slot and adds it to the shared one, under
+ * the lock, in pgactive_count_flush().
+ */
+static bool pgactive_count_deferred = false;
+static pgactiveCountSlot pgactive_count_pending;
+
 static shmem_startup_hook_type prev_shmem_startup_hook = NULL;
 
 static void pgactive_count_shmem_startup(void);
@@ -98,11 +163,17 @@ static Size pgactive_count_shmem_size(void);
 static void pgactive_count_serialize(void);
 static void pgactive_count_unserialize(void);
 
-#define pgactive_COUNT_STAT_COLS 12
+#define pgactive_COUNT_STAT_COLS 15
+#define pgactive_COUNT_HIST_COLS 6
+#define pgactive_COUNT_REL_COLS 16
 
 PGDLLEXPORT Datum pgactive_get_stats(PG_FUNCTION_ARGS);
+PGDLLEXPORT Datum pgactive_get_stats_histograms(PG_FUNCTION_ARGS);
+PGDLLEXPORT Datum pgactive_get_relation_stats(PG_FUNCTION_ARGS);
 
 PG_FUNCTION_INFO_V1(pgactive_get_stats);
+PG_FUNCTION_INFO_V1(pgactive_get_stats_histograms);
+PG_FUNCTION_INFO_V1(pgactive_get_relation_stats);
 
 static Size
 pgactive_count_shmem_size(void)
@@ -128,8 +199,11 @@ pgactive_count_shmem_init(int nnodes)
 	pgactive_count_nnodes = (Size) nnodes;
 
 	RequestAddinShmemSpace(pgactive_count_shmem_size());
-	/* lock for slot acquiration */
-	RequestNamedLWLockTranche("pgactive_count", 1);
+	if (pgactive_max_relation_stats > 0)
+		RequestAddinShmemSpace(hash_estimate_size(pgactive_max_relation_stats,
+												  sizeof(pgactiveRelStats)));
+	/* locks for slot acquiration and per-relation entry creation */
+	RequestNamedLWLockTranche("pgactive_count", 2);
 
 	prev_shmem_startup_hook = shmem_startup_hook;
 	shmem_startup_hook = pgactive_count_shmem_startup;
@@ -151,9 +225,24 @@ pgactive_count_shmem_startup(void)
 	{
 		/* initialize */
 		memset(pgactiveCountCtl, 0, pgactive_count_shmem_size());
-		pgactiveCountCtl->lock = &(GetNamedLWLockTranche("pgactive_count"))->lock;
+		pgactiveCountCtl->lock = &(GetNamedLWLockTranche("pgactive_count"))[0].lock;
+		pgactiveCountCtl->rel_lock = &(GetNamedLWLockTranche("pgactive_count"))[1].lock;
 		pgactive_count_unserialize();
 	}
+
+	if (pgactive_max_relation_stats > 0)
+	{
+		HASHCTL		ctl;
+
+		memset(&ctl, 0, sizeof(ctl));
+		ctl.keysize = sizeof(pgactiveRelStatsKey);
+		ctl.entrysize = sizeof(pgactiveRelStats);
+		pgactiveRelStatsHash = ShmemInitHash("pgactive relation stats",
+											 pgactive_max_relation_stats,
+											 pgactive_max_relation_stats,
+											 &ctl,
+											 HASH_ELEM | HASH_BLOBS);
+	}
 	LWLockRelease(AddinShmemInitLock);
 
 	/*
@@ -222,73 +311,236 @@ out:
 	LWLockRelease(pgactiveCountCtl->lock);
 }
 
+/*
+ * Switch between counting directly into our shared slot and counting into
+ * a backend-local slot that is added to the shared one by
+ * pgactive_count_flush().
+ */
+void
+pgactive_count_set_deferred(bool deferred)
+{
+	if (pgactive_count_deferred && !deferred)
+		pgactive_count_flush();
+
+	memset(&pgactive_count_pending, 0, sizeof(pgactiveCountSlot));
+	pgactive_count_deferred = deferred;
+}
+
+/*
+ * Add the counts accumulated in deferred mode to our shared slot.
+ */
+void
+pgactive_count_flush(void)
+{
+	pgactiveCountSlot *slot;
+	int			i;
+
+	if (!pgactive_count_deferred || MyCountOffsetIdx == -1)
+		return;
+
+	LWLockAcquire(pgactiveCountCtl->lock, LW_EXCLUSIVE);
+	slot = &pgactiveCountCtl->slots[MyCountOffsetIdx];
+	slot->nr_commit += pgactive_count_pending.nr_commit;
+	slot->nr_rollback += pgactive_count_pending.nr_rollback;
+	slot->nr_insert += pgactive_count_pending.nr_insert;
+	slot->nr_insert_conflict += pgactive_count_pending.nr_insert_conflict;
+	slot->nr_update += pgactive_count_pending.nr_update;
+	slot->nr_update_conflict += pgactive_count_pending.nr_update_conflict;
+	slot->nr_delete += pgactive_count_pending.nr_delete;
+	slot->nr_delete_conflict += pgactive_count_pending.nr_delete_conflict;
+	slot->nr_disconnect += pgactive_count_pending.nr_disconnect;
+	slot->nr_conflict_log_dropped += pgactive_count_pending.nr_conflict_log_dropped;
+	slot->nr_bytes_compressed += pgactive_count_pending.nr_bytes_compressed;
+	slot->nr_bytes_decompressed += pgactive_count_pending.nr_bytes_decompressed;
+	for (i = 0; i < pgactive_COUNT_HIST_BUCKETS; i++)
+	{
+		slot->hist_apply_lag[i] += pgactive_count_pending.hist_apply_lag[i];
+		slot->hist_apply_duration[i] += pgactive_count_pending.hist_apply_duration[i];
+		slot->hist_xact_rows[i] += pgactive_count_pending.hist_xact_rows[i];
+		slot->hist_xact_bytes[i] += pgactive_count_pending.hist_xact_bytes[i];
+	}
+	LWLockRelease(pgactiveCountCtl->lock);
+
+	memset(&pgactive_count_pending, 0, sizeof(pgactiveCountSlot));
+}
+
+/*
+ * Slot the statistic manipulation functions below count into.
+ */
+static inline pgactiveCountSlot *
+pgactive_count_my_slot(void)
+{
+	Assert(MyCountOffsetIdx != -1);
+
+	if (pgactive_count_deferred)
+		return &pgactive_count_pending;
+
+	return &pgactiveCountCtl->slots[MyCountOffsetIdx];
+}
+
 /*
  * Statistic manipulation functions.
  *
  * We assume we don't have to do any locking for *our* slot since only one
- * backend will do writing there.
+ * backend will do writing there, unless counting is deferred; see
+ * pgactive_count_set_deferred().
  */
 void
 pgactive_count_commit(void)
 {
-	Assert(MyCountOffsetIdx != -1);
-	pgactiveCountCtl->slots[MyCountOffsetIdx].nr_commit++;
+	pgactive_count_my_slot()->nr_commit++;
 }
 
 void
 pgactive_count_rollback(void)
 {
-	Assert(MyCountOffsetIdx != -1);
-	pgactiveCountCtl->slots[MyCountOffsetIdx].nr_rollback++;
+	pgactive_count_my_slot()->nr_rollback++;
 }
 
 void
 pgactive_count_insert(void)
 {
-	Assert(MyCountOffsetIdx != -1);
-	pgactiveCountCtl->slots[MyCountOffsetIdx].nr_insert++;
+	pgactive_count_my_slot()->nr_insert++;
 }
 
 void
 pgactive_count_insert_conflict(void)
 {
-	Assert(MyCountOffsetIdx != -1);
-	pgactiveCountCtl->slots[MyCountOffsetIdx].nr_insert_conflict++;
+	pgactive_count_my_slot()->nr_insert_conflict++;
 }
 
 void
 pgactive_count_update(void)
 {
-	Assert(MyCountOffsetIdx != -1);
-	pgactiveCountCtl->slots[MyCountOffsetIdx].nr_update++;
+	pgactive_count_my_slot()->nr_update++;
 }
 
 void
 pgactive_count_update_conflict(void)
 {
-	Assert(MyCountOffsetIdx != -1);
-	pgactiveCountCtl->slots[MyCountOffsetIdx].nr_update_conflict++;
+	pgactive_count_my_slot()->nr_update_conflict++;
 }
 
 void
 pgactive_count_delete(void)
 {
-	Assert(MyCountOffsetIdx != -1);
-	pgactiveCountCtl->slots[MyCountOffsetIdx].nr_delete++;
+	pgactive_count_my_slot()->nr_delete++;
 }
 
 void
 pgactive_count_delete_conflict(void)
 {
-	Assert(MyCountOffsetIdx != -1);
-	pgactiveCountCtl->slots[MyCountOffsetIdx].nr_delete_conflict++;
+	pgactive_count_my_slot()->nr_delete_conflict++;
 }
 
 void
 pgactive_count_disconnect(void)
 {
-	Assert(MyCountOffsetIdx != -1);
-	pgactiveCountCtl->slots[MyCountOffsetIdx].nr_disconnect++;
+	pgactive_count_my_slot()->nr_disconnect++;
+}
+
+void
+pgactive_count_conflict_log_dropped(void)
+{
+	pgactive_count_my_slot()->nr_conflict_log_dropped++;
+}
+
+void
+pgactive_count_compressed(uint64 compressed, uint64 uncompressed)
+{
+	pgactiveCountSlot *slot = pgactive_count_my_slot();
+
+	slot->nr_bytes_compressed += compressed;
+	slot->nr_bytes_decompressed += uncompressed;
+}
+
+static inline int
+pgactive_count_hist_bucket(uint64 value)
+{
+	int			bucket;
+
+	if (value == 0)
+		return 0;
+
+	bucket = pg_leftmost_one_pos64(value) + 1;
+
+	return Min(bucket, pgactive_COUNT_HIST_BUCKETS - 1);
+}
+
+/*
+ * Count an applied remote transaction into the histograms. It was committed
+ * remotely at remote_committime, and was applied from begin_at to
+ * applied_at.
+ */
+void
+pgactive_count_apply_xact(TimestampTz remote_committime, TimestampTz begin_at,
+						  TimestampTz applied_at, uint64 rows, uint64 bytes)
+{
+	pgactiveCountSlot *slot = pgactive_count_my_slot();
+
+	/* remote clocks running ahead of ours count as no lag */
+	slot->hist_apply_lag[pgactive_count_hist_bucket(Max(applied_at - remote_committime, 0))]++;
+	slot->hist_apply_duration[pgactive_count_hist_bucket(Max(applied_at - begin_at, 0))]++;
+	slot->hist_xact_rows[pgactive_count_hist_bucket(rows)]++;
+	slot->hist_xact_bytes[pgactive_count_hist_bucket(bytes)]++;
+}
+
+/*
+ * Find or create the statistics of changes to a relation sent to (sent) or
+ * applied from (!sent) a peer node. Returns NULL if per-relation statistics
+ * are disabled or no more relations can be counted.
+ */
+pgactiveRelStats *
+pgactive_count_relation_stats(const pgactiveNodeId * const peer, Oid relid,
+							  bool sent)
+{
+	pgactiveRelStatsKey key;
+	pgactiveRelStats *stats;
+	bool		found;
+	int			i;
+
+	if (pgactiveRelStatsHash == NULL)
+		return NULL;
+
+	/* the key is hashed as a whole, including padding */
+	memset(&key, 0, sizeof(key));
+	pgactive_nodeid_cpy(&key.peer, peer);
+	key.dboid = MyDatabaseId;
+	key.relid = relid;
+	key.sent = sent;
+
+	LWLockAcquire(pgactiveCountCtl->rel_lock, LW_SHARED);
+	stats = hash_search(pgactiveRelStatsHash, &key, HASH_FIND, NULL);
+	LWLockRelease(pgactiveCountCtl->rel_lock);
+
+	if (stats != NULL)
+		return stats;
+
+	LWLockAcquire(pgactiveCountCtl->rel_lock, LW_EXCLUSIVE);
+	stats = hash_search(pgactiveRelStatsHash, &key, HASH_ENTER_NULL, &found);
+	if (stats != NULL && !found)
+	{
+		for (i = 0; i < pgactiveRelStat_NumStats; i++)
+			pg_atomic_init_u64(&stats->counters[i], 0);
+	}
+	LWLockRelease(pgactiveCountCtl->rel_lock);
+
+	return stats;
+}
+
+/*
+ * Add n to a per-relation statistic. Parallel apply workers count into the
+ * same entries, hence the atomics.
+ */
+void
+pgactive_count_relation(pgactiveRelStats * stats, pgactiveRelStat stat,
+						uint64 n)
+{
+	if (stats == NULL)
+		return;
+
+	Assert(stat >= 0 && stat < pgactiveRelStat_NumStats);
+	pg_atomic_fetch_add_u64(&stats->counters[stat], n);
 }
 
 Datum
@@ -334,6 +586,9 @@ pgactive_get_stats(PG_FUNCTION_ARGS)
 		values[9] = Int64GetDatumFast(slot->nr_delete);
 		values[10] = Int64GetDatumFast(slot->nr_delete_conflict);
 		values[11] = Int64GetDatumFast(slot->nr_disconnect);
+		values[12] = Int64GetDatumFast(slot->nr_conflict_log_dropped);
+		values[13] = Int64GetDatumFast(slot->nr_bytes_compressed);
+		values[14] = Int64GetDatumFast(slot->nr_bytes_decompressed);
 
 		tuplestore_putvalues(rsinfo->setResult, rsinfo->setDesc,
 							 values, nulls);
@@ -343,6 +598,142 @@ pgactive_get_stats(PG_FUNCTION_ARGS)
 	PG_RETURN_VOID();
 }
 
+static void
+pgactive_count_put_histogram(ReturnSetInfo *rsinfo, pgactiveCountSlot * slot,
+							 const char *riname, const char *histogram,
+							 int64 *counts)
+{
+	int			i;
+
+	for (i = 0; i < pgactive_COUNT_HIST_BUCKETS; i++)
+	{
+		Datum		values[pgactive_COUNT_HIST_COLS];
+		bool		nulls[pgactive_COUNT_HIST_COLS];
+
+		/* omit empty buckets */
+		if (counts[i] == 0)
+			continue;
+
+		memset(nulls, 0, sizeof(nulls));
+
+		values[0] = ObjectIdGetDatum(slot->node_id);
+		values[1] = CStringGetTextDatum(riname);
+		values[2] = CStringGetTextDatum(histogram);
+		values[3] = Int64GetDatumFast(i == 0 ? INT64CONST(0) : INT64CONST(1) << (i - 1));
+		if (i == pgactive_COUNT_HIST_BUCKETS - 1)
+		{
+			values[4] = (Datum) 0;
+			nulls[4] = true;
+		}
+		else
+			values[4] = Int64GetDatumFast(INT64CONST(1) << i);
+		values[5] = Int64GetDatumFast(counts[i]);
+
+		tuplestore_putvalues(rsinfo->setResult, rsinfo->setDesc,
+							 values, nulls);
+	}
+}
+
+/*
+ * Get the histograms of applied transactions, one row per non-empty bucket.
+ * A bucket counts values >= bucket_lower and < bucket_upper.
+ */
+Datum
+pgactive_get_stats_histograms(PG_FUNCTION_ARGS)
+{
+	ReturnSetInfo *rsinfo = (ReturnSetInfo *) fcinfo->resultinfo;
+	size_t		current_offset;
+
+	InitMaterializedSRF(fcinfo, 0);
+
+	LWLockAcquire(pgactiveCountCtl->lock, LW_SHARED);
+
+	for (current_offset = 0; current_offset < pgactive_count_nnodes;
+		 current_offset++)
+	{
+		pgactiveCountSlot *slot;
+		char	   *riname;
+
+		slot = &pgactiveCountCtl->slots[current_offset];
+
+		if (slot->node_id == InvalidRepOriginId)
+			continue;
+
+		replorigin_by_oid(slot->node_id, false, &riname);
+
+		pgactive_count_put_histogram(rsinfo, slot, riname, "apply_lag_us",
+									 slot->hist_apply_lag);
+		pgactive_count_put_histogram(rsinfo, slot, riname, "apply_duration_us",
+									 slot->hist_apply_duration);
+		pgactive_count_put_histogram(rsinfo, slot, riname, "xact_rows",
+									 slot->hist_xact_rows);
+		pgactive_count_put_histogram(rsinfo, slot, riname, "xact_bytes",
+									 slot->hist_xact_bytes);
+	}
+	LWLockRelease(pgactiveCountCtl->lock);
+
+	PG_RETURN_VOID();
+}
+
+/*
+ * Get the per-relation statistics of all databases, times in milliseconds.
+ */
+Datum
+pgactive_get_relation_stats(PG_FUNCTION_ARGS)
+{
+	ReturnSetInfo *rsinfo = (ReturnSetInfo *) fcinfo->resultinfo;
+	HASH_SEQ_STATUS status;
+	pgactiveRelStats *stats;
+
+	InitMaterializedSRF(fcinfo, 0);
+
+	if (pgactiveRelStatsHash == NULL)
+		PG_RETURN_VOID();
+
+	LWLockAcquire(pgactiveCountCtl->rel_lock, LW_SHARED);
+
+	hash_seq_init(&status, pgactiveRelStatsHash);
+	while ((stats = hash_seq_search(&status)) != NULL)
+	{
+		Datum		values[pgactive_COUNT_REL_COLS];
+		bool		nulls[pgactive_COUNT_REL_COLS];
+		char		sysid_str[33];
+		uint64		counters[pgactiveRelStat_NumStats];
+		int			i;
+
+		memset(nulls, 0, sizeof(nulls));
+
+		for (i = 0; i < pgactiveRelStat_NumStats; i++)
+			counters[i] = pg_atomic_read_u64(&stats->counters[i]);
+
+		snprintf(sysid_str, sizeof(sysid_str), UINT64_FORMAT,
+				 stats->key.peer.sysid);
+
+		values[0] = CStringGetTextDatum(sysid_str);
+		values[1] = ObjectIdGetDatum(stats->key.peer.timeline);
+		values[2] = ObjectIdGetDatum(stats->key.peer.dboid);
+		values[3] = ObjectIdGetDatum(stats->key.dboid);
+		values[4] = ObjectIdGetDatum(stats->key.relid);
+		values[5] = CStringGetTextDatum(stats->key.sent ? "sent" : "applied");
+		values[6] = Int64GetDatum((int64) counters[pgactiveRelStat_Insert]);
+		values[7] = Int64GetDatum((int64) counters[pgactiveRelStat_Update]);
+		values[8] = Int64GetDatum((int64) counters[pgactiveRelStat_Delete]);
+		values[9] = Int64GetDatum((int64) counters[pgactiveRelStat_InsertInsert]);
+		values[10] = Int64GetDatum((int64) counters[pgactiveRelStat_UpdateUpdate]);
+		values[11] = Int64GetDatum((int64) counters[pgactiveRelStat_UpdateDelete]);
+		values[12] = Int64GetDatum((int64) counters[pgactiveRelStat_DeleteDelete]);
+		values[13] = Float8GetDatum(counters[pgactiveRelStat_LookupTime] / 1000.0);
+		values[14] = Float8GetDatum(counters[pgactiveRelStat_WriteTime] / 1000.0);
+		values[15] = Int64GetDatum((int64) counters[pgactiveRelStat_Bytes]);
+
+		tuplestore_putvalues(rsinfo->setResult, rsinfo->setDesc,
+							 values, nulls);
+	}
+	LWLockRelease(pgactiveCountCtl->rel_lock);
+
+	PG_RETURN_VOID();
+}
+
 /*
  * Write the pgactive stats from shared memory to a file
  */
@@ -38,6 +38,9 @@ typedef struct pgactiveDatabaseCacheEntry
 
 static HTAB *pgactiveDatabaseCacheHash = NULL;
 
+/* entry of MyDatabaseId, checked for every writing statement */
+static pgactiveDatabaseCacheEntry * pgactiveMyDatabaseCacheEntry = NULL;
+
 static pgactiveDatabaseCacheEntry * pgactive_dbcache_lookup(Oid dboid, bool missing_ok);
 
 static void
@@ -218,7 +221,15 @@ pgactive_is_pgactive_activated_db(Oid dboid)
 	/* potentially need to access syscaches */
 	Assert(IsTransactionState());
 
+	/* entries are never removed, only invalidated */
+	if (dboid == MyDatabaseId && pgactiveMyDatabaseCacheEntry != NULL &&
+		pgactiveMyDatabaseCacheEntry->valid)
+		return pgactiveMyDatabaseCacheEntry->pgactive_activated;
+
 	entry = pgactive_dbcache_lookup(dboid, false);
 
+	if (dboid == MyDatabaseId)
+		pgactiveMyDatabaseCacheEntry = entry;
+
 	return entry->pgactive_activated;
 }
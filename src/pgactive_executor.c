@@ -139,44 +139,6 @@ UserTableUpdateOpenIndexes(EState *estate, TupleTableSlot *slot,
 	list_free(recheckIndexes);
 }
 
-void
-build_index_scan_keys(ResultRelInfo *relinfo, ScanKey *scan_keys, pgactiveTupleData * tup)
-{
-	int			i;
-
-	/* build scankeys for each index */
-	for (i = 0; i < relinfo->ri_NumIndices; i++)
-	{
-		IndexInfo  *ii = relinfo->ri_IndexRelationInfo[i];
-
-		/*
-		 * Only unique indexes are of interest here, and we can't deal with
-		 * expression indexes so far. FIXME: predicates should be handled
-		 * better.
-		 */
-		if (!ii->ii_Unique || ii->ii_Expressions != NIL)
-		{
-			scan_keys[i] = NULL;
-			continue;
-		}
-
-		scan_keys[i] = palloc(ii->ii_NumIndexAttrs * sizeof(ScanKeyData));
-
-		/*
-		 * Only return index if we could build a key without NULLs.
-		 */
-		if (build_index_scan_key(scan_keys[i],
-								 relinfo->ri_RelationDesc,
-								 relinfo->ri_IndexRelationDescs[i],
-								 tup))
-		{
-			pfree(scan_keys[i]);
-			scan_keys[i] = NULL;
-			continue;
-		}
-	}
-}
-
 /*
  * Setup a ScanKey for a search in the relation 'rel' for a tuple 'key' that
  * is setup to match 'rel' (*NOT* idxrel!).
@@ -185,33 +147,41 @@ build_index_scan_keys(ResultRelInfo *relinfo, ScanKey *scan_keys, pgactiveTupleD
  */
 bool
 build_index_scan_key(ScanKey skey, Relation rel, Relation idxrel, pgactiveTupleData * tup)
+{
+	build_index_scan_key_template(skey, rel, idxrel);
+
+	return build_index_scan_key_values(skey, idxrel, tup);
+}
+
+/*
+ * Setup the parts of a ScanKey for a search in the relation 'rel' using the
+ * index 'idxrel' that don't depend on the tuple searched for. Looking up the
+ * equality operators isn't free, so the apply worker keeps the result around
+ * and only fills in the values of each tuple with
+ * build_index_scan_key_values().
+ *
+ * The lookup results are allocated in the current memory context.
+ */
+void
+build_index_scan_key_template(ScanKey skey, Relation rel, Relation idxrel)
 {
 	int			attoff;
 	Datum		indclassDatum;
-	Datum		indkeyDatum;
 	bool		isnull;
 	oidvector  *opclass;
-	int2vector *indkey;
-	bool		hasnulls = false;
 
 	indclassDatum = SysCacheGetAttr(INDEXRELID, idxrel->rd_indextuple,
 									Anum_pg_index_indclass, &isnull);
 	Assert(!isnull);
 	opclass = (oidvector *) DatumGetPointer(indclassDatum);
 
-	indkeyDatum = SysCacheGetAttr(INDEXRELID, idxrel->rd_indextuple,
-								  Anum_pg_index_indkey, &isnull);
-	Assert(!isnull);
-	indkey = (int2vector *) DatumGetPointer(indkeyDatum);
-
-
 	for (attoff = 0; attoff < RelationGetNumberOfAttributes(idxrel); attoff++)
 	{
 		Oid			operator;
 		Oid			opfamily;
 		RegProcedure regop;
 		int			pkattno = attoff + 1;
-		int			mainattno = indkey->values[attoff];
+		int			mainattno = idxrel->rd_index->indkey.values[attoff];
 		Oid			atttype = attnumTypeId(rel, mainattno);
 		Oid			optype = get_opclass_input_type(opclass->values[attoff]);
 
@@ -233,15 +203,37 @@ build_index_scan_key(ScanKey skey, Relation rel, Relation idxrel, pgactiveTupleD
 					pkattno,
 					BTEqualStrategyNumber,
 					regop,
-					tup->values[mainattno - 1]);
+					(Datum) 0);
 
 		skey[attoff].sk_collation = idxrel->rd_indcollation[attoff];
+	}
+}
+
+/*
+ * Fill in the values of tuple 'tup' into a ScanKey set up by
+ * build_index_scan_key_template().
+ *
+ * Returns whether any column contains NULLs.
+ */
+bool
+build_index_scan_key_values(ScanKey skey, Relation idxrel, pgactiveTupleData * tup)
+{
+	int			attoff;
+	bool		hasnulls = false;
+
+	for (attoff = 0; attoff < RelationGetNumberOfAttributes(idxrel); attoff++)
+	{
+		int			mainattno = idxrel->rd_index->indkey.values[attoff];
+
+		skey[attoff].sk_argument = tup->values[mainattno - 1];
 
 		if (tup->isnull[mainattno - 1])
 		{
 			hasnulls = true;
 			skey[attoff].sk_flags |= SK_ISNULL;
 		}
+		else
+			skey[attoff].sk_flags &= ~SK_ISNULL;
 	}
 	return hasnulls;
 }
@@ -542,7 +534,7 @@ pgactiveExecutorStart(QueryDesc *queryDesc, int eflags)
 	read_only_node = pgactive_local_node_read_only() && !pgactive_skip_ddl_replication;
 
 	/* check for concurrent global DDL locks */
-	pgactive_locks_check_dml();
+	pgactive_locks_check_dml(plannedstmt->rtable);
 
 	/*
 	 * Are we in pgactive.replicate_ddl_command? If so, it's not safe to do
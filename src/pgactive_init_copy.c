@@ -126,6 +126,8 @@ static int	run_pg_ctl(char *cmdargv[],
 					   int cmdargc_total,
 					   int cmdargc_current);
 static void run_basebackup(const char *remote_connstr, const char *data_dir);
+static void run_rewind(const char *remote_connstr, const char *data_dir,
+					   bool dry_run);
 static void wait_postmaster_connection(const char *connstr);
 static void wait_for_end_recovery(const char *connstr);
 static void wait_postmaster_shutdown(void);
@@ -165,7 +167,7 @@ static void pgactive_node_start(PGconn *conn, char *node_name, char *remote_conn
 								int apply_delay, char *dbname, uint64 nid);
 static RemoteInfo * get_remote_info(char *connstr);
 
-static void initialize_data_dir(char *data_dir, char *connstr,
+static void initialize_data_dir(char *data_dir, char *connstr, bool rewind,
 								char *postgresql_conf, char *pg_hba_conf);
 static bool check_data_dir(char *data_dir, RemoteInfo * remoteinfo);
 
@@ -254,6 +256,7 @@ main(int argc, char **argv)
 #endif
 	char	   *replication_sets = NULL;
 	bool		use_existing_data_dir;
+	bool		rewind = false;
 	int			pg_ctl_ret,
 				logfd;
 	int			apply_delay = 0;
@@ -282,6 +285,7 @@ main(int argc, char **argv)
 #else
 		{"replication-sets", required_argument, NULL, 8},
 #endif
+		{"rewind", no_argument, NULL, 10},
 		{"stop", no_argument, NULL, 's'},
 		{NULL, 0, NULL, 0}
 	};
@@ -396,6 +400,9 @@ main(int argc, char **argv)
 				replication_sets = validate_replication_set_input(optarg);
 				break;
 #endif
+			case 10:
+				rewind = true;
+				break;
 			case 's':
 				stop = true;
 				break;
@@ -467,6 +474,21 @@ main(int argc, char **argv)
 		remote_info->sysid != read_sysid(data_dir))
 		die(_("Local data directory is not basebackup of remote node.\n"));
 
+	if (rewind && !use_existing_data_dir)
+		die(_("--rewind requires an existing data directory.\n"));
+
+	/*
+	 * Make sure pg_rewind can resynchronize the data directory before
+	 * creating anything on the remote node, which it would otherwise be left
+	 * with should pg_rewind fail.
+	 */
+	if (rewind)
+	{
+		print_msg(VERBOSITY_NORMAL,
+				  _("Checking that the data directory can be rewound ...\n"));
+		run_rewind(remote_connstr, data_dir, true);
+	}
+
 	print_msg(VERBOSITY_NORMAL,
 			  _("Detected %d pgactive database(s) on remote server\n"),
 			  remote_info->numdbs);
@@ -533,11 +555,11 @@ main(int argc, char **argv)
 	}
 
 	/*
-	 * Create basebackup or use existing one
+	 * Create basebackup, use existing one or rewind existing one
 	 */
 	initialize_data_dir(data_dir,
-						use_existing_data_dir ? NULL : remote_connstr,
-						postgresql_conf, pg_hba_conf);
+						use_existing_data_dir && !rewind ? NULL : remote_connstr,
+						rewind, postgresql_conf, pg_hba_conf);
 	snprintf(pid_file, MAXPGPATH, "%s/postmaster.pid", data_dir);
 
 	/*
@@ -750,6 +772,9 @@ usage(void)
 	printf(_("  -l, --log-file          log file name, default pgactive_init_copy_postgres.log\n"));
 	printf(_("  -n, --node-name=NAME    name of the newly created node\n"));
 	printf(_("  --replication-sets=SETS comma separated list of replication set names to use\n"));
+	printf(_("  --rewind                resynchronize the existing data directory of a\n"));
+	printf(_("                          former clone of the remote node with pg_rewind\n"));
+	printf(_("                          instead of taking a new base backup\n"));
 	printf(_("  -s, --stop              stop the server once the initialization is done\n"));
 	printf(_("  -v                      increase logging verbosity\n"));
 	printf(_("\nConfiguration files override:\n"));
@@ -903,6 +928,54 @@ run_basebackup(const char *remote_connstr, const char *data_dir)
 	pg_free(exec_path);
 }
 
+/*
+ * Run pg_rewind to bring an existing data directory, diverged from the origin
+ * node since it was cloned from it, back in sync. Only the blocks changed on
+ * either side since the divergence are copied; the origin node's WAL since
+ * then is replayed by the restore point catchup that follows.
+ *
+ * With dry_run, only check that pg_rewind can do that, without changing the
+ * data directory.
+ */
+static void
+run_rewind(const char *remote_connstr, const char *data_dir, bool dry_run)
+{
+	char	   *exec_path = find_other_exec_or_die(argv0, "pg_rewind");
+	char	   *cmdargv[10];
+	int			cmdargc;
+	char		arg_tmp1[MAXPGPATH];
+	char		arg_tmp2[MAXPGPATH];
+
+	snprintf(arg_tmp1, sizeof(arg_tmp1), "--target-pgdata=%s", data_dir);
+	snprintf(arg_tmp2, sizeof(arg_tmp2), "--source-server=%s", remote_connstr);
+
+	cmdargc = 0;
+	cmdargv[cmdargc++] = exec_path;
+	cmdargv[cmdargc++] = arg_tmp1;
+	cmdargv[cmdargc++] = arg_tmp2;
+	if (dry_run)
+		cmdargv[cmdargc++] = "--dry-run";
+	else
+		cmdargv[cmdargc++] = "--progress";
+
+	/* Run pg_rewind in debug mode if we are running in debug mode. */
+	if (verbosity >= VERBOSITY_DEBUG)
+		cmdargv[cmdargc++] = "--debug";
+
+	cmdargv[cmdargc++] = NULL;
+
+	print_msg(VERBOSITY_DEBUG, _("Executing pg_rewind command...\n"));
+	if (execute_command(exec_path, cmdargv, true) != 0)
+	{
+		if (dry_run)
+			die(_("pg_rewind can't resynchronize data directory \"%s\", nothing was changed on the remote node; run without --rewind on an empty data directory to take a new base backup\n"),
+				data_dir);
+		die(_("pg_rewind of data directory \"%s\" failed, run without --rewind on an empty data directory to take a new base backup\n"),
+			data_dir);
+	}
+	pg_free(exec_path);
+}
+
 /*
  * Cleans specified files that were replicated via basebackup but we don't
  * want it.
@@ -920,16 +993,22 @@ remove_unwanted_files(char *data_dir)
  * Init the datadir
  *
  * This function can either ensure provided datadir is a postgres datadir,
- * or create it using pg_basebackup.
+ * create it using pg_basebackup or resynchronize it using pg_rewind.
  *
  * In any case, new postresql.conf and pg_hba.conf will be copied to the
  * datadir if they are provided.
  */
 static void
-initialize_data_dir(char *data_dir, char *connstr,
+initialize_data_dir(char *data_dir, char *connstr, bool rewind,
 					char *postgresql_conf, char *pg_hba_conf)
 {
-	if (connstr)
+	if (connstr && rewind)
+	{
+		print_msg(VERBOSITY_NORMAL,
+				  _("Rewinding data directory to the remote node...\n"));
+		run_rewind(connstr, data_dir, false);
+	}
+	else if (connstr)
 	{
 		print_msg(VERBOSITY_NORMAL,
 				  _("Creating base backup of the remote node...\n"));
@@ -17,6 +17,8 @@
 #include "postgres.h"
 
 #include <errno.h>
+#include <signal.h>
+#include <fcntl.h>
 #include <unistd.h>
 #include <sys/types.h>
 #include <sys/wait.h>
@@ -34,6 +36,7 @@
 #include "libpq/pqformat.h"
 
 #include "access/heapam.h"
+#include "access/transam.h"
 #include "access/xact.h"
 
 #include "catalog/pg_type.h"
@@ -170,16 +173,14 @@ pgactive_ensure_ext_installed(PGconn *pgconn)
 }
 
 /*
- * Function to execute a given commnd.
- *
- * Any sort of failure in command execution is a FATAL error so that
- * postmaster will just start the per-db worker again.
+ * Start a given command, optionally with its standard input or output
+ * redirected to the given file descriptors (-1 for no redirection).
  */
-static void
-pgactive_execute_command(const char *cmd, char *cmdargv[])
+static pid_t
+pgactive_start_command(const char *cmd, char *cmdargv[], int stdin_fd,
+					   int stdout_fd)
 {
 	pid_t		pid;
-	int			exitstatus;
 
 #ifdef WIN32
 
@@ -197,6 +198,15 @@ pgactive_execute_command(const char *cmd, char *cmdargv[])
 
 	if (pid == 0)				/* child */
 	{
+		if ((stdin_fd >= 0 && dup2(stdin_fd, STDIN_FILENO) < 0) ||
+			(stdout_fd >= 0 && dup2(stdout_fd, STDOUT_FILENO) < 0))
+		{
+			ereport(LOG,
+					(errmsg("could not redirect standard input or output of command \"%s\": %m",
+							cmd)));
+			exit(1);
+		}
+
 		if (execv(cmd, cmdargv) < 0)
 		{
 			ereport(LOG,
@@ -215,7 +225,18 @@ pgactive_execute_command(const char *cmd, char *cmdargv[])
 						cmd)));
 	}
 
-	/* in parent, successful fork */
+	return pid;
+}
+
+/*
+ * Wait for a process started by pgactive_start_command() to exit, and return
+ * its exit status.
+ */
+static int
+pgactive_wait_for_process(pid_t pid, const char *cmd)
+{
+	int			exitstatus;
+
 	ereport(LOG,
 			(errmsg("waiting for process %d to execute command \"%s\" for init_replica",
 					(int) pid, cmd)));
@@ -239,6 +260,18 @@ pgactive_execute_command(const char *cmd, char *cmdargv[])
 		CHECK_FOR_INTERRUPTS();
 	}
 
+	return exitstatus;
+}
+
+/*
+ * Report the exit status of a command run by pgactive_start_command().
+ *
+ * Any sort of failure in command execution is a FATAL error so that
+ * postmaster will just start the per-db worker again.
+ */
+static void
+pgactive_check_command_status(pid_t pid, const char *cmd, int exitstatus)
+{
 	if (exitstatus != 0)
 	{
 		if (WIFEXITED(exitstatus))
@@ -257,6 +290,74 @@ pgactive_execute_command(const char *cmd, char *cmdargv[])
 					cmd)));
 }
 
+/*
+ * Function to execute a given commnd.
+ *
+ * Any sort of failure in command execution is a FATAL error so that
+ * postmaster will just start the per-db worker again.
+ */
+static void
+pgactive_execute_command(const char *cmd, char *cmdargv[])
+{
+	pid_t		pid = pgactive_start_command(cmd, cmdargv, -1, -1);
+
+	pgactive_check_command_status(pid, cmd,
+								  pgactive_wait_for_process(pid, cmd));
+}
+
+/*
+ * Execute two commands with the standard output of the first piped into the
+ * standard input of the second.
+ *
+ * Both commands are waited for before either's failure is reported, so that
+ * neither is left running or unreaped. When one fails, the other one sees its
+ * end of the pipe closed and exits too.
+ */
+static void
+pgactive_execute_pipeline(const char *cmd1, char *cmd1argv[],
+						  const char *cmd2, char *cmd2argv[])
+{
+	int			fds[2];
+	pid_t		pid1;
+	pid_t		pid2;
+	int			exitstatus1;
+	int			exitstatus2;
+
+	/*
+	 * Close-on-exec, so that neither command holds on to the other end of the
+	 * pipe; the redirected copies of the descriptors stay open.
+	 */
+	if (pipe(fds) < 0 ||
+		fcntl(fds[0], F_SETFD, FD_CLOEXEC) < 0 ||
+		fcntl(fds[1], F_SETFD, FD_CLOEXEC) < 0)
+		ereport(ERROR,
+				(errcode_for_file_access(),
+				 errmsg("could not create pipe for init_replica: %m")));
+
+	pid1 = pgactive_start_command(cmd1, cmd1argv, -1, fds[1]);
+	close(fds[1]);
+
+	PG_TRY();
+	{
+		pid2 = pgactive_start_command(cmd2, cmd2argv, fds[0], -1);
+	}
+	PG_CATCH();
+	{
+		close(fds[0]);
+		(void) kill(pid1, SIGTERM);
+		(void) waitpid(pid1, NULL, 0);
+		PG_RE_THROW();
+	}
+	PG_END_TRY();
+	close(fds[0]);
+
+	exitstatus1 = pgactive_wait_for_process(pid1, cmd1);
+	exitstatus2 = pgactive_wait_for_process(pid2, cmd2);
+
+	pgactive_check_command_status(pid1, cmd1, exitstatus1);
+	pgactive_check_command_status(pid2, cmd2, exitstatus2);
+}
+
 static void
 pgactive_get_replication_set_tables(pgactiveNodeInfo * node,
 									pgactiveNodeId * remote,
@@ -332,6 +433,545 @@ found:
 #undef pgactive_EXCLUDE_REPLICATION_SET_NAME
 }
 
+/*
+ * A table, or a range of its blocks, to be copied. The ranges of a table
+ * share its name and column list, which the caller frees separately.
+ */
+typedef struct pgactiveInitStreamItem
+{
+	char	   *table;			/* qualified and quoted name */
+	char	   *columns;		/* quoted column list */
+	bool		binary;			/* use binary COPY */
+	BlockNumber start;			/* first block of the range */
+	BlockNumber end;			/* end of the range, InvalidBlockNumber for
+								 * the whole rest of the table */
+}			pgactiveInitStreamItem;
+
+/*
+ * A connection pair streaming table data from the remote node into the local
+ * node when pgactive.init_node_stream_data is set.
+ */
+typedef struct pgactiveInitStreamJob
+{
+	PGconn	   *remote;
+	PGconn	   *local;
+	char	   *table;			/* table being copied, NULL if idle */
+}			pgactiveInitStreamJob;
+
+typedef struct pgactiveInitStreamState
+{
+	int			maxjobs;
+	int			njobs;			/* jobs with connections opened */
+	pgactiveInitStreamJob *jobs;
+}			pgactiveInitStreamState;
+
+static void
+pgactive_init_stream_cleanup(int code, Datum arg)
+{
+	pgactiveInitStreamState *state = (pgactiveInitStreamState *) DatumGetPointer(arg);
+	int			i;
+
+	for (i = 0; i < state->njobs; i++)
+	{
+		if (state->jobs[i].remote != NULL)
+			PQfinish(state->jobs[i].remote);
+		if (state->jobs[i].local != NULL)
+			PQfinish(state->jobs[i].local);
+		state->jobs[i].remote = NULL;
+		state->jobs[i].local = NULL;
+	}
+}
+
+/*
+ * Open the connections of a streaming job. The remote one reads in the
+ * snapshot the dump is taken in.
+ */
+static void
+pgactive_init_stream_connect(pgactiveInitStreamJob * job, const char *origin_dsn,
+							 const char *local_dsn, const char *snapshot)
+{
+	StringInfoData cmd;
+	PGresult   *res;
+
+	job->remote = PQconnectdb(origin_dsn);
+	if (PQstatus(job->remote) != CONNECTION_OK)
+		ereport(ERROR,
+				(errmsg("could not connect to the remote node to stream initial data: %s",
+						GetPQerrorMessage(job->remote))));
+
+	initStringInfo(&cmd);
+	appendStringInfo(&cmd,
+					 "BEGIN ISOLATION LEVEL REPEATABLE READ READ ONLY; "
+					 "SET TRANSACTION SNAPSHOT '%s';",
+					 snapshot);
+	res = PQexec(job->remote, cmd.data);
+	if (PQresultStatus(res) != PGRES_COMMAND_OK)
+		ereport(ERROR,
+				(errmsg("could not import snapshot %s to stream initial data: %s",
+						snapshot, PQerrorMessage(job->remote))));
+	PQclear(res);
+	pfree(cmd.data);
+
+	job->local = PQconnectdb(local_dsn);
+	if (PQstatus(job->local) != CONNECTION_OK)
+		ereport(ERROR,
+				(errmsg("could not connect to the local node to stream initial data: %s",
+						GetPQerrorMessage(job->local))));
+
+	/*
+	 * Tables are copied concurrently in no particular order, so foreign keys
+	 * already present on a data-only join must not be checked, just as for
+	 * changes applied later.
+	 */
+	res = PQexec(job->local, "SET session_replication_role = replica;");
+	if (PQresultStatus(res) != PGRES_COMMAND_OK)
+		ereport(ERROR,
+				(errmsg("could not set session_replication_role to stream initial data: %s",
+						PQerrorMessage(job->local))));
+	PQclear(res);
+}
+
+/*
+ * Start copying a table, or a range of it, with an idle streaming job.
+ */
+static void
+pgactive_init_stream_start(pgactiveInitStreamJob * job,
+						   pgactiveInitStreamItem * item)
+{
+	StringInfoData cmd;
+	PGresult   *res;
+	const char *options = item->binary ? " WITH (FORMAT binary)" : "";
+
+	Assert(job->table == NULL);
+
+	initStringInfo(&cmd);
+	appendStringInfo(&cmd, "COPY %s (%s) FROM STDIN%s",
+					 item->table, item->columns, options);
+	res = PQexec(job->local, cmd.data);
+	if (PQresultStatus(res) != PGRES_COPY_IN)
+		ereport(ERROR,
+				(errmsg("execution of COPY ... FROM stdin failed"),
+				 errdetail("Query '%s': %s", cmd.data,
+						   PQerrorMessage(job->local))));
+	PQclear(res);
+
+	resetStringInfo(&cmd);
+	if (item->start == 0 && item->end == InvalidBlockNumber)
+		appendStringInfo(&cmd, "COPY %s (%s) TO STDOUT%s",
+						 item->table, item->columns, options);
+	else
+	{
+		/* a TID range scan reads just the blocks of the range */
+		appendStringInfo(&cmd,
+						 "COPY (SELECT %s FROM ONLY %s WHERE ctid >= '(%u,0)'::pg_catalog.tid",
+						 item->columns, item->table, item->start);
+		if (item->end != InvalidBlockNumber)
+			appendStringInfo(&cmd, " AND ctid < '(%u,0)'::pg_catalog.tid",
+							 item->end);
+		appendStringInfo(&cmd, ") TO STDOUT%s", options);
+	}
+	res = PQexec(job->remote, cmd.data);
+	if (PQresultStatus(res) != PGRES_COPY_OUT)
+		ereport(ERROR,
+				(errmsg("execution of COPY ... TO stdout failed"),
+				 errdetail("Query '%s': %s", cmd.data,
+						   PQerrorMessage(job->remote))));
+	PQclear(res);
+	pfree(cmd.data);
+
+	job->table = item->table;
+}
+
+/*
+ * Pass the rows received by a streaming job on to the local node, without
+ * waiting for more. Returns true once the table has been copied completely.
+ */
+static bool
+pgactive_init_stream_pump(pgactiveInitStreamJob * job)
+{
+	PGresult   *res;
+	char	   *copybuf;
+	int			len;
+
+	Assert(job->table != NULL);
+
+	if (PQconsumeInput(job->remote) == 0)
+		ereport(ERROR,
+				(errmsg("reading from origin table %s failed", job->table),
+				 errdetail("Source connection reported: %s",
+						   PQerrorMessage(job->remote))));
+
+	while ((len = PQgetCopyData(job->remote, &copybuf, true)) > 0)
+	{
+		if (PQputCopyData(job->local, copybuf, len) != 1)
+			ereport(ERROR,
+					(errmsg("writing to destination table %s failed", job->table),
+					 errdetail("Destination connection reported: %s",
+							   PQerrorMessage(job->local))));
+		PQfreemem(copybuf);
+	}
+
+	/* no complete row available yet */
+	if (len == 0)
+		return false;
+
+	if (len != -1)
+		ereport(ERROR,
+				(errmsg("reading from origin table %s failed", job->table),
+				 errdetail("Source connection returned %d: %s",
+						   len, PQerrorMessage(job->remote))));
+
+	res = PQgetResult(job->remote);
+	if (PQresultStatus(res) != PGRES_COMMAND_OK)
+		ereport(ERROR,
+				(errmsg("reading from origin table %s failed", job->table),
+				 errdetail("Source connection reported: %s",
+						   PQerrorMessage(job->remote))));
+	PQclear(res);
+	while ((res = PQgetResult(job->remote)) != NULL)
+		PQclear(res);
+
+	if (PQputCopyEnd(job->local, NULL) != 1)
+		ereport(ERROR,
+				(errmsg("sending copy-completion to destination connection failed"),
+				 errdetail("Destination connection reported: %s",
+						   PQerrorMessage(job->local))));
+
+	res = PQgetResult(job->local);
+	if (PQresultStatus(res) != PGRES_COMMAND_OK)
+		ereport(ERROR,
+				(errmsg("writing to destination table %s failed", job->table),
+				 errdetail("Destination connection reported: %s",
+						   PQerrorMessage(job->local))));
+	PQclear(res);
+	while ((res = PQgetResult(job->local)) != NULL)
+		PQclear(res);
+
+	elog(DEBUG1, "streamed initial data of table %s", job->table);
+
+	job->table = NULL;
+
+	return true;
+}
+
+/*
+ * Copy the given tables or table ranges from the remote node into the local
+ * node with up to pgactive.init_node_parallel_jobs of them in flight at once.
+ * The first job's connections are already open.
+ */
+static void
+pgactive_init_stream_tables(pgactiveInitStreamState * state, List *items,
+							const char *origin_dsn, const char *local_dsn,
+							const char *snapshot)
+{
+	WaitEventSet *set;
+	ListCell   *next = list_head(items);
+	int			nactive = 0;
+	int			i;
+
+	Assert(state->njobs == 1);
+
+	while (state->njobs < Min(state->maxjobs, list_length(items)))
+		pgactive_init_stream_connect(&state->jobs[state->njobs++], origin_dsn,
+									 local_dsn, snapshot);
+
+	elog(LOG, "streaming initial data in %d parts with %d jobs",
+		 list_length(items), state->njobs);
+
+#if PG_VERSION_NUM >= 170000
+	set = CreateWaitEventSet(NULL, state->njobs + 2);
+#else
+	set = CreateWaitEventSet(CurrentMemoryContext, state->njobs + 2);
+#endif
+	AddWaitEventToSet(set, WL_LATCH_SET, PGINVALID_SOCKET, &MyProc->procLatch, NULL);
+	AddWaitEventToSet(set, WL_EXIT_ON_PM_DEATH, PGINVALID_SOCKET, NULL, NULL);
+
+	for (i = 0; i < state->njobs; i++)
+	{
+		AddWaitEventToSet(set, WL_SOCKET_READABLE, PQsocket(state->jobs[i].remote),
+						  NULL, NULL);
+
+		if (next != NULL)
+		{
+			pgactive_init_stream_start(&state->jobs[i],
+									   (pgactiveInitStreamItem *) lfirst(next));
+			next = lnext(items, next);
+			nactive++;
+		}
+	}
+
+	while (nactive > 0)
+	{
+		WaitEvent	event;
+
+		for (i = 0; i < state->njobs; i++)
+		{
+			pgactiveInitStreamJob *job = &state->jobs[i];
+
+			if (job->table == NULL || !pgactive_init_stream_pump(job))
+				continue;
+
+			nactive--;
+			if (next != NULL)
+			{
+				pgactive_init_stream_start(job,
+										   (pgactiveInitStreamItem *) lfirst(next));
+				next = lnext(items, next);
+				nactive++;
+			}
+		}
+
+		if (nactive == 0)
+			break;
+
+		if (WaitEventSetWait(set, 1000L, &event, 1, PG_WAIT_EXTENSION) == 1 &&
+			(event.events & WL_LATCH_SET))
+			ResetLatch(&MyProc->procLatch);
+		CHECK_FOR_INTERRUPTS();
+	}
+
+	FreeWaitEventSet(set);
+}
+
+/*
+ * Streaming variant of the dump and restore below, used when
+ * pgactive.init_node_stream_data is set. Nothing but the post-data section of
+ * the schema, which is restored in parallel, is stored in tmpdir:
+ *
+ * 1. pg_dump's pre-data and data sections, except for the data of regular
+ *    tables, are piped into pg_restore.
+ * 2. The data of regular tables is streamed with COPY from the remote node's
+ *    snapshot into the local node, several tables at a time. Big tables are
+ *    split into block ranges copied in parallel, and binary COPY is used
+ *    where the binary format can be read by the local node.
+ * 3. The post-data section - indexes, constraints, triggers and the like - is
+ *    dumped to tmpdir and restored with pg_restore --jobs.
+ *
+ * table_args are the pg_dump options selecting tables per replication set,
+ * and table_filter the corresponding condition on pg_class.
+ */
+static void
+pgactive_init_stream_dump_restore(const char *snapshot, const char *tmpdir,
+								  char *dump_path, char *restore_path,
+								  char *origin_dsn, char *local_dsn,
+								  List *table_args, const char *table_filter)
+{
+	pgactiveInitStreamState state;
+	StringInfoData cmd;
+	PGresult   *res;
+	List	   *items = NIL;
+	List	   *item_strings = NIL;
+	List	   *exclude_args = NIL;
+	bool		binary_ok;
+	bool		data_only = pgactive_get_data_only_node_init(MyDatabaseId);
+	BlockNumber range_blocks = pgactive_debug_init_node_stream_range_size;
+	char	  **dumpargv;
+	char	   *restoreargv[8];
+	char		arg_jobs[12];
+	char		arg_snapshot[MAXPGPATH];
+	char		arg_dbname[MAXPGPATH];
+	char		arg_file[MAXPGPATH];
+	char		postdata_path[MAXPGPATH];
+	ListCell   *lc;
+	int			argc;
+	int			i;
+
+	state.maxjobs = pgactive_init_node_parallel_jobs;
+	state.njobs = 1;
+	state.jobs = palloc0(state.maxjobs * sizeof(pgactiveInitStreamJob));
+
+	PG_ENSURE_ERROR_CLEANUP(pgactive_init_stream_cleanup,
+							PointerGetDatum(&state));
+	{
+		pgactive_init_stream_connect(&state.jobs[0], origin_dsn, local_dsn,
+									 snapshot);
+
+		/*
+		 * Binary COPY is only used between nodes of the same major version,
+		 * for tables with built-in column types only: the binary format of
+		 * arrays and composites carries type OIDs, which differ between nodes
+		 * for user-defined types.
+		 */
+		binary_ok = (PQserverVersion(state.jobs[0].remote) / 10000 ==
+					 PG_VERSION_NUM / 10000);
+
+		/*
+		 * Regular tables whose data pg_dump would dump, as of the snapshot,
+		 * biggest first so they don't end up being copied last. Extension
+		 * configuration tables are left to pg_dump, which knows how to filter
+		 * them. Generated columns are computed on the local node.
+		 */
+		initStringInfo(&cmd);
+		appendStringInfo(&cmd,
+						 "SELECT pg_catalog.format('%%I.%%I', n.nspname, c.relname), "
+						 "pg_catalog.pg_relation_size(c.oid) / pg_catalog.current_setting('block_size')::pg_catalog.int8, "
+						 "(SELECT pg_catalog.string_agg(pg_catalog.quote_ident(a.attname), ', ' ORDER BY a.attnum) "
+						 " FROM pg_catalog.pg_attribute a "
+						 " WHERE a.attrelid = c.oid AND a.attnum > 0 "
+						 " AND NOT a.attisdropped AND a.attgenerated = ''), "
+						 "NOT EXISTS (SELECT 1 FROM pg_catalog.pg_attribute a "
+						 " WHERE a.attrelid = c.oid AND a.attnum > 0 "
+						 " AND NOT a.attisdropped AND a.atttypid >= %u) "
+						 "FROM pg_catalog.pg_class c "
+						 "JOIN pg_catalog.pg_namespace n ON n.oid = c.relnamespace "
+						 "WHERE c.relkind = 'r' AND c.relpersistence <> 't' "
+						 "AND n.nspname <> 'information_schema' "
+						 "AND n.nspname NOT LIKE 'pg\\_%%' "
+						 "AND NOT EXISTS (SELECT 1 FROM pg_catalog.pg_depend d "
+						 "WHERE d.classid = 'pg_catalog.pg_class'::pg_catalog.regclass "
+						 "AND d.objid = c.oid AND d.deptype = 'e') "
+						 "%s "
+						 "ORDER BY 2 DESC",
+						 FirstNormalObjectId, table_filter);
+		res = PQexec(state.jobs[0].remote, cmd.data);
+		if (PQresultStatus(res) != PGRES_TUPLES_OK)
+			ereport(ERROR,
+					(errmsg("could not get tables to stream initial data of: %s",
+							PQerrorMessage(state.jobs[0].remote))));
+
+		for (i = 0; i < PQntuples(res); i++)
+		{
+			char	   *table = pstrdup(PQgetvalue(res, i, 0));
+			BlockNumber nblocks = (BlockNumber) strtoul(PQgetvalue(res, i, 1), NULL, 10);
+			char	   *columns = pstrdup(PQgetvalue(res, i, 2));
+			bool		binary = binary_ok && PQgetvalue(res, i, 3)[0] == 't';
+			BlockNumber start = 0;
+
+			/* can't be copied with a column list, leave it to pg_dump */
+			if (columns[0] == '\0')
+			{
+				pfree(table);
+				pfree(columns);
+				continue;
+			}
+
+			/* shared by the items of the table's ranges */
+			item_strings = lappend(item_strings, table);
+			item_strings = lappend(item_strings, columns);
+
+			/*
+			 * Split big tables into block ranges, copied concurrently, so the
+			 * biggest table doesn't decide how long the initial data copy
+			 * takes; see pgactive.debug_init_node_stream_range_size. The
+			 * table may have grown since its size was read, so the last range
+			 * extends to the end of the table.
+			 */
+			for (;;)
+			{
+				pgactiveInitStreamItem *item = palloc(sizeof(pgactiveInitStreamItem));
+
+				item->table = table;
+				item->columns = columns;
+				item->binary = binary;
+				item->start = start;
+				item->end = InvalidBlockNumber;
+
+				/* don't leave a small range at the end */
+				if (state.maxjobs > 1 &&
+					nblocks - start > range_blocks + range_blocks / 2)
+					item->end = start + range_blocks;
+				items = lappend(items, item);
+
+				if (item->end == InvalidBlockNumber)
+					break;
+				start = item->end;
+			}
+
+			/* a quoted identifier is matched literally by pg_dump */
+			exclude_args = lappend(exclude_args,
+								   psprintf("--exclude-table-data=%s", table));
+		}
+		PQclear(res);
+		pfree(cmd.data);
+
+		dumpargv = (char **) palloc0((16 + list_length(table_args) +
+									  list_length(exclude_args)) * sizeof(char *));
+
+		snprintf(arg_snapshot, sizeof(arg_snapshot), "--snapshot=%s", snapshot);
+		snprintf(arg_dbname, sizeof(arg_dbname), "--dbname=%s", local_dsn);
+
+		/* pre-data and data, except for the tables streamed */
+		argc = 0;
+		dumpargv[argc++] = dump_path;
+		dumpargv[argc++] = "--exclude-table=pgactive.pgactive_nodes";
+		dumpargv[argc++] = "--exclude-table=pgactive.pgactive_connections";
+		dumpargv[argc++] = "--pgactive-init-node";
+		dumpargv[argc++] = arg_snapshot;
+		dumpargv[argc++] = "--format=custom";
+		if (data_only)
+			dumpargv[argc++] = "--data-only";
+		else
+		{
+			dumpargv[argc++] = "--section=pre-data";
+			dumpargv[argc++] = "--section=data";
+		}
+		dumpargv[argc++] = origin_dsn;
+		foreach(lc, table_args)
+			dumpargv[argc++] = (char *) lfirst(lc);
+		foreach(lc, exclude_args)
+			dumpargv[argc++] = (char *) lfirst(lc);
+		dumpargv[argc++] = NULL;
+
+		argc = 0;
+		restoreargv[argc++] = restore_path;
+		restoreargv[argc++] = "--exit-on-error";
+		restoreargv[argc++] = "--format=custom";
+		restoreargv[argc++] = arg_dbname;
+		restoreargv[argc++] = NULL;
+
+		pgactive_execute_pipeline(dump_path, dumpargv, restore_path, restoreargv);
+
+		pgactive_init_stream_tables(&state, items, origin_dsn, local_dsn,
+									snapshot);
+
+		pgactive_init_stream_cleanup(0, PointerGetDatum(&state));
+
+		if (!data_only)
+		{
+			snprintf(postdata_path, sizeof(postdata_path), "%s/post-data.dump",
+					 tmpdir);
+			snprintf(arg_file, sizeof(arg_file), "--file=%s", postdata_path);
+			snprintf(arg_jobs, sizeof(arg_jobs), "--jobs=%d",
+					 pgactive_init_node_parallel_jobs);
+
+			argc = 0;
+			dumpargv[argc++] = dump_path;
+			dumpargv[argc++] = "--exclude-table=pgactive.pgactive_nodes";
+			dumpargv[argc++] = "--exclude-table=pgactive.pgactive_connections";
+			dumpargv[argc++] = "--pgactive-init-node";
+			dumpargv[argc++] = arg_snapshot;
+			dumpargv[argc++] = "--format=custom";
+			dumpargv[argc++] = "--section=post-data";
+			dumpargv[argc++] = arg_file;
+			dumpargv[argc++] = origin_dsn;
+			foreach(lc, table_args)
+				dumpargv[argc++] = (char *) lfirst(lc);
+			dumpargv[argc++] = NULL;
+
+			pgactive_execute_command(dump_path, dumpargv);
+
+			argc = 0;
+			restoreargv[argc++] = restore_path;
+			restoreargv[argc++] = "--exit-on-error";
+			restoreargv[argc++] = arg_jobs;
+			restoreargv[argc++] = "--format=custom";
+			restoreargv[argc++] = arg_dbname;
+			restoreargv[argc++] = postdata_path;
+			restoreargv[argc++] = NULL;
+
+			pgactive_execute_command(restore_path, restoreargv);
+		}
+	}
+	PG_END_ENSURE_ERROR_CLEANUP(pgactive_init_stream_cleanup,
+								PointerGetDatum(&state));
+
+	pfree(dumpargv);
+	list_free_deep(items);
+	list_free_deep(item_strings);
+	list_free_deep(exclude_args);
+	pfree(state.jobs);
+}
+
 /*
  * Copy the contents of a remote node using pg_dump and apply it to the local
  * node using pg_restore. Runs during node join creation to bring up a new
@@ -467,78 +1107,103 @@ pgactive_init_exec_dump_restore(pgactiveNodeInfo * node,
 		 */
 		pgactive_get_replication_set_tables(node, remote, conn, &tables,
 											&is_include_set, &is_exclude_set);
-		cmdargv = (char **) palloc0((pgactive_MAX_NO_OF_NON_TABLE_OPTS + list_length(tables))
-									* sizeof(char *));
-
-		/* Get contents from remote node with pg_dump */
-		snprintf(arg_jobs, sizeof(arg_jobs), "--jobs=%d", pgactive_init_node_parallel_jobs);
-		snprintf(arg_tmp1, sizeof(arg_tmp1), "--snapshot=%s", snapshot);
-		snprintf(arg_tmp2, sizeof(arg_tmp2), "--file=%s", tmpdir);
-
-		cmdargc = 0;
-		cmdargv[cmdargc++] = pgactive_dump_path;
-		cmdargv[cmdargc++] = "--exclude-table=pgactive.pgactive_nodes";
-		cmdargv[cmdargc++] = "--exclude-table=pgactive.pgactive_connections";
-		cmdargv[cmdargc++] = "--pgactive-init-node";
-		cmdargv[cmdargc++] = arg_jobs;
-		cmdargv[cmdargc++] = arg_tmp1;
-		cmdargv[cmdargc++] = "--format=directory";
-		cmdargv[cmdargc++] = arg_tmp2;
-		cmdargv[cmdargc++] = origin_dsn->data;
-
-		if (pgactive_get_data_only_node_init(MyDatabaseId))
-			cmdargv[cmdargc++] = "--data-only";
 
 		foreach(lc, tables)
 		{
 			char	   *table = (char *) lfirst(lc);
 			char		table_arg[2 * NAMEDATALEN]; /* For option name + table
 													 * name */
-			char	   *ptr;
 
 			if (is_include_set)
 				snprintf(table_arg, (2 * NAMEDATALEN), "--table=%s", table);
 			else if (is_exclude_set)
 				snprintf(table_arg, (2 * NAMEDATALEN), "--exclude-table=%s", table);
 
-			ptr = pstrdup(table_arg);
-			table_args = lappend(table_args, ptr);
-			cmdargv[cmdargc++] = ptr;
+			table_args = lappend(table_args, pstrdup(table_arg));
 		}
 
-		cmdargv[cmdargc++] = NULL;
+		if (pgactive_init_node_stream_data)
+		{
+			const char *table_filter = "";
 
-		pgactive_execute_command(pgactive_dump_path, cmdargv);
+			if (is_include_set)
+				table_filter = "AND c.oid IN (SELECT pgactive.pgactive_get_replication_set_tables(ARRAY['include_rs'])::pg_catalog.regclass)";
+			else if (is_exclude_set)
+				table_filter = "AND c.oid NOT IN (SELECT pgactive.pgactive_get_replication_set_tables(ARRAY['exclude_rs'])::pg_catalog.regclass)";
 
-		list_free_deep(tables);
-		tables = NIL;
-		list_free_deep(table_args);
-		table_args = NIL;
+			pgactive_init_stream_dump_restore(snapshot, tmpdir,
+											  pgactive_dump_path,
+											  pgactive_restore_path,
+											  origin_dsn->data, local_dsn->data,
+											  table_args, table_filter);
 
-		/*
-		 * We don't need this flag anymore after the dump finishes, so reset
-		 * it
-		 */
-		pgactive_set_data_only_node_init(MyDatabaseId, false);
+			/*
+			 * The data only flag isn't needed anymore after the dump
+			 * finishes, so reset it
+			 */
+			pgactive_set_data_only_node_init(MyDatabaseId, false);
+		}
+		else
+		{
+			cmdargv = (char **) palloc0((pgactive_MAX_NO_OF_NON_TABLE_OPTS + list_length(tables))
+										* sizeof(char *));
 
-		/*
-		 * Restore contents from remote node on to local node with pg_restore.
-		 */
+			/* Get contents from remote node with pg_dump */
+			snprintf(arg_jobs, sizeof(arg_jobs), "--jobs=%d", pgactive_init_node_parallel_jobs);
+			snprintf(arg_tmp1, sizeof(arg_tmp1), "--snapshot=%s", snapshot);
+			snprintf(arg_tmp2, sizeof(arg_tmp2), "--file=%s", tmpdir);
+
+			cmdargc = 0;
+			cmdargv[cmdargc++] = pgactive_dump_path;
+			cmdargv[cmdargc++] = "--exclude-table=pgactive.pgactive_nodes";
+			cmdargv[cmdargc++] = "--exclude-table=pgactive.pgactive_connections";
+			cmdargv[cmdargc++] = "--pgactive-init-node";
+			cmdargv[cmdargc++] = arg_jobs;
+			cmdargv[cmdargc++] = arg_tmp1;
+			cmdargv[cmdargc++] = "--format=directory";
+			cmdargv[cmdargc++] = arg_tmp2;
+			cmdargv[cmdargc++] = origin_dsn->data;
+
+			if (pgactive_get_data_only_node_init(MyDatabaseId))
+				cmdargv[cmdargc++] = "--data-only";
 
-		snprintf(arg_jobs, sizeof(arg_jobs), "--jobs=%d", pgactive_init_node_parallel_jobs);
-		snprintf(arg_tmp1, sizeof(arg_tmp1), "--dbname=%s", local_dsn->data);
+			foreach(lc, table_args)
+				cmdargv[cmdargc++] = (char *) lfirst(lc);
 
-		cmdargc = 0;
-		cmdargv[cmdargc++] = pgactive_restore_path;
-		cmdargv[cmdargc++] = "--exit-on-error";
-		cmdargv[cmdargc++] = arg_jobs;
-		cmdargv[cmdargc++] = "--format=directory";
-		cmdargv[cmdargc++] = arg_tmp1;
-		cmdargv[cmdargc++] = tmpdir;
-		cmdargv[cmdargc++] = NULL;
+			cmdargv[cmdargc++] = NULL;
 
-		pgactive_execute_command(pgactive_restore_path, cmdargv);
-		pfree(cmdargv);
+			pgactive_execute_command(pgactive_dump_path, cmdargv);
+
+			list_free_deep(tables);
+			tables = NIL;
+			list_free_deep(table_args);
+			table_args = NIL;
+
+			/*
+			 * We don't need this flag anymore after the dump finishes, so reset
+			 * it
+			 */
+			pgactive_set_data_only_node_init(MyDatabaseId, false);
+
+			/*
+			 * Restore contents from remote node on to local node with pg_restore.
+			 */
+
+			snprintf(arg_jobs, sizeof(arg_jobs), "--jobs=%d", pgactive_init_node_parallel_jobs);
+			snprintf(arg_tmp1, sizeof(arg_tmp1), "--dbname=%s", local_dsn->data);
+
+			cmdargc = 0;
+			cmdargv[cmdargc++] = pgactive_restore_path;
+			cmdargv[cmdargc++] = "--exit-on-error";
+			cmdargv[cmdargc++] = arg_jobs;
+			cmdargv[cmdargc++] = "--format=directory";
+			cmdargv[cmdargc++] = arg_tmp1;
+			cmdargv[cmdargc++] = tmpdir;
+			cmdargv[cmdargc++] = NULL;
+
+			pgactive_execute_command(pgactive_restore_path, cmdargv);
+			pfree(cmdargv);
+		}
 	}
 	PG_END_ENSURE_ERROR_CLEANUP(destroy_temp_dump_dir,
 								PointerGetDatum(tmpdir));
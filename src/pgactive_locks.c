@@ -33,6 +33,15 @@
  *    carries no deadlock hazard because the weakest lock mode is still an
  *    exclusive lock.
  *
+ *    A 'write' lock may be limited to a set of relations, for DDL like ALTER
+ *    TABLE that only affects the rows of the tables it alters. The holder
+ *    still owns the local DDL locks on each node exclusively, but peers only
+ *    block and cancel writers of those relations instead of all writers. The
+ *    relations are sent by name in the 'acquire_lock' message; if a peer
+ *    can't resolve all of them, it falls back to locking the whole database.
+ *    The scope isn't stored in pgactive_global_locks, so locks reacquired at
+ *    startup always cover the whole database.
+ *
  *    Note that DDL locking in 'write' mode flushes the queues of all edges in
  *    the node graph, not just those between the acquiring node and its peers.
  *    If node A requests the lock, then it must have fully replayed from B and
@@ -165,16 +174,23 @@
 
 #include "commands/dbcommands.h"
 #include "catalog/indexing.h"
+#include "catalog/namespace.h"
+#include "catalog/partition.h"
+#include "catalog/pg_inherits.h"
 
 #include "executor/executor.h"
 
 #include "libpq/pqformat.h"
 
+#include "nodes/makefuncs.h"
+
 #include "replication/message.h"
 #include "replication/origin.h"
 #include "replication/slot.h"
 
 #include "storage/barrier.h"
+#include "storage/condition_variable.h"
+#include "storage/lock.h"
 #include "storage/lwlock.h"
 #include "storage/proc.h"
 #include "storage/procarray.h"
@@ -186,6 +202,7 @@
 
 #include "utils/builtins.h"
 #include "utils/fmgroids.h"
+#include "utils/lsyscache.h"
 #include "utils/memutils.h"
 #include "utils/pg_lsn.h"
 #include "utils/rel.h"
@@ -230,11 +247,19 @@ typedef enum pgactiveLockState
 
 }			pgactiveLockState;
 
-typedef struct pgactiveLockWaiter
-{
-	PGPROC	   *proc;
-	slist_node	node;
-}			pgactiveLockWaiter;
+/*
+ * Flags of pgactiveLocksDBState.dml_state. DML may proceed without further
+ * checks if the state is exactly pgactive_LOCKS_DML_LOADED.
+ */
+#define pgactive_LOCKS_DML_LOADED	0x01	/* locked_and_loaded */
+#define pgactive_LOCKS_DML_BLOCKED	0x02	/* a peer holds the write lock */
+#define pgactive_LOCKS_DML_RELATIONS	0x04	/* ... limited to some relations */
+
+/*
+ * Maximum number of relations a write lock may be limited to. Statements
+ * touching more lock the whole database.
+ */
+#define pgactive_LOCKS_MAX_RELATIONS	64
 
 typedef struct pgactiveLocksDBState
 {
@@ -269,6 +294,13 @@ typedef struct pgactiveLocksDBState
 	/* Type of lock held or being acquired */
 	pgactiveLockType lock_type;
 
+	/*
+	 * Relations a write lock is limited to. nrelids = 0 means the whole
+	 * database, which is all there is for weaker locks.
+	 */
+	int			nrelids;
+	Oid			relids[pgactive_LOCKS_MAX_RELATIONS];
+
 	/*
 	 * Progress of lock acquisition. We need this so that if we set lock_type
 	 * then rollback a subxact, or if we start a lock upgrade, we know we're
@@ -285,14 +317,22 @@ typedef struct pgactiveLocksDBState
 	XLogRecPtr	replay_confirmed_lsn;
 
 	Latch	   *requestor;
-	slist_head	waiters;		/* list of waiting PGPROCs */
+
+	/*
+	 * Summary of the above for pgactive_locks_check_dml(), which runs for
+	 * every writing statement and reads it without taking the lock. Only
+	 * updated by pgactive_locks_publish_dml_state().
+	 */
+	pg_atomic_uint32 dml_state;
+
+	/* broadcast when DML may proceed again */
+	ConditionVariable dml_cv;
 }			pgactiveLocksDBState;
 
 typedef struct pgactiveLocksCtl
 {
 	LWLockId	lock;
 	pgactiveLocksDBState *dbstate;
-	pgactiveLockWaiter *waiters;
 }			pgactiveLocksCtl;
 
 typedef struct pgactiveLockXactCallbackInfo
@@ -319,8 +359,11 @@ static char *pgactive_lock_state_to_name(pgactiveLockState lock_state);
 static void pgactive_request_replay_confirmation(void);
 static void pgactive_send_confirm_lock(void);
 
-static void pgactive_locks_addwaiter(PGPROC *proc);
-static void pgactive_locks_on_unlock(void);
+static void pgactive_locks_init_database(pgactiveLocksDBState * db);
+static void pgactive_locks_publish_dml_state(void);
+static bool pgactive_locks_scope_covers(const Oid *relids, int nrelids);
+static void pgactive_locks_set_scope(const Oid *relids, int nrelids);
+static int	pgactive_locks_resolve_relations(List *relations, Oid *relids);
 static int	ddl_lock_log_level(int);
 static void register_holder_xact_callback(void);
 static void register_state_xact_callback(void);
@@ -347,11 +390,9 @@ static size_t
 pgactive_locks_shmem_size(void)
 {
 	Size		size = 0;
-	uint32		TotalProcs = MaxBackends + NUM_AUXILIARY_PROCS;
 
 	size = add_size(size, sizeof(pgactiveLocksCtl));
 	size = add_size(size, mul_size(sizeof(pgactiveLocksDBState), pgactive_max_databases));
-	size = add_size(size, mul_size(sizeof(pgactiveLockWaiter), TotalProcs));
 
 	return size;
 }
@@ -370,11 +411,15 @@ pgactive_locks_shmem_startup(void)
 										 &found);
 	if (!found)
 	{
+		int			off;
+
 		memset(pgactive_locks_ctl, 0, pgactive_locks_shmem_size());
 		pgactive_locks_ctl->lock = &(GetNamedLWLockTranche("pgactive_locks")->lock);
-		pgactive_locks_ctl->dbstate = (pgactiveLocksDBState *) pgactive_locks_ctl + sizeof(pgactiveLocksCtl);
-		pgactive_locks_ctl->waiters = (pgactiveLockWaiter *) pgactive_locks_ctl + sizeof(pgactiveLocksCtl) +
-			mul_size(sizeof(pgactiveLocksDBState), pgactive_max_databases);
+		pgactive_locks_ctl->dbstate = (pgactiveLocksDBState *)
+			((char *) pgactive_locks_ctl + sizeof(pgactiveLocksCtl));
+
+		for (off = 0; off < pgactive_max_databases; off++)
+			pgactive_locks_init_database(&pgactive_locks_ctl->dbstate[off]);
 	}
 	LWLockRelease(AddinShmemInitLock);
 }
@@ -395,73 +440,145 @@ pgactive_locks_shmem_init(void)
 	shmem_startup_hook = pgactive_locks_shmem_startup;
 }
 
-/* Waiter manipulation. */
-void
-pgactive_locks_addwaiter(PGPROC *proc)
+/*
+ * Reset a database's lock state.
+ */
+static void
+pgactive_locks_init_database(pgactiveLocksDBState * db)
 {
-#if PG_VERSION_NUM < 170000
-	pgactiveLockWaiter *waiter = &pgactive_locks_ctl->waiters[proc->pgprocno];
-#else
-	pgactiveLockWaiter *waiter = &pgactive_locks_ctl->waiters[GetNumberFromPGProc(proc)];
-#endif
-	slist_iter	iter;
+	memset(db, 0, sizeof(pgactiveLocksDBState));
+	pg_atomic_init_u32(&db->dml_state, 0);
+	ConditionVariableInit(&db->dml_cv);
+}
 
-	waiter->proc = proc;
+/*
+ * Update the dml_state of our database after changing what it summarizes,
+ * and wake up backends waiting in pgactive_locks_check_dml() to check again.
+ *
+ * Must be called with pgactive_locks_ctl->lock held exclusively.
+ */
+static void
+pgactive_locks_publish_dml_state(void)
+{
+	pgactiveLocksDBState *db = pgactive_my_locks_database;
+	uint32		dml_state = 0;
+
+	Assert(LWLockHeldByMeInMode(pgactive_locks_ctl->lock, LW_EXCLUSIVE));
+
+	if (db->locked_and_loaded)
+		dml_state |= pgactive_LOCKS_DML_LOADED;
+
+	/* same test as pgactive_locks_peer_has_lock(pgactive_LOCK_WRITE) */
+	if (db->lockcount > 0 &&
+		db->lock_type >= pgactive_LOCK_WRITE &&
+		db->lock_holder != InvalidRepOriginId)
+		dml_state |= db->nrelids > 0 ?
+			pgactive_LOCKS_DML_RELATIONS : pgactive_LOCKS_DML_BLOCKED;
+
+	/* full barrier, so the state is published before anyone's woken up */
+	(void) pg_atomic_exchange_u32(&db->dml_state, dml_state);
 
 	/*
-	 * The waiter list shouldn't be huge, and compared to the expense of a DDL
-	 * lock it's cheap to check if we're already registered. After all, we're
-	 * just adding ourselves to a wait-notification list. slist has no guard
-	 * against adding a cycle, and we'd infinite-loop in
-	 * pgactive_locks_on_unlock otherwise. See
-	 * 2ndQuadrant/pgactive-private#130.
+	 * Wake waiters on every change, not only when DML may proceed
+	 * everywhere: a released or narrowed lock may no longer block the
+	 * relations they write to, which the state word doesn't tell. This runs
+	 * on lock state changes only, so broadcasting when nobody waits is
+	 * cheap enough.
 	 */
-	slist_foreach(iter, &pgactive_my_locks_database->waiters)
+	elog(ddl_lock_log_level(DDL_LOCK_TRACE_DEBUG),
+		 LOCKTRACE "waking up backends waiting to perform DML");
+	ConditionVariableBroadcast(&db->dml_cv);
+}
+
+/*
+ * Does the write lock held or being acquired in our database block writes to
+ * all of the given relations? nrelids = 0 stands for the whole database.
+ */
+static bool
+pgactive_locks_scope_covers(const Oid *relids, int nrelids)
+{
+	pgactiveLocksDBState *db = pgactive_my_locks_database;
+	int			i,
+				j;
+
+	if (db->nrelids == 0)
+		return true;
+
+	if (nrelids == 0)
+		return false;
+
+	for (i = 0; i < nrelids; i++)
 	{
-		if (iter.cur == &waiter->node)
+		for (j = 0; j < db->nrelids; j++)
 		{
-			elog(WARNING, LOCKTRACE "backend %d already registered as waiter for DDL lock release",
-				 MyProcPid);
-			Assert(false);		/* crash in debug builds */
-			return;
+			if (db->relids[j] == relids[i])
+				break;
 		}
+
+		if (j == db->nrelids)
+			return false;
 	}
-	slist_push_head(&pgactive_my_locks_database->waiters, &waiter->node);
 
-	elog(ddl_lock_log_level(DDL_LOCK_TRACE_DEBUG), LOCKTRACE "backend started waiting on DDL lock");
+	return true;
 }
 
-void
-pgactive_locks_on_unlock(void)
+/*
+ * Limit the lock in our database to the given relations, or lift the limit if
+ * nrelids = 0.
+ *
+ * Must be called with pgactive_locks_ctl->lock held exclusively.
+ */
+static void
+pgactive_locks_set_scope(const Oid *relids, int nrelids)
 {
-	while (!slist_is_empty(&pgactive_my_locks_database->waiters))
-	{
-		slist_node *node;
-		pgactiveLockWaiter *waiter;
-		PGPROC	   *proc;
+	Assert(LWLockHeldByMeInMode(pgactive_locks_ctl->lock, LW_EXCLUSIVE));
+	Assert(nrelids >= 0 && nrelids <= pgactive_LOCKS_MAX_RELATIONS);
 
-		node = slist_pop_head_node(&pgactive_my_locks_database->waiters);
+	pgactive_my_locks_database->nrelids = nrelids;
+	if (nrelids > 0)
+		memcpy(pgactive_my_locks_database->relids, relids, nrelids * sizeof(Oid));
+}
 
-		/*
-		 * Detect a self-referencing node and bail out by tossing the rest of
-		 * the list. This shouldn't be necessary, it's an emergency bailout to
-		 * stop us going into an infinite loop while holding a LWLock.
-		 *
-		 * We have to PANIC here so we force shmem and lwlock state to be
-		 * re-inited. We could possibly just clobber the list and exit,
-		 * leaving waiters dangling. But since this should be guarded against
-		 * by pgactive_locks_addwaiter, it shouldn't happen anyway. (See:
-		 * 2ndQuadrant/pgactive-private#130)
-		 */
-		if (slist_has_next(&pgactive_my_locks_database->waiters, node)
-			&& slist_next_node(&pgactive_my_locks_database->waiters, node) == node)
-			elog(PANIC, "cycle detected in DDL lock waiter linked list");
+/*
+ * Look up the relations a peer's write lock request is limited to. Returns
+ * the number of relations found, or 0 - the whole database - if there are
+ * too many or any of them doesn't exist here.
+ *
+ * Runs in the apply worker, outside of a transaction.
+ */
+static int
+pgactive_locks_resolve_relations(List *relations, Oid *relids)
+{
+	MemoryContext old_ctx = CurrentMemoryContext;
+	ListCell   *lc;
+	int			nrelids = 0;
+
+	Assert(!IsTransactionState());
+
+	if (list_length(relations) > pgactive_LOCKS_MAX_RELATIONS)
+		return 0;
+
+	StartTransactionCommand();
+	foreach(lc, relations)
+	{
+		RangeVar   *rv = lfirst_node(RangeVar, lc);
+		Oid			relid = RangeVarGetRelid(rv, NoLock, true);
 
-		waiter = slist_container(pgactiveLockWaiter, node, node);
-		proc = waiter->proc;
+		if (!OidIsValid(relid))
+		{
+			elog(ddl_lock_log_level(DDL_LOCK_TRACE_DEBUG),
+				 LOCKTRACE "relation \"%s.%s\" of lock request not found, locking the whole database",
+				 rv->schemaname, rv->relname);
+			nrelids = 0;
+			break;
+		}
 
-		SetLatch(&proc->procLatch);
+		relids[nrelids++] = relid;
 	}
+	CommitTransactionCommand();
+	MemoryContextSwitchTo(old_ctx);
+
+	return nrelids;
 }
 
 /*
@@ -527,7 +644,7 @@ pgactive_locks_find_database(Oid dboid, bool create)
 	{
 		pgactiveLocksDBState *db = &pgactive_locks_ctl->dbstate[free_off];
 
-		memset(db, 0, sizeof(pgactiveLocksDBState));
+		pgactive_locks_init_database(db);
 		db->dboid = MyDatabaseId;
 		db->in_use = true;
 		return db;
@@ -581,8 +698,6 @@ pgactive_locks_startup(void)
 	if (pgactive_my_locks_database->locked_and_loaded)
 		return;
 
-	slist_init(&pgactive_my_locks_database->waiters);
-
 	/* We haven't yet established how many nodes we're connected to. */
 	pgactive_my_locks_database->nnodes = -1;
 
@@ -615,7 +730,12 @@ pgactive_locks_startup(void)
 
 	scan = systable_beginscan(rel, 0, true, snap, 1, key);
 
-	/* TODO: support multiple locks */
+	/*
+	 * TODO: support multiple locks
+	 *
+	 * The relations a write lock was limited to aren't stored, so the locks
+	 * are reacquired for the whole database.
+	 */
 	while ((tuple = systable_getnext(scan)) != NULL)
 	{
 		Datum		values[10];
@@ -694,7 +814,10 @@ pgactive_locks_startup(void)
 	elog(DEBUG2, "global locking startup completed, local DML enabled");
 
 	/* allow local DML */
+	LWLockAcquire(pgactive_locks_ctl->lock, LW_EXCLUSIVE);
 	pgactive_my_locks_database->locked_and_loaded = true;
+	pgactive_locks_publish_dml_state();
+	LWLockRelease(pgactive_locks_ctl->lock);
 }
 
 /*
@@ -766,12 +889,37 @@ pgactive_locks_process_message(int msg_type, bool transactional, XLogRecPtr lsn,
 	else if (msg_type == pgactive_MESSAGE_ACQUIRE_LOCK)
 	{
 		int			lock_type;
+		List	   *relations = NIL;
 
 		if (message->cursor == message->len)	/* Old proto */
 			lock_type = pgactive_LOCK_WRITE;
 		else
 			lock_type = pq_getmsgint(message, 4);
-		pgactive_process_acquire_ddl_lock(origin, lock_type);
+
+		/* relations a write lock is limited to, if any */
+		if (message->cursor < message->len)
+		{
+			int			nrelations = pq_getmsgint(message, 4);
+			int			i;
+
+			for (i = 0; i < nrelations; i++)
+			{
+				int			nspnamelen;
+				int			relnamelen;
+				char	   *nspname;
+				char	   *relname;
+
+				nspnamelen = pq_getmsgint(message, 2);
+				nspname = (char *) pq_getmsgbytes(message, nspnamelen);
+				relnamelen = pq_getmsgint(message, 2);
+				relname = (char *) pq_getmsgbytes(message, relnamelen);
+
+				relations = lappend(relations,
+									makeRangeVar(nspname, relname, -1));
+			}
+		}
+
+		pgactive_process_acquire_ddl_lock(origin, lock_type, relations);
 	}
 	else if (msg_type == pgactive_MESSAGE_RELEASE_LOCK)
 	{
@@ -884,6 +1032,7 @@ pgactive_lock_holder_xact_callback(XactEvent event, void *arg)
 		Assert(pgactive_my_locks_database->lock_holder_local_pid == MyProcPid);
 		pgactive_my_locks_database->lock_holder_local_pid = 0;
 		pgactive_my_locks_database->lock_type = pgactive_LOCK_NOLOCK;
+		pgactive_my_locks_database->nrelids = 0;
 		pgactive_my_locks_database->lock_state = pgactive_LOCKSTATE_NOLOCK;
 		pgactive_my_locks_database->replay_confirmed = 0;
 		pgactive_my_locks_database->replay_confirmed_lsn = InvalidXLogRecPtr;
@@ -891,8 +1040,7 @@ pgactive_lock_holder_xact_callback(XactEvent event, void *arg)
 
 		/* We requested the lock we're releasing */
 
-		if (pgactive_my_locks_database->lockcount == 0)
-			pgactive_locks_on_unlock();
+		pgactive_locks_publish_dml_state();
 
 		LWLockRelease(pgactive_locks_ctl->lock);
 	}
@@ -975,14 +1123,22 @@ locks_begin_scan(Relation rel, Snapshot snap, const pgactiveNodeId * const node)
 /*
  * Acquire DDL lock on the side that wants to perform DDL.
  *
+ * A write lock can be limited to the relations in relids, so that peers only
+ * block writes to those. NIL locks the whole database.
+ *
  * Called from a user backend when the command filter spots a DDL attempt; runs
  * in the user backend.
  */
 void
-pgactive_acquire_ddl_lock(pgactiveLockType lock_type)
+pgactive_acquire_ddl_lock(pgactiveLockType lock_type, List *relids)
 {
 	StringInfoData s;
+	StringInfoData relnames;
 	TimestampTz endtime PG_USED_FOR_ASSERTS_ONLY = 0;
+	Oid			scope[pgactive_LOCKS_MAX_RELATIONS];
+	int			nscope = 0;
+	ListCell   *lc;
+	int			i;
 
 	Assert(IsTransactionState());
 	/* Not called from within a pgactive worker */
@@ -1008,14 +1164,82 @@ pgactive_acquire_ddl_lock(pgactiveLockType lock_type)
 	Assert((pgactive_my_locks_database->lock_type == pgactive_LOCK_NOLOCK && pgactive_my_locks_database->lockcount == 0 && !this_xact_acquired_lock)
 		   || (pgactive_my_locks_database->lock_type > pgactive_LOCK_NOLOCK && pgactive_my_locks_database->lockcount == 1));
 
+	if (lock_type >= pgactive_LOCK_WRITE &&
+		list_length(relids) <= pgactive_LOCKS_MAX_RELATIONS)
+	{
+		foreach(lc, relids)
+			scope[nscope++] = lfirst_oid(lc);
+	}
+
 	/* No need to do anything if already holding requested lock. */
 	if (this_xact_acquired_lock &&
-		pgactive_my_locks_database->lock_type >= lock_type)
+		pgactive_my_locks_database->lock_type >= lock_type &&
+		(lock_type < pgactive_LOCK_WRITE ||
+		 pgactive_locks_scope_covers(scope, nscope)))
 	{
 		Assert(pgactive_my_locks_database->lock_holder_local_pid == MyProcPid);
 		return;
 	}
 
+	/*
+	 * When widening a write lock limited to some relations, keep them locked.
+	 * Nobody else changes the lock while we hold it.
+	 */
+	if (this_xact_acquired_lock &&
+		pgactive_my_locks_database->lock_type >= pgactive_LOCK_WRITE &&
+		nscope > 0)
+	{
+		Assert(pgactive_my_locks_database->nrelids > 0);
+
+		for (i = 0; i < pgactive_my_locks_database->nrelids; i++)
+		{
+			Oid			relid = pgactive_my_locks_database->relids[i];
+			int			j;
+
+			for (j = 0; j < nscope; j++)
+			{
+				if (scope[j] == relid)
+					break;
+			}
+
+			if (j < nscope)
+				continue;
+
+			if (nscope == pgactive_LOCKS_MAX_RELATIONS)
+			{
+				nscope = 0;
+				break;
+			}
+
+			scope[nscope++] = relid;
+		}
+	}
+
+	/*
+	 * Peers look the relations up by name. If one went away meanwhile, lock
+	 * the whole database instead.
+	 */
+	initStringInfo(&relnames);
+	for (i = 0; i < nscope; i++)
+	{
+		char	   *relname = get_rel_name(scope[i]);
+		char	   *nspname = NULL;
+
+		if (relname != NULL)
+			nspname = get_namespace_name(get_rel_namespace(scope[i]));
+
+		if (nspname == NULL)
+		{
+			nscope = 0;
+			break;
+		}
+
+		pq_sendint(&relnames, strlen(nspname) + 1, 2);
+		appendBinaryStringInfo(&relnames, nspname, strlen(nspname) + 1);
+		pq_sendint(&relnames, strlen(relname) + 1, 2);
+		appendBinaryStringInfo(&relnames, relname, strlen(relname) + 1);
+	}
+
 	/*
 	 * If this is the first time in current transaction that we are trying to
 	 * acquire DDL lock, do the sanity checking first.
@@ -1097,18 +1321,17 @@ pgactive_acquire_ddl_lock(pgactiveLockType lock_type)
 						 pgactive_NODEID_FORMAT_WITHNAME_ARGS(holder))));
 	}
 
-	/*
-	 * There should be nobody waiting to be notified if the DDL lock isn't
-	 * held, and now we hold pgactive_locks_ctl->lock and know the lock is
-	 * free.
-	 */
-	Assert(slist_is_empty(&pgactive_my_locks_database->waiters));
-
 	/* send message about ddl lock */
 	initStringInfo(&s);
 	pgactive_prepare_message(&s, pgactive_MESSAGE_ACQUIRE_LOCK);
 	/* Add lock type */
 	pq_sendint(&s, lock_type, 4);
+	/* and the relations it's limited to, old peers lock the whole database */
+	if (nscope > 0)
+	{
+		pq_sendint(&s, nscope, 4);
+		appendBinaryStringInfo(&s, relnames.data, relnames.len);
+	}
 
 	START_CRIT_SECTION();
 
@@ -1150,6 +1373,7 @@ pgactive_acquire_ddl_lock(pgactiveLockType lock_type)
 	Assert(pgactive_my_locks_database->lock_holder_local_pid == MyProcPid);
 	pgactive_my_locks_database->requestor = &MyProc->procLatch;
 	pgactive_my_locks_database->lock_type = lock_type;
+	pgactive_locks_set_scope(scope, nscope);
 	pgactive_my_locks_database->lock_state = pgactive_LOCKSTATE_ACQUIRE_TALLY_CONFIRMATIONS;
 
 	/* lock looks to be free, try to acquire it */
@@ -1160,14 +1384,15 @@ pgactive_acquire_ddl_lock(pgactiveLockType lock_type)
 	LWLockRelease(pgactive_locks_ctl->lock);
 
 	pfree(s.data);
+	pfree(relnames.data);
 
 	/* ---
 	 * Now wait for standbys to ack ddl lock
 	 * ---
 	 */
 	elog(ddl_lock_log_level(DDL_LOCK_TRACE_DEBUG),
-		 LOCKTRACE "sent DDL lock mode %s request for " pgactive_NODEID_FORMAT_WITHNAME ", waiting for confirmation",
-		 pgactive_lock_type_to_name(lock_type), pgactive_LOCALID_FORMAT_WITHNAME_ARGS);
+		 LOCKTRACE "sent DDL lock mode %s request on %d relations (0 for the whole database) for " pgactive_NODEID_FORMAT_WITHNAME ", waiting for confirmation",
+		 pgactive_lock_type_to_name(lock_type), nscope, pgactive_LOCALID_FORMAT_WITHNAME_ARGS);
 
 #ifdef USE_ASSERT_CHECKING
 	if (pgactive_ddl_lock_acquire_timeout > 0)
@@ -1256,7 +1481,7 @@ pgactive_acquire_global_lock(PG_FUNCTION_ARGS)
 		ereport(WARNING,
 				(errmsg("pgactive.skip_ddl_replication is set, ignoring explicit pgactive.pgactive_acquire_global_lock(...) call")));
 	else
-		pgactive_acquire_ddl_lock(pgactive_lock_name_to_type(mode));
+		pgactive_acquire_ddl_lock(pgactive_lock_name_to_type(mode), NIL);
 
 	PG_RETURN_VOID();
 }
@@ -1295,15 +1520,50 @@ check_is_my_node(const pgactiveNodeId * const node)
 	return pgactive_nodeid_eq(node, &myid);
 }
 
+/*
+ * Virtual transactions holding locks on any of the given relations that
+ * conflict with writes, terminated by an invalid one like the result of
+ * GetConflictingVirtualXIDs().
+ */
+static VirtualTransactionId *
+get_conflicting_relation_vxids(const Oid *relids, int nrelids)
+{
+	VirtualTransactionId *result;
+	int			nresult = 0;
+	int			i;
+
+	result = palloc(sizeof(VirtualTransactionId));
+
+	for (i = 0; i < nrelids; i++)
+	{
+		VirtualTransactionId *vxids;
+		LOCKTAG		tag;
+		int			nvxids;
+
+		SET_LOCKTAG_RELATION(tag, MyDatabaseId, relids[i]);
+		vxids = GetLockConflicts(&tag, ExclusiveLock, &nvxids);
+
+		result = repalloc(result, (nresult + nvxids + 1) * sizeof(VirtualTransactionId));
+		memcpy(&result[nresult], vxids, nvxids * sizeof(VirtualTransactionId));
+		nresult += nvxids;
+		pfree(vxids);
+	}
+
+	SetInvalidVirtualTransactionId(result[nresult]);
+
+	return result;
+}
+
 /*
  * Kill any writing transactions while giving them some grace period for
- * finishing.
+ * finishing. If the lock is limited to some relations, only transactions that
+ * have written to or locked rows of them are affected.
  *
  * Caller is responsible for ensuring that no new writes can be started during
  * the execution of this function.
  */
 static bool
-cancel_conflicting_transactions(void)
+cancel_conflicting_transactions(const Oid *relids, int nrelids)
 {
 	VirtualTransactionId *conflict;
 	TimestampTz killtime,
@@ -1325,7 +1585,10 @@ cancel_conflicting_transactions(void)
 	else
 		TIMESTAMP_NOEND(canceltime);
 
-	conflict = GetConflictingVirtualXIDs(InvalidTransactionId, MyDatabaseId);
+	if (nrelids > 0)
+		conflict = get_conflicting_relation_vxids(relids, nrelids);
+	else
+		conflict = GetConflictingVirtualXIDs(InvalidTransactionId, MyDatabaseId);
 
 #if PG_VERSION_NUM < 170000
 	while (conflict->backendId != InvalidBackendId)
@@ -1445,15 +1708,21 @@ pgactive_request_replay_confirmation(void)
 /*
  * Another node has asked for a DDL lock. Try to acquire the local ddl lock.
  *
+ * A write lock may be limited to the given relations, NIL meaning the whole
+ * database.
+ *
  * Runs in the apply worker.
  */
 void
-pgactive_process_acquire_ddl_lock(const pgactiveNodeId * const node, pgactiveLockType lock_type)
+pgactive_process_acquire_ddl_lock(const pgactiveNodeId * const node, pgactiveLockType lock_type,
+								  List *relations)
 {
 	StringInfoData s;
 	const char *lock_name = pgactive_lock_type_to_name(lock_type);
 	pgactiveNodeId myid;
 	MemoryContext old_ctx = CurrentMemoryContext;
+	Oid			relids[pgactive_LOCKS_MAX_RELATIONS];
+	int			nrelids = 0;
 
 	pgactive_make_my_nodeid(&myid);
 
@@ -1464,9 +1733,12 @@ pgactive_process_acquire_ddl_lock(const pgactiveNodeId * const node, pgactiveLoc
 
 	pgactive_locks_find_my_database(false);
 
+	if (lock_type >= pgactive_LOCK_WRITE && relations != NIL)
+		nrelids = pgactive_locks_resolve_relations(relations, relids);
+
 	elog(ddl_lock_log_level(DDL_LOCK_TRACE_PEERS),
-		 LOCKTRACE "%s lock requested by node " pgactive_NODEID_FORMAT_WITHNAME,
-		 lock_name, pgactive_NODEID_FORMAT_WITHNAME_ARGS(*node));
+		 LOCKTRACE "%s lock on %d relations (0 for the whole database) requested by node " pgactive_NODEID_FORMAT_WITHNAME,
+		 lock_name, nrelids, pgactive_NODEID_FORMAT_WITHNAME_ARGS(*node));
 
 	initStringInfo(&s);
 
@@ -1557,7 +1829,9 @@ pgactive_process_acquire_ddl_lock(const pgactiveNodeId * const node, pgactiveLoc
 		/* setup ddl lock */
 		pgactive_my_locks_database->lockcount++;
 		pgactive_my_locks_database->lock_type = lock_type;
+		pgactive_locks_set_scope(relids, nrelids);
 		pgactive_my_locks_database->lock_holder = replorigin_session_origin;
+		pgactive_locks_publish_dml_state();
 		LWLockRelease(pgactive_locks_ctl->lock);
 
 		if (lock_type >= pgactive_LOCK_WRITE)
@@ -1569,7 +1843,7 @@ pgactive_process_acquire_ddl_lock(const pgactiveNodeId * const node, pgactiveLoc
 			 */
 			elog(ddl_lock_log_level(DDL_LOCK_TRACE_PEERS),
 				 LOCKTRACE "terminating any local processes that conflict with the global lock");
-			if (!cancel_conflicting_transactions())
+			if (!cancel_conflicting_transactions(relids, nrelids))
 			{
 				elog(ddl_lock_log_level(DDL_LOCK_TRACE_PEERS),
 					 LOCKTRACE "failed to terminate, declining the lock");
@@ -1609,7 +1883,9 @@ pgactive_process_acquire_ddl_lock(const pgactiveNodeId * const node, pgactiveLoc
 			 pgactive_NODEID_FORMAT_WITHNAME_ARGS(*node));
 	}
 	else if (pgactive_my_locks_database->lock_holder == replorigin_session_origin &&
-			 lock_type > pgactive_my_locks_database->lock_type)
+			 (lock_type > pgactive_my_locks_database->lock_type ||
+			  (lock_type >= pgactive_LOCK_WRITE &&
+			   !pgactive_locks_scope_covers(relids, nrelids))))
 	{
 		Relation	rel;
 		SysScanDesc scan;
@@ -1681,7 +1957,7 @@ pgactive_process_acquire_ddl_lock(const pgactiveNodeId * const node, pgactiveLoc
 			 */
 			elog(ddl_lock_log_level(DDL_LOCK_TRACE_PEERS),
 				 LOCKTRACE "terminating any local processes that conflict with the global lock");
-			if (!cancel_conflicting_transactions())
+			if (!cancel_conflicting_transactions(relids, nrelids))
 			{
 				elog(ddl_lock_log_level(DDL_LOCK_TRACE_PEERS),
 					 LOCKTRACE "failed to terminate, declining the lock");
@@ -1691,6 +1967,8 @@ pgactive_process_acquire_ddl_lock(const pgactiveNodeId * const node, pgactiveLoc
 			/* update inmemory lock state */
 			LWLockAcquire(pgactive_locks_ctl->lock, LW_EXCLUSIVE);
 			pgactive_my_locks_database->lock_type = lock_type;
+			pgactive_locks_set_scope(relids, nrelids);
+			pgactive_locks_publish_dml_state();
 			LWLockRelease(pgactive_locks_ctl->lock);
 
 			/*
@@ -1958,6 +2236,7 @@ pgactive_locks_release_local_ddl_lock(const pgactiveNodeId * const lock)
 	pgactive_my_locks_database->lockcount--;
 	pgactive_my_locks_database->lock_holder = InvalidRepOriginId;
 	pgactive_my_locks_database->lock_type = pgactive_LOCK_NOLOCK;
+	pgactive_my_locks_database->nrelids = 0;
 	pgactive_my_locks_database->replay_confirmed = 0;
 	pgactive_my_locks_database->replay_confirmed_lsn = InvalidXLogRecPtr;
 	pgactive_my_locks_database->requestor = NULL;
@@ -1966,7 +2245,7 @@ pgactive_locks_release_local_ddl_lock(const pgactiveNodeId * const lock)
 	END_CRIT_SECTION();
 
 	Assert(pgactive_my_locks_database->lockcount == 0);
-	pgactive_locks_on_unlock();
+	pgactive_locks_publish_dml_state();
 
 	LWLockRelease(pgactive_locks_ctl->lock);
 
@@ -2290,12 +2569,12 @@ pgactive_locks_process_remote_startup(const pgactiveNodeId * const node)
 			pgactive_my_locks_database->lockcount--;
 			pgactive_my_locks_database->lock_holder = InvalidRepOriginId;
 			pgactive_my_locks_database->lock_type = pgactive_LOCK_NOLOCK;
+			pgactive_my_locks_database->nrelids = 0;
 			pgactive_my_locks_database->replay_confirmed = 0;
 			pgactive_my_locks_database->replay_confirmed_lsn = InvalidXLogRecPtr;
 		}
 
-		if (pgactive_my_locks_database->lockcount == 0)
-			pgactive_locks_on_unlock();
+		pgactive_locks_publish_dml_state();
 
 		LWLockRelease(pgactive_locks_ctl->lock);
 	}
@@ -2351,14 +2630,72 @@ pgactive_locks_peer_has_lock(pgactiveLockType min_mode)
 }
 
 /*
- * Function for checking if there is no conflicting pgactive lock.
+ * Does a peer's write lock block writes to any of the given relations?
+ */
+static bool
+pgactive_locks_peer_blocks_dml(List *relids)
+{
+	ListCell   *lc;
+
+	if (!pgactive_locks_peer_has_lock(pgactive_LOCK_WRITE))
+		return false;
+
+	if (pgactive_my_locks_database->nrelids == 0)
+		return true;
+
+	foreach(lc, relids)
+	{
+		Oid			relid = lfirst_oid(lc);
+
+		if (pgactive_locks_scope_covers(&relid, 1))
+			return true;
+	}
+
+	return false;
+}
+
+/*
+ * Add the relations that writes to the given ones may also write to: rows
+ * written through a partitioned table are routed to its partitions, which
+ * aren't in the range table of an INSERT, and rows of a partition are also
+ * rows of its ancestors. A write lock may be limited to any of them.
+ */
+static List *
+pgactive_locks_add_partitions(List *relids)
+{
+	List	   *result = list_copy(relids);
+	ListCell   *lc;
+
+	foreach(lc, relids)
+	{
+		Oid			relid = lfirst_oid(lc);
+
+		if (get_rel_relkind(relid) == RELKIND_PARTITIONED_TABLE)
+			result = list_concat_unique_oid(result,
+											find_all_inheritors(relid, NoLock, NULL));
+
+		if (get_rel_relispartition(relid))
+			result = list_concat_unique_oid(result,
+											get_partition_ancestors(relid));
+	}
+
+	return result;
+}
+
+/*
+ * Function for checking if there is no conflicting pgactive lock for a
+ * statement with the given range table.
  *
  * Should be caled from ExecutorStart_hook.
  */
 void
-pgactive_locks_check_dml(void)
+pgactive_locks_check_dml(List *rtable)
 {
+	pgactiveLocksDBState *db;
+	uint32		dml_state;
 	bool		lock_held_by_peer;
+	List	   *relids = NIL;
+	ListCell   *lc;
 
 	/*
 	 * replace pgactive_skip_ddl_locking by pgactive_skip_ddl_replication for
@@ -2368,21 +2705,45 @@ pgactive_locks_check_dml(void)
 		return;
 
 	pgactive_locks_find_my_database(false);
+	db = pgactive_my_locks_database;
+
+	/*
+	 * The common case is that locks are loaded and no peer holds the global
+	 * write lock. That is answered by the state word alone, so writing
+	 * statements don't contend on pgactive_locks_ctl->lock.
+	 */
+	dml_state = pg_atomic_read_u32(&db->dml_state);
+	if (dml_state == pgactive_LOCKS_DML_LOADED)
+		return;
 
 	/*
 	 * The pgactive is still starting up and hasn't loaded locks, wait for it.
 	 * The statement_timeout will kill us if necessary.
 	 */
-	while (!pgactive_my_locks_database->locked_and_loaded)
+	if (!(dml_state & pgactive_LOCKS_DML_LOADED))
 	{
-		CHECK_FOR_INTERRUPTS();
+		ConditionVariablePrepareToSleep(&db->dml_cv);
+		while (!(pg_atomic_read_u32(&db->dml_state) & pgactive_LOCKS_DML_LOADED))
+			ConditionVariableSleep(&db->dml_cv, PG_WAIT_EXTENSION);
+		ConditionVariableCancelSleep();
+	}
+
+	/*
+	 * Relations the statement writes to or locks rows of, for write locks
+	 * limited to some relations.
+	 */
+	foreach(lc, rtable)
+	{
+		RangeTblEntry *rte = lfirst_node(RangeTblEntry, lc);
 
-		/* Probably can't use latch here easily, since init didn't happen yet. */
-		pg_usleep(10000L);
+		if (rte->rtekind == RTE_RELATION && rte->rellockmode > AccessShareLock)
+			relids = list_append_unique_oid(relids, rte->relid);
 	}
+	relids = pgactive_locks_add_partitions(relids);
 
 	/*
-	 * Is this database locked against user initiated dml by another node?
+	 * Is this database, or a relation we're about to write to, locked against
+	 * user initiated dml by another node?
 	 *
 	 * If the locker is our own node we can safely continue. Postgres's normal
 	 * heavyweight locks will ensure consistency, and we'll replay changes in
@@ -2392,7 +2753,7 @@ pgactive_locks_check_dml(void)
 	 * deal with any running xacts then.
 	 */
 	LWLockAcquire(pgactive_locks_ctl->lock, LW_SHARED);
-	lock_held_by_peer = pgactive_locks_peer_has_lock(pgactive_LOCK_WRITE);
+	lock_held_by_peer = pgactive_locks_peer_blocks_dml(relids);
 	LWLockRelease(pgactive_locks_ctl->lock);
 
 	/*
@@ -2403,11 +2764,7 @@ pgactive_locks_check_dml(void)
 	{
 		TimestampTz canceltime;
 
-		/*
-		 * If we add a waiter after the lock is released we may get woken
-		 * unnecessarily, but it won't do any harm.
-		 */
-		pgactive_locks_addwaiter(MyProc);
+		elog(ddl_lock_log_level(DDL_LOCK_TRACE_DEBUG), LOCKTRACE "backend started waiting on DDL lock");
 
 		if (pgactive_ddl_lock_timeout > 0 || LockTimeout > 0)
 			canceltime = TimestampTzPlusMilliseconds(GetCurrentTimestamp(),
@@ -2415,30 +2772,38 @@ pgactive_locks_check_dml(void)
 		else
 			TIMESTAMP_NOEND(canceltime);
 
-		/* Wait for lock to be released. */
+		/*
+		 * Wait for lock to be released. Once we're prepared to sleep, a
+		 * release will wake us even if it happens before we sleep.
+		 */
+		ConditionVariablePrepareToSleep(&db->dml_cv);
 		for (;;)
 		{
-			if (!TIMESTAMP_IS_NOEND(canceltime) &&
-				GetCurrentTimestamp() < canceltime)
-			{
-				ereport(ERROR,
-						(errcode(ERRCODE_LOCK_NOT_AVAILABLE),
-						 errmsg("canceling statement due to global lock timeout")));
-			}
-
 			LWLockAcquire(pgactive_locks_ctl->lock, LW_SHARED);
-			lock_held_by_peer = pgactive_locks_peer_has_lock(pgactive_LOCK_WRITE);
+			lock_held_by_peer = pgactive_locks_peer_blocks_dml(relids);
 			LWLockRelease(pgactive_locks_ctl->lock);
 
 			if (!lock_held_by_peer)
 				break;
 
-			(void) pgactiveWaitLatch(&MyProc->procLatch,
-									 WL_LATCH_SET | WL_TIMEOUT | WL_EXIT_ON_PM_DEATH,
-									 10000L, PG_WAIT_EXTENSION);
-			ResetLatch(&MyProc->procLatch);
-			CHECK_FOR_INTERRUPTS();
+			if (TIMESTAMP_IS_NOEND(canceltime))
+				ConditionVariableSleep(&db->dml_cv, PG_WAIT_EXTENSION);
+			else
+			{
+				long		timeout;
+
+				timeout = TimestampDifferenceMilliseconds(GetCurrentTimestamp(),
+														  canceltime);
+				if (timeout <= 0)
+					ereport(ERROR,
+							(errcode(ERRCODE_LOCK_NOT_AVAILABLE),
+							 errmsg("canceling statement due to global lock timeout")));
+
+				(void) ConditionVariableTimedSleep(&db->dml_cv, timeout,
+												   PG_WAIT_EXTENSION);
+			}
 		}
+		ConditionVariableCancelSleep();
 	}
 }
 
@@ -69,6 +69,9 @@ pgactive_process_remote_message(StringInfo s)
 	if (pgactive_locks_process_message(msg_type, transactional, lsn, &origin_node, &message))
 		goto done;
 
+	if (pgactive_range_seq_process_message(msg_type, transactional, lsn, &origin_node, &message))
+		goto done;
+
 	elog(WARNING, "unhandled pgactive message of type %s", pgactive_message_type_str(msg_type));
 
 	resetStringInfo(&message);
@@ -156,6 +159,10 @@ pgactive_message_type_str(pgactiveMessageType message_type)
 			return "pgactive_MESSAGE_REQUEST_REPLAY_CONFIRM";
 		case pgactive_MESSAGE_REPLAY_CONFIRM:
 			return "pgactive_MESSAGE_REPLAY_CONFIRM";
+		case pgactive_MESSAGE_SEQ_CLAIM:
+			return "pgactive_MESSAGE_SEQ_CLAIM";
+		case pgactive_MESSAGE_SEQ_VOTE:
+			return "pgactive_MESSAGE_SEQ_VOTE";
 	}
 	elog(ERROR, "unhandled pgactiveMessageType %d", message_type);
 }
@@ -41,6 +41,9 @@ static const char *remote_node_name = NULL;
 
 static HTAB *pgactiveNodeCacheHash = NULL;
 
+/* entry of the local node, checked for every writing statement */
+static pgactiveNodeInfo * pgactiveMyNodeCacheEntry = NULL;
+
 /*
  * Because PostgreSQL does not have enought relation lookup functions.
  */
@@ -240,12 +243,18 @@ pgactive_local_node_read_only(void)
 	pgactiveNodeId nodeid;
 	pgactiveNodeInfo *node;
 
+	/* entries are never removed, only invalidated */
+	if (pgactiveMyNodeCacheEntry != NULL && pgactiveMyNodeCacheEntry->valid)
+		return pgactiveMyNodeCacheEntry->read_only;
+
 	pgactive_make_my_nodeid(&nodeid);
 	node = pgactive_nodecache_lookup(&nodeid, true);
 
 	if (node == NULL)
 		return false;
 
+	pgactiveMyNodeCacheEntry = node;
+
 	return node->read_only;
 }
 
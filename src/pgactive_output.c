@@ -28,6 +28,8 @@
 #include "access/tuptoaster.h"
 #endif
 #include "access/xact.h"
+#include "access/xlog.h"
+#include "access/xlogutils.h"
 
 #include "catalog/catversion.h"
 #include "catalog/index.h"
@@ -40,14 +42,20 @@
 
 #include "commands/dbcommands.h"
 
+#include "executor/executor.h"
 #include "executor/spi.h"
 
+#include "funcapi.h"
+
 #include "libpq/pqformat.h"
 
 #include "mb/pg_wchar.h"
 
+#include "nodes/makefuncs.h"
 #include "nodes/parsenodes.h"
 
+#include "portability/instr_time.h"
+
 #include "replication/logical.h"
 #include "replication/output_plugin.h"
 #include "replication/origin.h"
@@ -58,16 +66,24 @@
 #include "storage/proc.h"
 
 #include "utils/builtins.h"
+#include "utils/hsearch.h"
+#include "utils/inval.h"
 #include "utils/lsyscache.h"
 #include "utils/memutils.h"
+#include "utils/pg_lsn.h"
 #include "utils/rel.h"
 #include "utils/snapmgr.h"
+#include "utils/syscache.h"
 #include "utils/timestamp.h"
 #include "utils/typcache.h"
 #include "utils/varlena.h"
 
 extern void _PG_output_plugin_init(OutputPluginCallbacks *cb);
 
+PGDLLEXPORT Datum pgactive_decode_benchmark(PG_FUNCTION_ARGS);
+
+PG_FUNCTION_INFO_V1(pgactive_decode_benchmark);
+
 /* PG 15-18 moved commit_time into txn->xact_time.commit_time */
 #if PG_VERSION_NUM >= 150000 && PG_VERSION_NUM < 190000
 #define TXN_COMMIT_TIME(txn) ((txn)->xact_time.commit_time)
@@ -85,6 +101,21 @@ typedef struct
 	bool		allow_sendrecv_protocol;
 	bool		int_datetime_mismatch;
 	bool		forward_changesets;
+	bool		relation_ids;
+	bool		streaming;
+
+	/* compress messages at least compression_threshold bytes long */
+	pgactiveCompression compression;
+	uint32		compression_threshold;
+
+	/* between stream start and stream stop */
+	bool		in_streaming;
+
+	/* where the message being written starts in ctx->out */
+	int			write_start;
+
+	/* to evaluate the row filters of replication sets in */
+	ExprContext *filter_econtext;
 
 	uint32		client_pg_version;
 	uint32		client_pg_catversion;
@@ -109,6 +140,53 @@ typedef struct
 	char	  **replication_sets;
 }			pgactiveOutputData;
 
+/*
+ * How to send a column, see decide_datum_transfer().
+ */
+typedef struct pgactiveOutputColumn
+{
+	/* 'b' (binary), 's' (send/recv) or 't' (text) */
+	char		kind;
+	/* the type's send or output function, unless sent binary */
+	FmgrInfo	func;
+}			pgactiveOutputColumn;
+
+/*
+ * How to send the columns of a relation, so write_tuple() doesn't need to
+ * look up the type of each column of every tuple. Invalidated by relcache
+ * invalidations of the relation and by any change to pg_type.
+ */
+typedef struct pgactiveOutputRelInfo
+{
+	Oid			relid;			/* hash key */
+	bool		valid;
+	/* holds columns and whatever the functions cache, NULL if not built */
+	MemoryContext context;
+	int			natts;
+	pgactiveOutputColumn *columns;
+	/* relation message sent since the entry was built, see write_relation() */
+	bool		relation_sent;
+	/* statistics of changes sent to the downstream, may be NULL */
+	pgactiveRelStats *stats;
+}			pgactiveOutputRelInfo;
+
+static HTAB *OutputRelInfoHash = NULL;
+
+/*
+ * What pgactive_decode_benchmark() counts, indexed by column kind where
+ * applicable: 0 for 'b', 1 for 's' and 2 for 't'.
+ */
+typedef struct pgactiveDecodeBenchmark
+{
+	int64		changes;
+	int64		bytes;
+	int64		columns[3];
+	int64		column_bytes[3];
+}			pgactiveDecodeBenchmark;
+
+/* set while pgactive_decode_benchmark() decodes in this backend */
+static pgactiveDecodeBenchmark * decode_benchmark = NULL;
+
 static pgactiveWalsenderWorker * pgactive_walsender_worker = NULL;
 
 /* These must be available to pg_dlsym() */
@@ -131,10 +209,32 @@ static void pg_decode_message(LogicalDecodingContext *ctx,
 							  Size sz,
 							  const char *message);
 
+static void pg_decode_stream_start(LogicalDecodingContext *ctx,
+								   ReorderBufferTXN *txn);
+static void pg_decode_stream_stop(LogicalDecodingContext *ctx,
+								  ReorderBufferTXN *txn);
+static void pg_decode_stream_abort(LogicalDecodingContext *ctx,
+								   ReorderBufferTXN *txn,
+								   XLogRecPtr abort_lsn);
+static void pg_decode_stream_commit(LogicalDecodingContext *ctx,
+									ReorderBufferTXN *txn,
+									XLogRecPtr commit_lsn);
+
 /* private prototypes */
-static void write_rel(StringInfo out, Relation rel);
+static pgactiveOutputRelInfo * get_output_relinfo(pgactiveOutputData * data,
+												  Relation rel);
+static void output_relinfo_invalidate_cb(Datum arg, Oid relid);
+static void write_relation(StringInfo out, Relation rel);
+static void write_stream_xid(pgactiveOutputData * data, StringInfo out,
+							 ReorderBufferTXN *txn);
+static void write_rel_name(StringInfo out, Relation rel);
+static void write_rel(pgactiveOutputData * data, StringInfo out, Relation rel);
+static inline void output_prepare_write(LogicalDecodingContext *ctx,
+										bool last_write);
+static inline void output_write(LogicalDecodingContext *ctx, bool last_write);
 static void write_tuple(pgactiveOutputData * data, StringInfo out, Relation rel,
-						HeapTuple tuple);
+						Bitmapset *columns,
+						pgactiveOutputRelInfo * relinfo, HeapTuple tuple);
 
 /* specify output plugin callbacks */
 void
@@ -149,6 +249,13 @@ _PG_output_plugin_init(OutputPluginCallbacks *cb)
 	cb->message_cb = pg_decode_message;
 	cb->shutdown_cb = pg_decode_shutdown;
 
+	cb->stream_start_cb = pg_decode_stream_start;
+	cb->stream_stop_cb = pg_decode_stream_stop;
+	cb->stream_abort_cb = pg_decode_stream_abort;
+	cb->stream_commit_cb = pg_decode_stream_commit;
+	cb->stream_change_cb = pg_decode_change;
+	cb->stream_message_cb = pg_decode_message;
+
 	Assert(ThisTimeLineID > 0);
 }
 
@@ -368,6 +475,16 @@ pg_decode_startup(LogicalDecodingContext *ctx, OutputPluginOptions *opt, bool is
 										  ALLOCSET_DEFAULT_INITSIZE,
 										  ALLOCSET_DEFAULT_MAXSIZE);
 
+	data->filter_econtext = CreateStandaloneExprContext();
+
+	/*
+	 * What we cache per relation depends on the peer and the options of the
+	 * decoding context, and a backend may use several one after the other,
+	 * e.g. with the SQL decoding functions.
+	 */
+	output_relinfo_invalidate_cb((Datum) 0, InvalidOid);
+	pgactiveRelcacheHashInvalidateCallback((Datum) 0, InvalidOid);
+
 	ctx->output_plugin_private = data;
 
 	opt->output_type = OUTPUT_PLUGIN_BINARY_OUTPUT;
@@ -378,9 +495,16 @@ pg_decode_startup(LogicalDecodingContext *ctx, OutputPluginOptions *opt, bool is
 	data->pgactive_schema_oid = InvalidOid;
 	data->num_replication_sets = -1;
 
-	/* parse where the connection has to be from */
-	pgactive_parse_slot_name(NameStr(MyReplicationSlot->data.name),
-							 &data->remote_node, &local_dboid);
+	/*
+	 * Parse where the connection has to be from. Slots not named like ours
+	 * may be created, but only be used by pgactive_decode_benchmark(), which
+	 * sends to no node.
+	 */
+	if (decode_benchmark == NULL &&
+		(!is_init || strncmp(NameStr(MyReplicationSlot->data.name),
+							 "pgactive_", strlen("pgactive_")) == 0))
+		pgactive_parse_slot_name(NameStr(MyReplicationSlot->data.name),
+								 &data->remote_node, &local_dboid);
 
 	/* parse options passed in by the client */
 
@@ -420,6 +544,24 @@ pg_decode_startup(LogicalDecodingContext *ctx, OutputPluginOptions *opt, bool is
 			data->client_db_encoding = pstrdup(strVal(elem->arg));
 		else if (strcmp(elem->defname, "forward_changesets") == 0)
 			pgactive_parse_bool(elem, &data->forward_changesets);
+		else if (strcmp(elem->defname, "relation_ids") == 0)
+			pgactive_parse_bool(elem, &data->relation_ids);
+		else if (strcmp(elem->defname, "streaming") == 0)
+			pgactive_parse_bool(elem, &data->streaming);
+		else if (strcmp(elem->defname, "compression") == 0)
+		{
+			char	   *method;
+
+			pgactive_parse_str(elem, &method);
+			if (!pgactive_compression_from_name(method, &data->compression))
+			{
+				elog(LOG, "not compressing, compression method \"%s\" is not supported by this build",
+					 method);
+				data->compression = pgactive_COMPRESSION_NONE;
+			}
+		}
+		else if (strcmp(elem->defname, "compression_threshold") == 0)
+			pgactive_parse_uint32(elem, &data->compression_threshold);
 		else if (strcmp(elem->defname, "replication_sets") == 0)
 		{
 			int			i;
@@ -472,6 +614,13 @@ pg_decode_startup(LogicalDecodingContext *ctx, OutputPluginOptions *opt, bool is
 		}
 	}
 
+	/*
+	 * Stream large transactions before they commit only if the client can
+	 * apply them. Not in catchup mode, where the client needs to know up
+	 * front which node a transaction originated on.
+	 */
+	ctx->streaming &= data->streaming && !data->forward_changesets;
+
 	/*
 	 * Ensure that the pgactive extension is installed on this database.
 	 *
@@ -628,6 +777,10 @@ pg_decode_startup(LogicalDecodingContext *ctx, OutputPluginOptions *opt, bool is
 	if (tx_started)
 		CommitTransactionCommand();
 
+	/* a benchmark isn't a walsender anyone needs to know about */
+	if (decode_benchmark != NULL)
+		return;
+
 	/*
 	 * Everything looks ok. Acquire a shmem slot to represent us running.
 	 */
@@ -662,8 +815,14 @@ pg_decode_startup(LogicalDecodingContext *ctx, OutputPluginOptions *opt, bool is
 static void
 pg_decode_shutdown(LogicalDecodingContext *ctx)
 {
+	pgactiveOutputData *data = ctx->output_plugin_private;
+
+	MemoryContextDelete(data->context);
+	FreeExprContext(data->filter_econtext, true);
+
 	/* release and free slot */
 	pgactive_worker_shmem_release();
+	pgactive_walsender_worker = NULL;
 }
 
 /*
@@ -749,6 +908,107 @@ should_forward_change(LogicalDecodingContext *ctx, pgactiveOutputData * data,
 	}
 }
 
+/*
+ * Check whether a tuple of a relation matches the row filter of the
+ * replication sets it's replicated by.
+ *
+ * Tuples with toasted filter columns that weren't decoded, like the
+ * unchanged ones of an UPDATE, are always replicated.
+ */
+static bool
+row_filter_matches(pgactiveOutputData * data, pgactiveRelation * r,
+				   HeapTuple tuple)
+{
+	TupleDesc	desc = RelationGetDescr(r->rel);
+	TupleTableSlot *slot = r->computed_repl_filter_slot;
+	ExprContext *econtext = data->filter_econtext;
+	int			attno;
+	Datum		result;
+	bool		isnull;
+
+	if (r->computed_repl_filter == NULL || tuple == NULL)
+		return true;
+
+	/* we can't read toasted values from the table here */
+	attno = -1;
+	while ((attno = bms_next_member(r->computed_repl_filter_columns, attno)) >= 0)
+	{
+		Form_pg_attribute att = TupleDescAttr(desc, attno - 1);
+		Datum		value;
+
+		if (att->attlen != -1)
+			continue;
+
+		value = heap_getattr(tuple, attno, desc, &isnull);
+		if (!isnull && VARATT_IS_EXTERNAL_ONDISK(DatumGetPointer(value)))
+			return true;
+	}
+
+	ExecStoreHeapTuple(tuple, slot, false);
+	econtext->ecxt_scantuple = slot;
+
+	result = ExecEvalExprSwitchContext(r->computed_repl_filter, econtext,
+									   &isnull);
+
+	ExecClearTuple(slot);
+	ResetExprContext(econtext);
+
+	return !isnull && DatumGetBool(result);
+}
+
+/*
+ * Replace the unchanged toasted values of the new row of an UPDATE with
+ * those of its old row, which has them inline with REPLICA IDENTITY FULL.
+ * Returns the new row itself if it has none, or NULL if the old row doesn't
+ * have them.
+ */
+static HeapTuple
+fill_unchanged_toast(Relation rel, HeapTuple newtuple, HeapTuple oldtuple)
+{
+	TupleDesc	desc = RelationGetDescr(rel);
+	Datum	   *values;
+	bool	   *isnull;
+	Datum	   *old_values = NULL;
+	bool	   *old_isnull = NULL;
+	int			i;
+
+	if (!HeapTupleHasExternal(newtuple))
+		return newtuple;
+
+	values = palloc(desc->natts * sizeof(Datum));
+	isnull = palloc(desc->natts * sizeof(bool));
+	heap_deform_tuple(newtuple, desc, values, isnull);
+
+	for (i = 0; i < desc->natts; i++)
+	{
+		FormData_pg_attribute *att = TupleDescAttr(desc, i);
+
+		if (isnull[i] || att->attlen != -1 ||
+			!VARATT_IS_EXTERNAL_ONDISK(DatumGetPointer(values[i])))
+			continue;
+
+		if (oldtuple == NULL ||
+			rel->rd_rel->relreplident != REPLICA_IDENTITY_FULL)
+			return NULL;
+
+		if (old_values == NULL)
+		{
+			old_values = palloc(desc->natts * sizeof(Datum));
+			old_isnull = palloc(desc->natts * sizeof(bool));
+			heap_deform_tuple(oldtuple, desc, old_values, old_isnull);
+		}
+
+		if (!old_isnull[i] &&
+			VARATT_IS_EXTERNAL_ONDISK(DatumGetPointer(old_values[i])))
+			return NULL;
+
+		values[i] = old_values[i];
+		isnull[i] = old_isnull[i];
+	}
+
+	return heap_form_tuple(desc, values, isnull);
+}
+
 /*
  * BEGIN callback
  *
@@ -766,7 +1026,7 @@ pg_decode_begin_txn(LogicalDecodingContext *ctx, ReorderBufferTXN *txn)
 	if (!should_forward_changeset(ctx, txn->origin_id))
 		return;
 
-	OutputPluginPrepareWrite(ctx, true);
+	output_prepare_write(ctx, true);
 	pq_sendbyte(ctx->out, 'B'); /* BEGIN */
 
 
@@ -808,7 +1068,7 @@ pg_decode_begin_txn(LogicalDecodingContext *ctx, ReorderBufferTXN *txn)
 		pq_sendint64(ctx->out, txn->origin_lsn);
 	}
 
-	OutputPluginWrite(ctx, true);
+	output_write(ctx, true);
 
 	return;
 }
@@ -836,7 +1096,7 @@ pg_decode_commit_txn(LogicalDecodingContext *ctx, ReorderBufferTXN *txn,
 	if (!should_forward_changeset(ctx, txn->origin_id))
 		return;
 
-	OutputPluginPrepareWrite(ctx, true);
+	output_prepare_write(ctx, true);
 	pq_sendbyte(ctx->out, 'C'); /* sending COMMIT */
 
 	/* send the flags field its self */
@@ -855,14 +1115,123 @@ pg_decode_commit_txn(LogicalDecodingContext *ctx, ReorderBufferTXN *txn,
 	pq_sendint64(ctx->out, txn->end_lsn);
 	pq_sendint64(ctx->out, TXN_COMMIT_TIME(txn));
 
-	OutputPluginWrite(ctx, true);
+	output_write(ctx, true);
 
 	committime = TXN_COMMIT_TIME(txn);
 
 	/* Save last sent transaction info */
-	pgactive_walsender_worker->last_sent_xact_id = txn->xid;
-	pgactive_walsender_worker->last_sent_xact_committs = committime;
-	pgactive_walsender_worker->last_sent_xact_at = GetCurrentTimestamp();
+	if (pgactive_walsender_worker != NULL)
+	{
+		pgactive_walsender_worker->last_sent_xact_id = txn->xid;
+		pgactive_walsender_worker->last_sent_xact_committs = committime;
+		pgactive_walsender_worker->last_sent_xact_at = GetCurrentTimestamp();
+	}
+}
+
+/*
+ * STREAM START callback
+ *
+ * A chunk of the changes of a large transaction that hasn't committed yet
+ * follows, up to the next stream stop. See pgactive_apply_stream.c.
+ */
+static void
+pg_decode_stream_start(LogicalDecodingContext *ctx, ReorderBufferTXN *txn)
+{
+	pgactiveOutputData *data = ctx->output_plugin_private;
+
+	Assert(!data->in_streaming);
+
+	output_prepare_write(ctx, true);
+	pq_sendbyte(ctx->out, 'S'); /* STREAM START */
+	pq_sendint(ctx->out, txn->xid, 4);
+	output_write(ctx, true);
+
+	data->in_streaming = true;
+}
+
+/*
+ * STREAM STOP callback
+ */
+static void
+pg_decode_stream_stop(LogicalDecodingContext *ctx, ReorderBufferTXN *txn)
+{
+	pgactiveOutputData *data = ctx->output_plugin_private;
+
+	Assert(data->in_streaming);
+
+	output_prepare_write(ctx, true);
+	pq_sendbyte(ctx->out, 'E'); /* STREAM STOP */
+	output_write(ctx, true);
+
+	data->in_streaming = false;
+}
+
+/*
+ * STREAM ABORT callback
+ *
+ * Sent for a streamed transaction that aborted, or for one of its
+ * subtransactions.
+ */
+static void
+pg_decode_stream_abort(LogicalDecodingContext *ctx, ReorderBufferTXN *txn,
+					   XLogRecPtr abort_lsn)
+{
+	ReorderBufferTXN *toptxn = txn->toptxn ? txn->toptxn : txn;
+
+	output_prepare_write(ctx, true);
+	pq_sendbyte(ctx->out, 'A'); /* STREAM ABORT */
+	pq_sendint(ctx->out, toptxn->xid, 4);
+	pq_sendint(ctx->out, txn->xid, 4);
+	output_write(ctx, true);
+}
+
+/*
+ * STREAM COMMIT callback
+ *
+ * Sends the xid of the streamed transaction followed by what
+ * pg_decode_commit_txn() sends, so the client can apply it like a
+ * transaction sent at commit.
+ *
+ * If you change this, you'll need to change pgactive_apply_stream_commit(...)
+ * too.
+ */
+static void
+pg_decode_stream_commit(LogicalDecodingContext *ctx, ReorderBufferTXN *txn,
+						XLogRecPtr commit_lsn)
+{
+	TimestampTz committime = TXN_COMMIT_TIME(txn);
+
+	/* only known now; the client has nothing to apply then */
+	if (!should_forward_changeset(ctx, txn->origin_id))
+	{
+		output_prepare_write(ctx, true);
+		pq_sendbyte(ctx->out, 'A'); /* STREAM ABORT */
+		pq_sendint(ctx->out, txn->xid, 4);
+		pq_sendint(ctx->out, txn->xid, 4);
+		output_write(ctx, true);
+		return;
+	}
+
+	output_prepare_write(ctx, true);
+	pq_sendbyte(ctx->out, 'c'); /* STREAM COMMIT */
+	pq_sendint(ctx->out, txn->xid, 4);
+
+	/* as in pg_decode_commit_txn() */
+	pq_sendint(ctx->out, 0, 4); /* flags */
+	pq_sendint64(ctx->out, commit_lsn);
+	Assert(txn->end_lsn != InvalidXLogRecPtr);
+	pq_sendint64(ctx->out, txn->end_lsn);
+	pq_sendint64(ctx->out, committime);
+
+	output_write(ctx, true);
+
+	/* Save last sent transaction info */
+	if (pgactive_walsender_worker != NULL)
+	{
+		pgactive_walsender_worker->last_sent_xact_id = txn->xid;
+		pgactive_walsender_worker->last_sent_xact_committs = committime;
+		pgactive_walsender_worker->last_sent_xact_at = GetCurrentTimestamp();
+	}
 }
 
 void
@@ -872,6 +1241,11 @@ pg_decode_change(LogicalDecodingContext *ctx, ReorderBufferTXN *txn,
 	pgactiveOutputData *data;
 	MemoryContext old;
 	pgactiveRelation *pgactive_relation;
+	pgactiveOutputRelInfo *relinfo;
+	pgactiveRelStat stat = pgactiveRelStat_Insert;
+	ReorderBufferChangeType action;
+	HeapTuple	oldtuple;
+	HeapTuple	newtuple;
 
 #ifdef USE_ASSERT_CHECKING
 
@@ -894,62 +1268,126 @@ pg_decode_change(LogicalDecodingContext *ctx, ReorderBufferTXN *txn,
 	/* Avoid leaking memory by using and resetting our own context */
 	old = MemoryContextSwitchTo(data->context);
 
-	if (!should_forward_changeset(ctx, txn->origin_id))
+	/* the origin of a streamed transaction is only known for its changes */
+	if (!should_forward_changeset(ctx, data->in_streaming ?
+								  change->origin_id : txn->origin_id))
 		goto skip;
 
 	if (!should_forward_change(ctx, data, pgactive_relation, change->action))
 		goto skip;
 
-	OutputPluginPrepareWrite(ctx, true);
+	/*
+	 * Row filters apply to the new row of an INSERT and the old row of a
+	 * DELETE, which has the filter columns, see check_row_filter_columns().
+	 * An UPDATE is sent if both its old and new rows match. If only the old
+	 * one does the row is deleted on the receiving nodes, if only the new one
+	 * it's inserted there. Without an old row the key didn't change, and
+	 * neither did the filter columns.
+	 */
+	action = change->action;
+#if PG_VERSION_NUM >= 170000
+	oldtuple = change->data.tp.oldtuple;
+	newtuple = change->data.tp.newtuple;
+#else
+	oldtuple = change->data.tp.oldtuple != NULL ?
+		&change->data.tp.oldtuple->tuple : NULL;
+	newtuple = change->data.tp.newtuple != NULL ?
+		&change->data.tp.newtuple->tuple : NULL;
+#endif
 
-	switch (change->action)
+	if (action == REORDER_BUFFER_CHANGE_DELETE)
+	{
+		if (!row_filter_matches(data, pgactive_relation, oldtuple))
+			goto skip;
+	}
+	else if (action == REORDER_BUFFER_CHANGE_INSERT)
+	{
+		if (!row_filter_matches(data, pgactive_relation, newtuple))
+			goto skip;
+	}
+	else if (pgactive_relation->computed_repl_filter != NULL)
+	{
+		bool		new_matches;
+		bool		old_matches;
+
+		new_matches = row_filter_matches(data, pgactive_relation, newtuple);
+		old_matches = oldtuple != NULL ?
+			row_filter_matches(data, pgactive_relation, oldtuple) : new_matches;
+
+		if (!old_matches && !new_matches)
+			goto skip;
+		else if (!new_matches)
+			action = REORDER_BUFFER_CHANGE_DELETE;
+		else if (!old_matches)
+		{
+			HeapTuple	insert_tuple;
+
+			/*
+			 * Unchanged toasted values would be sent as unchanged and lost,
+			 * so take them from the old row. If that doesn't have them send
+			 * the UPDATE, which the receiving nodes report as a conflict.
+			 */
+			insert_tuple = fill_unchanged_toast(relation, newtuple, oldtuple);
+			if (insert_tuple != NULL)
+			{
+				newtuple = insert_tuple;
+				action = REORDER_BUFFER_CHANGE_INSERT;
+			}
+		}
+	}
+
+	relinfo = get_output_relinfo(data, relation);
+
+	/* describe the relation before the first change referring to its id */
+	if (data->relation_ids && !relinfo->relation_sent)
+	{
+		output_prepare_write(ctx, false);
+		write_relation(ctx->out, relation);
+		output_write(ctx, false);
+		relinfo->relation_sent = true;
+	}
+
+	output_prepare_write(ctx, true);
+
+	switch (action)
 	{
 		case REORDER_BUFFER_CHANGE_INSERT:
 			pq_sendbyte(ctx->out, 'I'); /* action INSERT */
-			write_rel(ctx->out, relation);
+			write_stream_xid(data, ctx->out, change->txn);
+			write_rel(data, ctx->out, relation);
 			pq_sendbyte(ctx->out, 'N'); /* new tuple follows */
-#if PG_VERSION_NUM >= 170000
-			write_tuple(data, ctx->out, relation, change->data.tp.newtuple);
-#else
 			write_tuple(data, ctx->out, relation,
-						&change->data.tp.newtuple->tuple);
-#endif
+						pgactive_relation->computed_repl_columns, relinfo,
+						newtuple);
 			break;
 		case REORDER_BUFFER_CHANGE_UPDATE:
+			stat = pgactiveRelStat_Update;
 			pq_sendbyte(ctx->out, 'U'); /* action UPDATE */
-			write_rel(ctx->out, relation);
-			if (change->data.tp.oldtuple != NULL)
+			write_stream_xid(data, ctx->out, change->txn);
+			write_rel(data, ctx->out, relation);
+			if (oldtuple != NULL)
 			{
 				pq_sendbyte(ctx->out, 'K'); /* old key follows */
-#if PG_VERSION_NUM >= 170000
-				write_tuple(data, ctx->out, relation,
-							change->data.tp.oldtuple);
-#else
 				write_tuple(data, ctx->out, relation,
-							&change->data.tp.oldtuple->tuple);
-#endif
+							pgactive_relation->computed_repl_columns, relinfo,
+							oldtuple);
 			}
 			pq_sendbyte(ctx->out, 'N'); /* new tuple follows */
-#if PG_VERSION_NUM >= 170000
-			write_tuple(data, ctx->out, relation, change->data.tp.newtuple);
-#else
 			write_tuple(data, ctx->out, relation,
-						&change->data.tp.newtuple->tuple);
-#endif
+						pgactive_relation->computed_repl_columns, relinfo,
+						newtuple);
 			break;
 		case REORDER_BUFFER_CHANGE_DELETE:
+			stat = pgactiveRelStat_Delete;
 			pq_sendbyte(ctx->out, 'D'); /* action DELETE */
-			write_rel(ctx->out, relation);
-			if (change->data.tp.oldtuple != NULL)
+			write_stream_xid(data, ctx->out, change->txn);
+			write_rel(data, ctx->out, relation);
+			if (oldtuple != NULL)
 			{
 				pq_sendbyte(ctx->out, 'K'); /* old key follows */
-#if PG_VERSION_NUM >= 170000
-				write_tuple(data, ctx->out, relation,
-							change->data.tp.oldtuple);
-#else
 				write_tuple(data, ctx->out, relation,
-							&change->data.tp.oldtuple->tuple);
-#endif
+							pgactive_relation->computed_repl_columns, relinfo,
+							oldtuple);
 			}
 			else
 				pq_sendbyte(ctx->out, 'E'); /* empty */
@@ -957,7 +1395,14 @@ pg_decode_change(LogicalDecodingContext *ctx, ReorderBufferTXN *txn,
 		default:
 			Assert(false);
 	}
-	OutputPluginWrite(ctx, true);
+
+	pgactive_count_relation(relinfo->stats, stat, 1);
+	pgactive_count_relation(relinfo->stats, pgactiveRelStat_Bytes, ctx->out->len);
+
+	if (decode_benchmark != NULL)
+		decode_benchmark->changes++;
+
+	output_write(ctx, true);
 
 skip:
 	MemoryContextSwitchTo(old);
@@ -966,11 +1411,82 @@ skip:
 	pgactive_table_close(pgactive_relation, NoLock);
 }
 
+/*
+ * Start writing a message; wraps OutputPluginPrepareWrite() to remember
+ * where the message starts.
+ */
+static inline void
+output_prepare_write(LogicalDecodingContext *ctx, bool last_write)
+{
+	pgactiveOutputData *data = ctx->output_plugin_private;
+
+	OutputPluginPrepareWrite(ctx, last_write);
+	data->write_start = ctx->out->len;
+}
+
+/*
+ * Send the message written since output_prepare_write(), compressed if the
+ * client asked for it and it's large enough.
+ */
+static inline void
+output_write(LogicalDecodingContext *ctx, bool last_write)
+{
+	pgactiveOutputData *data = ctx->output_plugin_private;
+
+	if (data->compression != pgactive_COMPRESSION_NONE &&
+		(uint32) (ctx->out->len - data->write_start) >= data->compression_threshold)
+		pgactive_compress_message(data->compression, ctx->out,
+								  data->write_start);
+
+	OutputPluginWrite(ctx, last_write);
+}
+
+/*
+ * Write a relation message, telling the client the name of the relation
+ * subsequent changes refer to by id.
+ */
+static void
+write_relation(StringInfo out, Relation rel)
+{
+	pq_sendbyte(out, 'R');		/* relation follows */
+	pq_sendint(out, RelationGetRelid(rel), 4);
+	write_rel_name(out, rel);
+}
+
+/*
+ * Changes of a streamed transaction carry the xid of the (sub)transaction
+ * that made them, so the client can discard them should it abort.
+ */
+static void
+write_stream_xid(pgactiveOutputData * data, StringInfo out,
+				 ReorderBufferTXN *txn)
+{
+	if (data->in_streaming)
+		pq_sendint(out, txn->xid, 4);
+}
+
+/*
+ * Write the relation a change applies to, as an id if the client asked for
+ * it (after a relation message, see write_relation()), otherwise by name.
+ */
+static void
+write_rel(pgactiveOutputData * data, StringInfo out, Relation rel)
+{
+	if (data->relation_ids)
+	{
+		/* a zero schema name length can't occur with names */
+		pq_sendint(out, 0, 2);
+		pq_sendint(out, RelationGetRelid(rel), 4);
+	}
+	else
+		write_rel_name(out, rel);
+}
+
 /*
  * Write schema.relation to the output stream.
  */
 static void
-write_rel(StringInfo out, Relation rel)
+write_rel_name(StringInfo out, Relation rel)
 {
 	const char *nspname;
 	int64		nspnamelen;
@@ -1036,11 +1552,139 @@ decide_datum_transfer(pgactiveOutputData * data,
 	}
 }
 
+static void
+output_relinfo_invalidate_cb(Datum arg, Oid relid)
+{
+	HASH_SEQ_STATUS status;
+	pgactiveOutputRelInfo *entry;
+
+	if (OutputRelInfoHash == NULL)
+		return;
+
+	if (relid == InvalidOid)
+	{
+		hash_seq_init(&status, OutputRelInfoHash);
+		while ((entry = hash_seq_search(&status)) != NULL)
+			entry->valid = false;
+	}
+	else if ((entry = hash_search(OutputRelInfoHash, &relid,
+								  HASH_FIND, NULL)) != NULL)
+		entry->valid = false;
+}
+
+static void
+output_relinfo_type_invalidate_cb(Datum arg, int cacheid, uint32 hashvalue)
+{
+	output_relinfo_invalidate_cb(arg, InvalidOid);
+}
+
+/*
+ * Look up how to send the columns of a relation, deciding it if not yet
+ * done.
+ *
+ * Invalidation callbacks only mark entries invalid; the entry, and the
+ * functions it points to, may still be in use by our caller when they run.
+ */
+static pgactiveOutputRelInfo *
+get_output_relinfo(pgactiveOutputData * data, Relation rel)
+{
+	Oid			relid = RelationGetRelid(rel);
+	TupleDesc	desc = RelationGetDescr(rel);
+	pgactiveOutputRelInfo *entry;
+	MemoryContext oldctx;
+	bool		found;
+	int			i;
+
+	if (OutputRelInfoHash == NULL)
+	{
+		HASHCTL		ctl;
+
+		memset(&ctl, 0, sizeof(ctl));
+		ctl.keysize = sizeof(Oid);
+		ctl.entrysize = sizeof(pgactiveOutputRelInfo);
+		ctl.hcxt = CacheMemoryContext;
+		OutputRelInfoHash = hash_create("pgactive output relation cache", 128,
+										&ctl, HASH_ELEM | HASH_BLOBS | HASH_CONTEXT);
+
+		CacheRegisterRelcacheCallback(output_relinfo_invalidate_cb, (Datum) 0);
+		CacheRegisterSyscacheCallback(TYPEOID, output_relinfo_type_invalidate_cb,
+									  (Datum) 0);
+	}
+
+	entry = hash_search(OutputRelInfoHash, &relid, HASH_ENTER, &found);
+	if (!found)
+		entry->context = NULL;
+	else if (entry->valid && entry->natts == desc->natts)
+		return entry;
+
+	if (entry->context != NULL)
+		MemoryContextDelete(entry->context);
+
+	entry->context = AllocSetContextCreate(CacheMemoryContext,
+										   "pgactive output relation",
+										   ALLOCSET_SMALL_SIZES);
+	oldctx = MemoryContextSwitchTo(entry->context);
+
+	entry->natts = desc->natts;
+	entry->columns = palloc0(desc->natts * sizeof(pgactiveOutputColumn));
+	entry->relation_sent = false;
+	/* benchmarks don't count as sent */
+	if (decode_benchmark == NULL)
+		entry->stats = pgactive_count_relation_stats(&data->remote_node, relid, true);
+	else
+		entry->stats = NULL;
+
+	for (i = 0; i < desc->natts; i++)
+	{
+		FormData_pg_attribute *att = TupleDescAttr(desc, i);
+		pgactiveOutputColumn *col = &entry->columns[i];
+		HeapTuple	typtup;
+		Form_pg_type typclass;
+		bool		use_binary = false;
+		bool		use_sendrecv = false;
+
+		/* always sent as null */
+		if (att->attisdropped)
+			continue;
+
+		typtup = SearchSysCache1(TYPEOID, ObjectIdGetDatum(att->atttypid));
+		if (!HeapTupleIsValid(typtup))
+			elog(ERROR, "cache lookup failed for type %u", att->atttypid);
+		typclass = (Form_pg_type) GETSTRUCT(typtup);
+
+		decide_datum_transfer(data, att, typclass, &use_binary, &use_sendrecv);
+
+		if (use_binary)
+			col->kind = 'b';
+		else if (use_sendrecv)
+		{
+			col->kind = 's';
+			fmgr_info(typclass->typsend, &col->func);
+		}
+		else
+		{
+			col->kind = 't';
+			fmgr_info(typclass->typoutput, &col->func);
+		}
+
+		ReleaseSysCache(typtup);
+	}
+
+	MemoryContextSwitchTo(oldctx);
+
+	entry->valid = true;
+
+	return entry;
+}
+
 /*
  * Write a tuple to the outputstream, in the most efficient format possible.
+ *
+ * Columns not in columns, unless that's NULL, are sent as unchanged.
  */
 static void
 write_tuple(pgactiveOutputData * data, StringInfo out, Relation rel,
+			Bitmapset *columns, pgactiveOutputRelInfo * relinfo,
 			HeapTuple tuple)
 {
 	TupleDesc	desc;
@@ -1067,14 +1711,17 @@ write_tuple(pgactiveOutputData * data, StringInfo out, Relation rel,
 
 	for (i = 0; i < desc->natts; i++)
 	{
-		HeapTuple	typtup;
-		Form_pg_type typclass;
 		FormData_pg_attribute *att = TupleDescAttr(desc, i);
+		pgactiveOutputColumn *col = &relinfo->columns[i];
+		int			start = out->len;
 
-		bool		use_binary = false;
-		bool		use_sendrecv = false;
-
-		if (isnull[i] || att->attisdropped)
+		if (columns != NULL && !att->attisdropped &&
+			!bms_is_member(i + 1, columns))
+		{
+			pq_sendbyte(out, 'u');	/* column not replicated */
+			continue;
+		}
+		else if (isnull[i] || att->attisdropped)
 		{
 			pq_sendbyte(out, 'n');	/* null column */
 			continue;
@@ -1085,14 +1732,7 @@ write_tuple(pgactiveOutputData * data, StringInfo out, Relation rel,
 			continue;
 		}
 
-		typtup = SearchSysCache1(TYPEOID, ObjectIdGetDatum(att->atttypid));
-		if (!HeapTupleIsValid(typtup))
-			elog(ERROR, "cache lookup failed for type %u", att->atttypid);
-		typclass = (Form_pg_type) GETSTRUCT(typtup);
-
-		decide_datum_transfer(data, att, typclass, &use_binary, &use_sendrecv);
-
-		if (use_binary)
+		if (col->kind == 'b')
 		{
 			pq_sendbyte(out, 'b');	/* binary data follows */
 
@@ -1139,15 +1779,14 @@ write_tuple(pgactiveOutputData * data, StringInfo out, Relation rel,
 			else
 				elog(ERROR, "unsupported tuple type");
 		}
-		else if (use_sendrecv)
+		else if (col->kind == 's')
 		{
 			bytea	   *outputbytes;
 			int			len;
 
 			pq_sendbyte(out, 's');	/* 'send' data follows */
 
-			outputbytes =
-				OidSendFunctionCall(typclass->typsend, values[i]);
+			outputbytes = SendFunctionCall(&col->func, values[i]);
 
 			len = VARSIZE(outputbytes) - VARHDRSZ;
 			pq_sendint(out, len, 4);	/* length */
@@ -1161,15 +1800,20 @@ write_tuple(pgactiveOutputData * data, StringInfo out, Relation rel,
 
 			pq_sendbyte(out, 't');	/* 'text' data follows */
 
-			outputstr =
-				OidOutputFunctionCall(typclass->typoutput, values[i]);
+			outputstr = OutputFunctionCall(&col->func, values[i]);
 			len = strlen(outputstr) + 1;
 			pq_sendint(out, len, 4);	/* length */
 			appendBinaryStringInfo(out, outputstr, len);	/* data */
 			pfree(outputstr);
 		}
 
-		ReleaseSysCache(typtup);
+		if (unlikely(decode_benchmark != NULL))
+		{
+			int			k = col->kind == 'b' ? 0 : col->kind == 's' ? 1 : 2;
+
+			decode_benchmark->columns[k]++;
+			decode_benchmark->column_bytes[k] += out->len - start;
+		}
 	}
 }
 
@@ -1179,14 +1823,175 @@ pg_decode_message(LogicalDecodingContext *ctx,
 				  bool transactional, const char *prefix,
 				  Size sz, const char *message)
 {
+	pgactiveOutputData *data = ctx->output_plugin_private;
+
 	if (strcmp(prefix, pgactive_LOGICAL_MSG_PREFIX) == 0)
 	{
-		OutputPluginPrepareWrite(ctx, true);
+		output_prepare_write(ctx, true);
 		pq_sendbyte(ctx->out, 'M'); /* message follows */
+		write_stream_xid(data, ctx->out, txn);
 		pq_sendbyte(ctx->out, transactional);
 		pq_sendint64(ctx->out, lsn);
 		pq_sendint(ctx->out, sz, 4);
 		pq_sendbytes(ctx->out, message, sz);
-		OutputPluginWrite(ctx, true);
+		output_write(ctx, true);
 	}
 }
+
+static void
+decode_benchmark_prepare_write(LogicalDecodingContext *ctx, XLogRecPtr lsn,
+							   TransactionId xid, bool last_write)
+{
+	resetStringInfo(ctx->out);
+}
+
+static void
+decode_benchmark_write(LogicalDecodingContext *ctx, XLogRecPtr lsn,
+					   TransactionId xid, bool last_write)
+{
+	/* count what a walsender would send, then discard it */
+	decode_benchmark->bytes += ctx->out->len;
+}
+
+/*
+ * Decode the changes of a logical slot using this plugin up to upto_lsn
+ * (or the end of WAL) loops times, like pg_logical_slot_peek_binary_changes()
+ * but without keeping the output, and report how long it took and how the
+ * columns were encoded. Changes are encoded the way they are for apply
+ * workers of this version and architecture.
+ *
+ * The slot isn't advanced, so every loop decodes the same changes.
+ */
+Datum
+pgactive_decode_benchmark(PG_FUNCTION_ARGS)
+{
+	Name		slot_name;
+	XLogRecPtr	upto_lsn;
+	int32		loops;
+	XLogRecPtr	end_of_wal;
+	List	   *options;
+	pgactiveDecodeBenchmark bench;
+	instr_time	start_time;
+	instr_time	elapsed;
+	double		seconds;
+	TupleDesc	tupdesc;
+	Datum		values[10];
+	bool		nulls[10];
+	int			i;
+
+	if (PG_ARGISNULL(0))
+		ereport(ERROR,
+				(errcode(ERRCODE_NULL_VALUE_NOT_ALLOWED),
+				 errmsg("slot name must not be null")));
+	slot_name = PG_GETARG_NAME(0);
+	upto_lsn = PG_ARGISNULL(1) ? InvalidXLogRecPtr : PG_GETARG_LSN(1);
+	loops = PG_ARGISNULL(2) ? 1 : PG_GETARG_INT32(2);
+
+	if (loops < 1)
+		ereport(ERROR,
+				(errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+				 errmsg("loops must be at least 1")));
+
+	if (get_call_result_type(fcinfo, NULL, &tupdesc) != TYPEFUNC_COMPOSITE)
+		elog(ERROR, "return type must be a row type");
+
+	if (RecoveryInProgress())
+		ereport(ERROR,
+				(errcode(ERRCODE_OBJECT_NOT_IN_PREREQUISITE_STATE),
+				 errmsg("pgactive_decode_benchmark cannot be executed during recovery")));
+
+	end_of_wal = GetFlushRecPtr();
+	if (upto_lsn == InvalidXLogRecPtr || upto_lsn > end_of_wal)
+		upto_lsn = end_of_wal;
+
+	/* as apply workers ask for it */
+	options = list_make2(makeDefElem("interactive", (Node *) makeString("true"), -1),
+						 makeDefElem("relation_ids", (Node *) makeString("true"), -1));
+
+#if PG_VERSION_NUM >= 180000
+	ReplicationSlotAcquire(NameStr(*slot_name), true, true);
+#else
+	ReplicationSlotAcquire(NameStr(*slot_name), true);
+#endif
+
+	if (!SlotIsLogical(MyReplicationSlot) ||
+		strcmp(NameStr(MyReplicationSlot->data.plugin), pgactive_LIBRARY_NAME) != 0)
+		ereport(ERROR,
+				(errcode(ERRCODE_OBJECT_NOT_IN_PREREQUISITE_STATE),
+				 errmsg("replication slot \"%s\" does not use the pgactive output plugin",
+						NameStr(*slot_name))));
+
+	memset(&bench, 0, sizeof(bench));
+	decode_benchmark = &bench;
+
+	INSTR_TIME_SET_CURRENT(start_time);
+
+	PG_TRY();
+	{
+		for (i = 0; i < loops; i++)
+		{
+			LogicalDecodingContext *ctx;
+
+			ctx = CreateDecodingContext(InvalidXLogRecPtr, options, false,
+										XL_ROUTINE(.page_read = read_local_xlog_page,
+												   .segment_open = wal_segment_open,
+												   .segment_close = wal_segment_close),
+										decode_benchmark_prepare_write,
+										decode_benchmark_write, NULL);
+
+			XLogBeginRead(ctx->reader, MyReplicationSlot->data.restart_lsn);
+
+			/* invalidate non-timetravel entries, and our relation cache */
+			InvalidateSystemCaches();
+
+			while (ctx->reader->EndRecPtr < upto_lsn)
+			{
+				XLogRecord *record;
+				char	   *errm = NULL;
+
+				record = XLogReadRecord(ctx->reader, &errm);
+				if (errm)
+					elog(ERROR, "could not find record for logical decoding: %s", errm);
+
+				if (record != NULL)
+					LogicalDecodingProcessRecord(ctx, ctx->reader);
+
+				CHECK_FOR_INTERRUPTS();
+			}
+
+			FreeDecodingContext(ctx);
+			InvalidateSystemCaches();
+		}
+	}
+	PG_CATCH();
+	{
+		decode_benchmark = NULL;
+		/* clear all timetravel entries */
+		InvalidateSystemCaches();
+		PG_RE_THROW();
+	}
+	PG_END_TRY();
+
+	decode_benchmark = NULL;
+	ReplicationSlotRelease();
+
+	INSTR_TIME_SET_CURRENT(elapsed);
+	INSTR_TIME_SUBTRACT(elapsed, start_time);
+	seconds = INSTR_TIME_GET_DOUBLE(elapsed);
+
+	memset(nulls, 0, sizeof(nulls));
+	values[0] = Int64GetDatum(bench.changes);
+	values[1] = Int64GetDatum(bench.bytes);
+	values[2] = Float8GetDatum(seconds);
+	if (seconds > 0)
+		values[3] = Float8GetDatum(bench.changes / seconds);
+	else
+		nulls[3] = true;
+	for (i = 0; i < 3; i++)
+	{
+		values[4 + 2 * i] = Int64GetDatum(bench.columns[i]);
+		values[5 + 2 * i] = Int64GetDatum(bench.column_bytes[i]);
+	}
+
+	PG_RETURN_DATUM(HeapTupleGetDatum(heap_form_tuple(tupdesc, values, nulls)));
+}
@@ -47,6 +47,7 @@
 #include "utils/memutils.h"
 #include "utils/snapmgr.h"
 #include "utils/regproc.h"
+#include "utils/timestamp.h"
 
 PG_FUNCTION_INFO_V1(pgactive_connections_changed);
 
@@ -243,6 +244,7 @@ pgactive_perdb_xact_callback(XactEvent event, void *arg)
 					 * then the worker is still starting and will see our new
 					 * changes anyway.
 					 */
+					w->data.perdb.connections_changed = true;
 					if (w->data.perdb.proclatch != NULL)
 						SetLatch(w->data.perdb.proclatch);
 				}
@@ -522,6 +524,15 @@ pgactive_maintain_db_workers(void)
 				else if (pgactive_nodeid_eq(&walsnd->remote_node, node))
 					kill_proc = true;
 			}
+			else if (w->worker_type == pgactive_WORKER_APPLY_PARALLEL)
+			{
+				pgactiveApplyParallelWorker *pw = &w->data.apply_parallel;
+
+				if (our_status == pgactive_NODE_STATUS_KILLED && w->worker_proc->databaseId == node->dboid)
+					kill_proc = true;
+				else if (pgactive_nodeid_eq(&pw->remote_node, node))
+					kill_proc = true;
+			}
 			else
 			{
 				/* unreachable */
@@ -636,7 +647,12 @@ pgactive_maintain_db_workers(void)
 	 * worker go into long wait.
 	 */
 	if (at_least_one_worker_terminated)
+	{
+		LWLockAcquire(pgactiveWorkerCtl->lock, LW_EXCLUSIVE);
+		pgactive_worker_slot->data.perdb.connections_changed = true;
+		LWLockRelease(pgactiveWorkerCtl->lock);
 		SetLatch(&MyProc->procLatch);
+	}
 
 	PopActiveSnapshot();
 	SPI_finish();
@@ -845,7 +861,10 @@ pgactive_maintain_db_workers(void)
 			 * anyway, so we don't have to set the latch.
 			 */
 			if (worker->data.apply.proclatch != NULL)
+			{
+				worker->data.apply.reload_requested = true;
 				SetLatch(worker->data.apply.proclatch);
+			}
 
 			LWLockRelease(pgactiveWorkerCtl->lock);
 			continue;
@@ -1214,10 +1233,13 @@ check_local_node_connectability(void)
 void
 pgactive_perdb_worker_main(Datum main_arg)
 {
-	int			rc = 0;
 	pgactivePerdbWorker *perdb;
 	StringInfoData si;
 	pgactiveNodeId myid;
+	bool		maintain_workers;
+	bool		maintain_range_seqs;
+	bool		have_range_seqs = true;
+	TimestampTz last_range_seq_maintain = 0;
 
 	pqsignal(SIGUSR2, pgactive_perdb_worker_sigusr2_handler);
 
@@ -1254,6 +1276,8 @@ pgactive_perdb_worker_main(Datum main_arg)
 	LWLockAcquire(pgactiveWorkerCtl->lock, LW_EXCLUSIVE);
 	perdb->proclatch = &MyProc->procLatch;
 	perdb->p_dboid = MyDatabaseId;
+	/* the first round of launching apply workers happens below anyway */
+	perdb->connections_changed = false;
 	LWLockRelease(pgactiveWorkerCtl->lock);
 
 	Assert(perdb->c_dboid == perdb->p_dboid);
@@ -1341,13 +1365,14 @@ pgactive_perdb_worker_main(Datum main_arg)
 		 * necessary, but is awakened if postmaster dies.  That way the
 		 * background process goes away immediately in an emergency.
 		 *
-		 * We wake up everytime our latch gets set or if 180 seconds have
-		 * passed without events. That's a stopgap for the case a backend
-		 * committed txn changes but died before setting the latch.
+		 * We wake up everytime our latch gets set or if a minute has passed
+		 * without events. That's a stopgap for the case a backend committed
+		 * txn changes but died before setting the latch, and gives up claims
+		 * of sequence chunks that weren't answered in time.
 		 */
-		rc = pgactiveWaitLatch(&MyProc->procLatch,
-							   WL_LATCH_SET | WL_TIMEOUT | WL_EXIT_ON_PM_DEATH,
-							   180000L, PG_WAIT_EXTENSION);
+		(void) pgactiveWaitLatch(&MyProc->procLatch,
+								 WL_LATCH_SET | WL_TIMEOUT | WL_EXIT_ON_PM_DEATH,
+								 pgactive_RANGE_SEQ_CLAIM_TIMEOUT_MS, PG_WAIT_EXTENSION);
 		ResetLatch(&MyProc->procLatch);
 		CHECK_FOR_INTERRUPTS();
 
@@ -1367,13 +1392,38 @@ pgactive_perdb_worker_main(Datum main_arg)
 			pg_unreachable();
 		}
 
-		if (rc & WL_LATCH_SET)
-		{
-			/*
-			 * If the perdb worker's latch is set we're being asked to rescan
-			 * and launch new apply workers.
-			 */
+		/*
+		 * The latch is also set for range-allocated sequences and signals, so
+		 * only rescan and launch new apply workers if we were asked to. A
+		 * request made while worker management is paused is kept for later.
+		 */
+		LWLockAcquire(pgactiveWorkerCtl->lock, LW_EXCLUSIVE);
+		maintain_workers = perdb->connections_changed &&
+			!pgactiveWorkerCtl->worker_management_paused;
+		if (maintain_workers)
+			perdb->connections_changed = false;
+		maintain_range_seqs = perdb->range_seq_pending;
+		perdb->range_seq_pending = false;
+		LWLockRelease(pgactiveWorkerCtl->lock);
+
+		if (maintain_workers)
 			pgactive_maintain_db_workers();
+
+		/*
+		 * Keep spare chunks of range-allocated sequences at hand when asked
+		 * to, and give up unanswered claims once in a while if there are any
+		 * such sequences.
+		 */
+		if (!maintain_range_seqs && have_range_seqs &&
+			TimestampDifferenceExceeds(last_range_seq_maintain,
+									   GetCurrentTimestamp(),
+									   pgactive_RANGE_SEQ_CLAIM_TIMEOUT_MS))
+			maintain_range_seqs = true;
+
+		if (maintain_range_seqs)
+		{
+			have_range_seqs = pgactive_range_seq_maintain();
+			last_range_seq_maintain = GetCurrentTimestamp();
 		}
 	}
 
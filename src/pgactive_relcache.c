@@ -21,15 +21,38 @@
 #include "access/xact.h"
 
 #include "catalog/pg_class.h"
+#include "catalog/pg_type.h"
 
 #include "commands/seclabel.h"
 
+#include "executor/executor.h"
+
+#include "nodes/makefuncs.h"
+
+#include "optimizer/optimizer.h"
+
+#include "parser/parse_coerce.h"
+#include "parser/parse_collate.h"
+#include "parser/parse_expr.h"
+#include "parser/parse_node.h"
+#include "parser/parse_relation.h"
+#include "parser/parser.h"
+
+#include "utils/array.h"
 #include "utils/builtins.h"
 #include "utils/catcache.h"
 #include "utils/fmgroids.h"
 #include "utils/inval.h"
 #include "utils/jsonb.h"
+#include "utils/lsyscache.h"
+#include "utils/memutils.h"
 #include "utils/rel.h"
+#include "utils/relcache.h"
+#include "utils/resowner.h"
+
+PGDLLEXPORT Datum pgactive_check_replication_set_config(PG_FUNCTION_ARGS);
+
+PG_FUNCTION_INFO_V1(pgactive_check_replication_set_config);
 
 static HTAB *pgactiveRelcacheHash = NULL;
 
@@ -38,8 +61,11 @@ pgactiveRelcacheHashInvalidateEntry(pgactiveRelation * entry)
 {
 	int			i;
 
-	if (entry->conflict_handlers)
-		pfree(entry->conflict_handlers);
+	if (entry->conflict_handlers_context)
+		MemoryContextDelete(entry->conflict_handlers_context);
+
+	if (entry->computed_repl_context)
+		MemoryContextDelete(entry->computed_repl_context);
 
 	if (entry->num_replication_sets > 0)
 	{
@@ -65,6 +91,11 @@ pgactiveRelcacheHashInvalidateCallback(Datum arg, Oid relid)
 	if (pgactiveRelcacheHash == NULL)
 		return;
 
+	/* the apply worker's per-transaction state built from the relcache */
+	pgactive_apply_relstate_invalidate(relid);
+	/* and its mapping of upstream relation ids to local relations */
+	pgactive_apply_remote_relation_invalidate(relid);
+
 	/*
 	 * If relid is InvalidOid, signalling a complete reset, we have to remove
 	 * all entries, otherwise just invalidate the specific relation's entry.
@@ -363,10 +394,314 @@ replset_lookup(Relation rel, const char *cname)
 	return tuple;
 }
 
+/*
+ * Parse the row filter of a replication set for a relation, as a WHERE
+ * clause on it would be. Since it's evaluated in the walsender on decoded
+ * tuples, it may only use immutable functions and no subqueries.
+ */
+static Expr *
+replset_parse_row_filter(Relation rel, const char *setname, const char *filter)
+{
+	List	   *raw;
+	SelectStmt *stmt;
+	ResTarget  *target;
+	ParseState *pstate;
+	ParseNamespaceItem *nsitem;
+	Node	   *expr;
+
+	raw = raw_parser(psprintf("SELECT %s", filter), RAW_PARSE_DEFAULT);
+
+	stmt = list_length(raw) == 1 ?
+		(SelectStmt *) linitial_node(RawStmt, raw)->stmt : NULL;
+	if (stmt == NULL || !IsA(stmt, SelectStmt) ||
+		list_length(stmt->targetList) != 1 || stmt->fromClause != NIL ||
+		stmt->whereClause != NULL || stmt->groupClause != NIL ||
+		stmt->havingClause != NULL || stmt->windowClause != NIL ||
+		stmt->distinctClause != NIL || stmt->sortClause != NIL ||
+		stmt->limitCount != NULL || stmt->limitOffset != NULL ||
+		stmt->lockingClause != NIL || stmt->withClause != NULL ||
+		stmt->op != SETOP_NONE)
+		ereport(ERROR,
+				(errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+				 errmsg("row filter of replication set \"%s\" is not an expression",
+						setname)));
+
+	target = linitial_node(ResTarget, stmt->targetList);
+
+	pstate = make_parsestate(NULL);
+	nsitem = addRangeTableEntryForRelation(pstate, rel, AccessShareLock,
+										   NULL, false, false);
+	addNSItemToQuery(pstate, nsitem, false, true, true);
+
+	expr = transformExpr(pstate, target->val, EXPR_KIND_WHERE);
+	expr = coerce_to_boolean(pstate, expr, "row filter");
+	assign_expr_collations(pstate, expr);
+
+	if (pstate->p_hasSubLinks)
+		ereport(ERROR,
+				(errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+				 errmsg("row filter of replication set \"%s\" must not contain subqueries",
+						setname)));
+
+	if (contain_mutable_functions(expr))
+		ereport(ERROR,
+				(errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+				 errmsg("functions in row filter of replication set \"%s\" must be marked IMMUTABLE",
+						setname)));
+
+	free_parsestate(pstate);
+
+	return expression_planner((Expr *) expr);
+}
+
+/*
+ * Parse a row filter in the walsender. The filter was checked when the
+ * replication set was configured, but the relation may have changed since,
+ * and an ERROR here would stop replication from this node on every retry.
+ * Report what's wrong as a WARNING and return NULL instead, so the filter is
+ * ignored.
+ */
+static Expr *
+replset_try_parse_row_filter(Relation rel, const char *setname,
+							 const char *filter)
+{
+	MemoryContext oldcontext = CurrentMemoryContext;
+	ResourceOwner oldowner = CurrentResourceOwner;
+	Expr	   *volatile expr = NULL;
+
+	BeginInternalSubTransaction(NULL);
+	MemoryContextSwitchTo(oldcontext);
+
+	PG_TRY();
+	{
+		expr = replset_parse_row_filter(rel, setname, filter);
+
+		ReleaseCurrentSubTransaction();
+		MemoryContextSwitchTo(oldcontext);
+		CurrentResourceOwner = oldowner;
+	}
+	PG_CATCH();
+	{
+		ErrorData  *edata;
+
+		MemoryContextSwitchTo(oldcontext);
+		edata = CopyErrorData();
+		FlushErrorState();
+
+		RollbackAndReleaseCurrentSubTransaction();
+		MemoryContextSwitchTo(oldcontext);
+		CurrentResourceOwner = oldowner;
+
+		ereport(WARNING,
+				(errmsg("ignoring row filter of replication set \"%s\" for table \"%s\"",
+						setname, RelationGetRelationName(rel)),
+				 errdetail("%s", edata->message)));
+
+		FreeErrorData(edata);
+		expr = NULL;
+	}
+	PG_END_TRY();
+
+	return expr;
+}
+
+/*
+ * Columns the replication sets of a relation don't send are null in the rows
+ * its INSERTs create on the receiving nodes, unless they have a default there.
+ * Column lists that leave out columns that can't be null are refused, rather
+ * than have the INSERTs fail on the receiving nodes.
+ *
+ * Reports at elevel and returns false if that's the case.
+ */
+static bool
+check_replicated_columns(Relation rel, Bitmapset *columns, int elevel)
+{
+	TupleDesc	desc = RelationGetDescr(rel);
+	int			i;
+
+	for (i = 0; i < desc->natts; i++)
+	{
+		Form_pg_attribute att = TupleDescAttr(desc, i);
+
+		if (att->attisdropped || !att->attnotnull || att->atthasdef ||
+			att->attidentity || bms_is_member(i + 1, columns))
+			continue;
+
+		ereport(elevel,
+				(errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+				 errmsg("column list of replication set leaves out column \"%s\" of table \"%s\"",
+						NameStr(att->attname), RelationGetRelationName(rel)),
+				 errdetail("The column is NOT NULL and has no default, so replicated INSERTs would fail."),
+				 errhint("Add the column to the column list, or give it a default.")));
+		return false;
+	}
+
+	return true;
+}
+
+/*
+ * The old row of an UPDATE or DELETE only has the replica identity columns,
+ * unless the relation has REPLICA IDENTITY FULL. Row filters of relations
+ * whose UPDATEs or DELETEs are replicated may only use those columns, so that
+ * they can be checked against the old row too.
+ *
+ * Reports at elevel and returns false if the filter uses other columns.
+ */
+static bool
+check_row_filter_columns(Relation rel, Bitmapset *filter_columns,
+						 Bitmapset *identity_columns, int elevel)
+{
+	int			attno;
+
+	if (rel->rd_rel->relreplident == REPLICA_IDENTITY_FULL)
+		return true;
+
+	attno = -1;
+	while ((attno = bms_next_member(filter_columns, attno)) >= 0)
+	{
+		if (bms_is_member(attno, identity_columns))
+			continue;
+
+		ereport(elevel,
+				(errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+				 errmsg("row filter of replication set uses column \"%s\" of table \"%s\", which isn't part of its replica identity",
+						get_attname(RelationGetRelid(rel), attno, false),
+						RelationGetRelationName(rel)),
+				 errdetail("UPDATEs or DELETEs of the table are replicated, and their old row only has the replica identity columns."),
+				 errhint("Only use replica identity columns in the row filter, or set REPLICA IDENTITY FULL on the table.")));
+		return false;
+	}
+
+	return true;
+}
+
+/*
+ * The columns of the replica identity of a relation, as attnos.
+ */
+static Bitmapset *
+relation_identity_columns(Relation rel)
+{
+	Bitmapset  *identity;
+	Bitmapset  *columns = NULL;
+	int			attno;
+
+	/* the attnos of the identity are offset by the system columns */
+	identity = RelationGetIndexAttrBitmap(rel, INDEX_ATTR_BITMAP_IDENTITY_KEY);
+	attno = -1;
+	while ((attno = bms_next_member(identity, attno)) >= 0)
+		columns = bms_add_member(columns,
+								 attno + FirstLowInvalidHeapAttributeNumber);
+
+	return columns;
+}
+
+/*
+ * The columns a row filter uses, as attnos.
+ */
+static Bitmapset *
+row_filter_columns(Expr *filter)
+{
+	Bitmapset  *varattnos = NULL;
+	Bitmapset  *columns = NULL;
+	int			attno;
+
+	/* these attnos are offset by the system columns too */
+	pull_varattnos((Node *) filter, 1, &varattnos);
+	attno = -1;
+	while ((attno = bms_next_member(varattnos, attno)) >= 0)
+		columns = bms_add_member(columns,
+								 attno + FirstLowInvalidHeapAttributeNumber);
+
+	return columns;
+}
+
+/*
+ * The columns of a column list the relation has, as attnos. Names of
+ * columns it doesn't have are ignored.
+ */
+static Bitmapset *
+column_list_columns(Relation rel, ArrayType *list)
+{
+	Bitmapset  *columns = NULL;
+	Datum	   *names;
+	int			nnames;
+	int			i;
+
+	deconstruct_array(list, NAMEOID, NAMEDATALEN, false, TYPALIGN_CHAR,
+					  &names, NULL, &nnames);
+
+	for (i = 0; i < nnames; i++)
+	{
+		AttrNumber	attno;
+
+		attno = get_attnum(RelationGetRelid(rel),
+						   NameStr(*DatumGetName(names[i])));
+		if (attno > 0)
+			columns = bms_add_member(columns, attno);
+	}
+
+	return columns;
+}
+
+/*
+ * Check the column list and row filter of a replication set against a
+ * relation in the set, as the walsender would use them, with ERRORs. Called
+ * by the trigger on pgactive_replication_set_config, so that a bad
+ * configuration is refused when it's written rather than found while
+ * decoding.
+ */
+Datum
+pgactive_check_replication_set_config(PG_FUNCTION_ARGS)
+{
+	Oid			relid = PG_GETARG_OID(0);
+	char	   *setname = NameStr(*PG_GETARG_NAME(1));
+	bool		inserts = PG_GETARG_BOOL(2);
+	bool		updates = PG_GETARG_BOOL(3);
+	bool		deletes = PG_GETARG_BOOL(4);
+	Relation	rel;
+	Bitmapset  *identity_columns;
+
+	rel = try_relation_open(relid, AccessShareLock);
+	if (rel == NULL)
+		PG_RETURN_VOID();
+
+	identity_columns = relation_identity_columns(rel);
+
+	if (!PG_ARGISNULL(6))
+	{
+		Expr	   *filter;
+
+		filter = replset_parse_row_filter(rel, setname,
+										  text_to_cstring(PG_GETARG_TEXT_PP(6)));
+		if (updates || deletes)
+			check_row_filter_columns(rel, row_filter_columns(filter),
+									 identity_columns, ERROR);
+	}
+
+	if (!PG_ARGISNULL(5) &&
+		(inserts || (updates && !PG_ARGISNULL(6))))
+		check_replicated_columns(rel,
+								 bms_add_members(column_list_columns(rel, PG_GETARG_ARRAYTYPE_P(5)),
+												 identity_columns),
+								 ERROR);
+
+	relation_close(rel, AccessShareLock);
+
+	PG_RETURN_VOID();
+}
+
 /*
  * Compute whether modifications to this relation should be replicated or not
  * and cache the result in the relation descriptor.
  *
+ * Also compute which of its columns and rows are sent: those in the column
+ * lists and matching the row filters of the sets it's replicated by. A set
+ * without a column list sends all columns and one without a row filter all
+ * rows. Replica identity columns are always sent, so the changes can be
+ * applied. Column lists and row filters that can't be applied correctly are
+ * ignored with a WARNING, see check_replicated_columns() and
+ * check_row_filter_columns().
+ *
  * NB: This can only sensibly used from inside logical decoding as we require
  * a constant set of 'to be replicated' sets to be passed in - which happens
  * to be what we need for logical decoding. As there really isn't another need
@@ -380,6 +715,14 @@ pgactive_heap_compute_replication_settings(pgactiveRelation * r,
 										   char **conf_replication_sets)
 {
 	int			i;
+	bool		all_columns = false;
+	bool		all_rows = false;
+	Bitmapset  *columns = NULL;
+	Bitmapset  *identity_columns;
+	List	   *filters = NIL;
+	Expr	   *filter = NULL;
+	Bitmapset  *filter_columns = NULL;
+	MemoryContext oldcontext;
 
 	Assert(MyReplicationSlot);	/* in decoding */
 
@@ -397,8 +740,8 @@ pgactive_heap_compute_replication_settings(pgactiveRelation * r,
 	}
 
 	/*
-	 * Build the union of all replicated actions across all configured
-	 * replication sets.
+	 * Build the union of all replicated actions, columns and rows across all
+	 * configured replication sets.
 	 */
 	for (i = 0; i < conf_num_replication_sets; i++)
 	{
@@ -418,6 +761,7 @@ pgactive_heap_compute_replication_settings(pgactiveRelation * r,
 		{
 			bool		isnull;
 			TupleDesc	desc = RelationGetDescr(repl_sets);
+			Datum		d;
 
 			if (DatumGetBool(fastgetattr(tuple, 2, desc, &isnull)))
 				r->computed_repl_insert = true;
@@ -428,6 +772,30 @@ pgactive_heap_compute_replication_settings(pgactiveRelation * r,
 			if (DatumGetBool(fastgetattr(tuple, 4, desc, &isnull)))
 				r->computed_repl_delete = true;
 
+			/* the columns are missing in tables of older versions */
+			d = desc->natts >= 5 ? heap_getattr(tuple, 5, desc, &isnull) : (Datum) 0;
+			if (desc->natts < 5 || isnull)
+				all_columns = true;
+			else
+				columns = bms_add_members(columns,
+										  column_list_columns(r->rel,
+															  DatumGetArrayTypeP(d)));
+
+			d = desc->natts >= 6 ? heap_getattr(tuple, 6, desc, &isnull) : (Datum) 0;
+			if (desc->natts < 6 || isnull)
+				all_rows = true;
+			else
+			{
+				Expr	   *filter;
+
+				filter = replset_try_parse_row_filter(r->rel, setname,
+													  TextDatumGetCString(d));
+				if (filter != NULL)
+					filters = lappend(filters, filter);
+				else
+					all_rows = true;
+			}
+
 			pfree(tuple);
 		}
 		else
@@ -435,6 +803,8 @@ pgactive_heap_compute_replication_settings(pgactiveRelation * r,
 			r->computed_repl_insert = true;
 			r->computed_repl_update = true;
 			r->computed_repl_delete = true;
+			all_columns = true;
+			all_rows = true;
 		}
 
 		table_close(repl_sets, AccessShareLock);
@@ -442,9 +812,71 @@ pgactive_heap_compute_replication_settings(pgactiveRelation * r,
 		/* no need to look any further, we replicate everything */
 		if (r->computed_repl_insert &&
 			r->computed_repl_update &&
-			r->computed_repl_delete)
+			r->computed_repl_delete &&
+			all_columns && all_rows)
 			break;
 	}
 
+	if (all_columns && all_rows)
+	{
+		r->computed_repl_valid = true;
+		return;
+	}
+
+	identity_columns = relation_identity_columns(r->rel);
+
+	/*
+	 * Column lists and row filters were checked when they were configured,
+	 * but the relation may have changed since. Rather than stop replication,
+	 * send all rows or all columns of the relation if they're no longer
+	 * usable.
+	 */
+	if (!all_rows)
+	{
+		filter = list_length(filters) == 1 ? linitial(filters) :
+			make_orclause(filters);
+		filter_columns = row_filter_columns(filter);
+
+		if ((r->computed_repl_update || r->computed_repl_delete) &&
+			!check_row_filter_columns(r->rel, filter_columns,
+									  identity_columns, WARNING))
+			all_rows = true;
+	}
+
+	if (!all_columns)
+	{
+		columns = bms_add_members(columns, identity_columns);
+
+		/* UPDATEs of rows that start matching the filters are sent as INSERTs */
+		if ((r->computed_repl_insert || (r->computed_repl_update && !all_rows)) &&
+			!check_replicated_columns(r->rel, columns, WARNING))
+			all_columns = true;
+	}
+
+	if (all_columns && all_rows)
+	{
+		r->computed_repl_valid = true;
+		return;
+	}
+
+	r->computed_repl_context = AllocSetContextCreate(CacheMemoryContext,
+													 "pgactive replicated columns and rows",
+													 ALLOCSET_SMALL_SIZES);
+	oldcontext = MemoryContextSwitchTo(r->computed_repl_context);
+
+	if (!all_columns)
+		r->computed_repl_columns = bms_copy(columns);
+
+	if (!all_rows)
+	{
+		r->computed_repl_filter = ExecInitExpr(copyObject(filter), NULL);
+		r->computed_repl_filter_columns = bms_copy(filter_columns);
+		r->computed_repl_filter_slot =
+			MakeSingleTupleTableSlot(CreateTupleDescCopy(RelationGetDescr(r->rel)),
+									 &TTSOpsHeapTuple);
+	}
+
+	MemoryContextSwitchTo(oldcontext);
+
 	r->computed_repl_valid = true;
 }
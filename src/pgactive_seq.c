@@ -3,6 +3,35 @@
  * pgactive_seq.c
  *		An implementation of global sequences.
  *
+ * Two kinds of global sequences are provided. Snowflake ids combine a
+ * timestamp, the node's sequence ID and a per-millisecond counter into a
+ * 64-bit value, without any coordination with other nodes.
+ *
+ * Range-allocated sequences hand out plain values of a local sequence from
+ * chunks of it that the node has reserved for itself. A node claims the next
+ * free chunk by inserting a row into pgactive.pgactive_sequence_chunks and
+ * sending a pgactive_MESSAGE_SEQ_CLAIM message in the same transaction. Each
+ * peer checks the claim against the chunks it knows about and answers with a
+ * pgactive_MESSAGE_SEQ_VOTE message. Once all peers accepted the claim, the
+ * chunk is allocated and its values are used. Concurrent claims of the same
+ * values are resolved in favour of the node with the lowest node id; the
+ * losing claim is rejected by that node and retried with the next chunk.
+ *
+ * The perdb worker keeps a spare allocated chunk for every range-allocated
+ * sequence, so nextval only waits for the network when values are consumed
+ * faster than chunks can be claimed. Chunk sizes are set per sequence in
+ * pgactive.pgactive_range_sequences, which is written on any node like other
+ * configuration. Chunk rows are only written by their owning node, so they
+ * replicate without conflicts; the votes a claim got are only tracked on the
+ * claiming node. A chunk never starts below the current value of the local
+ * sequence, so sequences that were in use before becoming range-allocated
+ * don't hand out their old values again.
+ *
+ * Claims and votes are received by apply workers, whose writes carry the
+ * replication origin of the peer and so wouldn't be replicated to the other
+ * peers. Apply workers therefore only queue the resulting changes of chunk
+ * rows in shared memory, and the perdb worker writes them.
+ *
  * Copyright (C) 2012-2015, PostgreSQL Global Development Group
  *
  * IDENTIFICATION
@@ -13,8 +42,35 @@
 #include "postgres.h"
 
 #include "fmgr.h"
+#include "funcapi.h"
+#include "pgstat.h"
+
+#include "access/xact.h"
+
+#include "catalog/namespace.h"
+#include "catalog/pg_namespace.h"
+#include "catalog/pg_type.h"
+
+#include "executor/spi.h"
+
+#include "libpq/pqformat.h"
+
+#include "port/atomics.h"
+
+#include "storage/ipc.h"
+#include "storage/latch.h"
+#include "storage/lmgr.h"
+#include "storage/lwlock.h"
+#include "storage/shmem.h"
+#include "storage/spin.h"
 
+#include "utils/builtins.h"
+#include "utils/hsearch.h"
 #include "utils/lsyscache.h"
+#include "utils/memutils.h"
+#include "utils/resowner.h"
+#include "utils/snapmgr.h"
+#include "utils/syscache.h"
 #include "utils/timestamp.h"
 #include "utils/datetime.h"
 #include "utils/fmgrprotos.h"
@@ -22,33 +78,145 @@
 #include "miscadmin.h"
 
 #include "pgactive.h"
+#include "pgactive_messaging.h"
 
 #define TIMESTAMP_BITS	40
 #define SEQUENCE_BITS	14
 #define MAX_SEQ_ID		((1 << SEQUENCE_BITS) - 1)
 #define MAX_TIMESTAMP	(((int64)1 << TIMESTAMP_BITS) - 1)
 
+/* Oct 7, 2016, when this code was written, in ms */
+#define SEQ_TS_EPOCH	INT64CONST(529111339634)
+
+/*
+ * When more than 2^SEQUENCE_BITS values are asked for in a millisecond, the
+ * generator hands out values of the following milliseconds, but never more
+ * than this far ahead of the clock, waiting for the clock to catch up
+ * instead. A clock that went backwards by up to SEQ_MAX_CLOCK_REGRESSION_MS
+ * is waited for too, beyond that values can't be generated until it has
+ * caught up.
+ */
+#define SEQ_MAX_AHEAD_MS			10
+#define SEQ_MAX_CLOCK_REGRESSION_MS 1000
+
+/*
+ * A change of a chunk row of the local node, queued by an apply worker for
+ * the perdb worker of its database.
+ */
+typedef struct RangeSeqChange
+{
+	Oid			dboid;
+	NameData	nspname;
+	NameData	relname;
+	int64		chunk_start;
+	int64		chunk_end;
+	char		action;			/* RANGE_SEQ_ACCEPTED etc. */
+	pgactiveNodeId voter;
+}			RangeSeqChange;
+
+#define RANGE_SEQ_ACCEPTED		'a'	/* voter accepted our claim */
+#define RANGE_SEQ_REJECTED		'r'	/* voter rejected our claim */
+#define RANGE_SEQ_WITHDRAWN		'w' /* a preceding node claimed the values */
+
+#define RANGE_SEQ_MAX_CHANGES	64
+
+/*
+ * The last value handed out by the generator on this instance, as the
+ * timestamp shifted left by SEQUENCE_BITS plus the sequence, and the changes
+ * of chunk rows not yet written by the perdb workers.
+ */
+typedef struct pgactiveSeqControl
+{
+	pg_atomic_uint64 last;
+	slock_t		mutex;
+	int			nchanges;
+	RangeSeqChange changes[RANGE_SEQ_MAX_CHANGES];
+}			pgactiveSeqControl;
+
+static pgactiveSeqControl * pgactiveSeqCtl = NULL;
+
+static shmem_startup_hook_type prev_shmem_startup_hook = NULL;
+
  /* Cache for nodeid so we don't have to read it for every nextval call. */
 static int16 seq_nodeid = -1;
 
 static Oid	seq_nodeid_dboid = InvalidOid;
 
 static int16 global_seq_get_nodeid(void);
+static int64 global_seq_reserve(int64 nvalues);
+static int64 global_seq_make_id(int64 timestamp, int64 nodeid, int64 sequence);
+
+/* How long nextval of a range-allocated sequence waits for a chunk */
+#define RANGE_SEQ_WAIT_MS			10000
+
+/* The chunk a backend last handed out values of, per sequence */
+typedef struct RangeSeqCacheEntry
+{
+	Oid			seqoid;			/* hash key */
+	int64		chunk_start;
+	int64		chunk_end;
+}			RangeSeqCacheEntry;
+
+static HTAB *RangeSeqCache = NULL;
 
 Datum		pgactive_snowflake_id_nextval_oid(PG_FUNCTION_ARGS);
+Datum		pgactive_snowflake_id_nextval_n(PG_FUNCTION_ARGS);
+Datum		pgactive_range_sequence_nextval(PG_FUNCTION_ARGS);
 
 PG_FUNCTION_INFO_V1(pgactive_snowflake_id_nextval_oid);
+PG_FUNCTION_INFO_V1(pgactive_snowflake_id_nextval_n);
+PG_FUNCTION_INFO_V1(pgactive_range_sequence_nextval);
+
+static void
+pgactive_seq_shmem_startup(void)
+{
+	bool		found;
+
+	if (prev_shmem_startup_hook != NULL)
+		prev_shmem_startup_hook();
+
+	LWLockAcquire(AddinShmemInitLock, LW_EXCLUSIVE);
+	pgactiveSeqCtl = ShmemInitStruct("pgactive_seq",
+									 sizeof(pgactiveSeqControl),
+									 &found);
+	if (!found)
+	{
+		pg_atomic_init_u64(&pgactiveSeqCtl->last, 0);
+		SpinLockInit(&pgactiveSeqCtl->mutex);
+		pgactiveSeqCtl->nchanges = 0;
+	}
+	LWLockRelease(AddinShmemInitLock);
+}
+
+/* Needs to be called from a shared_preload_library _PG_init() */
+void
+pgactive_seq_shmem_init(void)
+{
+	/* Must be called from postmaster its self */
+	Assert(IsPostmasterEnvironment && !IsUnderPostmaster);
+
+	pgactiveSeqCtl = NULL;
+
+	RequestAddinShmemSpace(sizeof(pgactiveSeqControl));
+
+	prev_shmem_startup_hook = shmem_startup_hook;
+	shmem_startup_hook = pgactive_seq_shmem_startup;
+}
 
 /*
  * We generate sequence number from postgres epoch in ms (40 bits),
  * node id (10 bits) and sequence (14 bits).
  *
  * This can handle milliseconds up to year 2042 (since we count the year from
- * 2016), 1024 nodes and 8192 sequences per millisecond (8M per second). Anyone
- * expecting more than that should consider using UUIDs.
+ * 2016), 1024 nodes and 16384 sequences per millisecond (16M per second).
+ * Anyone expecting more than that should consider using UUIDs.
  *
- * We wrap the input sequence. If more than 2048 values are generated in a
- * millisecond we could wrap.
+ * The timestamp and sequence come from a counter in shared memory, so no
+ * sequence is accessed and concurrent callers never get the same value; the
+ * sequence passed is only used by the testing variant, which takes the
+ * timestamp as its second argument and wraps the input sequence instead. If
+ * more than 16383 values are generated in a millisecond that variant could
+ * wrap.
  *
  * New variants of this sequence generator may be added by adding new
  * SQL callable functions with different epoch offset and bit ranges,
@@ -62,29 +230,145 @@ pgactive_snowflake_id_nextval_oid(PG_FUNCTION_ARGS)
 	int64		sequence;
 	int64		nodeid;
 	int64		timestamp;
-	int64		res;
-
-	/* Oct 7, 2016, when this code was written, in ms */
-	const int64 seq_ts_epoch = 529111339634;
+	int64		value;
 
-	int64		current_ts = GetCurrentTimestamp();
+	nodeid = global_seq_get_nodeid();
 
-	if (PG_NARGS() == 2)
+	if (PG_NARGS() == 1)
 	{
-		/*
-		 * We allow an override timestamp to be passed for testing purposes
-		 * using an alternate function signature. We've received one.
-		 */
-		current_ts = PG_GETARG_INT64(1);
+		value = global_seq_reserve(1);
+
+		PG_RETURN_INT64(global_seq_make_id(value >> SEQUENCE_BITS, nodeid,
+										   value & MAX_SEQ_ID));
 	}
 
-	/* timestamp is in milliseconds */
-	timestamp = (current_ts / 1000) - seq_ts_epoch;
+	/*
+	 * We allow an override timestamp to be passed for testing purposes using
+	 * an alternate function signature. We've received one. Timestamp is in
+	 * milliseconds.
+	 */
+	timestamp = (PG_GETARG_INT64(1) / 1000) - SEQ_TS_EPOCH;
 
-	nodeid = global_seq_get_nodeid();
 	sequenced = DirectFunctionCall1(nextval_oid, seqoid);
 	sequence = DatumGetInt64(sequenced) % MAX_SEQ_ID;
 
+	if (sequence < 0)
+		ereport(ERROR,
+				(errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+				 errmsg("sequence produced negative value"),
+				 errdetail("Sequence \"%s\" produced a negative result. Sequences used as inputs to pgactive global sequence functions must produce positive outputs.",
+						   get_rel_name(seqoid))));
+
+	PG_RETURN_INT64(global_seq_make_id(timestamp, nodeid, sequence));
+}
+
+/*
+ * Set-returning variant handing out the given number of values at once, for
+ * bulk inserts. The values are reserved from the counter in blocks of up to
+ * a millisecond's worth.
+ */
+Datum
+pgactive_snowflake_id_nextval_n(PG_FUNCTION_ARGS)
+{
+	FuncCallContext *funcctx;
+	int64	   *state;
+	int64		value;
+
+	if (SRF_IS_FIRSTCALL())
+	{
+		int64		nvalues = PG_GETARG_INT64(1);
+		MemoryContext oldcontext;
+
+		if (nvalues < 0)
+			ereport(ERROR,
+					(errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+					 errmsg("number of values must not be negative")));
+
+		funcctx = SRF_FIRSTCALL_INIT();
+		oldcontext = MemoryContextSwitchTo(funcctx->multi_call_memory_ctx);
+
+		/* next value and end of the reserved block */
+		state = palloc0(2 * sizeof(int64));
+		funcctx->user_fctx = state;
+		funcctx->max_calls = nvalues;
+
+		MemoryContextSwitchTo(oldcontext);
+	}
+
+	funcctx = SRF_PERCALL_SETUP();
+	state = (int64 *) funcctx->user_fctx;
+
+	if (funcctx->call_cntr >= funcctx->max_calls)
+		SRF_RETURN_DONE(funcctx);
+
+	if (state[0] == state[1])
+	{
+		int64		nvalues = Min(funcctx->max_calls - funcctx->call_cntr,
+								  MAX_SEQ_ID + 1);
+
+		state[0] = global_seq_reserve(nvalues);
+		state[1] = state[0] + nvalues;
+	}
+
+	value = state[0]++;
+
+	SRF_RETURN_NEXT(funcctx,
+					Int64GetDatum(global_seq_make_id(value >> SEQUENCE_BITS,
+													 global_seq_get_nodeid(),
+													 value & MAX_SEQ_ID)));
+}
+
+/*
+ * Reserve nvalues consecutive values of the shared counter, returning the
+ * first one. Values are never handed out twice, even if the clock goes
+ * backwards.
+ */
+static int64
+global_seq_reserve(int64 nvalues)
+{
+	Assert(nvalues > 0 && nvalues <= MAX_SEQ_ID + 1);
+	Assert(pgactiveSeqCtl != NULL);
+
+	for (;;)
+	{
+		int64		now = (GetCurrentTimestamp() / 1000) - SEQ_TS_EPOCH;
+		uint64		last = pg_atomic_read_u64(&pgactiveSeqCtl->last);
+		int64		first;
+		int64		ahead;
+
+		if (now < 0 || now > MAX_TIMESTAMP)
+			elog(ERROR, "cannot generate sequence, timestamp " INT64_FORMAT " out of range 0 .. " INT64_FORMAT,
+				 now, MAX_TIMESTAMP);
+
+		first = Max((int64) last + 1, now << SEQUENCE_BITS);
+		ahead = ((first + nvalues - 1) >> SEQUENCE_BITS) - now;
+
+		if (ahead > SEQ_MAX_AHEAD_MS)
+		{
+			if (ahead > SEQ_MAX_CLOCK_REGRESSION_MS)
+				ereport(ERROR,
+						(errcode(ERRCODE_OBJECT_NOT_IN_PREREQUISITE_STATE),
+						 errmsg("cannot generate sequence, system clock went backwards by " INT64_FORMAT " ms",
+								ahead),
+						 errhint("Values can be generated again once the clock has caught up.")));
+
+			pg_usleep(1000L);
+			CHECK_FOR_INTERRUPTS();
+			continue;
+		}
+
+		if (pg_atomic_compare_exchange_u64(&pgactiveSeqCtl->last, &last,
+										   (uint64) (first + nvalues - 1)))
+			return first;
+	}
+}
+
+/*
+ * Assemble an id from its parts.
+ */
+static int64
+global_seq_make_id(int64 timestamp, int64 nodeid, int64 sequence)
+{
 	/*
 	 * This is mainly a failsafe so that we don't generate corrupted sequence
 	 * numbers if machine date is incorrect (or if somebody is still using
@@ -97,25 +381,16 @@ pgactive_snowflake_id_nextval_oid(PG_FUNCTION_ARGS)
 	if (nodeid < 0 || nodeid > MAX_NODE_ID)
 		elog(ERROR, "nodeid must be in range 0 .. %d", MAX_NODE_ID);
 
-	if (sequence < 0)
-		ereport(ERROR,
-				(errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
-				 errmsg("sequence produced negative value"),
-				 errdetail("Sequence \"%s\" produced a negative result. Sequences used as inputs to pgactive global sequence functions must produce positive outputs.",
-						   get_rel_name(seqoid))));
-
-	Assert(sequence >= 0 && sequence < MAX_SEQ_ID);
+	Assert(sequence >= 0 && sequence <= MAX_SEQ_ID);
 
 	/* static assertions against programmer error: */
 	Assert((MAX_SEQ_ID + 1) % 2 == 0);
 
 	Assert(TIMESTAMP_BITS + NODEID_BITS + SEQUENCE_BITS == 64);
 
-	res = (timestamp << (64 - TIMESTAMP_BITS)) |
+	return (timestamp << (64 - TIMESTAMP_BITS)) |
 		(nodeid << (64 - TIMESTAMP_BITS - NODEID_BITS)) |
 		sequence;
-
-	PG_RETURN_INT64(res);
 }
 
 /*
@@ -153,3 +428,772 @@ global_seq_get_nodeid(void)
 
 	return seq_nodeid;
 }
+
+/*
+ * Range-allocated sequences
+ */
+
+/*
+ * Ask the perdb worker of this database to claim chunks.
+ */
+static void
+range_seq_wake_perdb(void)
+{
+	pgactiveWorker *w;
+
+	LWLockAcquire(pgactiveWorkerCtl->lock, LW_SHARED);
+	if (find_perdb_worker_slot(MyDatabaseId, &w) >= pgactive_PER_DB_WORKER_SLOT_FOUND)
+	{
+		w->data.perdb.range_seq_pending = true;
+		if (w->data.perdb.proclatch != NULL)
+			SetLatch(w->data.perdb.proclatch);
+	}
+	LWLockRelease(pgactiveWorkerCtl->lock);
+}
+
+/*
+ * Queue a change of a chunk row of the local node for the perdb worker,
+ * waiting for room in the queue if needed.
+ *
+ * Changes that are lost in a crash leave a claim unanswered; it is given up
+ * after pgactive_RANGE_SEQ_CLAIM_TIMEOUT_MS and the chunk claimed again.
+ */
+static void
+range_seq_queue_change(const RangeSeqChange * change)
+{
+	bool		waited = false;
+
+	for (;;)
+	{
+		bool		queued = false;
+
+		SpinLockAcquire(&pgactiveSeqCtl->mutex);
+		if (pgactiveSeqCtl->nchanges < RANGE_SEQ_MAX_CHANGES)
+		{
+			pgactiveSeqCtl->changes[pgactiveSeqCtl->nchanges++] = *change;
+			queued = true;
+		}
+		SpinLockRelease(&pgactiveSeqCtl->mutex);
+
+		range_seq_wake_perdb();
+
+		if (queued)
+			break;
+
+		(void) pgactiveWaitLatch(MyLatch,
+								 WL_LATCH_SET | WL_TIMEOUT | WL_EXIT_ON_PM_DEATH,
+								 10L, PG_WAIT_EXTENSION);
+		ResetLatch(MyLatch);
+		CHECK_FOR_INTERRUPTS();
+		waited = true;
+	}
+
+	/* don't swallow a wakeup meant for the caller's main loop */
+	if (waited)
+		SetLatch(MyLatch);
+}
+
+/*
+ * Take the queued changes for this database out of the queue, returning
+ * their number.
+ */
+static int
+range_seq_take_changes(RangeSeqChange * changes)
+{
+	int			nchanges = 0;
+	int			nkept = 0;
+	int			i;
+
+	SpinLockAcquire(&pgactiveSeqCtl->mutex);
+	for (i = 0; i < pgactiveSeqCtl->nchanges; i++)
+	{
+		if (pgactiveSeqCtl->changes[i].dboid == MyDatabaseId)
+			changes[nchanges++] = pgactiveSeqCtl->changes[i];
+		else
+			pgactiveSeqCtl->changes[nkept++] = pgactiveSeqCtl->changes[i];
+	}
+	pgactiveSeqCtl->nchanges = nkept;
+	SpinLockRelease(&pgactiveSeqCtl->mutex);
+
+	return nchanges;
+}
+
+/*
+ * The owner of the pgactive schema, who created the extension and can
+ * access its tables.
+ */
+static Oid
+range_seq_get_owner(void)
+{
+	Oid			nspoid = get_namespace_oid(pgactive_SCHEMA_NAME, false);
+	HeapTuple	tuple;
+	Oid			owner;
+
+	tuple = SearchSysCache1(NAMESPACEOID, ObjectIdGetDatum(nspoid));
+	if (!HeapTupleIsValid(tuple))
+		elog(ERROR, "cache lookup failed for namespace %u", nspoid);
+	owner = ((Form_pg_namespace) GETSTRUCT(tuple))->nspowner;
+	ReleaseSysCache(tuple);
+
+	return owner;
+}
+
+/*
+ * Does node a win over node b when their claims overlap?
+ */
+static bool
+range_seq_node_precedes(const pgactiveNodeId * const a,
+						const pgactiveNodeId * const b)
+{
+	if (a->sysid != b->sysid)
+		return a->sysid < b->sysid;
+	if (a->timeline != b->timeline)
+		return a->timeline < b->timeline;
+	return a->dboid < b->dboid;
+}
+
+/*
+ * Find the allocated chunk of this node that values from v on are to be
+ * taken from. Reads the latest committed state, whatever the isolation level
+ * of the calling transaction.
+ */
+static bool
+range_seq_find_chunk(const char *nspname, const char *relname, int64 v,
+					 int64 *chunk_start, int64 *chunk_end)
+{
+	pgactiveNodeId myid;
+	Oid			argtypes[6] = {TEXTOID, TEXTOID, INT8OID, TEXTOID, OIDOID, OIDOID};
+	Datum		values[6];
+	bool		found = false;
+	int			ret;
+
+	pgactive_make_my_nodeid(&myid);
+
+	values[0] = CStringGetTextDatum(nspname);
+	values[1] = CStringGetTextDatum(relname);
+	values[2] = Int64GetDatum(v);
+	values[3] = CStringGetTextDatum(psprintf(UINT64_FORMAT, myid.sysid));
+	values[4] = ObjectIdGetDatum(myid.timeline);
+	values[5] = ObjectIdGetDatum(myid.dboid);
+
+	if (SPI_connect() != SPI_OK_CONNECT)
+		elog(ERROR, "SPI_connect failed");
+	PushActiveSnapshot(GetLatestSnapshot());
+
+	ret = SPI_execute_with_args("SELECT chunk_start, chunk_end "
+								"FROM pgactive.pgactive_sequence_chunks "
+								"WHERE seqschema = $1 AND seqname = $2 "
+								"AND chunk_end >= $3 AND state = 'a' "
+								"AND owner_sysid = $4 AND owner_timeline = $5 "
+								"AND owner_dboid = $6 "
+								"ORDER BY chunk_start LIMIT 1",
+								6, argtypes, values, NULL, true, 1);
+	if (ret != SPI_OK_SELECT)
+		elog(ERROR, "SPI_execute_with_args failed: %d", ret);
+
+	if (SPI_processed > 0)
+	{
+		bool		isnull;
+
+		*chunk_start = DatumGetInt64(SPI_getbinval(SPI_tuptable->vals[0],
+												   SPI_tuptable->tupdesc,
+												   1, &isnull));
+		*chunk_end = DatumGetInt64(SPI_getbinval(SPI_tuptable->vals[0],
+												 SPI_tuptable->tupdesc,
+												 2, &isnull));
+		found = true;
+	}
+
+	PopActiveSnapshot();
+	SPI_finish();
+
+	return found;
+}
+
+/*
+ * nextval() for range-allocated sequences: a value of the local sequence
+ * that lies in a chunk allocated to this node.
+ */
+Datum
+pgactive_range_sequence_nextval(PG_FUNCTION_ARGS)
+{
+	Oid			seqoid = PG_GETARG_OID(0);
+	RangeSeqCacheEntry *entry;
+	char	   *nspname;
+	char	   *relname;
+	int64		v;
+	bool		found;
+	TimestampTz wait_start = 0;
+	Oid			save_userid;
+	int			save_sec_context;
+
+	if (RangeSeqCache == NULL)
+	{
+		HASHCTL		ctl;
+
+		memset(&ctl, 0, sizeof(ctl));
+		ctl.keysize = sizeof(Oid);
+		ctl.entrysize = sizeof(RangeSeqCacheEntry);
+		ctl.hcxt = TopMemoryContext;
+		RangeSeqCache = hash_create("pgactive range sequences", 16, &ctl,
+									HASH_ELEM | HASH_BLOBS | HASH_CONTEXT);
+	}
+
+	v = DatumGetInt64(DirectFunctionCall1(nextval_oid, ObjectIdGetDatum(seqoid)));
+
+	entry = hash_search(RangeSeqCache, &seqoid, HASH_ENTER, &found);
+	if (found && v >= entry->chunk_start && v <= entry->chunk_end)
+		PG_RETURN_INT64(v);
+
+	entry->chunk_start = 1;
+	entry->chunk_end = 0;
+
+	nspname = get_namespace_name(get_rel_namespace(seqoid));
+	relname = get_rel_name(seqoid);
+	if (nspname == NULL || relname == NULL)
+		elog(ERROR, "cache lookup failed for relation %u", seqoid);
+
+	/*
+	 * The caller only needs USAGE on the sequence for nextval. Looking up the
+	 * chunks and moving the sequence on to the next one is done as the owner
+	 * of the extension, the changed user is restored on error by the
+	 * transaction abort.
+	 */
+	GetUserIdAndSecContext(&save_userid, &save_sec_context);
+	SetUserIdAndSecContext(range_seq_get_owner(),
+						   save_sec_context | SECURITY_LOCAL_USERID_CHANGE);
+
+	/*
+	 * Switching to another chunk is serialized, concurrent nextval calls of
+	 * backends that still have values of their chunk aren't blocked.
+	 */
+	LockRelationOid(seqoid, ShareUpdateExclusiveLock);
+
+	for (;;)
+	{
+		int64		chunk_start;
+		int64		chunk_end;
+
+		if (range_seq_find_chunk(nspname, relname, v, &chunk_start, &chunk_end))
+		{
+			if (v >= chunk_start)
+			{
+				entry->chunk_start = chunk_start;
+				entry->chunk_end = chunk_end;
+
+				/* the chunk may have been the spare one, claim another */
+				range_seq_wake_perdb();
+				break;
+			}
+
+			/* move on to the next chunk */
+			DirectFunctionCall3(setval3_oid, ObjectIdGetDatum(seqoid),
+								Int64GetDatum(chunk_start), BoolGetDatum(false));
+			v = DatumGetInt64(DirectFunctionCall1(nextval_oid,
+												  ObjectIdGetDatum(seqoid)));
+			continue;
+		}
+
+		if (wait_start == 0)
+		{
+			wait_start = GetCurrentTimestamp();
+			range_seq_wake_perdb();
+		}
+		else if (TimestampDifferenceExceeds(wait_start, GetCurrentTimestamp(),
+											RANGE_SEQ_WAIT_MS))
+			ereport(ERROR,
+					(errcode(ERRCODE_OBJECT_NOT_IN_PREREQUISITE_STATE),
+					 errmsg("no values of range-allocated sequence \"%s.%s\" are allocated to this node",
+							nspname, relname),
+					 errhint("Check that the sequence has a chunk size set with pgactive.pgactive_set_sequence_chunk_size() and that all nodes are reachable.")));
+
+		(void) pgactiveWaitLatch(MyLatch,
+								 WL_LATCH_SET | WL_TIMEOUT | WL_EXIT_ON_PM_DEATH,
+								 100L, PG_WAIT_EXTENSION);
+		ResetLatch(MyLatch);
+		CHECK_FOR_INTERRUPTS();
+	}
+
+	UnlockRelationOid(seqoid, ShareUpdateExclusiveLock);
+
+	SetUserIdAndSecContext(save_userid, save_sec_context);
+
+	PG_RETURN_INT64(v);
+}
+
+/*
+ * Write a change of a chunk row of the local node queued by an apply worker.
+ */
+static void
+range_seq_write_change(const RangeSeqChange * change)
+{
+	pgactiveNodeId myid;
+	Oid			argtypes[8] = {TEXTOID, TEXTOID, INT8OID, TEXTOID, OIDOID,
+	OIDOID, TEXTOID, INT8OID};
+	Datum		values[8];
+	int			ret;
+
+	pgactive_make_my_nodeid(&myid);
+
+	values[0] = CStringGetTextDatum(NameStr(change->nspname));
+	values[1] = CStringGetTextDatum(NameStr(change->relname));
+	values[2] = Int64GetDatum(change->chunk_start);
+	values[3] = CStringGetTextDatum(psprintf(UINT64_FORMAT, myid.sysid));
+	values[4] = ObjectIdGetDatum(myid.timeline);
+	values[5] = ObjectIdGetDatum(myid.dboid);
+	values[6] = CStringGetTextDatum(psprintf(UINT64_FORMAT ":%u:%u",
+											 change->voter.sysid,
+											 change->voter.timeline,
+											 change->voter.dboid));
+	values[7] = Int64GetDatum(change->chunk_end);
+
+	switch (change->action)
+	{
+		case RANGE_SEQ_ACCEPTED:
+			ret = SPI_execute_with_args("UPDATE pgactive.pgactive_sequence_chunks "
+										"SET accepted_by = accepted_by || $7, "
+										" state = CASE WHEN pg_catalog.cardinality(accepted_by) + 1 >= votes_needed "
+										"  THEN 'a' ELSE 'p' END "
+										"WHERE seqschema = $1 AND seqname = $2 "
+										"AND chunk_start = $3 AND owner_sysid = $4 "
+										"AND owner_timeline = $5 AND owner_dboid = $6 "
+										"AND state = 'p' AND NOT $7 = ANY (accepted_by)",
+										7, argtypes, values, NULL, false, 0);
+			break;
+		case RANGE_SEQ_REJECTED:
+			ret = SPI_execute_with_args("UPDATE pgactive.pgactive_sequence_chunks "
+										"SET state = 'r' "
+										"WHERE seqschema = $1 AND seqname = $2 "
+										"AND chunk_start = $3 AND owner_sysid = $4 "
+										"AND owner_timeline = $5 AND owner_dboid = $6 "
+										"AND state = 'p'",
+										6, argtypes, values, NULL, false, 0);
+			break;
+		case RANGE_SEQ_WITHDRAWN:
+			ret = SPI_execute_with_args("UPDATE pgactive.pgactive_sequence_chunks "
+										"SET state = 'r' "
+										"WHERE seqschema = $1 AND seqname = $2 "
+										"AND chunk_start <= $8 AND chunk_end >= $3 "
+										"AND state = 'p' AND owner_sysid = $4 "
+										"AND owner_timeline = $5 AND owner_dboid = $6",
+										8, argtypes, values, NULL, false, 0);
+			break;
+		default:
+			elog(ERROR, "unexpected sequence chunk change %c", change->action);
+	}
+	if (ret != SPI_OK_UPDATE)
+		elog(ERROR, "SPI_execute_with_args failed: %d", ret);
+}
+
+/*
+ * Write the given chunk changes, claim chunks for range-allocated sequences
+ * that are short of them, and give up claims that weren't answered in time.
+ *
+ * Returns whether there are any range-allocated sequences.
+ */
+static bool
+range_seq_maintain_xact(const RangeSeqChange * changes, int nchanges)
+{
+	pgactiveNodeId myid;
+	Oid			argtypes[4] = {TEXTOID, OIDOID, OIDOID, INT4OID};
+	Datum		values[4];
+	StringInfoData s;
+	int			votes_needed;
+	bool		isnull;
+	bool		have_sequences;
+	uint64		i;
+	int			ret;
+
+	pgactive_make_my_nodeid(&myid);
+
+	SPI_connect();
+	PushActiveSnapshot(GetTransactionSnapshot());
+
+	/* tables not created yet by the extension update */
+	ret = SPI_execute("SELECT pg_catalog.to_regclass('pgactive.pgactive_sequence_chunks') IS NOT NULL",
+					  true, 1);
+	if (ret != SPI_OK_SELECT)
+		elog(ERROR, "SPI_execute failed: %d", ret);
+	if (!DatumGetBool(SPI_getbinval(SPI_tuptable->vals[0],
+									SPI_tuptable->tupdesc, 1, &isnull)))
+	{
+		PopActiveSnapshot();
+		SPI_finish();
+		return false;
+	}
+
+	for (i = 0; i < nchanges; i++)
+		range_seq_write_change(&changes[i]);
+
+	values[0] = CStringGetTextDatum(psprintf(UINT64_FORMAT, myid.sysid));
+	values[1] = ObjectIdGetDatum(myid.timeline);
+	values[2] = ObjectIdGetDatum(myid.dboid);
+	values[3] = Int32GetDatum(pgactive_RANGE_SEQ_CLAIM_TIMEOUT_MS);
+
+	ret = SPI_execute_with_args("UPDATE pgactive.pgactive_sequence_chunks "
+								"SET state = 'r' "
+								"WHERE state = 'p' AND owner_sysid = $1 "
+								"AND owner_timeline = $2 AND owner_dboid = $3 "
+								"AND claimed_at < pg_catalog.now() - $4 * interval '1 ms'",
+								4, argtypes, values, NULL, false, 0);
+	if (ret != SPI_OK_UPDATE)
+		elog(ERROR, "SPI_execute_with_args failed: %d", ret);
+
+	ret = SPI_execute_with_args("SELECT count(*) FROM pgactive.pgactive_nodes "
+								"WHERE node_status = " pgactive_NODE_STATUS_READY_S " "
+								"AND (node_sysid, node_timeline, node_dboid) <> ($1, $2, $3)",
+								3, argtypes, values, NULL, true, 1);
+	if (ret != SPI_OK_SELECT)
+		elog(ERROR, "SPI_execute_with_args failed: %d", ret);
+	votes_needed = (int) DatumGetInt64(SPI_getbinval(SPI_tuptable->vals[0],
+													 SPI_tuptable->tupdesc,
+													 1, &isnull));
+
+	/*
+	 * Sequences with fewer than two chunks, the one in use and a spare one,
+	 * allocated or claimed beyond their current value. New chunks start after
+	 * the last chunk claimed by any node and the current value, whichever is
+	 * higher.
+	 */
+	ret = SPI_execute_with_args("SELECT s.seqschema::text, s.seqname::text, s.chunk_size, "
+								"(SELECT pg_catalog.count(*) FROM pgactive.pgactive_sequence_chunks c "
+								" WHERE c.seqschema = s.seqschema AND c.seqname = s.seqname "
+								" AND c.state IN ('p', 'a') AND c.owner_sysid = $1 "
+								" AND c.owner_timeline = $2 AND c.owner_dboid = $3 "
+								" AND c.chunk_end > COALESCE(pg_catalog.pg_sequence_last_value(r.oid), 0)), "
+								"GREATEST((SELECT COALESCE(pg_catalog.max(c.chunk_end), 0) FROM pgactive.pgactive_sequence_chunks c "
+								"          WHERE c.seqschema = s.seqschema AND c.seqname = s.seqname), "
+								"         COALESCE(pg_catalog.pg_sequence_last_value(r.oid), 0)) "
+								"FROM pgactive.pgactive_range_sequences s "
+								"JOIN pg_catalog.pg_namespace n ON n.nspname = s.seqschema "
+								"JOIN pg_catalog.pg_class r ON r.relnamespace = n.oid "
+								" AND r.relname = s.seqname AND r.relkind = 'S'",
+								3, argtypes, values, NULL, true, 0);
+	if (ret != SPI_OK_SELECT)
+		elog(ERROR, "SPI_execute_with_args failed: %d", ret);
+
+	have_sequences = SPI_processed > 0;
+
+	initStringInfo(&s);
+
+	for (i = 0; i < SPI_processed; i++)
+	{
+		HeapTuple	tup = SPI_tuptable->vals[i];
+		TupleDesc	tupdesc = SPI_tuptable->tupdesc;
+		char	   *nspname = SPI_getvalue(tup, tupdesc, 1);
+		char	   *relname = SPI_getvalue(tup, tupdesc, 2);
+		int64		chunk_size = DatumGetInt64(SPI_getbinval(tup, tupdesc, 3, &isnull));
+		int64		nchunks = DatumGetInt64(SPI_getbinval(tup, tupdesc, 4, &isnull));
+		int64		chunk_start = DatumGetInt64(SPI_getbinval(tup, tupdesc, 5, &isnull)) + 1;
+
+		for (; nchunks < 2; nchunks++)
+		{
+			Oid			claimtypes[8] = {TEXTOID, TEXTOID, INT8OID, INT8OID,
+			TEXTOID, OIDOID, OIDOID, INT4OID};
+			Datum		claimvalues[8];
+			int64		chunk_end = chunk_start + chunk_size - 1;
+
+			claimvalues[0] = CStringGetTextDatum(nspname);
+			claimvalues[1] = CStringGetTextDatum(relname);
+			claimvalues[2] = Int64GetDatum(chunk_start);
+			claimvalues[3] = Int64GetDatum(chunk_end);
+			claimvalues[4] = values[0];
+			claimvalues[5] = values[1];
+			claimvalues[6] = values[2];
+			claimvalues[7] = Int32GetDatum(votes_needed);
+
+			/* without peers, there's nobody to ask */
+			ret = SPI_execute_with_args("INSERT INTO pgactive.pgactive_sequence_chunks "
+										"(seqschema, seqname, chunk_start, chunk_end, owner_sysid, "
+										" owner_timeline, owner_dboid, state, votes_needed) "
+										"VALUES ($1, $2, $3, $4, $5, $6, $7, "
+										" CASE WHEN $8 > 0 THEN 'p' ELSE 'a' END, $8)",
+										8, claimtypes, claimvalues, NULL, false, 0);
+			if (ret != SPI_OK_INSERT)
+				elog(ERROR, "SPI_execute_with_args failed: %d", ret);
+
+			elog(DEBUG1, "claiming values " INT64_FORMAT " to " INT64_FORMAT " of sequence %s.%s",
+				 chunk_start, chunk_end, nspname, relname);
+
+			if (votes_needed > 0)
+			{
+				pgactive_prepare_message(&s, pgactive_MESSAGE_SEQ_CLAIM);
+				pq_sendstring(&s, nspname);
+				pq_sendstring(&s, relname);
+				pq_sendint64(&s, chunk_start);
+				pq_sendint64(&s, chunk_end);
+				pgactive_send_message(&s, true);	/* transactional */
+			}
+
+			chunk_start = chunk_end + 1;
+		}
+	}
+
+	pfree(s.data);
+
+	PopActiveSnapshot();
+	SPI_finish();
+
+	return have_sequences;
+}
+
+/*
+ * Write the chunk changes queued by apply workers, claim chunks for
+ * range-allocated sequences that are short of them, and give up claims that
+ * weren't answered in time.
+ *
+ * Runs in the perdb worker when a backend starts using the spare chunk of a
+ * sequence or a change has been queued, and every
+ * pgactive_RANGE_SEQ_CLAIM_TIMEOUT_MS while there are range-allocated
+ * sequences. Errors are reported as warnings so they don't take the perdb
+ * worker, and with it the apply workers, down; the work is retried later.
+ *
+ * Returns whether there are any range-allocated sequences, assuming there are
+ * if that couldn't be found out.
+ */
+bool
+pgactive_range_seq_maintain(void)
+{
+	RangeSeqChange changes[RANGE_SEQ_MAX_CHANGES];
+	int			nchanges;
+	volatile bool have_sequences = true;
+	MemoryContext oldcontext;
+	ResourceOwner oldowner;
+
+	Assert(!IsTransactionState());
+
+	/* lost if writing them fails, the claims then time out */
+	nchanges = range_seq_take_changes(changes);
+
+	StartTransactionCommand();
+
+	oldcontext = CurrentMemoryContext;
+	oldowner = CurrentResourceOwner;
+
+	BeginInternalSubTransaction(NULL);
+	MemoryContextSwitchTo(oldcontext);
+
+	PG_TRY();
+	{
+		have_sequences = range_seq_maintain_xact(changes, nchanges) ||
+			nchanges > 0;
+
+		ReleaseCurrentSubTransaction();
+		MemoryContextSwitchTo(oldcontext);
+		CurrentResourceOwner = oldowner;
+	}
+	PG_CATCH();
+	{
+		ErrorData  *edata;
+
+		MemoryContextSwitchTo(oldcontext);
+		edata = CopyErrorData();
+		FlushErrorState();
+
+		RollbackAndReleaseCurrentSubTransaction();
+		MemoryContextSwitchTo(oldcontext);
+		CurrentResourceOwner = oldowner;
+
+		ereport(WARNING,
+				(errmsg("could not maintain range-allocated sequences: %s",
+						edata->message)));
+		FreeErrorData(edata);
+	}
+	PG_END_TRY();
+
+	CommitTransactionCommand();
+
+	return have_sequences;
+}
+
+/*
+ * A peer claimed a chunk of a sequence: accept the claim unless it overlaps a
+ * chunk we know to be claimed or allocated by another node, and answer with
+ * our vote. If the claimant precedes us, a pending claim of ours for the same
+ * values is withdrawn by the perdb worker.
+ *
+ * Runs in the apply worker, inside the transaction that inserted the claimed
+ * chunk.
+ */
+static void
+range_seq_process_claim(const pgactiveNodeId * const claimant,
+						const char *nspname, const char *relname,
+						int64 chunk_start, int64 chunk_end)
+{
+	pgactiveNodeId myid;
+	Oid			argtypes[7] = {TEXTOID, TEXTOID, INT8OID, INT8OID,
+	TEXTOID, OIDOID, OIDOID};
+	Datum		values[7];
+	StringInfoData s;
+	bool		accept = true;
+	bool		withdraw = false;
+	bool		start_xact = !IsTransactionState();
+	uint64		i;
+	int			ret;
+
+	pgactive_make_my_nodeid(&myid);
+
+	values[0] = CStringGetTextDatum(nspname);
+	values[1] = CStringGetTextDatum(relname);
+	values[2] = Int64GetDatum(chunk_start);
+	values[3] = Int64GetDatum(chunk_end);
+	values[4] = CStringGetTextDatum(psprintf(UINT64_FORMAT, claimant->sysid));
+	values[5] = ObjectIdGetDatum(claimant->timeline);
+	values[6] = ObjectIdGetDatum(claimant->dboid);
+
+	if (start_xact)
+		StartTransactionCommand();
+	SPI_connect();
+	PushActiveSnapshot(GetTransactionSnapshot());
+
+	ret = SPI_execute_with_args("SELECT owner_sysid, owner_timeline, owner_dboid, state "
+								"FROM pgactive.pgactive_sequence_chunks "
+								"WHERE seqschema = $1 AND seqname = $2 "
+								"AND chunk_start <= $4 AND chunk_end >= $3 "
+								"AND state <> 'r' "
+								"AND (owner_sysid, owner_timeline, owner_dboid) <> ($5, $6, $7)",
+								7, argtypes, values, NULL, true, 0);
+	if (ret != SPI_OK_SELECT)
+		elog(ERROR, "SPI_execute_with_args failed: %d", ret);
+
+	for (i = 0; i < SPI_processed; i++)
+	{
+		HeapTuple	tup = SPI_tuptable->vals[i];
+		TupleDesc	tupdesc = SPI_tuptable->tupdesc;
+		pgactiveNodeId owner;
+		bool		isnull;
+
+		if (sscanf(SPI_getvalue(tup, tupdesc, 1), UINT64_FORMAT, &owner.sysid) != 1)
+			elog(ERROR, "could not parse sysid of sequence chunk owner");
+		owner.timeline = DatumGetObjectId(SPI_getbinval(tup, tupdesc, 2, &isnull));
+		owner.dboid = DatumGetObjectId(SPI_getbinval(tup, tupdesc, 3, &isnull));
+
+		/*
+		 * A pending claim of a node the claimant precedes will be rejected
+		 * by the claimant. If it's ours, withdraw it.
+		 */
+		if (DatumGetChar(SPI_getbinval(tup, tupdesc, 4, &isnull)) == 'p' &&
+			range_seq_node_precedes(claimant, &owner))
+		{
+			if (pgactive_nodeid_eq(&owner, &myid))
+				withdraw = true;
+			continue;
+		}
+
+		accept = false;
+		break;
+	}
+
+	PopActiveSnapshot();
+	SPI_finish();
+	if (start_xact)
+		CommitTransactionCommand();
+
+	elog(DEBUG1, "%s claim of values " INT64_FORMAT " to " INT64_FORMAT " of sequence %s.%s by node " pgactive_NODEID_FORMAT_WITHNAME,
+		 accept ? "accepting" : "rejecting", chunk_start, chunk_end,
+		 nspname, relname, pgactive_NODEID_FORMAT_WITHNAME_ARGS(*claimant));
+
+	initStringInfo(&s);
+	pgactive_prepare_message(&s, pgactive_MESSAGE_SEQ_VOTE);
+	pgactive_send_nodeid(&s, claimant, false);
+	pq_sendstring(&s, nspname);
+	pq_sendstring(&s, relname);
+	pq_sendint64(&s, chunk_start);
+	pq_sendbyte(&s, accept);
+	pgactive_send_message(&s, false);
+	pfree(s.data);
+
+	if (accept && withdraw)
+	{
+		RangeSeqChange change;
+
+		memset(&change, 0, sizeof(change));
+		change.dboid = MyDatabaseId;
+		namestrcpy(&change.nspname, nspname);
+		namestrcpy(&change.relname, relname);
+		change.chunk_start = chunk_start;
+		change.chunk_end = chunk_end;
+		change.action = RANGE_SEQ_WITHDRAWN;
+		pgactive_nodeid_cpy(&change.voter, claimant);
+		range_seq_queue_change(&change);
+	}
+}
+
+/*
+ * A peer voted on a claim. Count it if it's one of ours; the chunk is
+ * allocated once all peers accepted it, and given up once one rejected it.
+ * Votes are remembered by node, so a vote received again is counted once.
+ *
+ * Runs in the apply worker, the vote is written by the perdb worker.
+ */
+static void
+range_seq_process_vote(const pgactiveNodeId * const voter,
+					   const pgactiveNodeId * const claimant,
+					   const char *nspname, const char *relname,
+					   int64 chunk_start, bool accept)
+{
+	pgactiveNodeId myid;
+	RangeSeqChange change;
+
+	pgactive_make_my_nodeid(&myid);
+	if (!pgactive_nodeid_eq(claimant, &myid))
+		return;
+
+	memset(&change, 0, sizeof(change));
+	change.dboid = MyDatabaseId;
+	namestrcpy(&change.nspname, nspname);
+	namestrcpy(&change.relname, relname);
+	change.chunk_start = chunk_start;
+	change.action = accept ? RANGE_SEQ_ACCEPTED : RANGE_SEQ_REJECTED;
+	pgactive_nodeid_cpy(&change.voter, voter);
+	range_seq_queue_change(&change);
+
+	elog(DEBUG1, "claim of values from " INT64_FORMAT " of sequence %s.%s %s by node " pgactive_NODEID_FORMAT_WITHNAME,
+		 chunk_start, nspname, relname, accept ? "accepted" : "rejected",
+		 pgactive_NODEID_FORMAT_WITHNAME_ARGS(*voter));
+}
+
+/*
+ * Handle a WAL message destined for range-allocated sequences.
+ */
+bool
+pgactive_range_seq_process_message(int msg_type, bool transactional,
+								   XLogRecPtr lsn,
+								   const pgactiveNodeId * const origin,
+								   StringInfo message)
+{
+	const char *nspname;
+	const char *relname;
+	int64		chunk_start;
+
+	if (msg_type == pgactive_MESSAGE_SEQ_CLAIM)
+	{
+		int64		chunk_end;
+
+		nspname = pq_getmsgstring(message);
+		relname = pq_getmsgstring(message);
+		chunk_start = pq_getmsgint64(message);
+		chunk_end = pq_getmsgint64(message);
+
+		range_seq_process_claim(origin, nspname, relname, chunk_start,
+								chunk_end);
+		return true;
+	}
+	else if (msg_type == pgactive_MESSAGE_SEQ_VOTE)
+	{
+		pgactiveNodeId claimant;
+		bool		accept;
+
+		pgactive_getmsg_nodeid(message, &claimant, false);
+		nspname = pq_getmsgstring(message);
+		relname = pq_getmsgstring(message);
+		chunk_start = pq_getmsgint64(message);
+		accept = pq_getmsgbyte(message);
+
+		range_seq_process_vote(origin, &claimant, nspname, relname,
+							   chunk_start, accept);
+		return true;
+	}
+
+	return false;
+}
@@ -70,6 +70,8 @@ pgactive_shmem_init(void)
 	pgactive_locks_shmem_init();
 
 	pgactive_nid_shmem_init();
+
+	pgactive_seq_shmem_init();
 }
 
 /*
@@ -401,7 +403,8 @@ pgactive_worker_unregister(void)
 		return;
 
 	Assert(pgactive_worker_type == pgactive_WORKER_PERDB ||
-		   pgactive_worker_type == pgactive_WORKER_APPLY);
+		   pgactive_worker_type == pgactive_WORKER_APPLY ||
+		   pgactive_worker_type == pgactive_WORKER_APPLY_PARALLEL);
 	Assert(!LWLockHeldByMe(pgactiveWorkerCtl->lock));
 
 	LWLockAcquire(pgactiveWorkerCtl->lock, LW_EXCLUSIVE);
@@ -82,3 +82,14 @@ SELECT pgactive.pgactive_wait_for_slots_confirmed_flush_lsn(NULL,NULL);
 \c regression
 
 SELECT count(id) FROM seqvalues;
+
+-- Values handed out in bulk must be distinct, increasing and carry this
+-- node's sequence ID.
+SELECT count(*) AS nvalues, count(DISTINCT val) AS ndistinct,
+       bool_and(prev IS NULL OR val > prev) AS increasing,
+       min((val >> 14) & 1023) AS min_node_seq_id,
+       max((val >> 14) & 1023) AS max_node_seq_id
+FROM (SELECT val, lag(val) OVER () AS prev
+      FROM pgactive.pgactive_snowflake_id_nextval('dummy_seq'::regclass, 40000) AS val) s;
+
+SELECT count(*) FROM pgactive.pgactive_snowflake_id_nextval('dummy_seq'::regclass, 0);
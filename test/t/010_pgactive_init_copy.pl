@@ -51,25 +51,32 @@ is($node_a->safe_psql($pgactive_test_dbname, 'SELECT pgactive.pgactive_is_active
 
 # The postgresql.conf copied by pgactive_init_copy's pg_basebackup invocation will
 # use the same port as node_a . We can't have that, so template a new config file.
-open(my $conf_a, "<", $node_a->data_dir . '/postgresql.conf')
-	or die ("can't open node_a conf file for reading: $!");
+sub write_node_conf
+{
+	my ($node, $file) = @_;
 
-open(my $conf_b, ">", "$tempdir/postgresql.conf.b")
-	or die ("can't open node_b conf file for writing: $!");
+	open(my $conf_a, "<", $node_a->data_dir . '/postgresql.conf')
+		or die ("can't open node_a conf file for reading: $!");
 
-while (<$conf_a>)
-{
-	if ($_ =~ "^port")
-	{
-		print $conf_b "port = " . $node_b->port . "\n";
-	}
-	else
+	open(my $conf_new, ">", $file)
+		or die ("can't open " . $node->name . " conf file for writing: $!");
+
+	while (<$conf_a>)
 	{
-		print $conf_b $_;
+		if ($_ =~ "^port")
+		{
+			print $conf_new "port = " . $node->port . "\n";
+		}
+		else
+		{
+			print $conf_new $_;
+		}
 	}
+	close($conf_a) or die ("failed to close old postgresql.conf: $!");
+	close($conf_new) or die ("failed to close new postgresql.conf: $!");
 }
-close($conf_a) or die ("failed to close old postgresql.conf: $!");
-close($conf_b) or die ("failed to close new postgresql.conf: $!");
+
+write_node_conf($node_b, "$tempdir/postgresql.conf.b");
 
 
 command_ok(
@@ -142,4 +149,86 @@ my $seqid_b = $node_b->safe_psql($pgactive_test_dbname, 'SELECT node_seq_id FROM
 is($seqid_a, 1, 'first node got global sequence ID 1');
 is($seqid_b, 2, 'second node got global sequence ID 2');
 
+# --rewind checks that pg_rewind can resynchronize the data directory before
+# creating anything on the remote node. A base backup taken from a running
+# node can't be rewound, as it wasn't shut down cleanly.
+$node_a->backup('rewind_backup');
+my $node_c = PostgreSQL::Test::Cluster->new('node-c');
+$node_c->init_from_backup($node_a, 'rewind_backup');
+
+my $remote_state_query = q[
+    SELECT (SELECT count(*) FROM pg_replication_slots) || ':' ||
+           (SELECT count(*) FROM pgactive.pgactive_nodes)];
+my $remote_state = $node_a->safe_psql($pgactive_test_dbname, $remote_state_query);
+
+command_fails_like(
+    [
+        'pgactive_init_copy', '-v',
+        '-D', $node_c->data_dir,
+        "-n", 'node-c',
+        '-d', $node_a->connstr($pgactive_test_dbname),
+        '--local-dbname', $pgactive_test_dbname,
+        '--local-port', $node_c->port,
+        '--log-file', $node_c->logfile . "_initcopy",
+        '--rewind'
+    ],
+    qr/nothing was changed on the remote node/,
+    'pgactive_init_copy --rewind fails when pg_rewind can\'t run');
+is($node_a->safe_psql($pgactive_test_dbname, $remote_state_query), $remote_state,
+   'failed pgactive_init_copy --rewind left no slot or node entry on the remote node');
+
+# A former clone of node_a that was promoted and written to is brought back
+# in sync with pg_rewind and joins. pg_rewind needs wal_log_hints, which the
+# clone gets from node_a.
+$node_a->append_conf('postgresql.conf', 'wal_log_hints = on');
+$node_a->restart;
+$node_a->safe_psql($pgactive_test_dbname,
+	qq[SELECT pgactive.pgactive_wait_for_node_ready($PostgreSQL::Test::Utils::timeout_default)]);
+
+$node_a->backup('rewind_clone');
+my $node_d = PostgreSQL::Test::Cluster->new('node-d');
+$node_d->init_from_backup($node_a, 'rewind_clone', has_streaming => 1);
+# the clone must not run pgactive as node_a while it diverges
+$node_d->append_conf('postgresql.conf', "shared_preload_libraries = ''");
+$node_d->start;
+$node_a->wait_for_catchup($node_d);
+$node_d->promote;
+$node_d->safe_psql('postgres', 'CREATE TABLE diverged AS SELECT 1 AS i;');
+$node_d->stop;
+
+$node_a->safe_psql($pgactive_test_dbname, "INSERT INTO reptest (id, dummy) VALUES (2, 'after clone')");
+
+write_node_conf($node_d, "$tempdir/postgresql.conf.d");
+
+command_ok(
+    [
+        'pgactive_init_copy', '-v',
+        '-D', $node_d->data_dir,
+        "-n", 'node-d',
+        '-d', $node_a->connstr($pgactive_test_dbname),
+        '--local-dbname', $pgactive_test_dbname,
+        '--local-port', $node_d->port,
+        '--postgresql-conf', "$tempdir/postgresql.conf.d",
+        '--log-file', $node_d->logfile . "_initcopy",
+        '--rewind'
+    ],
+	'pgactive_init_copy --rewind succeeds on a diverged former clone');
+
+$node_d->_update_pid(1);
+$node_d->safe_psql($pgactive_test_dbname,
+	qq[SELECT pgactive.pgactive_wait_for_node_ready($PostgreSQL::Test::Utils::timeout_default)]);
+
+is($node_d->safe_psql($pgactive_test_dbname,
+	"SELECT pgactive.pgactive_node_status_from_char(node_status) FROM pgactive.pgactive_nodes WHERE node_name = 'node-d'"),
+   'pgactive_NODE_STATUS_READY', 'rewound node joined');
+is($node_d->safe_psql('postgres', "SELECT to_regclass('public.diverged') IS NULL"), 't',
+   'changes made after the clone diverged were rewound');
+is($node_d->safe_psql($pgactive_test_dbname, 'SELECT id, dummy FROM reptest ORDER BY id;'),
+   "1|42\n2|after clone", 'rewound node has the upstream\'s rows');
+
+$node_a->safe_psql($pgactive_test_dbname, "INSERT INTO reptest (id, dummy) VALUES (3, 'after join')");
+$node_d->poll_query_until($pgactive_test_dbname,
+	q[SELECT EXISTS (SELECT 1 FROM reptest WHERE id = 3);])
+	or die "Timed out waiting for reptest insert to replicate to node_d";
+
 done_testing();
@@ -134,7 +134,9 @@ pgactive.pgactive_queued_drops|3|dropped_objects|f|pgactive.dropped_object[]|t
 pgactive.pgactive_replication_set_config|1|set_name|f|name|t
 pgactive.pgactive_replication_set_config|2|replicate_inserts|f|boolean|t
 pgactive.pgactive_replication_set_config|3|replicate_updates|f|boolean|t
-pgactive.pgactive_replication_set_config|4|replicate_deletes|f|boolean|t';
+pgactive.pgactive_replication_set_config|4|replicate_deletes|f|boolean|t
+pgactive.pgactive_replication_set_config|5|column_list|f|name[]|f
+pgactive.pgactive_replication_set_config|6|row_filter|f|text|f';
 
 my $query = qq[SELECT attrelid::regclass::text, attnum, attname, attisdropped, atttypid::regtype, attnotnull
 FROM pg_attribute WHERE attrelid = ANY (ARRAY[
@@ -182,4 +184,7 @@ $node_a->safe_psql($pgactive_test_dbname, q{ALTER EXTENSION pgactive UPDATE TO '
 # Move to new version 2.1.9.
 $node_a->safe_psql($pgactive_test_dbname, q{ALTER EXTENSION pgactive UPDATE TO '2.1.9';});
 
+# Move to new version 2.1.10.
+$node_a->safe_psql($pgactive_test_dbname, q{ALTER EXTENSION pgactive UPDATE TO '2.1.10';});
+
 done_testing();
@@ -0,0 +1,104 @@
+#!/usr/bin/env perl
+#
+# Test pgactive.apply_group_max_xacts: remote transactions received together
+# are committed together on the downstream, up to the configured number of
+# transactions and time between their remote commits, and a conflict ends
+# the group without losing the transactions around it.
+#
+use strict;
+use warnings;
+use lib 'test/t/';
+use Cwd;
+use Config;
+use PostgreSQL::Test::Cluster;
+use PostgreSQL::Test::Utils;
+use Test::More;
+use utils::nodemanagement;
+
+my $nodes = make_pgactive_group(2, 'node_');
+my ($node_0, $node_1) = @$nodes;
+
+$node_1->safe_psql($pgactive_test_dbname,
+    q[ALTER SYSTEM SET pgactive.log_conflicts_to_table = on;]);
+$node_1->safe_psql($pgactive_test_dbname, q[SELECT pg_reload_conf();]);
+
+sub set_group_settings
+{
+    my ($max_xacts, $max_interval) = @_;
+
+    $node_1->safe_psql($pgactive_test_dbname, qq[
+        ALTER SYSTEM SET pgactive.apply_group_max_xacts = $max_xacts;
+        ALTER SYSTEM SET pgactive.apply_group_max_interval = $max_interval;]);
+    $node_1->safe_psql($pgactive_test_dbname, q[SELECT pg_reload_conf();]);
+    $node_1->poll_query_until($pgactive_test_dbname,
+        qq[SELECT current_setting('pgactive.apply_group_max_xacts') = '$max_xacts';])
+        or die "timed out waiting for the new settings";
+}
+
+# Run $nxacts single-row transactions on node_0 while node_1's apply is
+# paused, so that node_1 receives them together, and return the number of
+# local transactions node_1 applied them in.
+sub apply_xacts
+{
+    my ($table, $nxacts, $sleep) = @_;
+
+    exec_ddl($node_0, qq[CREATE TABLE public.$table(id integer PRIMARY KEY, data text);]);
+    wait_for_apply($node_0, $node_1);
+
+    $node_1->safe_psql($pgactive_test_dbname, q[SELECT pgactive.pgactive_apply_pause();]);
+    $node_0->safe_psql($pgactive_test_dbname,
+        join('', map { "INSERT INTO $table VALUES ($_, 'row $_');\n" .
+                       ($sleep ? "SELECT pg_sleep($sleep);\n" : '') } (1 .. $nxacts)));
+    $node_1->safe_psql($pgactive_test_dbname, q[SELECT pgactive.pgactive_apply_resume();]);
+    wait_for_apply($node_0, $node_1);
+
+    is($node_1->safe_psql($pgactive_test_dbname,
+        qq[SELECT count(*) || ':' || sum(id) FROM $table;]),
+       $node_0->safe_psql($pgactive_test_dbname,
+        qq[SELECT count(*) || ':' || sum(id) FROM $table;]),
+       "all transactions of $table applied");
+
+    return $node_1->safe_psql($pgactive_test_dbname,
+        qq[SELECT count(DISTINCT xmin::text) FROM $table;]);
+}
+
+is(apply_xacts('group_off', 200, 0), '200',
+   "each remote transaction committed on its own by default");
+
+set_group_settings(50, 60000);
+my $groups = apply_xacts('group_on', 200, 0);
+cmp_ok($groups, '>=', 4, "no more than apply_group_max_xacts transactions per group");
+cmp_ok($groups, '<', 100, "remote transactions received together committed together");
+
+# Remote commits further apart than apply_group_max_interval aren't grouped.
+set_group_settings(50, 10);
+is(apply_xacts('group_interval', 20, 0.05), '20',
+   "remote transactions further apart than apply_group_max_interval committed on their own");
+
+# A transaction with a conflict ends its group; the transactions before and
+# after it are still applied.
+set_group_settings(50, 60000);
+exec_ddl($node_0, q[CREATE TABLE public.group_conflict(id integer PRIMARY KEY, origin text);]);
+wait_for_apply($node_0, $node_1);
+{
+    local $ENV{PGOPTIONS} = '-c pgactive.do_not_replicate=on';
+    $node_1->safe_psql($pgactive_test_dbname,
+        q[INSERT INTO group_conflict VALUES (50, 'local');]);
+}
+$node_1->safe_psql($pgactive_test_dbname, q[SELECT pgactive.pgactive_apply_pause();]);
+$node_0->safe_psql($pgactive_test_dbname,
+    join('', map { "INSERT INTO group_conflict VALUES ($_, 'remote');\n" } (1 .. 100)));
+$node_1->safe_psql($pgactive_test_dbname, q[SELECT pgactive.pgactive_apply_resume();]);
+wait_for_apply($node_0, $node_1);
+
+is($node_1->safe_psql($pgactive_test_dbname,
+    q[SELECT conflict_type FROM pgactive.pgactive_conflict_history WHERE object_name = 'group_conflict';]),
+   'insert_insert', "conflict inside a group detected");
+is($node_1->safe_psql($pgactive_test_dbname,
+    q[SELECT count(*) FROM group_conflict;]),
+   '100', "transactions around the conflict applied");
+cmp_ok($node_1->safe_psql($pgactive_test_dbname,
+    q[SELECT count(DISTINCT xmin::text) FROM group_conflict WHERE id > 50;]), '<', 50,
+    "grouping resumed after the conflict");
+
+done_testing();
@@ -0,0 +1,114 @@
+#!/usr/bin/env perl
+#
+# Test the per-relation replication statistics: rows sent and applied by
+# action, conflicts, bytes and, with pgactive.track_apply_timing, apply
+# times, counted per relation.
+#
+use strict;
+use warnings;
+use lib 'test/t/';
+use Cwd;
+use Config;
+use PostgreSQL::Test::Cluster;
+use PostgreSQL::Test::Utils;
+use Test::More;
+use utils::nodemanagement;
+
+my $nodes = make_pgactive_group(2, 'node_');
+my ($node_0, $node_1) = @$nodes;
+
+$node_1->safe_psql($pgactive_test_dbname,
+    q[ALTER SYSTEM SET pgactive.track_apply_timing = on;]);
+$node_1->safe_psql($pgactive_test_dbname, q[SELECT pg_reload_conf();]);
+
+exec_ddl($node_0, q[CREATE TABLE public.rs_a(id integer PRIMARY KEY, data text);]);
+exec_ddl($node_0, q[CREATE TABLE public.rs_b(id integer PRIMARY KEY, data text);]);
+wait_for_apply($node_0, $node_1);
+
+# a row only node_1 has, which the insert of id 10 conflicts with
+{
+    local $ENV{PGOPTIONS} = '-c pgactive.do_not_replicate=on';
+    $node_1->safe_psql($pgactive_test_dbname, q[INSERT INTO rs_a VALUES (10, 'local');]);
+}
+
+$node_0->safe_psql($pgactive_test_dbname, q[
+    INSERT INTO rs_a SELECT g, 'row ' || g FROM generate_series(1, 10) g;
+    UPDATE rs_a SET data = 'updated' WHERE id <= 5;
+    DELETE FROM rs_a WHERE id > 7;
+    INSERT INTO rs_b SELECT g, 'row ' || g FROM generate_series(1, 4) g;]);
+wait_for_apply($node_0, $node_1);
+
+my $stats_query = q[
+    SELECT relation, n_insert, n_update, n_delete, n_insert_insert_conflict,
+           n_update_update_conflict, n_update_delete_conflict, n_delete_delete_conflict
+    FROM pgactive.pgactive_relation_stats
+    WHERE direction = '%s' AND relation IN ('rs_a'::regclass, 'rs_b'::regclass)
+    ORDER BY relation::text;];
+
+is($node_0->safe_psql($pgactive_test_dbname, sprintf($stats_query, 'sent')),
+   "rs_a|10|5|3|0|0|0|0\nrs_b|4|0|0|0|0|0|0",
+   "rows sent counted per relation and action");
+is($node_1->safe_psql($pgactive_test_dbname, sprintf($stats_query, 'applied')),
+   "rs_a|10|5|3|1|0|0|0\nrs_b|4|0|0|0|0|0|0",
+   "rows applied and conflicts counted per relation and action");
+is($node_0->safe_psql($pgactive_test_dbname, sprintf($stats_query, 'applied')),
+   '', "nothing applied on the upstream");
+
+is($node_1->safe_psql($pgactive_test_dbname, q[
+    SELECT bytes > 0 AND lookup_time > 0 AND write_time > 0
+    FROM pgactive.pgactive_relation_stats
+    WHERE direction = 'applied' AND relation = 'rs_a'::regclass;]),
+   't', "bytes and apply times counted with track_apply_timing");
+is($node_0->safe_psql($pgactive_test_dbname, q[
+    SELECT bytes > 0 AND lookup_time = 0 AND write_time = 0
+    FROM pgactive.pgactive_relation_stats
+    WHERE direction = 'sent' AND relation = 'rs_a'::regclass;]),
+   't', "bytes sent counted, without apply times");
+
+# Every applied transaction is counted once in each apply histogram, and
+# transactions of three rows in the xact_rows bucket for three rows.
+my $hist_query = q[
+    SELECT h.histogram, sum(h.count),
+           sum(h.count) FILTER (WHERE h.histogram = 'xact_rows'
+                                AND 3 >= h.bucket_lower
+                                AND (h.bucket_upper IS NULL OR 3 < h.bucket_upper))
+    FROM pgactive.pgactive_stats_histograms h
+    GROUP BY h.histogram ORDER BY h.histogram;];
+my $commits_query = q[SELECT sum(nr_commit) FROM pgactive.pgactive_get_stats();];
+
+my %hist_before = map { my @f = split /\|/; $f[0] => [@f] }
+    split /\n/, $node_1->safe_psql($pgactive_test_dbname, $hist_query);
+my $commits_before = $node_1->safe_psql($pgactive_test_dbname, $commits_query);
+
+$node_0->safe_psql($pgactive_test_dbname, join('', map {
+    "BEGIN; INSERT INTO rs_b VALUES ($_, 'a'); UPDATE rs_b SET data = 'b' WHERE id = $_; DELETE FROM rs_b WHERE id = $_; COMMIT;\n"
+} (101 .. 150)));
+wait_for_apply($node_0, $node_1);
+
+my $commits = $node_1->safe_psql($pgactive_test_dbname, $commits_query) - $commits_before;
+cmp_ok($commits, '>=', 50, "applied transactions counted");
+
+my %hist_after = map { my @f = split /\|/; $f[0] => [@f] }
+    split /\n/, $node_1->safe_psql($pgactive_test_dbname, $hist_query);
+foreach my $h (qw(apply_duration_us apply_lag_us xact_bytes xact_rows))
+{
+    my $before = $hist_before{$h} ? $hist_before{$h}[1] : 0;
+    ok($hist_after{$h} && $hist_after{$h}[1] - $before == $commits,
+       "histogram $h counts every applied transaction once");
+}
+my $three_before = $hist_before{xact_rows} ? ($hist_before{xact_rows}[2] || 0) : 0;
+cmp_ok(($hist_after{xact_rows}[2] || 0) - $three_before, '>=', 50,
+       "transactions of three rows counted in their xact_rows bucket");
+
+# With pgactive.max_relation_stats = 0 no relation is counted.
+$node_1->append_conf('postgresql.conf', 'pgactive.max_relation_stats = 0');
+$node_1->restart;
+$node_1->safe_psql($pgactive_test_dbname,
+    qq[SELECT pgactive.pgactive_wait_for_node_ready($PostgreSQL::Test::Utils::timeout_default)]);
+$node_0->safe_psql($pgactive_test_dbname, q[INSERT INTO rs_b VALUES (5, 'row 5');]);
+wait_for_apply($node_0, $node_1);
+is($node_1->safe_psql($pgactive_test_dbname,
+    q[SELECT count(*) FROM pgactive.pgactive_relation_stats;]),
+   '0', "no relations counted with max_relation_stats = 0");
+
+done_testing();
@@ -0,0 +1,112 @@
+#!/usr/bin/env perl
+#
+# Test capturing the replication stream an apply worker receives with
+# pgactive.apply_capture_directory, and replaying the capture with
+# pgactive_apply_replay(), as a dry run and for real.
+#
+use strict;
+use warnings;
+use lib 'test/t/';
+use Cwd;
+use Config;
+use Time::HiRes qw(usleep);
+use PostgreSQL::Test::Cluster;
+use PostgreSQL::Test::Utils;
+use Test::More;
+use utils::nodemanagement;
+
+my $nodes = make_pgactive_group(2, 'node_');
+my ($node_0, $node_1) = @$nodes;
+my $capture_dir = PostgreSQL::Test::Utils::tempdir;
+
+$node_0->safe_psql($pgactive_test_dbname,
+    q[ALTER SYSTEM SET pgactive.log_conflicts_to_table = on;]);
+$node_0->safe_psql($pgactive_test_dbname, q[SELECT pg_reload_conf();]);
+
+exec_ddl($node_0, q[CREATE TABLE public.capture_test(id integer PRIMARY KEY, data text);]);
+wait_for_apply($node_0, $node_1);
+
+my $rows_query = q[SELECT string_agg(id || ':' || data, ',' ORDER BY id) FROM capture_test;];
+
+# Capturing doesn't start in the middle of the stream on a reload, only when
+# the apply worker connects.
+my $log_offset = get_log_size($node_1);
+$node_1->safe_psql($pgactive_test_dbname,
+    qq[ALTER SYSTEM SET pgactive.apply_capture_directory = '$capture_dir';]);
+$node_1->safe_psql($pgactive_test_dbname, q[SELECT pg_reload_conf();]);
+ok(find_in_log($node_1, qr/starts when the apply worker reconnects/, $log_offset),
+   "capturing waits for the apply worker to reconnect");
+
+$node_0->safe_psql($pgactive_test_dbname,
+    q[INSERT INTO capture_test VALUES (0, 'before capture');]);
+wait_for_apply($node_0, $node_1);
+is(scalar(my @files = glob("$capture_dir/pgactive_capture_*.bin")), 0,
+   "no capture started on reload");
+
+$node_1->safe_psql($pgactive_test_dbname,
+    q[SELECT pgactive.pgactive_terminate_workers(node_sysid, node_timeline, node_dboid, 'apply')
+      FROM pgactive.pgactive_nodes;]);
+
+my @captures;
+foreach my $i (1 .. 10 * $PostgreSQL::Test::Utils::timeout_default)
+{
+    @captures = glob("$capture_dir/pgactive_capture_*.bin");
+    last if @captures;
+    usleep(100_000);
+}
+is(scalar(@captures), 1, "capture started when the apply worker connected");
+my $capture = $captures[0];
+
+$node_0->safe_psql($pgactive_test_dbname, q[
+    INSERT INTO capture_test SELECT g, 'row ' || g FROM generate_series(1, 100) g;
+    UPDATE capture_test SET data = 'updated' WHERE id BETWEEN 1 AND 10;
+    DELETE FROM capture_test WHERE id > 90;]);
+wait_for_apply($node_0, $node_1);
+
+# stopping the capture writes out what's buffered
+$log_offset = get_log_size($node_1);
+$node_1->safe_psql($pgactive_test_dbname,
+    q[ALTER SYSTEM RESET pgactive.apply_capture_directory;]);
+$node_1->safe_psql($pgactive_test_dbname, q[SELECT pg_reload_conf();]);
+ok(find_in_log($node_1, qr/stopped capturing replication stream/, $log_offset),
+   "capture stopped on reload");
+
+my $rows_before = $node_1->safe_psql($pgactive_test_dbname, $rows_query);
+
+# A dry run applies the captured transactions and rolls them back.
+my ($xacts, $changes) = split(/\|/, $node_1->safe_psql($pgactive_test_dbname,
+    qq[SELECT transactions, changes FROM pgactive.pgactive_apply_replay('$capture', true);]));
+cmp_ok($xacts, '>=', 3, "dry run replayed the captured transactions");
+cmp_ok($changes, '>=', 120, "dry run replayed the captured changes");
+is($node_1->safe_psql($pgactive_test_dbname, $rows_query), $rows_before,
+   "dry run left the table alone");
+
+# Replaying the capture for real brings back the rows applied from it; row 0
+# was applied before the capture started.
+{
+    local $ENV{PGOPTIONS} = '-c pgactive.do_not_replicate=on';
+    $node_1->safe_psql($pgactive_test_dbname,
+        q[DELETE FROM capture_test WHERE id > 0;]);
+}
+my ($xacts_replayed, $changes_replayed) = split(/\|/, $node_1->safe_psql($pgactive_test_dbname,
+    qq[SELECT transactions, changes FROM pgactive.pgactive_apply_replay('$capture');]));
+is("$xacts_replayed|$changes_replayed", "$xacts|$changes",
+   "replay applied what the dry run did");
+is($node_1->safe_psql($pgactive_test_dbname, $rows_query),
+   $node_0->safe_psql($pgactive_test_dbname, $rows_query),
+   "replay restored the captured changes");
+
+# Replayed changes aren't sent on to the peers, where they would conflict
+# with the rows they came from.
+$node_0->safe_psql($pgactive_test_dbname,
+    q[INSERT INTO capture_test VALUES (1000, 'after replay');]);
+wait_for_apply($node_0, $node_1);
+wait_for_apply($node_1, $node_0);
+is($node_0->safe_psql($pgactive_test_dbname,
+    q[SELECT count(*) FROM pgactive.pgactive_conflict_history WHERE object_name = 'capture_test';]),
+   '0', "no conflicts from replayed changes on the upstream");
+is($node_1->safe_psql($pgactive_test_dbname, $rows_query),
+   $node_0->safe_psql($pgactive_test_dbname, $rows_query),
+   "nodes still agree after the replay");
+
+done_testing();
@@ -0,0 +1,66 @@
+#!/usr/bin/env perl
+#
+# Test pgactive_decode_benchmark(): decoding a known workload through the
+# output plugin counts its changes and columns, the slot isn't advanced, and
+# slots not named like pgactive slots can only be decoded by the benchmark.
+#
+use strict;
+use warnings;
+use lib 'test/t/';
+use Cwd;
+use Config;
+use PostgreSQL::Test::Cluster;
+use PostgreSQL::Test::Utils;
+use Test::More;
+use utils::nodemanagement;
+
+my $node = PostgreSQL::Test::Cluster->new('node_a');
+initandstart_pgactive_group($node);
+
+exec_ddl($node, q[CREATE TABLE public.bench_t(id integer PRIMARY KEY, data text);]);
+
+# Slots of the pgactive plugin not named like pgactive slots can be created.
+$node->safe_psql($pgactive_test_dbname,
+    q[SELECT pg_create_logical_replication_slot('bench', 'pgactive');]);
+
+# 100 inserts of two columns, 10 updates of two columns and 5 deletes sending
+# the key only: 115 changes of 225 column values.
+$node->safe_psql($pgactive_test_dbname, q[
+    INSERT INTO bench_t SELECT g, 'row ' || g FROM generate_series(1, 100) g;
+    UPDATE bench_t SET data = 'updated' WHERE id <= 10;
+    DELETE FROM bench_t WHERE id > 95;]);
+my $upto_lsn = $node->safe_psql($pgactive_test_dbname,
+    q[SELECT pg_current_wal_insert_lsn();]);
+
+my $bench_query = qq[
+    SELECT changes, bytes > 0, binary_columns + sendrecv_columns + text_columns,
+           binary_bytes + sendrecv_bytes + text_bytes > 0
+    FROM pgactive.pgactive_decode_benchmark('bench', '$upto_lsn', %d);];
+
+is($node->safe_psql($pgactive_test_dbname, sprintf($bench_query, 1)),
+   '115|t|225|t', "changes and columns of the workload counted");
+
+# The slot isn't advanced, so every loop decodes the same changes again.
+is($node->safe_psql($pgactive_test_dbname, sprintf($bench_query, 3)),
+   '345|t|675|t', "every loop decodes the workload again");
+
+is($node->safe_psql($pgactive_test_dbname, q[
+    SELECT count(*) FROM pgactive.pgactive_relation_stats
+    WHERE relation = 'bench_t'::regclass;]),
+   '0', "benchmark not counted in relation stats");
+
+# Such slots can't be decoded by anything but the benchmark, as there's no
+# peer to decode for.
+my ($ret, $stdout, $stderr) = $node->psql($pgactive_test_dbname,
+    q[SELECT count(*) FROM pg_logical_slot_peek_binary_changes('bench', NULL, NULL);]);
+like($stderr, qr/could not parse slot name: bench/,
+     "slot not named like a pgactive slot only usable by the benchmark");
+
+($ret, $stdout, $stderr) = $node->psql($pgactive_test_dbname,
+    q[SELECT * FROM pgactive.pgactive_decode_benchmark('bench', NULL, 0);]);
+like($stderr, qr/loops must be at least 1/, "loops checked");
+
+$node->safe_psql($pgactive_test_dbname, q[
+    SELECT pg_drop_replication_slot('bench');]);
+
+done_testing();
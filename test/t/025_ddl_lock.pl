@@ -10,6 +10,7 @@ use Config;
 use PostgreSQL::Test::Cluster;
 use PostgreSQL::Test::Utils;
 use IPC::Run qw(timeout);;
+use Time::HiRes qw(time);
 use Test::More;
 use utils::nodemanagement;
 
@@ -57,13 +58,84 @@ my ($stdout,$stderr);
 is($ret, 0, 'write succeds on lock holder node_0');
 is($stderr, '', 'no stderr after write on lock holder');
 print "attempting insert 1\n";
+my $start = time();
 ($ret,$stdout,$stderr) = $node_1->psql($pgactive_test_dbname, 'INSERT INTO write_me(x) VALUES (42)');
 is($ret, 3, 'write failed on peer node_1');
 like($stderr, qr/canceling statement due to global lock timeout/, 'write on peer failed with global lock timeout');
+cmp_ok(time() - $start, '>=', 1, 'write on peer waited for pgactive.ddl_lock_timeout');
+
+# A write on a peer without a timeout waits for the lock, and proceeds as
+# soon as the lock is released.
+$node_1->safe_psql($pgactive_test_dbname, q[ALTER SYSTEM SET pgactive.ddl_lock_timeout = 0;]);
+$node_1->safe_psql($pgactive_test_dbname, q[SELECT pg_reload_conf();]);
+my ($wait_stdin, $wait_stdout, $wait_stderr) = ('', '', '');
+$wait_stdin = q[
+INSERT INTO write_me(x) VALUES (43);
+SELECT 'inserted';
+];
+my $wait_psql = IPC::Run::start(
+    ['psql', '-qAtX', '-d', $node_1->connstr($pgactive_test_dbname), '-f', '-'],
+    '<', \$wait_stdin, '>', \$wait_stdout, '2>', \$wait_stderr, $timer);
+$wait_psql->pump while length $wait_stdin;
+ok($node_1->poll_query_until($pgactive_test_dbname, q[
+    SELECT EXISTS (SELECT 1 FROM pg_stat_activity
+                   WHERE query LIKE 'INSERT INTO write_me(x) VALUES (43)%'
+                   AND wait_event_type = 'Extension');]),
+   'write on peer waits for the global write lock');
+is($wait_stdout, '', 'write on peer did not proceed while the lock is held');
 
 print "done inserts, releasing ddl lock\n";
 release_ddl_lock($handle);
 
+$wait_psql->pump until $wait_stdout =~ /inserted/ || $wait_stderr ne '';
+$wait_psql->finish;
+is($wait_stderr, '', 'waiting write on peer succeeded once the lock was released');
+$node_1->safe_psql($pgactive_test_dbname, q[ALTER SYSTEM RESET pgactive.ddl_lock_timeout;]);
+$node_1->safe_psql($pgactive_test_dbname, q[SELECT pg_reload_conf();]);
+
+#--------------------------------------------
+# Write locks limited to some relations
+#--------------------------------------------
+#
+# An ALTER TABLE that takes the write lock only blocks writes to the relations
+# it alters on peers, including writes routed to an altered partition through
+# its partitioned table.
+#
+exec_ddl($node_0, q[CREATE TABLE public.parted(id integer primary key) PARTITION BY RANGE (id);]);
+exec_ddl($node_0, q[CREATE TABLE public.parted_1 PARTITION OF public.parted FOR VALUES FROM (0) TO (100);]);
+exec_ddl($node_0, q[CREATE TABLE public.parted_2 PARTITION OF public.parted FOR VALUES FROM (100) TO (200);]);
+wait_for_apply($node_0, $node_1);
+
+my ($alter_stdin, $alter_stdout, $alter_stderr) = ('', '', '');
+$alter_stdin = q[
+BEGIN;
+ALTER TABLE public.parted_1 ALTER COLUMN id SET STATISTICS 100;
+SELECT 'altered';
+];
+my $alter_psql = IPC::Run::start(
+    ['psql', '-qAtX', '-d', $node_0->connstr($pgactive_test_dbname), '-f', '-'],
+    '<', \$alter_stdin, '>', \$alter_stdout, '2>', \$alter_stderr, $timer);
+$alter_psql->pump until $alter_stdout =~ /altered/ || $alter_stderr ne '';
+is($alter_stderr, '', 'ALTER TABLE of a partition acquired the global write lock');
+
+($ret, $stdout, $stderr) = $node_1->psql($pgactive_test_dbname, 'INSERT INTO write_me(x) VALUES (44)');
+is($ret, 0, 'write to an unrelated table succeeds on peer');
+($ret, $stdout, $stderr) = $node_1->psql($pgactive_test_dbname, 'INSERT INTO parted_2 VALUES (150)');
+is($ret, 0, 'write to another partition succeeds on peer');
+($ret, $stdout, $stderr) = $node_1->psql($pgactive_test_dbname, 'INSERT INTO parted_1 VALUES (1)');
+like($stderr, qr/canceling statement due to global lock timeout/, 'write to the altered partition waits on peer');
+($ret, $stdout, $stderr) = $node_1->psql($pgactive_test_dbname, 'INSERT INTO parted VALUES (2)');
+like($stderr, qr/canceling statement due to global lock timeout/, 'insert through the partitioned table waits on peer');
+($ret, $stdout, $stderr) = $node_1->psql($pgactive_test_dbname, 'UPDATE parted SET id = id + 1 WHERE id = 150');
+like($stderr, qr/canceling statement due to global lock timeout/, 'update through the partitioned table waits on peer');
+
+$alter_stdin .= "COMMIT;\n\\q\n";
+$alter_psql->finish;
+wait_for_apply($node_0, $node_1);
+
+($ret, $stdout, $stderr) = $node_1->psql($pgactive_test_dbname, 'INSERT INTO parted VALUES (2)');
+is($ret, 0, 'insert through the partitioned table succeeds once the lock is released');
+
 #--------------------------------------------
 # DDL lock acquire stalls while node offline
 #--------------------------------------------
@@ -0,0 +1,86 @@
+#!/usr/bin/env perl
+#
+# Test the built-in conflict handlers: with
+# pgactive_conflict_handler_keep_local() the local row wins an insert/insert
+# conflict, with pgactive_conflict_handler_apply_remote() the remote row, both
+# whether the local or the remote row is the more recent one.
+#
+use strict;
+use warnings;
+use lib 'test/t/';
+use Cwd;
+use Config;
+use PostgreSQL::Test::Cluster;
+use PostgreSQL::Test::Utils;
+use Test::More;
+use utils::nodemanagement;
+
+my $nodes = make_pgactive_group(2, 'node_');
+my ($node_0, $node_1) = @$nodes;
+
+exec_ddl($node_0, q[CREATE TABLE public.ch_keep(id integer PRIMARY KEY, origin text);]);
+exec_ddl($node_0, q[CREATE TABLE public.ch_remote(id integer PRIMARY KEY, origin text);]);
+wait_for_apply($node_0, $node_1);
+
+# pgactive_create_conflict_handler() isn't available, so register the
+# handlers on node_1 only, directly in the catalog.
+{
+    local $ENV{PGOPTIONS} = '-c pgactive.do_not_replicate=on';
+    $node_1->safe_psql($pgactive_test_dbname, q[
+        INSERT INTO pgactive.pgactive_conflict_handlers (ch_name, ch_type, ch_reloid, ch_fun) VALUES
+        ('keep', 'insert_insert', 'public.ch_keep'::regclass,
+         'pgactive.pgactive_conflict_handler_keep_local(anyelement,anyelement,text,regclass,pgactive.pgactive_conflict_type)'),
+        ('remote', 'insert_insert', 'public.ch_remote'::regclass,
+         'pgactive.pgactive_conflict_handler_apply_remote(anyelement,anyelement,text,regclass,pgactive.pgactive_conflict_type)');]);
+}
+
+# make sure the apply worker loads the handlers afresh
+$node_1->safe_psql($pgactive_test_dbname,
+    "SELECT pgactive.pgactive_terminate_workers(node_sysid, node_timeline, node_dboid, 'apply')
+     FROM pgactive.pgactive_nodes;");
+$node_1->poll_query_until($pgactive_test_dbname,
+    q[SELECT count(*) = 1 FROM pgactive.pgactive_get_workers_info() WHERE worker_type = 'apply';])
+    or die "Timed out waiting for the apply worker to restart on node_1";
+
+sub insert_local
+{
+    my ($id) = @_;
+    local $ENV{PGOPTIONS} = '-c pgactive.do_not_replicate=on';
+    $node_1->safe_psql($pgactive_test_dbname, qq[
+        INSERT INTO ch_keep VALUES ($id, 'local');
+        INSERT INTO ch_remote VALUES ($id, 'local');]);
+}
+
+sub insert_remote
+{
+    my ($id) = @_;
+    $node_0->safe_psql($pgactive_test_dbname, qq[
+        INSERT INTO ch_keep VALUES ($id, 'remote');
+        INSERT INTO ch_remote VALUES ($id, 'remote');]);
+}
+
+# The remote row is the more recent one, which last-update-wins would keep.
+insert_local(1);
+insert_remote(1);
+wait_for_apply($node_0, $node_1);
+
+# The local row is the more recent one, which last-update-wins would keep.
+$node_1->safe_psql($pgactive_test_dbname, q[SELECT pgactive.pgactive_apply_pause();]);
+insert_remote(2);
+insert_local(2);
+$node_1->safe_psql($pgactive_test_dbname, q[SELECT pgactive.pgactive_apply_resume();]);
+wait_for_apply($node_0, $node_1);
+
+is($node_1->safe_psql($pgactive_test_dbname,
+    q[SELECT string_agg(id || ':' || origin, ',' ORDER BY id) FROM ch_keep;]),
+   '1:local,2:local', "keep_local handler keeps the local row");
+is($node_1->safe_psql($pgactive_test_dbname,
+    q[SELECT string_agg(id || ':' || origin, ',' ORDER BY id) FROM ch_remote;]),
+   '1:remote,2:remote', "apply_remote handler applies the remote row");
+
+# node_0 has no handlers and no conflicts
+is($node_0->safe_psql($pgactive_test_dbname,
+    q[SELECT string_agg(id || ':' || origin, ',' ORDER BY id) FROM ch_keep;]),
+   '1:remote,2:remote', "rows of the upstream unchanged");
+
+done_testing();
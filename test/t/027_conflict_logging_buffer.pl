@@ -0,0 +1,62 @@
+#!/usr/bin/env perl
+#
+# Test pgactive.conflict_logging_buffer_size: conflicts of a remote
+# transaction beyond the buffer size aren't logged to the conflict history
+# but counted as dropped, every conflict is either logged once or counted,
+# and the buffer starts empty again with the next transaction.
+#
+use strict;
+use warnings;
+use lib 'test/t/';
+use Cwd;
+use Config;
+use PostgreSQL::Test::Cluster;
+use PostgreSQL::Test::Utils;
+use Test::More;
+use utils::nodemanagement;
+
+my $nodes = make_pgactive_group(2, 'node_');
+my ($node_0, $node_1) = @$nodes;
+
+$node_1->append_conf('postgresql.conf', qq[
+pgactive.log_conflicts_to_table = on
+pgactive.conflict_logging_buffer_size = 5
+]);
+$node_1->restart;
+$node_1->safe_psql($pgactive_test_dbname,
+    qq[SELECT pgactive.pgactive_wait_for_node_ready($PostgreSQL::Test::Utils::timeout_default)]);
+
+exec_ddl($node_0, q[CREATE TABLE public.clb(id integer PRIMARY KEY, origin text);]);
+wait_for_apply($node_0, $node_1);
+
+# rows only node_1 has, which the inserts from node_0 conflict with
+{
+    local $ENV{PGOPTIONS} = '-c pgactive.do_not_replicate=on';
+    $node_1->safe_psql($pgactive_test_dbname,
+        q[INSERT INTO clb SELECT g, 'local' FROM generate_series(1, 23) g;]);
+}
+
+# 20 conflicts in one remote transaction overflow the buffer, the 3 of the
+# next one fit.
+$node_0->safe_psql($pgactive_test_dbname,
+    q[INSERT INTO clb SELECT g, 'remote' FROM generate_series(1, 20) g;]);
+$node_0->safe_psql($pgactive_test_dbname,
+    q[INSERT INTO clb SELECT g, 'remote' FROM generate_series(21, 23) g;]);
+wait_for_apply($node_0, $node_1);
+
+my $history_query = q[
+    SELECT count(*), count(DISTINCT remote_tuple->>'id'),
+           count(*) FILTER (WHERE (remote_tuple->>'id')::int > 20)
+    FROM pgactive.pgactive_conflict_history WHERE object_name = 'clb';];
+is($node_1->safe_psql($pgactive_test_dbname, $history_query),
+   '8|8|3', "buffer size conflicts of each transaction logged, none twice");
+is($node_1->safe_psql($pgactive_test_dbname,
+    q[SELECT sum(nr_conflict_log_dropped) FROM pgactive.pgactive_get_stats();]),
+   '15', "conflicts beyond the buffer size counted as dropped");
+
+# Conflicts are still resolved, logged or not.
+is($node_1->safe_psql($pgactive_test_dbname,
+    q[SELECT count(*) FROM clb WHERE origin = 'remote';]),
+   '23', "all conflicts resolved");
+
+done_testing();
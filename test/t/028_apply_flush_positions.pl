@@ -0,0 +1,63 @@
+#!/usr/bin/env perl
+#
+# Test the ring buffer of commits an apply worker keeps until they're flushed
+# locally: starting with room for two, it fills up and grows, wraps around
+# once flushed commits are dropped from its head, and keeps confirming
+# commits to the upstream.
+#
+use strict;
+use warnings;
+use lib 'test/t/';
+use Cwd;
+use Config;
+use PostgreSQL::Test::Cluster;
+use PostgreSQL::Test::Utils;
+use Test::More;
+use utils::nodemanagement;
+
+my $nodes = make_pgactive_group(2, 'node_');
+my ($node_0, $node_1) = @$nodes;
+
+$node_1->append_conf('postgresql.conf', 'pgactive.debug_flush_positions_initial_size = 2');
+$node_1->restart;
+$node_1->safe_psql($pgactive_test_dbname,
+    qq[SELECT pgactive.pgactive_wait_for_node_ready($PostgreSQL::Test::Utils::timeout_default)]);
+
+exec_ddl($node_0, q[CREATE TABLE public.fp(id integer PRIMARY KEY);]);
+wait_for_apply($node_0, $node_1);
+
+my $pending_query = q[
+    SELECT pending_flush_positions FROM pgactive.pgactive_get_workers_info()
+    WHERE worker_type = 'apply';];
+my $capacity_query = q[
+    SELECT flush_positions_capacity FROM pgactive.pgactive_get_workers_info()
+    WHERE worker_type = 'apply';];
+
+# one remote transaction per row, applied with asynchronous commit
+sub insert_rows
+{
+    my ($from, $to) = @_;
+    $node_0->safe_psql($pgactive_test_dbname,
+        join('', map { "INSERT INTO fp VALUES ($_);\n" } ($from .. $to)));
+    wait_for_apply($node_0, $node_1);
+    $node_1->poll_query_until($pgactive_test_dbname, $pending_query, '0')
+        or die "Timed out waiting for the applied commits to be confirmed";
+}
+
+insert_rows(1, 300);
+my $capacity = $node_1->safe_psql($pgactive_test_dbname, $capacity_query);
+cmp_ok($capacity, '>', 2, "full buffer grew");
+is($capacity & ($capacity - 1), 0, "buffer size stays a power of 2");
+
+# The buffer's head has moved on, so new commits wrap around its end.
+insert_rows(301, 600);
+insert_rows(601, 603);
+
+my $rows_query = q[SELECT count(*), sum(id) FROM fp;];
+is($node_1->safe_psql($pgactive_test_dbname, $rows_query),
+   $node_0->safe_psql($pgactive_test_dbname, $rows_query),
+   "all commits applied through a wrapped buffer");
+is($node_1->safe_psql($pgactive_test_dbname, $pending_query),
+   '0', "all applied commits confirmed to the upstream");
+
+done_testing();
@@ -0,0 +1,94 @@
+#!/usr/bin/env perl
+#
+# Test apply of rows whose columns are all sent in binary format, which the
+# apply worker forms into heap tuples straight from the message: by-value
+# and fixed-width columns, short, long, compressed and plain-storage varlena
+# values, and NULLs in any position. The rows, and how their values are
+# stored, must come out the same as on the upstream.
+#
+use strict;
+use warnings;
+use lib 'test/t/';
+use Cwd;
+use Config;
+use PostgreSQL::Test::Cluster;
+use PostgreSQL::Test::Utils;
+use Test::More;
+use utils::nodemanagement;
+
+my $nodes = make_pgactive_group(2, 'node_');
+my ($node_0, $node_1) = @$nodes;
+
+exec_ddl($node_0, q[
+    CREATE TABLE public.binary_test(
+        id integer PRIMARY KEY,
+        b boolean,
+        i2 smallint,
+        i8 bigint,
+        f8 float8,
+        ts timestamptz,
+        u uuid,
+        n name,
+        iv interval,
+        short_text text,
+        long_text text,
+        plain_text text,
+        num numeric,
+        j jsonb,
+        arr integer[],
+        by bytea);]);
+exec_ddl($node_0, q[ALTER TABLE public.binary_test ALTER COLUMN plain_text SET STORAGE PLAIN;]);
+wait_for_apply($node_0, $node_1);
+
+# Every fifth row has all of its nullable columns NULL, the others have one
+# NULL column that moves along the row.
+$node_0->safe_psql($pgactive_test_dbname, q[
+    INSERT INTO binary_test
+    SELECT g,
+           CASE WHEN g % 5 = 0 OR g % 15 = 1 THEN NULL ELSE g % 2 = 0 END,
+           CASE WHEN g % 5 = 0 OR g % 15 = 2 THEN NULL ELSE g END,
+           CASE WHEN g % 5 = 0 OR g % 15 = 3 THEN NULL ELSE g * 1000000000::bigint END,
+           CASE WHEN g % 5 = 0 OR g % 15 = 4 THEN NULL ELSE g / 7.0 END,
+           CASE WHEN g % 5 = 0 OR g % 15 = 6 THEN NULL ELSE '2020-01-01'::timestamptz + g * interval '1 hour' END,
+           CASE WHEN g % 5 = 0 OR g % 15 = 7 THEN NULL ELSE md5(g::text)::uuid END,
+           CASE WHEN g % 5 = 0 OR g % 15 = 8 THEN NULL ELSE 'name' || g END,
+           CASE WHEN g % 5 = 0 OR g % 15 = 9 THEN NULL ELSE g * interval '1 minute' END,
+           CASE WHEN g % 5 = 0 OR g % 15 = 11 THEN NULL ELSE 'v' || g END,
+           CASE WHEN g % 5 = 0 OR g % 15 = 12 THEN NULL ELSE repeat(md5(g::text), g % 10 + 1) END,
+           CASE WHEN g % 5 = 0 OR g % 15 = 13 THEN NULL ELSE repeat('p', g) END,
+           CASE WHEN g % 5 = 0 OR g % 15 = 14 THEN NULL ELSE g * 1.5 END,
+           CASE WHEN g % 5 = 0 OR g % 15 = 14 THEN NULL ELSE jsonb_build_object('g', g, 'tag', 'x' || g) END,
+           CASE WHEN g % 5 = 0 THEN NULL ELSE ARRAY[g, g + 1, g + 2] END,
+           CASE WHEN g % 5 = 0 THEN NULL ELSE decode(repeat('ab', g), 'hex') END
+    FROM generate_series(1, 300) g;
+
+    -- compressed inline
+    INSERT INTO binary_test(id, long_text, by)
+    VALUES (1001, repeat('c', 5000), decode(repeat('00', 5000), 'hex'));]);
+
+$node_0->safe_psql($pgactive_test_dbname, q[
+    UPDATE binary_test SET short_text = 'updated ' || id, i8 = NULL WHERE id % 4 = 0;
+    UPDATE binary_test SET plain_text = repeat('q', 200), b = true WHERE id % 7 = 0;]);
+wait_for_apply($node_0, $node_1);
+
+my $rows_query = q[SELECT md5(string_agg(t::text, ',' ORDER BY id)) FROM binary_test t;];
+is($node_1->safe_psql($pgactive_test_dbname, $rows_query),
+   $node_0->safe_psql($pgactive_test_dbname, $rows_query),
+   "binary rows applied with the same values");
+
+my $sizes_query = q[
+    SELECT string_agg(id || ':' || pg_column_size(t.*) || ':' ||
+                      coalesce(pg_column_size(long_text), 0) || ':' ||
+                      coalesce(pg_column_size(plain_text), 0), ',' ORDER BY id)
+    FROM binary_test t;];
+is($node_1->safe_psql($pgactive_test_dbname, $sizes_query),
+   $node_0->safe_psql($pgactive_test_dbname, $sizes_query),
+   "binary rows applied with the same storage as on the upstream");
+
+is($node_1->safe_psql($pgactive_test_dbname,
+    q[SELECT count(*) FROM binary_test WHERE short_text IS NULL AND id % 5 <> 0 AND id <> 1001;]),
+   $node_0->safe_psql($pgactive_test_dbname,
+    q[SELECT count(*) FROM binary_test WHERE short_text IS NULL AND id % 5 <> 0 AND id <> 1001;]),
+   "NULLs applied in place");
+
+done_testing();
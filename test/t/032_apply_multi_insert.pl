@@ -0,0 +1,85 @@
+#!/usr/bin/env perl
+#
+# Test that remote INSERTs buffered by pgactive.apply_multi_insert go through
+# conflict handling like INSERTs applied one by one, even when they only
+# conflict with each other on a unique index that exists on the downstream
+# only.
+#
+use strict;
+use warnings;
+use lib 'test/t/';
+use Cwd;
+use Config;
+use PostgreSQL::Test::Cluster;
+use PostgreSQL::Test::Utils;
+use Test::More;
+use utils::nodemanagement;
+
+my $nodes = make_pgactive_group(2, 'node_');
+my ($node_0, $node_1) = @$nodes;
+
+$node_1->safe_psql($pgactive_test_dbname,
+    q[ALTER SYSTEM SET pgactive.log_conflicts_to_table = on;]);
+$node_1->safe_psql($pgactive_test_dbname, q[SELECT pg_reload_conf();]);
+
+foreach my $table ('mi_batched', 'mi_serial')
+{
+    exec_ddl($node_0, qq[CREATE TABLE public.$table(id integer PRIMARY KEY, code text);]);
+    wait_for_apply($node_0, $node_1);
+
+    # a unique index node_0 doesn't have
+    $node_1->safe_psql($pgactive_test_dbname, qq[
+        SET pgactive.skip_ddl_replication = on;
+        CREATE UNIQUE INDEX ${table}_code ON public.$table(code);]);
+}
+
+sub insert_duplicates
+{
+    my ($table) = @_;
+
+    $node_0->safe_psql($pgactive_test_dbname, qq[
+        BEGIN;
+        INSERT INTO $table SELECT g, 'code' || g FROM generate_series(1, 100) g;
+        INSERT INTO $table VALUES (101, 'code50');
+        COMMIT;
+        INSERT INTO $table VALUES (102, 'after');]);
+    wait_for_apply($node_0, $node_1);
+}
+
+insert_duplicates('mi_batched');
+
+$node_1->safe_psql($pgactive_test_dbname,
+    q[ALTER SYSTEM SET pgactive.apply_multi_insert = off;]);
+$node_1->safe_psql($pgactive_test_dbname, q[SELECT pg_reload_conf();]);
+
+# Restart the apply worker, so that it applies with the new setting from
+# the start.
+my $apply_pid = $node_1->safe_psql($pgactive_test_dbname,
+    q[SELECT pid FROM pgactive.pgactive_get_workers_info() WHERE worker_type = 'apply';]);
+$node_1->safe_psql($pgactive_test_dbname,
+    "SELECT pgactive.pgactive_terminate_workers(node_sysid, node_timeline, node_dboid, 'apply')
+     FROM pgactive.pgactive_nodes;");
+$node_1->poll_query_until($pgactive_test_dbname,
+    qq[SELECT count(*) = 1 FROM pgactive.pgactive_get_workers_info()
+       WHERE worker_type = 'apply' AND pid NOT IN (0, $apply_pid);])
+    or die "Timed out waiting for the apply worker to restart on node_1";
+
+insert_duplicates('mi_serial');
+
+foreach my $table ('mi_batched', 'mi_serial')
+{
+    is($node_1->safe_psql($pgactive_test_dbname,
+        qq[SELECT conflict_type FROM pgactive.pgactive_conflict_history WHERE object_name = '$table';]),
+       'insert_insert', "INSERT/INSERT conflict on the downstream-only index of $table detected");
+    is($node_1->safe_psql($pgactive_test_dbname,
+        qq[SELECT count(*) FROM $table WHERE id = 102;]),
+       '1', "apply continued after the conflict in $table");
+}
+
+is($node_1->safe_psql($pgactive_test_dbname,
+    q[SELECT string_agg(id || ':' || code, ',' ORDER BY id) FROM mi_batched;]),
+   $node_1->safe_psql($pgactive_test_dbname,
+    q[SELECT string_agg(id || ':' || code, ',' ORDER BY id) FROM mi_serial;]),
+   "batched INSERTs resolved the conflict like INSERTs applied one by one");
+
+done_testing();
@@ -0,0 +1,120 @@
+#!/usr/bin/env perl
+#
+# Test that transactions larger than logical_decoding_work_mem on the
+# upstream are streamed to the downstream before they commit, and applied
+# there once they commit: committed, aborted, with an aborted subtransaction,
+# and with the downstream restarting while a transaction is being streamed.
+#
+use strict;
+use warnings;
+use lib 'test/t/';
+use Cwd;
+use Config;
+use IPC::Run;
+use PostgreSQL::Test::Cluster;
+use PostgreSQL::Test::Utils;
+use Test::More;
+use utils::nodemanagement;
+
+my $nodes = make_pgactive_group(2, 'node_');
+my ($node_0, $node_1) = @$nodes;
+
+# Make node_0's walsender stream transactions of a few hundred rows. The
+# streaming option is only passed when the apply worker connects.
+$node_0->safe_psql($pgactive_test_dbname,
+    q[ALTER SYSTEM SET logical_decoding_work_mem = '64kB';]);
+$node_0->safe_psql($pgactive_test_dbname, q[SELECT pg_reload_conf();]);
+$node_1->safe_psql($pgactive_test_dbname,
+    q[SELECT pgactive.pgactive_terminate_workers(node_sysid, node_timeline, node_dboid, 'apply')
+      FROM pgactive.pgactive_nodes;]);
+$node_1->safe_psql($pgactive_test_dbname,
+    qq[SELECT pgactive.pgactive_wait_for_node_ready($PostgreSQL::Test::Utils::timeout_default)]);
+
+exec_ddl($node_0, q[CREATE TABLE public.stream_test(id integer PRIMARY KEY, data text);]);
+wait_for_apply($node_0, $node_1);
+
+# Slot statistics are reported asynchronously, so poll for them to change.
+my $stream_txns_query = q[
+    SELECT coalesce(sum(stream_txns), 0) FROM pg_stat_replication_slots
+    WHERE slot_name LIKE 'pgactive%'];
+my $rows_query = q[SELECT count(*) || ':' || coalesce(sum(id), 0) FROM stream_test;];
+
+sub check_streamed
+{
+    my ($sql, $test_name) = @_;
+    my $stream_txns = $node_0->safe_psql($pgactive_test_dbname, $stream_txns_query);
+
+    $node_0->safe_psql($pgactive_test_dbname, $sql);
+    wait_for_apply($node_0, $node_1);
+
+    ok($node_0->poll_query_until($pgactive_test_dbname,
+           qq[SELECT ($stream_txns_query) > $stream_txns;]),
+       "$test_name was streamed");
+    is($node_1->safe_psql($pgactive_test_dbname, $rows_query),
+       $node_0->safe_psql($pgactive_test_dbname, $rows_query),
+       "$test_name was applied on the downstream like on the upstream");
+}
+
+check_streamed(q[
+    INSERT INTO stream_test SELECT g, repeat('x', 100) FROM generate_series(1, 5000) g;],
+    "committed transaction");
+
+check_streamed(q[
+    BEGIN;
+    INSERT INTO stream_test SELECT g, repeat('x', 100) FROM generate_series(5001, 10000) g;
+    ROLLBACK;],
+    "aborted transaction");
+
+check_streamed(q[
+    BEGIN;
+    INSERT INTO stream_test SELECT g, repeat('x', 100) FROM generate_series(10001, 12000) g;
+    SAVEPOINT s1;
+    INSERT INTO stream_test SELECT g, repeat('y', 100) FROM generate_series(12001, 14000) g;
+    ROLLBACK TO SAVEPOINT s1;
+    UPDATE stream_test SET data = 'updated' WHERE id <= 2000;
+    INSERT INTO stream_test SELECT g, repeat('z', 100) FROM generate_series(14001, 16000) g;
+    COMMIT;],
+    "transaction with an aborted subtransaction");
+is($node_1->safe_psql($pgactive_test_dbname,
+    q[SELECT count(*) FROM stream_test WHERE data = 'updated' OR id BETWEEN 12001 AND 14000;]),
+   '2000', "changes of the aborted subtransaction were discarded");
+
+# Restart the downstream while a transaction is being streamed to it. The
+# upstream streams the transaction again from its start once the apply
+# worker reconnects.
+my $stream_txns = $node_0->safe_psql($pgactive_test_dbname, $stream_txns_query);
+my ($psql_stdin, $psql_stdout, $psql_stderr) = ('', '', '');
+my $psql = IPC::Run::start(
+    ['psql', '-qAtX', '-v', 'ON_ERROR_STOP=1', '-d', $node_0->connstr($pgactive_test_dbname), '-f', '-'],
+    '<', \$psql_stdin, '>', \$psql_stdout, '2>', \$psql_stderr);
+
+$psql_stdin .= q[
+BEGIN;
+INSERT INTO stream_test SELECT g, repeat('x', 100) FROM generate_series(20001, 25000) g;
+SELECT 'inserted';
+];
+$psql->pump until $psql_stdout =~ /inserted/;
+
+$node_0->poll_query_until($pgactive_test_dbname,
+    qq[SELECT ($stream_txns_query) > $stream_txns;])
+    or die "timed out waiting for the open transaction to be streamed";
+
+$node_1->restart;
+
+$psql_stdin .= q[
+INSERT INTO stream_test SELECT g, repeat('x', 100) FROM generate_series(25001, 30000) g;
+COMMIT;
+];
+$psql_stdin .= "\\q\n";
+$psql->finish;
+is($psql_stderr, '', "transaction streamed across the restart committed");
+
+$node_1->safe_psql($pgactive_test_dbname,
+    qq[SELECT pgactive.pgactive_wait_for_node_ready($PostgreSQL::Test::Utils::timeout_default)]);
+wait_for_apply($node_0, $node_1);
+
+is($node_1->safe_psql($pgactive_test_dbname, $rows_query),
+   $node_0->safe_psql($pgactive_test_dbname, $rows_query),
+   "transaction streamed across a downstream restart was applied once");
+
+done_testing();
@@ -0,0 +1,128 @@
+#!/usr/bin/env perl
+#
+# Test parallel apply against serial apply: node_1 applies the changes of
+# node_0 with parallel apply workers, node_2 applies them serially. Both
+# must end up with the same rows, and resolve the same conflicts the same
+# way.
+#
+use strict;
+use warnings;
+use lib 'test/t/';
+use Cwd;
+use Config;
+use PostgreSQL::Test::Cluster;
+use PostgreSQL::Test::Utils;
+use Test::More;
+use utils::nodemanagement;
+
+my $nodes = make_pgactive_group(3, 'node_');
+my ($node_0, $node_1, $node_2) = @$nodes;
+
+my $pg_version = $node_0->safe_psql($pgactive_test_dbname,
+    q[SELECT setting::int/10000 FROM pg_settings WHERE name = 'server_version_num';]);
+
+SKIP:
+{
+    skip "parallel apply requires PostgreSQL 16 or later", 8
+        if ($pg_version < 16);
+
+    foreach my $node (@$nodes)
+    {
+        $node->safe_psql($pgactive_test_dbname,
+            q[ALTER SYSTEM SET pgactive.log_conflicts_to_table = on;]);
+    }
+    $node_1->safe_psql($pgactive_test_dbname,
+        q[ALTER SYSTEM SET pgactive.apply_parallel_workers = 4;]);
+
+    # apply workers only start parallel apply workers when they connect
+    $_->restart foreach (@$nodes);
+    $_->safe_psql($pgactive_test_dbname,
+        qq[SELECT pgactive.pgactive_wait_for_node_ready($PostgreSQL::Test::Utils::timeout_default)])
+        foreach (@$nodes);
+
+    $node_1->poll_query_until($pgactive_test_dbname,
+        q[SELECT count(*) > 0 FROM pgactive.pgactive_get_workers_info() WHERE worker_type = 'parallel apply'])
+        or die "timed out waiting for parallel apply workers on node_1";
+    is($node_2->safe_psql($pgactive_test_dbname,
+        q[SELECT count(*) FROM pgactive.pgactive_get_workers_info() WHERE worker_type = 'parallel apply']),
+        '0', "node_2 applies serially");
+
+    exec_ddl($node_0, q[CREATE TABLE public.pa_items(id integer PRIMARY KEY, data text);]);
+    exec_ddl($node_0, q[CREATE TABLE public.pa_counter(id integer PRIMARY KEY, n integer, last text);]);
+    exec_ddl($node_0, q[CREATE TABLE public.pa_conflict(id integer PRIMARY KEY, origin text);]);
+    $node_0->safe_psql($pgactive_test_dbname,
+        q[INSERT INTO pa_counter SELECT g, 0, NULL FROM generate_series(0, 4) g;]);
+    wait_for_apply($node_0, $_) foreach ($node_1, $node_2);
+
+    # Independent inserts mixed with updates of the same few rows, deletes
+    # and re-inserts of earlier keys. Each UPDATE sets literal values, so
+    # applying any two changes of the same row out of order would leave a
+    # different row behind.
+    my $sql = '';
+    foreach my $i (1 .. 600)
+    {
+        my $k = $i % 5;
+        $sql .= "INSERT INTO pa_items VALUES ($i, 'item $i');\n";
+        $sql .= "UPDATE pa_counter SET n = $i, last = 'item $i' WHERE id = $k;\n";
+        $sql .= "DELETE FROM pa_items WHERE id = " . ($i - 2) . ";\n"
+            if ($i % 3 == 0);
+        $sql .= "INSERT INTO pa_items VALUES (" . ($i - 5) . ", 'again $i');\n"
+            if ($i % 6 == 0 && $i > 6);
+        $sql .= "BEGIN; UPDATE pa_counter SET n = n + 1000; UPDATE pa_items SET data = data || '+' WHERE id = $i; COMMIT;\n"
+            if ($i % 10 == 0);
+    }
+    $node_0->safe_psql($pgactive_test_dbname, $sql);
+    wait_for_apply($node_0, $_) foreach ($node_1, $node_2);
+
+    my $rows_query = q[SELECT string_agg(id || ':' || coalesce(data, ''), ',' ORDER BY id) FROM pa_items;];
+    my $counter_query = q[SELECT string_agg(id || ':' || n || ':' || coalesce(last, ''), ',' ORDER BY id) FROM pa_counter;];
+
+    my $rows_0 = $node_0->safe_psql($pgactive_test_dbname, $rows_query);
+    is($node_1->safe_psql($pgactive_test_dbname, $rows_query), $rows_0,
+       "parallel apply has the same rows as the upstream");
+    is($node_2->safe_psql($pgactive_test_dbname, $rows_query), $rows_0,
+       "serial apply has the same rows as the upstream");
+    is($node_1->safe_psql($pgactive_test_dbname, $counter_query),
+       $node_0->safe_psql($pgactive_test_dbname, $counter_query),
+       "parallel apply applied updates of the same rows in order");
+
+    # The leader publishes the last transaction its workers committed, in
+    # commit order, so it's the same one serial apply reports.
+    my $last_applied_query = q[
+        SELECT i.last_applied_xact_id, i.last_applied_xact_committs
+        FROM pgactive.pgactive_nodes n,
+             pgactive.get_last_applied_xact_info(n.node_sysid, n.node_timeline, n.node_dboid) i
+        WHERE n.node_name = 'node_0';];
+    is($node_1->safe_psql($pgactive_test_dbname, $last_applied_query),
+       $node_2->safe_psql($pgactive_test_dbname, $last_applied_query),
+       "parallel apply reports the last remote transaction as applied");
+
+    # Rows only inserted locally on node_1 and node_2 make the same inserts
+    # from node_0 conflict on both.
+    foreach my $node ($node_1, $node_2)
+    {
+        local $ENV{PGOPTIONS} = '-c pgactive.do_not_replicate=on';
+        $node->safe_psql($pgactive_test_dbname,
+            q[INSERT INTO pa_conflict SELECT g, 'local' FROM generate_series(1, 20, 2) g;]);
+    }
+    $node_0->safe_psql($pgactive_test_dbname,
+        join('', map { "INSERT INTO pa_conflict VALUES ($_, 'remote');\n" } (1 .. 20)));
+    wait_for_apply($node_0, $_) foreach ($node_1, $node_2);
+
+    my $conflict_query = q[
+        SELECT string_agg(conflict_type || ' ' || conflict_resolution || ' ' || remote_tuple::text, E'\n'
+                          ORDER BY (remote_tuple->>'id')::int)
+        FROM pgactive.pgactive_conflict_history WHERE object_name = 'pa_conflict';];
+    my $conflicts_2 = $node_2->safe_psql($pgactive_test_dbname, $conflict_query);
+    is(scalar(() = $conflicts_2 =~ /insert_insert/g), 10,
+       "serial apply detected the insert/insert conflicts");
+    is($node_1->safe_psql($pgactive_test_dbname, $conflict_query), $conflicts_2,
+       "parallel apply resolved conflicts like serial apply");
+
+    my $conflict_rows = q[SELECT string_agg(id || ':' || origin, ',' ORDER BY id) FROM pa_conflict;];
+    is($node_1->safe_psql($pgactive_test_dbname, $conflict_rows),
+       $node_2->safe_psql($pgactive_test_dbname, $conflict_rows),
+       "parallel and serial apply kept the same conflicting rows");
+}
+
+done_testing();
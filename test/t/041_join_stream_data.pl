@@ -0,0 +1,121 @@
+#!/usr/bin/env perl
+#
+# Test logical join with pgactive.init_node_stream_data: table data is
+# streamed from the upstream with several jobs instead of being dumped and
+# restored, and indexes, constraints and triggers are created afterwards.
+# Big tables are split into block ranges copied concurrently.
+#
+use strict;
+use warnings;
+use lib 'test/t/';
+use Cwd;
+use Config;
+use PostgreSQL::Test::Cluster;
+use PostgreSQL::Test::Utils;
+use Test::More;
+use utils::nodemanagement;
+
+my $node_a = PostgreSQL::Test::Cluster->new('node_a');
+initandstart_pgactive_group($node_a);
+
+exec_ddl($node_a, q[CREATE TYPE public.mood AS ENUM ('sad', 'ok', 'happy');]);
+exec_ddl($node_a, q[CREATE TABLE public.t_big(id integer PRIMARY KEY, v text, ts timestamptz, n numeric);]);
+exec_ddl($node_a, q[CREATE TABLE public.t_enum(id integer PRIMARY KEY, m public.mood, ms public.mood[]);]);
+exec_ddl($node_a, q[CREATE TABLE public.t_gen(id integer PRIMARY KEY, a integer, b integer GENERATED ALWAYS AS (a * 2) STORED);]);
+exec_ddl($node_a, q[CREATE TABLE public.t_dropped(id integer PRIMARY KEY, x integer, y text);]);
+exec_ddl($node_a, q[ALTER TABLE public.t_dropped DROP COLUMN x;]);
+exec_ddl($node_a, q[CREATE TABLE public.t_fk(id integer PRIMARY KEY, big_id integer REFERENCES public.t_big(id), note text);]);
+exec_ddl($node_a, q[CREATE INDEX t_fk_note ON public.t_fk(note);]);
+exec_ddl($node_a, q[CREATE FUNCTION public.t_fk_trg() RETURNS trigger LANGUAGE plpgsql AS $$BEGIN NEW.note := upper(NEW.note); RETURN NEW; END;$$;]);
+exec_ddl($node_a, q[CREATE TRIGGER t_fk_trg BEFORE INSERT ON public.t_fk FOR EACH ROW EXECUTE FUNCTION public.t_fk_trg();]);
+exec_ddl($node_a, q[CREATE SEQUENCE public.s_join;]);
+
+$node_a->safe_psql($pgactive_test_dbname, q[
+    INSERT INTO t_big SELECT g, md5(g::text), '2020-01-01'::timestamptz + g * interval '1 second', g / 3.0
+    FROM generate_series(1, 20000) g;
+    INSERT INTO t_enum SELECT g, (ARRAY['sad', 'ok', 'happy'])[g % 3 + 1]::mood, ARRAY['ok', 'happy']::mood[]
+    FROM generate_series(1, 100) g;
+    INSERT INTO t_gen SELECT g, g FROM generate_series(1, 100) g;
+    INSERT INTO t_dropped SELECT g, 'y' || g FROM generate_series(1, 100) g;
+    INSERT INTO t_fk SELECT g, g, 'note ' || g FROM generate_series(1, 100) g;
+    SELECT setval('s_join', 1234);]);
+
+sub check_streamed_data
+{
+    my ($node, $what) = @_;
+
+    foreach my $table ('t_big', 't_enum', 't_gen', 't_dropped', 't_fk')
+    {
+        my $query = qq[SELECT count(*) || ':' || coalesce(md5(string_agg(t::text, ',' ORDER BY id)), '') FROM $table t;];
+        is($node->safe_psql($pgactive_test_dbname, $query),
+           $node_a->safe_psql($pgactive_test_dbname, $query),
+           "data of $table $what");
+    }
+}
+
+# holes for the block ranges to skip over
+$node_a->safe_psql($pgactive_test_dbname, q[DELETE FROM t_big WHERE id % 7 = 0;]);
+
+my $node_b = PostgreSQL::Test::Cluster->new('node_b');
+initandstart_node($node_b);
+$node_b->append_conf('postgresql.conf', q[
+    pgactive.init_node_stream_data = on
+    pgactive.init_node_parallel_jobs = 3
+]);
+$node_b->restart;
+
+my $log_offset = get_log_size($node_b);
+pgactive_logical_join($node_b, $node_a);
+check_join_status($node_b, $node_a);
+
+ok(find_in_log($node_b, qr/streaming initial data in 5 parts with 3 jobs/, $log_offset),
+   "table data streamed with several jobs");
+
+check_streamed_data($node_b, "streamed");
+
+my $schema_query = q[
+    SELECT string_agg(conrelid::regclass || ' ' || contype, ',' ORDER BY conrelid::regclass::text, contype)
+    FROM pg_constraint WHERE connamespace = 'public'::regnamespace AND contype <> 'n'
+    UNION ALL
+    SELECT string_agg(indexrelid::regclass::text, ',' ORDER BY indexrelid::regclass::text)
+    FROM pg_index i JOIN pg_class c ON c.oid = i.indrelid WHERE c.relnamespace = 'public'::regnamespace
+    UNION ALL
+    SELECT string_agg(tgname, ',' ORDER BY tgname) FROM pg_trigger WHERE NOT tgisinternal
+        AND tgrelid IN (SELECT oid FROM pg_class WHERE relnamespace = 'public'::regnamespace);];
+is($node_b->safe_psql($pgactive_test_dbname, $schema_query),
+   $node_a->safe_psql($pgactive_test_dbname, $schema_query),
+   "constraints, indexes and triggers created after the data");
+is($node_b->safe_psql($pgactive_test_dbname, q[SELECT last_value FROM s_join;]),
+   '1234', "sequence state restored");
+
+# the node replicates like any other once joined
+$node_a->safe_psql($pgactive_test_dbname, q[INSERT INTO t_fk VALUES (101, 101, 'after join');]);
+wait_for_apply($node_a, $node_b);
+is($node_b->safe_psql($pgactive_test_dbname, q[SELECT note FROM t_fk WHERE id = 101;]),
+   'AFTER JOIN', "changes replicated after streamed join");
+
+# Join another node with t_big split into ranges of 16 blocks.
+my $node_c = PostgreSQL::Test::Cluster->new('node_c');
+initandstart_node($node_c);
+$node_c->append_conf('postgresql.conf', q[
+    pgactive.init_node_stream_data = on
+    pgactive.init_node_parallel_jobs = 4
+    pgactive.debug_init_node_stream_range_size = 16
+]);
+$node_c->restart;
+
+$log_offset = get_log_size($node_c);
+pgactive_logical_join($node_c, $node_a);
+check_join_status($node_c, $node_a);
+
+ok(find_in_log($node_c, qr/streaming initial data in \d+ parts with 4 jobs/, $log_offset),
+   "table data streamed with several jobs");
+my ($parts) = substr(slurp_file($node_c->logfile), $log_offset) =~
+    /streaming initial data in (\d+) parts/;
+my $big_blocks = $node_a->safe_psql($pgactive_test_dbname,
+    q[SELECT pg_relation_size('t_big') / current_setting('block_size')::int;]);
+cmp_ok($parts, '>=', 4 + int($big_blocks / 16) - 1, "t_big split into block ranges");
+
+check_streamed_data($node_c, "streamed in block ranges");
+
+done_testing();
@@ -56,6 +56,107 @@ $node_0->poll_query_until($pgactive_test_dbname,
   qq[SELECT COUNT(*) = 2 FROM fruits;])
   or die "Timed out waiting for fruits count = 2 on node_0";
 
+# An apply worker only asks its upstream for the protocol features the
+# upstream's version has, since older output plugins reject options they
+# don't know. Make node_0 report the last version without any of them, and
+# check that node_1 still replicates from it without asking for them.
+sub restart_apply_and_get_command
+{
+    my ($node) = @_;
+    my $offset = get_log_size($node);
+
+    $node->safe_psql($pgactive_test_dbname,
+        "SELECT pgactive.pgactive_terminate_workers(node_sysid, node_timeline, node_dboid, 'apply')
+         FROM pgactive.pgactive_nodes;");
+    find_in_log($node, qr/sending replication command: START_REPLICATION/, $offset)
+        or die "Timed out waiting for the apply worker of " . $node->name . " to reconnect";
+
+    my $log = substr(slurp_file($node->logfile), $offset);
+    my ($command) = $log =~ /sending replication command: (START_REPLICATION[^\n]*)/;
+    return $command;
+}
+
+$node_1->safe_psql($pgactive_test_dbname,
+    q[ALTER SYSTEM SET pgactive.log_min_messages = debug3;]);
+
+# ask for compression too, if the server was built with a method for it
+my $compression = $node_1->safe_psql($pgactive_test_dbname, q[
+    SELECT m FROM pg_settings, unnest(enumvals) m
+    WHERE name = 'pgactive.apply_compression' AND m <> 'none' LIMIT 1;]);
+if ($compression ne '')
+{
+    $node_1->safe_psql($pgactive_test_dbname,
+        qq[ALTER SYSTEM SET pgactive.apply_compression = '$compression';]);
+    $node_1->safe_psql($pgactive_test_dbname,
+        q[ALTER SYSTEM SET pgactive.apply_compression_threshold = 0;]);
+}
+$node_1->safe_psql($pgactive_test_dbname, q[SELECT pg_reload_conf();]);
+
+$node_0->safe_psql($pgactive_test_dbname, q[
+    SET pgactive.skip_ddl_replication = on;
+    CREATE OR REPLACE FUNCTION pgactive.pgactive_version_num() RETURNS integer
+    LANGUAGE sql AS 'SELECT 20109';]);
+
+my $command = restart_apply_and_get_command($node_1);
+unlike($command, qr/relation_ids|streaming|compression/,
+       "apply worker asks an old upstream for no new protocol features");
+
+$node_0->safe_psql($pgactive_test_dbname,
+    q[INSERT INTO fruits VALUES (3, 'Banana');]);
+wait_for_apply($node_0, $node_1);
+is($node_1->safe_psql($pgactive_test_dbname, q[SELECT name FROM fruits WHERE id = 3;]),
+   'Banana', "apply worker replicates from an old upstream");
+
+$node_0->safe_psql($pgactive_test_dbname, q[
+    SET pgactive.skip_ddl_replication = on;
+    CREATE OR REPLACE FUNCTION pgactive.pgactive_version_num() RETURNS integer
+    LANGUAGE c AS '$libdir/pgactive', 'pgactive_version_num';]);
+
+$command = restart_apply_and_get_command($node_1);
+like($command, qr/relation_ids 't'/,
+     "apply worker asks a current upstream for relation ids");
+SKIP:
+{
+    skip "no compression method available", 1 if $compression eq '';
+    like($command, qr/compression '$compression'/,
+         "apply worker asks a current upstream for compression");
+}
+
+# Rows, small and large, arrive intact through the compressed stream.
+$node_0->safe_psql($pgactive_test_dbname, q[
+    INSERT INTO fruits SELECT g, 'Fruit ' || g || ' ' || repeat('compressible ', g * 100)
+    FROM generate_series(10, 29) g;]);
+wait_for_apply($node_0, $node_1);
+
+my $fruits_query = q[SELECT count(*), md5(string_agg(id || ':' || name, ',' ORDER BY id))
+                     FROM fruits WHERE id BETWEEN 10 AND 29;];
+is($node_1->safe_psql($pgactive_test_dbname, $fruits_query),
+   $node_0->safe_psql($pgactive_test_dbname, $fruits_query),
+   "rows arrive intact through the compressed stream");
+SKIP:
+{
+    skip "no compression method available", 1 if $compression eq '';
+    is($node_1->safe_psql($pgactive_test_dbname, q[
+        SELECT sum(nr_bytes_compressed) > 0
+           AND sum(nr_bytes_decompressed) > sum(nr_bytes_compressed)
+        FROM pgactive.pgactive_get_stats();]),
+       't', "compressed bytes received and decompressed");
+}
+$node_0->safe_psql($pgactive_test_dbname,
+    q[DELETE FROM fruits WHERE id BETWEEN 10 AND 29;]);
+
+$node_0->safe_psql($pgactive_test_dbname,
+    q[DELETE FROM fruits WHERE id = 3;]);
+wait_for_apply($node_0, $node_1);
+
+$node_1->safe_psql($pgactive_test_dbname,
+    q[ALTER SYSTEM RESET pgactive.log_min_messages;]);
+$node_1->safe_psql($pgactive_test_dbname,
+    q[ALTER SYSTEM RESET pgactive.apply_compression;]);
+$node_1->safe_psql($pgactive_test_dbname,
+    q[ALTER SYSTEM RESET pgactive.apply_compression_threshold;]);
+$node_1->safe_psql($pgactive_test_dbname, q[SELECT pg_reload_conf();]);
+
 # Test the capability to set all pgactive nodes read-only
 # Set all nodes read-only
 $node_0->safe_psql($pgactive_test_dbname,
@@ -316,4 +316,143 @@ is( $test_include_node_b->safe_psql(
 $test_include_node_a->stop;
 $test_include_node_b->stop;
 
+# Column lists and row filters
+my $test_rs_node_a = PostgreSQL::Test::Cluster->new('test_rs_node_a');
+
+$test_rs_node_a->init();
+pgactive_update_postgresql_conf($test_rs_node_a);
+$test_rs_node_a->start;
+
+$test_rs_node_a->safe_psql('postgres', qq{CREATE DATABASE $pgactive_test_dbname;});
+$test_rs_node_a->safe_psql($pgactive_test_dbname, q{CREATE EXTENSION pgactive;});
+
+create_pgactive_group($test_rs_node_a);
+
+# The filter uses a column outside the primary key, so the old rows of
+# UPDATEs and DELETEs need all columns.
+$test_rs_node_a->safe_psql($pgactive_test_dbname, q[
+    CREATE TABLE test_rs(id integer PRIMARY KEY, region text, note text, qty integer NOT NULL DEFAULT 7);
+    ALTER TABLE test_rs REPLICA IDENTITY FULL;]);
+$test_rs_node_a->safe_psql($pgactive_test_dbname, q{select pgactive.pgactive_include_table_replication_set('test_rs');});
+
+my $test_rs_node_b = PostgreSQL::Test::Cluster->new('test_rs_node_b');
+
+$test_rs_node_b->init();
+pgactive_update_postgresql_conf($test_rs_node_b);
+$test_rs_node_b->start;
+
+$test_rs_node_b->safe_psql('postgres', qq{CREATE DATABASE $pgactive_test_dbname;});
+$test_rs_node_b->safe_psql($pgactive_test_dbname, q{CREATE EXTENSION pgactive;});
+
+pgactive_logical_join($test_rs_node_b, $test_rs_node_a);
+check_join_status($test_rs_node_b, $test_rs_node_a);
+
+$test_rs_node_a->safe_psql($pgactive_test_dbname, q[
+    INSERT INTO pgactive.pgactive_replication_set_config (set_name, column_list, row_filter)
+    VALUES ('include_rs', '{id,region}', $$region = 'eu'$$);]);
+wait_for_apply($test_rs_node_a, $test_rs_node_b);
+
+my $rs_query = q[SELECT string_agg(id || ':' || region || ':' || coalesce(note, '-') || ':' || qty, ',' ORDER BY id) FROM test_rs;];
+
+# Only rows matching the filter are inserted, without the columns outside
+# the list, which get their default.
+$test_rs_node_a->safe_psql($pgactive_test_dbname,
+    q[INSERT INTO test_rs VALUES (1, 'eu', 'note 1', 1), (2, 'us', 'note 2', 2);]);
+wait_for_apply($test_rs_node_a, $test_rs_node_b);
+
+is($test_rs_node_b->safe_psql($pgactive_test_dbname, $rs_query),
+    '1:eu:-:7', "filtered insert replicated the listed columns of matching rows");
+
+# UPDATEs leave the columns outside the list alone
+{
+    local $ENV{PGOPTIONS} = '-c pgactive.do_not_replicate=on';
+    $test_rs_node_b->safe_psql($pgactive_test_dbname,
+        q[UPDATE test_rs SET note = 'local', qty = 8 WHERE id = 1;]);
+}
+$test_rs_node_a->safe_psql($pgactive_test_dbname,
+    q[UPDATE test_rs SET note = 'remote', qty = 100 WHERE id = 1;]);
+wait_for_apply($test_rs_node_a, $test_rs_node_b);
+
+is($test_rs_node_b->safe_psql($pgactive_test_dbname, $rs_query),
+    '1:eu:local:8', "update kept the columns outside the list");
+
+# A row updated out of the filter is deleted, one updated into it inserted
+$test_rs_node_a->safe_psql($pgactive_test_dbname,
+    q[UPDATE test_rs SET region = 'us' WHERE id = 1;]);
+$test_rs_node_a->safe_psql($pgactive_test_dbname,
+    q[UPDATE test_rs SET region = 'eu' WHERE id = 2;]);
+wait_for_apply($test_rs_node_a, $test_rs_node_b);
+
+is($test_rs_node_b->safe_psql($pgactive_test_dbname, $rs_query),
+    '2:eu:-:7', "filtered updates deleted and inserted the rows crossing the filter");
+
+# Only deletes of rows matching the filter are sent; row 4 only exists
+# locally on node_b, so deleting it there shows the delete wasn't sent.
+$test_rs_node_a->safe_psql($pgactive_test_dbname,
+    q[INSERT INTO test_rs VALUES (3, 'eu', NULL, 3), (4, 'us', NULL, 4);]);
+wait_for_apply($test_rs_node_a, $test_rs_node_b);
+{
+    local $ENV{PGOPTIONS} = '-c pgactive.do_not_replicate=on';
+    $test_rs_node_b->safe_psql($pgactive_test_dbname,
+        q[INSERT INTO test_rs VALUES (4, 'us', 'local', 4);]);
+}
+$test_rs_node_a->safe_psql($pgactive_test_dbname,
+    q[DELETE FROM test_rs WHERE id IN (2, 3, 4);]);
+wait_for_apply($test_rs_node_a, $test_rs_node_b);
+
+is($test_rs_node_b->safe_psql($pgactive_test_dbname, $rs_query),
+    '4:us:local:4', "filtered delete only deleted the matching rows");
+
+# A row updated into the filter gets its unchanged toasted values from the
+# old row.
+$test_rs_node_a->safe_psql($pgactive_test_dbname, q[
+    UPDATE pgactive.pgactive_replication_set_config SET column_list = '{id,region,note}'
+    WHERE set_name = 'include_rs';]);
+$test_rs_node_a->safe_psql($pgactive_test_dbname,
+    q[ALTER TABLE test_rs ALTER COLUMN note SET STORAGE EXTERNAL;]);
+$test_rs_node_a->safe_psql($pgactive_test_dbname,
+    q[INSERT INTO test_rs VALUES (6, 'us', repeat('toasted ', 1000), 6);]);
+$test_rs_node_a->safe_psql($pgactive_test_dbname,
+    q[UPDATE test_rs SET region = 'eu' WHERE id = 6;]);
+wait_for_apply($test_rs_node_a, $test_rs_node_b);
+
+my $toast_query = q[SELECT length(note) || ':' || md5(note) FROM test_rs WHERE id = 6;];
+is($test_rs_node_b->safe_psql($pgactive_test_dbname, $toast_query),
+    $test_rs_node_a->safe_psql($pgactive_test_dbname, $toast_query),
+    "row updated into the filter kept its toasted value");
+
+# Column lists and filters are checked when they're configured
+($psql_ret, $psql_stdout, $psql_stderr) = ('', '', '');
+($psql_ret, $psql_stdout, $psql_stderr) = $test_rs_node_a->psql(
+    $pgactive_test_dbname,
+    q[UPDATE pgactive.pgactive_replication_set_config SET row_filter = 'no_such_column = 1' WHERE set_name = 'include_rs';]);
+like($psql_stderr, qr/column "no_such_column" does not exist/,
+     "row filter using an unknown column refused");
+
+$test_rs_node_a->safe_psql($pgactive_test_dbname,
+    q[ALTER TABLE test_rs ALTER COLUMN qty DROP DEFAULT;]);
+
+($psql_ret, $psql_stdout, $psql_stderr) = ('', '', '');
+($psql_ret, $psql_stdout, $psql_stderr) = $test_rs_node_a->psql(
+    $pgactive_test_dbname,
+    q[UPDATE pgactive.pgactive_replication_set_config SET column_list = '{id,region}' WHERE set_name = 'include_rs';]);
+like($psql_stderr, qr/leaves out column "qty"/,
+     "column list leaving out a NOT NULL column without default refused");
+
+# The configured column list no longer works for the table now that qty has
+# no default, so all columns are sent, rather than stopping replication.
+my $log_offset = get_log_size($test_rs_node_a);
+$test_rs_node_a->safe_psql($pgactive_test_dbname,
+    q[INSERT INTO test_rs VALUES (7, 'eu', 'note 7', 5);]);
+wait_for_apply($test_rs_node_a, $test_rs_node_b);
+
+ok(find_in_log($test_rs_node_a, qr/leaves out column "qty"/, $log_offset),
+    "walsender warned about the column list");
+is($test_rs_node_b->safe_psql($pgactive_test_dbname,
+    q[SELECT id || ':' || region || ':' || note || ':' || qty FROM test_rs WHERE id = 7;]),
+    '7:eu:note 7:5', "all columns sent when the column list no longer works");
+
+$test_rs_node_a->stop;
+$test_rs_node_b->stop;
+
 done_testing();
@@ -51,4 +51,52 @@ exec_ddl( $node_a, qq{ALTER SEQUENCE public.test_seq CYCLE;} );
 qq{ SELECT pgactive.pgactive_snowflake_id_nextval('test_seq'::regclass) FROM generate_series(1,4::bigint); });
 like($stderr, qr/produced a negative result/, "psql error message for nextval cycling back to negative");
 
+# Range-allocated sequences: without peers, chunks are allocated as soon as
+# they are claimed, and values run on across chunk boundaries.
+exec_ddl( $node_a, qq{CREATE SEQUENCE public.range_seq;} );
+$node_a->safe_psql($pgactive_test_dbname,
+    qq{SELECT pgactive.pgactive_set_sequence_chunk_size('public.range_seq', 10);});
+
+is($node_a->safe_psql($pgactive_test_dbname,
+    qq{SELECT string_agg(v::text, ',' ORDER BY v) FROM (SELECT pgactive.pgactive_range_sequence_nextval('public.range_seq') v FROM generate_series(1, 25)) s;}),
+   join(',', 1 .. 25), "range-allocated sequence values run on across chunks");
+is($node_a->safe_psql($pgactive_test_dbname,
+    qq{SELECT count(*) >= 3 FROM pgactive.pgactive_sequence_chunks WHERE seqname = 'range_seq' AND state = 'a';}),
+   't', "chunks allocated for the values handed out");
+
+# A sequence that was in use before becoming range-allocated doesn't hand out
+# its old values again: its chunks start after its current value.
+exec_ddl( $node_a, qq{CREATE SEQUENCE public.range_seq_used;} );
+exec_ddl( $node_a, qq{SELECT setval('public.range_seq_used', 37);} );
+$node_a->safe_psql($pgactive_test_dbname,
+    qq{SELECT pgactive.pgactive_set_sequence_chunk_size('public.range_seq_used', 10);});
+
+is($node_a->safe_psql($pgactive_test_dbname,
+    qq{SELECT string_agg(v::text, ',' ORDER BY v) FROM (SELECT pgactive.pgactive_range_sequence_nextval('public.range_seq_used') v FROM generate_series(1, 15)) s;}),
+   join(',', 38 .. 52), "converted sequence continues after its current value");
+is($node_a->safe_psql($pgactive_test_dbname,
+    qq{SELECT min(chunk_start) FROM pgactive.pgactive_sequence_chunks WHERE seqname = 'range_seq_used';}),
+   '38', "chunks of converted sequence start after its current value");
+
+# Values allocated to another node are skipped, even by a role that only has
+# USAGE on the sequence.
+exec_ddl( $node_a, qq{CREATE SEQUENCE public.range_seq_usage;} );
+$node_a->safe_psql($pgactive_test_dbname, qq{
+    INSERT INTO pgactive.pgactive_sequence_chunks
+        (seqschema, seqname, chunk_start, chunk_end, owner_sysid, owner_timeline, owner_dboid, state, votes_needed)
+    VALUES ('public', 'range_seq_usage', 1, 100, '1', 1, 1, 'a', 0);
+    SELECT pgactive.pgactive_set_sequence_chunk_size('public.range_seq_usage', 10);});
+exec_ddl( $node_a, qq{CREATE ROLE seq_usage;} );
+exec_ddl( $node_a, qq{CREATE ROLE seq_nothing;} );
+exec_ddl( $node_a, qq{GRANT USAGE ON SEQUENCE public.range_seq_usage TO seq_usage;} );
+
+is($node_a->safe_psql($pgactive_test_dbname,
+    qq{SET ROLE seq_usage; SELECT string_agg(v::text, ',' ORDER BY v) FROM (SELECT pgactive.pgactive_range_sequence_nextval('public.range_seq_usage') v FROM generate_series(1, 25)) s;}),
+   join(',', 101 .. 125), "role with USAGE only gets values of the chunks of this node");
+
+($ret, $stdout, $stderr) = $node_a->psql($pgactive_test_dbname,
+    qq{SET ROLE seq_nothing; SELECT pgactive.pgactive_range_sequence_nextval('public.range_seq_usage');});
+like($stderr, qr/permission denied for sequence range_seq_usage/,
+     "role without privileges on the sequence can't get values");
+
 done_testing();
@@ -0,0 +1,49 @@
+#!/usr/bin/env perl
+#
+# Replication throughput and lag benchmark.
+#
+# Brings up a group of PGACTIVE_BENCH_NODES nodes (default 3, 2 to 5) and
+# runs insert-only, wide insert-only, non-conflicting update and
+# conflict-heavy update workloads on all of them at once with pgbench. For
+# each workload, records apply rows/s, walsender and apply worker CPU,
+# percentiles of the lag from commit to apply and conflicts/s in a JSON file,
+# so results can be compared between builds. The wide inserts of columns sent
+# in binary format measure the cost of forming tuples from the wire data.
+#
+# Not run by "make check"; run with "make bench_check".
+#
+use strict;
+use warnings;
+use lib 'test/t/';
+use Cwd;
+use Config;
+use POSIX qw(strftime);
+use PostgreSQL::Test::Cluster;
+use PostgreSQL::Test::Utils;
+use Test::More;
+use utils::nodemanagement;
+use utils::benchmark;
+
+my $n_nodes = bench_setting('nodes', 3);
+die "PGACTIVE_BENCH_NODES must be between 2 and 5"
+    if ($n_nodes < 2 || $n_nodes > 5);
+
+my @workloads = split(/,/, bench_setting('workloads', 'insert,insert_wide,update,conflict'));
+
+my %results = (
+    started_at => strftime('%Y-%m-%dT%H:%M:%SZ', gmtime()),
+    workloads => {},
+);
+
+my $nodes = make_pgactive_group($n_nodes, 'bench_');
+bench_create_schema($nodes);
+
+foreach my $workload (@workloads) {
+    $results{workloads}{$workload} = bench_run_workload($nodes, $workload);
+}
+
+bench_write_results($nodes, \%results);
+
+stop_nodes($nodes);
+
+done_testing();
@@ -30,6 +30,10 @@ sub global_sequence_tests {
     my $node_b = PostgreSQL::Test::Cluster->new('node_b');
     check_insert_on_new_joins( $node_a, $type, [$node_b] );
 
+    # Both nodes claim chunks of a range-allocated sequence at once
+    note "Concurrent claims of range-allocated sequence chunks\n";
+    check_range_sequence_claims( $node_a, $node_b );
+
     # Join a multiple nodes to first node
     # and check insert on table_with_sequence
     my $node_c = PostgreSQL::Test::Cluster->new('node_c');
@@ -81,6 +85,66 @@ sub global_sequence_tests {
     };
 }
 
+# Take values of a range-allocated sequence on all nodes at once, starting
+# with no chunks allocated, so the nodes claim the same chunks concurrently.
+# Every node must only get values of chunks allocated to it.
+sub check_range_sequence_claims {
+    my (@nodes) = @_;
+    my $node_a = $nodes[0];
+    my @handles;
+
+    exec_ddl( $node_a, qq{CREATE SEQUENCE public.range_seq;} );
+    exec_ddl( $node_a, qq{CREATE TABLE public.range_values (id bigint NOT NULL, node_name text);} );
+    $node_a->safe_psql( $pgactive_test_dbname,
+        "SELECT pgactive.pgactive_set_sequence_chunk_size('public.range_seq', 10)" );
+    wait_for_apply( $node_a, $_ ) foreach ( @nodes[ 1 .. $#nodes ] );
+
+    foreach my $node (@nodes) {
+        my $query = "INSERT INTO public.range_values SELECT pgactive.pgactive_range_sequence_nextval('public.range_seq'), pgactive.pgactive_get_local_node_name() FROM generate_series(1, 50);";
+        my ( $stdout, $stderr ) = ( '', '' );
+        push @handles, IPC::Run::start(
+            [ 'psql', '-v', 'ON_ERROR_STOP=1', $node->connstr($pgactive_test_dbname), '-f', '-' ],
+            '<', \$query, '1>', \$stdout, '2>', \$stderr,
+            IPC::Run::timeout( $PostgreSQL::Test::Utils::timeout_default ) );
+    }
+    foreach my $i ( 0 .. $#nodes ) {
+        $handles[$i]->finish;
+        is( $handles[$i]->full_result(0), 0,
+            "range-allocated sequence values taken on " . $nodes[$i]->name );
+    }
+
+    foreach my $from (@nodes) {
+        foreach my $to (@nodes) {
+            wait_for_apply( $from, $to ) if $from != $to;
+        }
+    }
+
+    foreach my $node (@nodes) {
+        is( $node->safe_psql( $pgactive_test_dbname,
+                "SELECT count(*), count(DISTINCT id) FROM public.range_values" ),
+            ( 50 * @nodes ) . '|' . ( 50 * @nodes ),
+            "range-allocated sequence values unique on " . $node->name );
+        is( $node->safe_psql( $pgactive_test_dbname, q{
+                SELECT count(*) FROM public.range_values v
+                WHERE NOT EXISTS (
+                    SELECT 1 FROM pgactive.pgactive_sequence_chunks c
+                    JOIN pgactive.pgactive_nodes n
+                      ON (n.node_sysid, n.node_timeline, n.node_dboid) = (c.owner_sysid, c.owner_timeline, c.owner_dboid)
+                    WHERE c.seqname = 'range_seq' AND c.state = 'a'
+                      AND n.node_name = v.node_name
+                      AND v.id BETWEEN c.chunk_start AND c.chunk_end)} ),
+            '0', "range-allocated sequence values lie in chunks of their node on " . $node->name );
+        is( $node->safe_psql( $pgactive_test_dbname, q{
+                SELECT count(*) FROM pgactive.pgactive_sequence_chunks a
+                JOIN pgactive.pgactive_sequence_chunks b
+                  ON a.seqname = b.seqname
+                 AND (a.owner_sysid, a.owner_timeline, a.owner_dboid) <> (b.owner_sysid, b.owner_timeline, b.owner_dboid)
+                 AND a.chunk_start <= b.chunk_end AND b.chunk_start <= a.chunk_end
+                WHERE a.seqname = 'range_seq' AND a.state = 'a' AND b.state = 'a'} ),
+            '0', "allocated chunks of different nodes don't overlap on " . $node->name );
+    }
+}
+
 # Start insert into table_with_sequence
 sub start_insert {
     my ( $upstream_node, $table_with_sequence, $no_of_inserts ) = @_;
@@ -0,0 +1,399 @@
+#!/usr/bin/env perl
+#
+# Shared code for the replication benchmarks in test/t/bench: run pgbench
+# workloads against every node of a group and measure how fast pgactive
+# replicates them.
+#
+package utils::benchmark;
+
+use strict;
+use warnings;
+use Exporter;
+use Cwd;
+use Config;
+use JSON::PP;
+use POSIX qw(sysconf _SC_CLK_TCK);
+use Time::HiRes qw(time);
+use PostgreSQL::Test::Cluster;
+use PostgreSQL::Test::Utils;
+use Test::More;
+use IPC::Run;
+use utils::nodemanagement;
+
+use vars qw(@ISA @EXPORT @EXPORT_OK);
+@ISA         = qw(Exporter);
+@EXPORT      = qw(
+    bench_setting
+    bench_create_schema
+    bench_run_workload
+    bench_write_results
+    );
+@EXPORT_OK   = qw();
+
+# Rows of bench_accounts updated by each node; nodes update disjoint ranges.
+my $bench_accounts_per_node = 10000;
+
+# Rows of bench_hot all nodes update concurrently.
+my $bench_hot_rows = 10;
+
+my %bench_scripts = (
+    insert => q{
+INSERT INTO public.bench_insert(node, payload) VALUES (:node, repeat('x', 100));
+},
+    insert_wide => q{
+\set v random(1, 1000000000)
+INSERT INTO public.bench_wide(node, i4, i8, f8, ts, b, t)
+VALUES (:node, :v, :v * 1000, :v / 7.0, now(),
+        decode(repeat(to_hex(:v), 16), 'hex'), repeat(:v::text, 20));
+},
+    update => q{
+\set id random(:node * } . $bench_accounts_per_node . q{ + 1, (:node + 1) * } . $bench_accounts_per_node . q{)
+UPDATE public.bench_accounts SET balance = balance + 1, updated_by = :node WHERE id = :id;
+},
+    conflict => q{
+\set id random(1, } . $bench_hot_rows . q{)
+UPDATE public.bench_hot SET v = v + 1, updated_by = :node WHERE id = :id;
+},
+);
+
+# Benchmark settings come from the environment, so they can be changed
+# without editing the scripts.
+sub bench_setting {
+    my ($name, $default) = @_;
+    my $value = $ENV{"PGACTIVE_BENCH_" . uc($name)};
+    return defined($value) && $value ne '' ? $value : $default;
+}
+
+# Create the benchmark tables on all nodes of the group.
+sub bench_create_schema {
+    my ($nodes) = @_;
+    my $node_0 = $nodes->[0];
+    my $n_nodes = scalar(@$nodes);
+
+    exec_ddl($node_0, q{CREATE SEQUENCE public.bench_id_seq;});
+    exec_ddl($node_0, q{
+        CREATE TABLE public.bench_insert (
+            id bigint PRIMARY KEY DEFAULT pgactive.pgactive_snowflake_id_nextval('public.bench_id_seq'),
+            node integer NOT NULL,
+            payload text NOT NULL);});
+    # Columns of types sent in binary format, which the apply worker forms
+    # tuples from without converting the values.
+    exec_ddl($node_0, q{
+        CREATE TABLE public.bench_wide (
+            id bigint PRIMARY KEY DEFAULT pgactive.pgactive_snowflake_id_nextval('public.bench_id_seq'),
+            node integer NOT NULL,
+            i4 integer NOT NULL,
+            i8 bigint NOT NULL,
+            f8 double precision NOT NULL,
+            ts timestamptz NOT NULL,
+            b bytea NOT NULL,
+            t text NOT NULL);});
+    exec_ddl($node_0, q{
+        CREATE TABLE public.bench_accounts (
+            id integer PRIMARY KEY,
+            balance bigint NOT NULL DEFAULT 0,
+            updated_by integer);});
+    exec_ddl($node_0, q{
+        CREATE TABLE public.bench_hot (
+            id integer PRIMARY KEY,
+            v bigint NOT NULL DEFAULT 0,
+            updated_by integer);});
+
+    $node_0->safe_psql($pgactive_test_dbname, qq{
+        INSERT INTO public.bench_accounts(id)
+        SELECT generate_series(1, @{[ $n_nodes * $bench_accounts_per_node ]});
+        INSERT INTO public.bench_hot(id) SELECT generate_series(1, $bench_hot_rows);});
+
+    bench_wait_for_catchup($nodes);
+}
+
+# Wait until every node has replayed everything every other node wrote.
+sub bench_wait_for_catchup {
+    my ($nodes) = @_;
+
+    foreach my $node (@$nodes) {
+        foreach my $peer (@$nodes) {
+            next if $node == $peer;
+            wait_for_apply($node, $peer);
+        }
+    }
+}
+
+# Apply counters of a node summed over its peers.
+sub bench_apply_counters {
+    my ($node) = @_;
+
+    my $res = $node->safe_psql($pgactive_test_dbname, q{
+        SELECT coalesce(sum(nr_insert + nr_update + nr_delete), 0),
+               coalesce(sum(nr_insert_conflict + nr_update_conflict + nr_delete_conflict), 0)
+        FROM pgactive.pgactive_stats;});
+    my ($rows, $conflicts) = split(/\|/, $res);
+
+    return { rows => $rows, conflicts => $conflicts };
+}
+
+# Counts of the apply_lag_us histogram buckets of a node summed over its
+# peers, keyed by "lower:upper" in microseconds; the last bucket has no upper
+# bound.
+sub bench_apply_lag_histogram {
+    my ($node) = @_;
+    my %buckets;
+
+    my $res = $node->safe_psql($pgactive_test_dbname, q{
+        SELECT bucket_lower, coalesce(bucket_upper, -1), sum(count)
+        FROM pgactive.pgactive_stats_histograms
+        WHERE histogram = 'apply_lag_us'
+        GROUP BY 1, 2;});
+
+    foreach my $line (split(/\n/, $res)) {
+        my ($lower, $upper, $count) = split(/\|/, $line);
+        $buckets{"$lower:$upper"} = $count;
+    }
+
+    return \%buckets;
+}
+
+# Percentiles in milliseconds of the transactions counted in a histogram,
+# interpolated linearly within the power-of-two buckets, so they are
+# estimates. Values in the open-ended last bucket are taken as its lower
+# bound.
+sub bench_lag_percentiles {
+    my ($buckets, @fractions) = @_;
+    my @sorted = sort { (split(/:/, $a))[0] <=> (split(/:/, $b))[0] } keys %$buckets;
+    my $total = 0;
+    my @result;
+
+    $total += $buckets->{$_} foreach (@sorted);
+
+    foreach my $fraction (@fractions) {
+        my $rank = $fraction * $total;
+        my $seen = 0;
+        my $value;
+
+        foreach my $key (@sorted) {
+            my ($lower, $upper) = split(/:/, $key);
+            my $count = $buckets->{$key};
+
+            next if $count <= 0;
+            if ($seen + $count >= $rank) {
+                $value = $upper < 0 ? $lower
+                    : $lower + ($upper - $lower) * ($rank - $seen) / $count;
+                last;
+            }
+            $seen += $count;
+        }
+        push @result, defined($value) ? $value / 1000 : undef;
+    }
+
+    return ($total, @result);
+}
+
+# CPU time in seconds used so far by the processes of a node whose pids a
+# query returns. Reads /proc, so it's only measured on Linux; undef
+# elsewhere.
+sub bench_process_cpu {
+    my ($node, $pid_query) = @_;
+    my $ticks = sysconf(_SC_CLK_TCK);
+    my $cpu = 0;
+
+    return undef if (!-d '/proc' || !$ticks);
+
+    my $pids = $node->safe_psql($pgactive_test_dbname, $pid_query);
+
+    foreach my $pid (split(/\n/, $pids)) {
+        open(my $fh, '<', "/proc/$pid/stat") or next;
+        my $stat = <$fh>;
+        close($fh);
+
+        # utime and stime are the 14th and 15th fields; the command name
+        # in parentheses may contain spaces.
+        $stat =~ s/^.*\) //;
+        my @fields = split(/ /, $stat);
+        $cpu += ($fields[11] + $fields[12]) / $ticks;
+    }
+
+    return $cpu;
+}
+
+# CPU time in seconds used so far by the walsenders of pgactive on a node.
+sub bench_walsender_cpu {
+    my ($node) = @_;
+
+    return bench_process_cpu($node, q{
+        SELECT pid FROM pg_catalog.pg_stat_replication
+        WHERE application_name LIKE 'pgactive:%:send';});
+}
+
+# CPU time in seconds used so far by the apply workers of a node. Apply
+# workers restarted during a workload lose what they used.
+sub bench_apply_cpu {
+    my ($node) = @_;
+
+    return bench_process_cpu($node, q{
+        SELECT pid FROM pgactive.pgactive_get_workers_info()
+        WHERE worker_type = 'apply' AND pid <> 0;});
+}
+
+# Start pgbench running one of the benchmark scripts on a node.
+sub bench_start_pgbench {
+    my ($node, $script, %kwargs) = @_;
+    my $script_file = PostgreSQL::Test::Utils::tempdir . "/$script.sql";
+
+    PostgreSQL::Test::Utils::append_to_file($script_file, $bench_scripts{$script});
+
+    my @cmd = ('pgbench', '-n', '-f', $script_file,
+               '-T', $kwargs{time},
+               '-c', $kwargs{clients}, '-j', $kwargs{clients});
+    push @cmd, '-R', $kwargs{rate} if defined $kwargs{rate};
+    while (my ($k, $v) = each(%{$kwargs{vars}})) {
+        push @cmd, '-D', "$k=$v";
+    }
+    push @cmd, $node->connstr($pgactive_test_dbname);
+
+    my ($stdout, $stderr) = ('', '');
+    my $handle = IPC::Run::start([@cmd], '>', \$stdout, '2>', \$stderr);
+
+    return [$handle, $node, \$stdout, \$stderr];
+}
+
+# Wait for pgbench to exit, returning the transactions per second it reported.
+sub bench_finish_pgbench {
+    my ($run) = @_;
+    my ($handle, $node, $stdout, $stderr) = @$run;
+
+    $handle->finish;
+    if (!is($handle->full_result(0), 0, "pgbench on node " . $node->name . " exited normally")) {
+        diag "Stdout:\n---\n$$stdout\n---\nStderr:\n----\n$$stderr\n---";
+        return 0;
+    }
+
+    return $$stdout =~ /tps = ([0-9.]+)/ ? $1 : 0;
+}
+
+# Run a workload on all nodes at once, then wait until they caught up with
+# each other, and return what was measured.
+sub bench_run_workload {
+    my ($nodes, $workload) = @_;
+    my $duration = bench_setting('duration', 30);
+    my $clients = bench_setting('clients', 4);
+    my (%before, %after);
+    my %lag_buckets;
+    my @runs;
+
+    die "unrecognised benchmark workload $workload" if !defined $bench_scripts{$workload};
+
+    note "running $workload workload on " . scalar(@$nodes) . " nodes for $duration seconds\n";
+
+    foreach my $node (@$nodes) {
+        $before{$node->name} = bench_apply_counters($node);
+        $before{$node->name}{cpu} = bench_walsender_cpu($node);
+        $before{$node->name}{apply_cpu} = bench_apply_cpu($node);
+        $before{$node->name}{lag} = bench_apply_lag_histogram($node);
+    }
+
+    my $start = time();
+    for (my $i = 0; $i < scalar(@$nodes); $i++) {
+        my $node = $nodes->[$i];
+        push @runs, bench_start_pgbench($node, $workload, time => $duration,
+                                        clients => $clients,
+                                        vars => { node => $i });
+    }
+
+    my $tps = 0;
+    $tps += bench_finish_pgbench($_) foreach (@runs);
+    my $load_end = time();
+
+    bench_wait_for_catchup($nodes);
+    my $end = time();
+
+    my ($rows, $conflicts, $cpu, $apply_cpu) = (0, 0, 0, 0);
+    foreach my $node (@$nodes) {
+        $after{$node->name} = bench_apply_counters($node);
+        $after{$node->name}{cpu} = bench_walsender_cpu($node);
+        $after{$node->name}{apply_cpu} = bench_apply_cpu($node);
+        $after{$node->name}{lag} = bench_apply_lag_histogram($node);
+
+        $rows += $after{$node->name}{rows} - $before{$node->name}{rows};
+        $conflicts += $after{$node->name}{conflicts} - $before{$node->name}{conflicts};
+        $cpu = defined($cpu) && defined($after{$node->name}{cpu})
+            ? $cpu + $after{$node->name}{cpu} - $before{$node->name}{cpu} : undef;
+        $apply_cpu = defined($apply_cpu) && defined($after{$node->name}{apply_cpu})
+            ? $apply_cpu + $after{$node->name}{apply_cpu} - $before{$node->name}{apply_cpu} : undef;
+
+        # Lag from the remote commit to the local apply of every transaction
+        # applied during the workload. All nodes run on this host, so their
+        # clocks agree.
+        foreach my $key (keys %{$after{$node->name}{lag}}) {
+            $lag_buckets{$key} += $after{$node->name}{lag}{$key}
+                - ($before{$node->name}{lag}{$key} // 0);
+        }
+    }
+
+    my ($lag_samples, $p50, $p90, $p99, $max) =
+        bench_lag_percentiles(\%lag_buckets, 0.50, 0.90, 0.99, 1);
+
+    my $elapsed = $end - $start;
+    my %result = (
+        duration_s => $duration,
+        clients_per_node => $clients,
+        client_tps => $tps + 0,
+        catchup_s => $end - $load_end,
+        apply_rows => $rows + 0,
+        apply_rows_per_s => $rows / $elapsed,
+        conflicts => $conflicts + 0,
+        conflicts_per_s => $conflicts / $elapsed,
+        walsender_cpu_s => $cpu,
+        walsender_cpu_pct => defined($cpu) ? 100 * $cpu / $elapsed : undef,
+        apply_cpu_s => $apply_cpu,
+        apply_cpu_us_per_row => defined($apply_cpu) && $rows > 0
+            ? 1000000 * $apply_cpu / $rows : undef,
+        lag_samples => $lag_samples + 0,
+        lag_ms => {
+            p50 => $p50,
+            p90 => $p90,
+            p99 => $p99,
+            max => $max,
+        },
+    );
+
+    ok($rows > 0, "$workload workload was replicated");
+
+    # Every transaction was applied before the catch-up finished, so its lag
+    # can't exceed the time the workload took, give or take a bucket.
+    ok($lag_samples > 0, "lag of the $workload workload was measured");
+    ok(defined($p50) && $p50 >= 0 && $p50 <= $p90 && $p90 <= $p99
+       && $p99 <= $max,
+       "lag percentiles of the $workload workload are ordered");
+    ok(defined($p50) && $p50 <= 1000 * $elapsed,
+       "median lag of the $workload workload is within the workload's run time")
+        or diag "median lag ${p50}ms, workload ran ${elapsed}s";
+
+    return \%result;
+}
+
+# Write the results of all workloads as JSON, along with what's needed to
+# tell the runs of different builds apart. The file goes to
+# PGACTIVE_BENCH_OUTPUT if that's set.
+sub bench_write_results {
+    my ($nodes, $results) = @_;
+    my $node_0 = $nodes->[0];
+    my $output = bench_setting('output', "$PostgreSQL::Test::Utils::tmp_check/pgactive_bench.json");
+
+    my %doc = (
+        pgactive_version => $node_0->safe_psql($pgactive_test_dbname,
+                                               q{SELECT pgactive.pgactive_version();}),
+        server_version_num => $node_0->safe_psql($pgactive_test_dbname,
+                                                 q{SHOW server_version_num;}) + 0,
+        nodes => scalar(@$nodes),
+        started_at => $results->{started_at},
+        workloads => $results->{workloads},
+    );
+
+    open(my $fh, '>', $output) or die "could not open \"$output\": $!";
+    print $fh JSON::PP->new->canonical->pretty->encode(\%doc);
+    close($fh);
+
+    note "benchmark results written to $output\n";
+}
+
+1;